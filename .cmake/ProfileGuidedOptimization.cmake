@@ -0,0 +1,62 @@
+#######################################################
+### Link-time and profile-guided optimization
+#######################################################
+# BUILD_LTO enables link-time optimization for all targets if the toolchain supports it.
+# BUILD_PGO selects the profile-guided optimization phase:
+#   GENERATE - instrumented binaries write their profiles into PGO_PROFILE_DIR when they exit
+#   USE      - binaries are optimized with the profiles from PGO_PROFILE_DIR
+# The profiles of GCC are matched by object file path, so GENERATE and USE must run in the
+# same build directory. scripts/pgo-build.sh drives the complete sequence.
+
+option(BUILD_LTO "Build with link-time optimization" OFF)
+set(BUILD_PGO "OFF" CACHE STRING "Profile-guided optimization phase: OFF, GENERATE or USE")
+set_property(CACHE BUILD_PGO PROPERTY STRINGS OFF GENERATE USE)
+set(PGO_PROFILE_DIR "${CMAKE_BINARY_DIR}/pgo-profiles" CACHE PATH "Directory of the collected profiles")
+
+if (BUILD_LTO)
+   # the subprojects require an older CMake version, the default lets their targets honor IPO as well
+   cmake_policy(SET CMP0069 NEW)
+   set(CMAKE_POLICY_DEFAULT_CMP0069 NEW)
+   include(CheckIPOSupported)
+   check_ipo_supported(RESULT LTO_SUPPORTED OUTPUT LTO_ERROR LANGUAGES C CXX)
+   if (LTO_SUPPORTED)
+      set(CMAKE_INTERPROCEDURAL_OPTIMIZATION ON)
+      message(STATUS "Link-time optimization enabled")
+   else ()
+      message(WARNING "Link-time optimization is not supported: ${LTO_ERROR}")
+   endif ()
+endif ()
+
+string(TOUPPER "${BUILD_PGO}" BUILD_PGO_PHASE)
+if (BUILD_PGO_PHASE STREQUAL "GENERATE")
+   file(MAKE_DIRECTORY "${PGO_PROFILE_DIR}")
+   if (CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+      # worker threads update the counters concurrently
+      add_compile_options(-fprofile-generate=${PGO_PROFILE_DIR} -fprofile-update=atomic)
+      add_link_options(-fprofile-generate=${PGO_PROFILE_DIR})
+   elseif (CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+      add_compile_options(-fprofile-generate=${PGO_PROFILE_DIR})
+      add_link_options(-fprofile-generate=${PGO_PROFILE_DIR})
+   else ()
+      message(FATAL_ERROR "Profile-guided optimization is not supported for ${CMAKE_CXX_COMPILER_ID}")
+   endif ()
+   message(STATUS "Profile-guided optimization: instrumented build, profiles in ${PGO_PROFILE_DIR}")
+elseif (BUILD_PGO_PHASE STREQUAL "USE")
+   if (CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+      # code not covered by the training keeps its normal optimization instead of being optimized for size
+      add_compile_options(-fprofile-use=${PGO_PROFILE_DIR} -fprofile-partial-training -Wno-missing-profile)
+      add_link_options(-fprofile-use=${PGO_PROFILE_DIR})
+   elseif (CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+      # the raw profiles are merged by llvm-profdata into default.profdata
+      add_compile_options(-fprofile-use=${PGO_PROFILE_DIR}/default.profdata -Wno-profile-instr-unprofiled)
+      add_link_options(-fprofile-use=${PGO_PROFILE_DIR}/default.profdata)
+   else ()
+      message(FATAL_ERROR "Profile-guided optimization is not supported for ${CMAKE_CXX_COMPILER_ID}")
+   endif ()
+   if (NOT IS_DIRECTORY "${PGO_PROFILE_DIR}")
+      message(WARNING "No profiles found in ${PGO_PROFILE_DIR}, run the GENERATE phase first")
+   endif ()
+   message(STATUS "Profile-guided optimization: optimized build with profiles from ${PGO_PROFILE_DIR}")
+elseif (NOT BUILD_PGO_PHASE STREQUAL "OFF")
+   message(FATAL_ERROR "BUILD_PGO must be OFF, GENERATE or USE")
+endif ()
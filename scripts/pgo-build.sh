@@ -0,0 +1,177 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: MIT
+#
+# Builds all daemon targets with profile-guided and link-time optimization and reports the speedup.
+#
+#  1. baseline  - release build, records the training capture, measures the benchmarks
+#  2. generate  - instrumented release build, runs the training workload to collect the profiles
+#  3. use       - the same build directory rebuilt with the profiles and LTO, measures the benchmarks
+#
+# The training workload drives daemon_with_context with loadgen over TCP and UDP, replays the
+# recorded capture at maximal speed and runs the daemonBench suite. The replay benchmark sends the
+# same capture to the baseline and the optimized daemon, so both are compared on identical traffic;
+# every daemonBench benchmark is timed on its own in both builds.
+#
+# Usage: scripts/pgo-build.sh [build-root]
+#   build-root   directory for the baseline and optimized builds (default: _pgo_build)
+# Environment:
+#   CMAKE_ARGS   additional cmake configure arguments
+#   PGO_PORT     TCP/UDP port of the daemon endpoint (default: 24040)
+#   PGO_RUNS     benchmark repetitions, the best run counts (default: 3)
+#   BENCH_ARGS   daemonBench options of the training and the measurement (default: -q)
+#   JOBS         parallel build jobs (default: nproc)
+
+set -euo pipefail
+
+SOURCE_DIR=${SOURCE_DIR:-$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)}
+BUILD_ROOT=$(realpath -m "${1:-_pgo_build}")
+PORT=${PGO_PORT:-24040}
+RUNS=${PGO_RUNS:-3}
+read -r -a BENCH_OPTIONS <<< "${BENCH_ARGS:--q}"
+JOBS=${JOBS:-$(nproc)}
+read -r -a EXTRA_ARGS <<< "${CMAKE_ARGS:-}"
+
+BASELINE_DIR="${BUILD_ROOT}/baseline"
+PGO_DIR="${BUILD_ROOT}/pgo"
+PROFILE_DIR="${PGO_DIR}/pgo-profiles"
+CAPTURE="${BUILD_ROOT}/training.dcap"
+
+DAEMON_PID=""
+
+log() {
+  echo "=== $*"
+}
+
+stop_daemon() {
+  if [[ -n "${DAEMON_PID}" ]]; then
+    kill -INT "${DAEMON_PID}" 2>/dev/null || true
+    wait "${DAEMON_PID}" 2>/dev/null || true
+    DAEMON_PID=""
+  fi
+}
+trap stop_daemon EXIT
+
+# start_daemon <bin-dir> [daemon options...]
+start_daemon() {
+  local bin=$1
+  shift
+  "${bin}/daemon_with_context" -l "127.0.0.1:${PORT}" "$@" > /dev/null 2>&1 &
+  DAEMON_PID=$!
+  # the application context needs a moment to start
+  for _ in $(seq 50); do
+    if (exec 3<>"/dev/tcp/127.0.0.1/${PORT}") 2>/dev/null; then
+      return 0
+    fi
+    sleep 0.1
+  done
+  echo "daemon_with_context did not open port ${PORT}" >&2
+  exit 1
+}
+
+# configure_and_build <build-dir> [cmake options...]
+configure_and_build() {
+  local dir=$1
+  shift
+  cmake -S "${SOURCE_DIR}" -B "${dir}" -DCMAKE_BUILD_TYPE=Release "${EXTRA_ARGS[@]}" "$@" > "${dir}.configure.log"
+  cmake --build "${dir}" -j"${JOBS}" > "${dir}.build.log"
+}
+
+# training <bin-dir> [daemon options...]
+training() {
+  local bin=$1
+  shift
+  start_daemon "${bin}" "$@"
+  "${bin}/loadgen" -t "${PORT}" -p tcp -c 200 -r 20000 -d 5 -W 0.5 -m 16:70,256:25,4096:5 -o /dev/null
+  "${bin}/loadgen" -t "${PORT}" -p udp -c 200 -r 10000 -d 3 -W 0.5 -m 64:80,1024:20 -o /dev/null
+  stop_daemon
+  if [[ -f "${CAPTURE}" ]]; then
+    start_daemon "${bin}"
+    "${bin}/trafficReplay" -i "${CAPTURE}" -t "${PORT}" -s 0 > /dev/null
+    stop_daemon
+  fi
+  # a failed check doesn't spoil the profile
+  "${bin}/daemonBench" "${BENCH_OPTIONS[@]}" > /dev/null 2>&1 || true
+}
+
+# benchmark <bin-dir>: prints the best replay throughput in records/s
+benchmark() {
+  local bin=$1
+  local best=0
+  start_daemon "${bin}"
+  for _ in $(seq "${RUNS}"); do
+    local rate
+    rate=$("${bin}/trafficReplay" -i "${CAPTURE}" -t "${PORT}" -s 0 | awk '/throughput/ { print $3 }')
+    if awk -v a="${rate}" -v b="${best}" 'BEGIN { exit !(a > b) }'; then
+      best=${rate}
+    fi
+  done
+  stop_daemon
+  echo "${best}"
+}
+
+# suite_times <bin-dir>: prints "name seconds" of every daemonBench benchmark, the best of the runs
+suite_times() {
+  local bin=$1
+  local name
+  for name in $("${bin}/daemonBench" -l | awk 'NF { print $1 }'); do
+    local best=""
+    for _ in $(seq "${RUNS}"); do
+      local seconds
+      seconds=$("${bin}/daemonBench" "${BENCH_OPTIONS[@]}" "${name}" 2>/dev/null | awk '/^suite time:/ { print $3 }' ||
+        true)
+      if [[ -z "${seconds}" ]]; then
+        continue
+      fi
+      if [[ -z "${best}" ]] || awk -v a="${seconds}" -v b="${best}" 'BEGIN { exit !(a < b) }'; then
+        best=${seconds}
+      fi
+    done
+    echo "${name} ${best:-0}"
+  done
+}
+
+mkdir -p "${BUILD_ROOT}"
+
+log "baseline release build in ${BASELINE_DIR}"
+configure_and_build "${BASELINE_DIR}" -DBUILD_LTO=OFF -DBUILD_PGO=OFF
+rm -f "${CAPTURE}"
+training "${BASELINE_DIR}/bin" -C "${CAPTURE}"
+BASELINE_RATE=$(benchmark "${BASELINE_DIR}/bin")
+suite_times "${BASELINE_DIR}/bin" > "${BUILD_ROOT}/baseline.times"
+
+log "instrumented build in ${PGO_DIR}"
+rm -rf "${PROFILE_DIR}"
+configure_and_build "${PGO_DIR}" -DBUILD_LTO=OFF -DBUILD_PGO=GENERATE -DPGO_PROFILE_DIR="${PROFILE_DIR}"
+log "collecting profiles"
+training "${PGO_DIR}/bin"
+
+# clang writes raw profiles that llvm-profdata merges, the compiler id is recorded per language
+if grep -qs 'CMAKE_CXX_COMPILER_ID "\(Apple\)\?Clang"' "${PGO_DIR}"/CMakeFiles/*/CMakeCXXCompiler.cmake ||
+   ls "${PROFILE_DIR}"/*.profraw > /dev/null 2>&1; then
+  llvm-profdata merge -output="${PROFILE_DIR}/default.profdata" "${PROFILE_DIR}"/*.profraw
+fi
+
+log "optimized build with profiles and LTO in ${PGO_DIR}"
+configure_and_build "${PGO_DIR}" -DBUILD_LTO=ON -DBUILD_PGO=USE -DPGO_PROFILE_DIR="${PROFILE_DIR}"
+OPTIMIZED_RATE=$(benchmark "${PGO_DIR}/bin")
+suite_times "${PGO_DIR}/bin" > "${BUILD_ROOT}/pgo.times"
+
+log "replay benchmark, $(basename "${CAPTURE}") at maximal speed, best of ${RUNS}"
+awk -v base="${BASELINE_RATE}" -v opt="${OPTIMIZED_RATE}" 'BEGIN {
+  printf "  baseline          : %12.0f records/s\n", base
+  printf "  PGO + LTO         : %12.0f records/s\n", opt
+  printf "  speedup           : %+11.1f %%\n", (base > 0 ? (opt / base - 1) * 100 : 0)
+}'
+
+log "daemonBench ${BENCH_OPTIONS[*]}, seconds per benchmark, best of ${RUNS}"
+awk 'NR == FNR { base[$1] = $2; next }
+  {
+    total_base += base[$1]; total_opt += $2
+    printf "  %-12s baseline %8.3f s   PGO + LTO %8.3f s   speedup %+6.1f %%\n", $1, base[$1], $2,
+           ($2 > 0 ? (base[$1] / $2 - 1) * 100 : 0)
+  }
+  END {
+    printf "  %-12s baseline %8.3f s   PGO + LTO %8.3f s   speedup %+6.1f %%\n", "suite", total_base, total_opt,
+           (total_opt > 0 ? (total_base / total_opt - 1) * 100 : 0)
+  }' "${BUILD_ROOT}/baseline.times" "${BUILD_ROOT}/pgo.times"
+echo "Optimized binaries: ${PGO_DIR}/bin"
@@ -0,0 +1,271 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the compiled map of source addresses to destination points
+ * \ingroup Application Common
+ *
+ * A converter maps every received value from its source address (an IOA, a register, an object
+ * reference) to a destination point and scales it. The map is compiled from the configuration at
+ * load or reload time into one of two layouts:
+ *  - dense: the source addresses fill a compact range, the entry is at source - first source;
+ *  - perfect hash: the addresses are spread, a hash-and-displace function with one 16-bit pilot
+ *    per bucket of four addresses places every address in its own slot of a table 2% larger than
+ *    the map.
+ * The entries hold the destination and the transform parameters inline, 32 bytes each, so a
+ * lookup reads one cache line of the table; the pilots of the perfect hash take 0.5 bytes per
+ * address and stay in the caches.
+ *
+ * A mapping file has one mapping per line, '#' starts a comment:
+ *   <source> <destination> [<scale> [<offset>]]   value * scale + offset, default 1 and 0
+ *   <source> <destination> bit <n>                bit n of the integer value
+ *   <source> <destination> invert                 1 for 0, otherwise 0
+ * A source is a number, "ioa:<common address>.<IOA>" of IEC 60870-5, "mb:<unit>.<register>" of
+ * Modbus or "ref:<object reference>" of IEC 61850.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The address space of a source address, in the top byte of the address.
+ */
+enum class AddressSpace : uint8_t {
+  raw = 0,        ///< a plain number, f.e. the session slot of the example converter
+  iec104 = 1,     ///< common address and IOA of IEC 60870-5-101/104
+  modbus = 2,     ///< unit and register of Modbus
+  reference = 3,  ///< hash of an IEC 61850 object reference
+};
+
+/**
+ * @brief Builds a source address.
+ * @param space The address space.
+ * @param address The address in the space, the low 56 bits are used.
+ * @return The source address.
+ */
+constexpr uint64_t make_address(AddressSpace space, uint64_t address) {
+  return (static_cast<uint64_t>(space) << 56) | (address & 0x00FF'FFFF'FFFF'FFFF);
+}
+
+/**
+ * @brief Builds the source address of an object reference from a 56-bit hash of the text. The
+ * compiler rejects a map in which two references collide.
+ * @param reference The object reference, f.e. "LD0/MMXU1.TotW.mag.f".
+ * @return The source address.
+ */
+uint64_t make_reference_address(std::string_view reference);
+
+/**
+ * @brief Parses a source address of a mapping file.
+ * @param text The address: a number, "ioa:ca.ioa", "mb:unit.register" or "ref:reference".
+ * @return The source address or std::nullopt if the text is invalid.
+ */
+std::optional<uint64_t> parse_address(std::string_view text);
+
+/**
+ * @brief The transform of a mapped value.
+ */
+enum class AddressTransform : uint8_t {
+  linear,  ///< value * scale + offset
+  bit,     ///< bit n of the integer value
+  invert,  ///< 1 for 0, otherwise 0
+};
+
+/**
+ * @brief A mapping of a source address to a destination point, one cache line holds two.
+ */
+struct alignas(32) AddressMapping {
+  uint64_t source{0};                                    ///< source address
+  uint32_t destination{0};                               ///< destination point
+  AddressTransform transform{AddressTransform::linear};  ///< transform of the value
+  uint8_t bit{0};                                        ///< bit of the bit transform
+  double scale{1.0};                                     ///< factor of the linear transform
+  double offset{0.0};                                    ///< offset of the linear transform
+
+  /**
+   * @brief Transforms a source value into the destination value.
+   * @param value The source value.
+   * @return The destination value.
+   */
+  [[nodiscard]] double apply(double value) const {
+    switch (transform) {
+      case AddressTransform::bit:
+        return static_cast<double>((static_cast<uint64_t>(static_cast<int64_t>(value)) >> bit) & 1);
+      case AddressTransform::invert:
+        return value == 0.0 ? 1.0 : 0.0;
+      case AddressTransform::linear:
+        break;
+    }
+    return value * scale + offset;
+  }
+};
+
+/**
+ * @brief The layout of a compiled address map.
+ */
+enum class AddressMapLayout {
+  empty,        ///< no mappings
+  dense,        ///< table indexed by the source address minus the first one
+  perfectHash,  ///< table indexed by a perfect hash of the source address
+};
+
+/**
+ * @brief Gets the name of an address map layout.
+ * @param layout The layout.
+ * @return The name.
+ */
+std::string_view to_string(AddressMapLayout layout);
+
+/**
+ * @brief The AddressMap class finds the mapping of a source address with one table access.
+ * @note Compiling and loading are not thread-safe; a reload compiles a new map and hands it to the
+ * thread that reads it.
+ */
+class AddressMap {
+ public:
+  static constexpr uint64_t NoSource = UINT64_MAX;  ///< source of the free slots, invalid in a map
+
+  /**
+   * @brief Compiles the mappings into the layout that suits their source addresses.
+   * @param mappings The mappings.
+   * @return true if compiled, otherwise false with last_error(); the map is empty then.
+   */
+  [[nodiscard]] bool compile(std::span<const AddressMapping> mappings);
+
+  /**
+   * @brief Parses a mapping file and compiles it.
+   * @param path The mapping file.
+   * @return true if loaded, otherwise false with last_error(); the map is empty then.
+   */
+  [[nodiscard]] bool load(const std::filesystem::path& path);
+
+  /**
+   * @brief Finds the mapping of a source address.
+   * @param source The source address.
+   * @return The mapping or nullptr if the address isn't mapped.
+   */
+  [[nodiscard]] const AddressMapping* find(uint64_t source) const {
+    // inline: the lookup runs for every received value
+    const AddressMapping* entry;
+    if (m_layout == AddressMapLayout::perfectHash) {
+      auto hash = hash_address(source, m_seed);
+      entry = &m_entries[slot(hash, m_pilots[reduce(hash >> 32, m_buckets)])];
+    } else {
+      auto index = source - m_base;
+      if (index >= m_entries.size()) {
+        return nullptr;
+      }
+      entry = &m_entries[index];
+    }
+    return entry->source == source ? entry : nullptr;
+  }
+
+  /**
+   * @brief Gets the layout chosen by the compiler.
+   * @return The layout.
+   */
+  [[nodiscard]] AddressMapLayout layout() const {
+    return m_layout;
+  }
+
+  /**
+   * @brief Gets the number of mappings.
+   * @return The number of mappings.
+   */
+  [[nodiscard]] size_t size() const {
+    return m_size;
+  }
+
+  /**
+   * @brief Gets the memory of the tables.
+   * @return The size in bytes.
+   */
+  [[nodiscard]] size_t memory_bytes() const {
+    return m_entries.size() * sizeof(AddressMapping) + m_pilots.size() * sizeof(uint16_t);
+  }
+
+  /**
+   * @brief Gets the reason the last compile or load failed.
+   * @return The reason, empty after a success.
+   */
+  [[nodiscard]] const std::string& last_error() const {
+    return m_error;
+  }
+
+ private:
+  /**
+   * @brief Hashes a source address, a bijection for every seed.
+   * @param source The source address.
+   * @param seed The seed.
+   * @return The hash.
+   */
+  static uint64_t hash_address(uint64_t source, uint64_t seed) {
+    // the finalizer of MurmurHash3
+    uint64_t hash = source ^ seed;
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    return hash ^ (hash >> 33);
+  }
+
+  /**
+   * @brief Maps 32 random bits onto a range without a division.
+   * @param value The bits.
+   * @param range The range.
+   * @return The value in [0, range).
+   */
+  static uint32_t reduce(uint64_t value, uint32_t range) {
+    return static_cast<uint32_t>(((value & 0xFFFFFFFF) * range) >> 32);
+  }
+
+  /**
+   * @brief Gets the slot of an address from its hash and the pilot of its bucket.
+   * @param hash The hash of the address.
+   * @param pilot The pilot.
+   * @return The slot.
+   */
+  [[nodiscard]] uint32_t slot(uint64_t hash, uint16_t pilot) const {
+    return reduce(hash_address(hash, (pilot + 1) * 0x9E3779B97F4A7C15ULL) >> 32, m_slots);
+  }
+
+  bool compile_dense(std::span<const AddressMapping> mappings, uint64_t first, uint64_t last);
+  bool compile_perfect_hash(std::span<const AddressMapping> mappings);
+  void clear();
+  bool fail(std::string error);
+
+  std::vector<AddressMapping> m_entries;               ///< mappings at their index or slot, free ones NoSource
+  std::vector<uint16_t> m_pilots;                      ///< pilot of each bucket of the perfect hash
+  AddressMapLayout m_layout{AddressMapLayout::empty};  ///< layout of the tables
+  uint64_t m_base{0};                                  ///< first source address of the dense layout
+  uint64_t m_seed{0};                                  ///< seed of the perfect hash
+  uint32_t m_buckets{0};                               ///< buckets of the perfect hash
+  uint32_t m_slots{0};                                 ///< slots of the perfect hash
+  size_t m_size{0};                                    ///< number of mappings
+  std::string m_error;                                 ///< reason of the last failure
+};
+
+}  // namespace app
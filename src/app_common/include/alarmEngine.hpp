@@ -0,0 +1,239 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the limit alarm engine of the point database
+ * \ingroup Application Common
+ *
+ * Every analog point may have four limits (HH, H, L, LL), a deadband, a delay and latching. A
+ * limit is violated when the value reaches it; the alarm returns only when the value is back
+ * beyond the limit by the deadband (hysteresis). With a delay a new level must hold for the delay
+ * before the alarm changes to it. A latching alarm stays latched when its value returns to normal
+ * until it is acknowledged.
+ *
+ * The limits and the state of a point share one cache line of an array, the flags are bitmaps. A
+ * tick evaluates only the points the change bitmap of the point database flags, plus the points
+ * with a delayed change pending, so a few changed points among many cost two cache lines each.
+ * Their values and limits are gathered into batches of 64 points (structure of arrays) and the
+ * new levels are computed with branch-free comparisons the compiler vectorizes, in a variant per
+ * CPU level bound by app::CpuDispatch (baseline, AVX2, AVX-512); only the points whose level
+ * differs take the scalar path of delays, latching and events. The transitions of a tick are
+ * delivered as one batch to every subscriber.
+ *
+ * An alarm file has one point per line, '#' starts a comment:
+ *   <point> [hh=<limit>] [h=<limit>] [l=<limit>] [ll=<limit>] [deadband=<value>] [delay=<ms>] [latch]
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "pointDatabase.hpp"
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The level of a limit alarm.
+ */
+enum class AlarmLevel : int8_t {
+  lowLow = -2,   ///< the value reached the LL limit
+  low = -1,      ///< the value reached the L limit
+  normal = 0,    ///< no limit violated
+  high = 1,      ///< the value reached the H limit
+  highHigh = 2,  ///< the value reached the HH limit
+};
+
+/**
+ * @brief Gets the name of an alarm level.
+ * @param level The level.
+ * @return The name.
+ */
+std::string_view to_string(AlarmLevel level);
+
+/**
+ * @brief The limits of a point, a limit at infinity is disabled.
+ */
+struct AlarmLimits {
+  double highHigh{std::numeric_limits<double>::infinity()};  ///< HH limit
+  double high{std::numeric_limits<double>::infinity()};      ///< H limit
+  double low{-std::numeric_limits<double>::infinity()};      ///< L limit
+  double lowLow{-std::numeric_limits<double>::infinity()};   ///< LL limit
+  double deadband{0.0};                                      ///< distance to return from a limit
+  std::chrono::milliseconds delay{0};                        ///< time a new level must hold
+  bool latching{false};                                      ///< the alarm stays until acknowledged
+};
+
+/**
+ * @brief A transition of an alarm.
+ */
+struct AlarmEvent {
+  uint32_t point{0};                        ///< point of the alarm
+  AlarmLevel previous{AlarmLevel::normal};  ///< level before the transition
+  AlarmLevel level{AlarmLevel::normal};     ///< level after the transition, equal for an acknowledgement
+  bool latched{false};                      ///< the alarm is latched after the transition
+  double value{0.0};                        ///< value of the point
+  int64_t timestamp{0};                     ///< time of the transition in nanoseconds
+};
+
+/**
+ * @brief The AlarmEngine class evaluates the limit alarms of the changed points.
+ * @note The engine is not thread-safe, it runs on the thread that owns the point database.
+ */
+class AlarmEngine {
+ public:
+  static constexpr size_t Lanes = 64;  ///< points of a batch
+
+  /// The subscriber of the transitions of a tick
+  using Subscriber = std::function<void(std::span<const AlarmEvent> events)>;
+
+  /**
+   * @brief Reserves the arrays for a number of points, all without limits and normal.
+   * @param points The number of points.
+   */
+  void reserve(size_t points);
+
+  /**
+   * @brief Sets the limits of a point and resets its alarm to normal.
+   * @param point The point, less than the reserved points.
+   * @param limits The limits.
+   * @return true if set, false if the limits aren't ordered LL <= L < H <= HH or the deadband is
+   * negative.
+   */
+  [[nodiscard]] bool configure(size_t point, const AlarmLimits& limits);
+
+  /**
+   * @brief Parses an alarm file and configures its points, the other points have no limits.
+   * @param path The alarm file.
+   * @return true if loaded, otherwise false with last_error(); no point is configured then.
+   */
+  [[nodiscard]] bool load(const std::filesystem::path& path);
+
+  /**
+   * @brief Evaluates the changed points and the points with a delayed change pending, then
+   * delivers the transitions and acknowledgements to the subscribers.
+   * @param points The point database, at least the reserved points. The changed bits are read,
+   * the owner clears them after it consumed them.
+   * @param now The time in nanoseconds on the time line of the point timestamps, for the delays.
+   * @return The number of transitions.
+   */
+  size_t evaluate(const PointDatabase& points, int64_t now);
+
+  /**
+   * @brief Acknowledges a latched alarm, the subscribers get the acknowledgement with the
+   * transitions of the next evaluate().
+   * @param point The point.
+   * @param now The time in nanoseconds on the time line of the point timestamps.
+   * @return true if the alarm was latched, otherwise false.
+   */
+  bool acknowledge(size_t point, int64_t now);
+
+  /**
+   * @brief Adds a subscriber of the transitions.
+   * @param subscriber The subscriber.
+   * @return The identifier of the subscription.
+   */
+  size_t subscribe(Subscriber subscriber);
+
+  /**
+   * @brief Removes a subscriber.
+   * @param id The identifier of the subscription.
+   */
+  void unsubscribe(size_t id);
+
+  /**
+   * @brief Gets the level of the alarm of a point.
+   * @param point The point.
+   * @return The level.
+   */
+  [[nodiscard]] AlarmLevel level(size_t point) const {
+    return static_cast<AlarmLevel>(m_alarms[point].level);
+  }
+
+  /**
+   * @brief Checks whether the alarm of a point is latched.
+   * @param point The point.
+   * @return true if latched, otherwise false.
+   */
+  [[nodiscard]] bool is_latched(size_t point) const {
+    return (m_latched[point / 64] >> (point % 64) & 1) != 0;
+  }
+
+  /**
+   * @brief Gets the number of points with limits.
+   * @return The number of points.
+   */
+  [[nodiscard]] size_t configured() const {
+    return m_configured;
+  }
+
+  /**
+   * @brief Gets the number of point evaluations since the reserve.
+   * @return The number of evaluations.
+   */
+  [[nodiscard]] uint64_t evaluated() const {
+    return m_evaluated;
+  }
+
+  /**
+   * @brief Gets the reason the last load failed.
+   * @return The reason, empty after a success.
+   */
+  [[nodiscard]] const std::string& last_error() const {
+    return m_error;
+  }
+
+ private:
+  /**
+   * @brief The limits and the state of the alarm of a point, one cache line.
+   */
+  struct alignas(64) PointAlarm {
+    double highHigh{std::numeric_limits<double>::infinity()};  ///< HH limit
+    double high{std::numeric_limits<double>::infinity()};      ///< H limit
+    double low{-std::numeric_limits<double>::infinity()};      ///< L limit
+    double lowLow{-std::numeric_limits<double>::infinity()};   ///< LL limit
+    double deadband{0.0};                                      ///< distance to return from a limit
+    int64_t delay{0};                                          ///< delay in nanoseconds
+    int64_t pendingSince{0};                                   ///< start of the pending level
+    int8_t level{0};                                           ///< level
+    int8_t pendingLevel{0};                                    ///< pending level
+  };
+
+  void evaluate_batch(std::span<const uint32_t> batch, const PointDatabase& points, int64_t now);
+  static void set_bit(std::vector<uint64_t>& bits, size_t point, bool value);
+  bool fail(std::string error);
+
+  std::vector<PointAlarm> m_alarms;       ///< alarm of each point
+  std::vector<uint64_t> m_enabled;        ///< one bit per point with limits
+  std::vector<uint64_t> m_latching;       ///< one bit per latching point
+  std::vector<uint64_t> m_latched;        ///< one bit per latched alarm
+  std::vector<uint64_t> m_pending;        ///< one bit per point with a delayed level pending
+  std::vector<AlarmEvent> m_events;       ///< transitions of the tick
+  std::vector<Subscriber> m_subscribers;  ///< subscribers, empty after unsubscribe
+  size_t m_configured{0};                 ///< number of points with limits
+  uint64_t m_evaluated{0};                ///< point evaluations since the reserve
+  std::string m_error;                    ///< reason of the last failure
+};
+
+}  // namespace app
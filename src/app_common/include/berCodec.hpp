@@ -0,0 +1,442 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the ASN.1 BER reader and writer of the IEC 61850 payloads
+ * \ingroup Application Common
+ *
+ * MMS, GOOSE and Sampled Values encode their PDUs with the basic encoding rules: a tag, a length and
+ * the contents, nested for constructed types. The reader walks the elements of a buffer in place and
+ * returns views of their contents, the caller descends into the constructed elements it needs and
+ * skips the others. The writer encodes from the end of a caller-provided buffer towards its start:
+ * the contents of an element are written before its header, so lengths are known without a second
+ * pass or a tree. Neither allocates, and both may be used from any thread on their own buffers.
+ *
+ * Tags are handled as their identifier octets in one integer: 0xA2 is the constructed context tag
+ * [2], 0xBF48 the constructed context tag [72]. The reader accepts definite lengths only; the
+ * indefinite form is not used by MMS, GOOSE or Sampled Values and is rejected.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The class of a BER tag.
+ */
+enum class BerClass : uint8_t {
+  universal = 0x00,    ///< types of ASN.1
+  application = 0x40,  ///< types of the application, f.e. the savPdu
+  context = 0x80,      ///< fields of a sequence or choice
+  priv = 0xC0,         ///< private types
+};
+
+/**
+ * @brief Builds the identifier octets of a tag.
+ * @param tagClass The class.
+ * @param constructed true for constructed, false for primitive contents.
+ * @param number The tag number, at most 2^21 - 1.
+ * @return The identifier octets, the first one in the most significant used byte.
+ */
+constexpr uint32_t ber_tag(BerClass tagClass, bool constructed, uint32_t number) {
+  auto first = static_cast<uint32_t>(tagClass) | (constructed ? 0x20U : 0x00U);
+  if (number < 0x1F) {
+    return first | number;
+  }
+  uint32_t tag = first | 0x1F;
+  int shift = number >= 0x4000 ? 14 : number >= 0x80 ? 7 : 0;
+  for (; shift > 0; shift -= 7) {
+    tag = (tag << 8) | 0x80 | ((number >> shift) & 0x7F);
+  }
+  return (tag << 8) | (number & 0x7F);
+}
+
+/**
+ * @brief The reason a BER reader stopped.
+ */
+enum class BerError {
+  none,        ///< no error, the end of the input may be reached
+  truncated,   ///< the input ends inside a header or the contents
+  tag,         ///< the tag has more than four identifier octets
+  length,      ///< the length has more than four octets
+  indefinite,  ///< the indefinite length form is used
+};
+
+/**
+ * @brief Gets the name of a BER error.
+ * @param error The error.
+ * @return The name.
+ */
+std::string_view to_string(BerError error);
+
+/**
+ * @brief An element of a BER encoding: its tag and a view of its contents.
+ */
+struct BerElement {
+  uint32_t tag{0};                   ///< identifier octets
+  std::span<const std::byte> value;  ///< contents in the input buffer
+
+  /**
+   * @brief Checks if the contents are a sequence of elements.
+   * @return true for constructed contents, otherwise false.
+   */
+  [[nodiscard]] bool is_constructed() const;
+
+  /**
+   * @brief Decodes a BOOLEAN.
+   * @param result Receives the value.
+   * @return false if the contents are not one octet.
+   */
+  [[nodiscard]] bool to_boolean(bool& result) const;
+
+  /**
+   * @brief Decodes an INTEGER in two's complement.
+   * @param result Receives the value.
+   * @return false if the contents are empty or longer than eight octets.
+   */
+  [[nodiscard]] bool to_integer(int64_t& result) const;
+
+  /**
+   * @brief Decodes an unsigned INTEGER, such as Unsigned of MMS, with an optional leading zero octet.
+   * @param result Receives the value.
+   * @return false if the contents are empty, negative or don't fit 64 bits.
+   */
+  [[nodiscard]] bool to_unsigned(uint64_t& result) const;
+
+  /**
+   * @brief Decodes a BIT STRING of at most 64 bits. Bit 0 of the result is the first bit of the
+   * string, as in the quality and option fields of IEC 61850.
+   * @param bits Receives the bits.
+   * @param count Receives the number of bits.
+   * @return false if the contents are empty, the unused bits exceed 7 or the string is longer.
+   */
+  [[nodiscard]] bool to_bit_string(uint64_t& bits, size_t& count) const;
+
+  /**
+   * @brief Decodes a FloatingPoint of MMS: the exponent width followed by an IEEE 754 value.
+   * @param result Receives the value.
+   * @return false if the contents are neither single nor double precision.
+   */
+  [[nodiscard]] bool to_float(double& result) const;
+
+  /**
+   * @brief Decodes a UtcTime of MMS: seconds since epoch, a binary fraction of 24 bits and the
+   * time quality.
+   * @param nanoseconds Receives the time in nanoseconds since epoch.
+   * @param quality Receives the time quality.
+   * @return false if the contents are not eight octets.
+   */
+  [[nodiscard]] bool to_utc_time(int64_t& nanoseconds, uint8_t& quality) const;
+
+  /**
+   * @brief Gets the contents as text, f.e. of a VisibleString or an MMS identifier.
+   * @return The text in the input buffer.
+   */
+  [[nodiscard]] std::string_view to_string() const {
+    return {reinterpret_cast<const char*>(value.data()), value.size()};
+  }
+};
+
+/**
+ * @brief The BerReader class walks the elements of a buffer in place. A reader over the contents
+ * of a constructed element walks its children.
+ */
+class BerReader {
+ public:
+  /// constructor of an empty reader
+  BerReader() = default;
+
+  /**
+   * @brief Constructor.
+   * @param data The encoded elements.
+   */
+  explicit BerReader(std::span<const std::byte> data) : m_data(data) {
+  }
+
+  /**
+   * @brief Constructor over the contents of a constructed element.
+   * @param element The element.
+   */
+  explicit BerReader(const BerElement& element) : m_data(element.value) {
+  }
+
+  /**
+   * @brief Reads the next element and advances behind it.
+   * @param element Receives the element.
+   * @return false at the end of the input or on an error, see error().
+   */
+  [[nodiscard]] bool next(BerElement& element) {
+    // inline: it is the loop of every decoder
+    if (m_data.empty()) {
+      return false;
+    }
+    const auto* data = reinterpret_cast<const uint8_t*>(m_data.data());
+    size_t size = m_data.size();
+    size_t offset = 1;
+    uint32_t tag = data[0];
+    if ((tag & 0x1F) == 0x1F) {
+      // high tag number: base 128 octets follow, the last one without the continuation bit
+      do {
+        if (offset >= size) {
+          return fail(BerError::truncated);
+        }
+        if (offset >= MaxTagOctets) {
+          return fail(BerError::tag);
+        }
+        tag = (tag << 8) | data[offset];
+      } while ((data[offset++] & 0x80) != 0);
+    }
+    if (offset >= size) {
+      return fail(BerError::truncated);
+    }
+    size_t length = data[offset++];
+    if (length == 0x80) {
+      return fail(BerError::indefinite);
+    }
+    if (length > 0x80) {
+      size_t count = length & 0x7F;
+      if (count > MaxLengthOctets) {
+        return fail(BerError::length);
+      }
+      if (count > size - offset) {
+        return fail(BerError::truncated);
+      }
+      length = 0;
+      for (size_t i = 0; i < count; ++i) {
+        length = (length << 8) | data[offset++];
+      }
+    }
+    if (length > size - offset) {
+      return fail(BerError::truncated);
+    }
+    element.tag = tag;
+    element.value = m_data.subspan(offset, length);
+    m_data = m_data.subspan(offset + length);
+    return true;
+  }
+
+  /**
+   * @brief Reads the next element and checks its tag.
+   * @param tag The expected tag.
+   * @param element Receives the element.
+   * @return false at the end of the input, on an error or if the tag differs. A differing element
+   * is not consumed.
+   */
+  [[nodiscard]] bool expect(uint32_t tag, BerElement& element) {
+    auto data = m_data;
+    if (!next(element)) {
+      return false;
+    }
+    if (element.tag != tag) {
+      m_data = data;
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Checks if all elements are read.
+   * @return true at the end of the input, otherwise false.
+   */
+  [[nodiscard]] bool empty() const {
+    return m_data.empty();
+  }
+
+  /**
+   * @brief Gets the input behind the last element read.
+   * @return The remaining input.
+   */
+  [[nodiscard]] std::span<const std::byte> remaining() const {
+    return m_data;
+  }
+
+  /**
+   * @brief Gets the reason the reader stopped.
+   * @return The error, BerError::none at the end of the input.
+   */
+  [[nodiscard]] BerError error() const {
+    return m_error;
+  }
+
+ private:
+  static constexpr size_t MaxTagOctets = 4;     ///< identifier octets that fit the tag
+  static constexpr size_t MaxLengthOctets = 4;  ///< length octets of the long form
+
+  /**
+   * @brief Stops the reader with an error.
+   * @param error The error.
+   * @return Always false.
+   */
+  bool fail(BerError error) {
+    m_error = error;
+    m_data = {};
+    return false;
+  }
+
+  std::span<const std::byte> m_data;  ///< input behind the last element
+  BerError m_error{BerError::none};   ///< reason of the stop
+};
+
+/**
+ * @brief The BerWriter class encodes elements backwards into a buffer: the last element of a
+ * sequence is written first, and a constructed element is closed after its children with the
+ * size() taken before them.
+ *
+ * @code
+ *   auto end = writer.size();
+ *   writer.put_unsigned(0x82, sampleCount);
+ *   writer.put_string(0x80, svId);
+ *   writer.close(0x30, end);
+ * @endcode
+ */
+class BerWriter {
+ public:
+  /**
+   * @brief Constructor.
+   * @param buffer The buffer, the encoding ends at its last byte.
+   */
+  explicit BerWriter(std::span<std::byte> buffer)
+      : m_begin(buffer.data()), m_end(buffer.data() + buffer.size()), m_position(m_end) {
+  }
+
+  /**
+   * @brief Writes the header of a constructed element around the elements written since a mark.
+   * @param tag The tag.
+   * @param mark The size() before the contents were written.
+   */
+  void close(uint32_t tag, size_t mark);
+
+  /**
+   * @brief Writes an element with the given contents.
+   * @param tag The tag.
+   * @param contents The contents.
+   */
+  void put_octets(uint32_t tag, std::span<const std::byte> contents);
+
+  /**
+   * @brief Writes an element with text contents.
+   * @param tag The tag.
+   * @param text The text.
+   */
+  void put_string(uint32_t tag, std::string_view text);
+
+  /**
+   * @brief Writes a BOOLEAN.
+   * @param tag The tag.
+   * @param value The value.
+   */
+  void put_boolean(uint32_t tag, bool value);
+
+  /**
+   * @brief Writes an INTEGER in the fewest octets.
+   * @param tag The tag.
+   * @param value The value.
+   */
+  void put_integer(uint32_t tag, int64_t value);
+
+  /**
+   * @brief Writes an unsigned INTEGER in the fewest octets, with a leading zero octet if the high
+   * bit is set.
+   * @param tag The tag.
+   * @param value The value.
+   */
+  void put_unsigned(uint32_t tag, uint64_t value);
+
+  /**
+   * @brief Writes a BIT STRING; bit 0 of the value is the first bit of the string.
+   * @param tag The tag.
+   * @param bits The bits.
+   * @param count The number of bits, at most 64.
+   */
+  void put_bit_string(uint32_t tag, uint64_t bits, size_t count);
+
+  /**
+   * @brief Writes a single precision FloatingPoint of MMS.
+   * @param tag The tag.
+   * @param value The value.
+   */
+  void put_float(uint32_t tag, float value);
+
+  /**
+   * @brief Writes a double precision FloatingPoint of MMS.
+   * @param tag The tag.
+   * @param value The value.
+   */
+  void put_double(uint32_t tag, double value);
+
+  /**
+   * @brief Writes a UtcTime of MMS.
+   * @param tag The tag.
+   * @param nanoseconds The time in nanoseconds since epoch.
+   * @param quality The time quality.
+   */
+  void put_utc_time(uint32_t tag, int64_t nanoseconds, uint8_t quality);
+
+  /**
+   * @brief Writes an element without contents, f.e. NULL.
+   * @param tag The tag.
+   */
+  void put_empty(uint32_t tag);
+
+  /**
+   * @brief Gets the encoding written so far.
+   * @return The encoding, empty after an overflow.
+   */
+  [[nodiscard]] std::span<const std::byte> data() const {
+    return m_overflow ? std::span<const std::byte>{} : std::span<const std::byte>{m_position, m_end};
+  }
+
+  /**
+   * @brief Gets the number of bytes written so far, the mark of close().
+   * @return The number of bytes.
+   */
+  [[nodiscard]] size_t size() const {
+    return static_cast<size_t>(m_end - m_position);
+  }
+
+  /**
+   * @brief Checks if an element didn't fit the buffer. The writer ignores all elements after it.
+   * @return true after an overflow, otherwise false.
+   */
+  [[nodiscard]] bool is_overflow() const {
+    return m_overflow;
+  }
+
+  /**
+   * @brief Discards the encoding to write the next one into the same buffer.
+   */
+  void reset() {
+    m_position = m_end;
+    m_overflow = false;
+  }
+
+ private:
+  void put_header(uint32_t tag, size_t length);
+  void put_big_endian(uint64_t value, size_t bytes);
+  bool reserve(size_t bytes);
+
+  std::byte* m_begin;      ///< start of the buffer
+  std::byte* m_end;        ///< end of the buffer and the encoding
+  std::byte* m_position;   ///< first byte of the encoding
+  bool m_overflow{false};  ///< an element didn't fit
+};
+
+}  // namespace app
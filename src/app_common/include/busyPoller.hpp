@@ -0,0 +1,142 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the spin-then-park policy of busy-polling tasks
+ * \ingroup Application Common
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <chrono>
+#include <cstdint>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The configuration of a busy-polling task.
+ */
+struct BusyPollConfig {
+  uint32_t idleSpins{20000};      ///< idle polls before the task parks
+  uint32_t minIdleSpins{1000};    ///< lower bound of the adaptive idle polls
+  uint32_t maxIdleSpins{200000};  ///< upper bound of the adaptive idle polls
+  bool adaptive{true};            ///< adapt the idle polls to the gaps between inputs
+};
+
+/**
+ * @brief Statistics of a busy-polling task.
+ */
+struct BusyPollStatistics {
+  uint64_t polls{0};                     ///< non-blocking polls
+  uint64_t productivePolls{0};           ///< polls that found work
+  uint64_t parks{0};                     ///< times the task parked
+  uint64_t shortParks{0};                ///< parks ended by input sooner than the spin phase would have lasted
+  std::chrono::nanoseconds spinTime{0};  ///< time spent polling
+  std::chrono::nanoseconds parkTime{0};  ///< time spent parked
+
+  /**
+   * @brief Gets the share of the time spent polling.
+   * @return The share between 0 and 1.
+   */
+  [[nodiscard]] double spin_ratio() const {
+    auto total = spinTime + parkTime;
+    return total.count() > 0 ? static_cast<double>(spinTime.count()) / static_cast<double>(total.count()) : 0.0;
+  }
+};
+
+/**
+ * @brief The BusyPoller class decides when a busy-polling task gives up its core and parks.
+ *
+ * The task polls its inputs without blocking and reports every poll. After idleSpins polls without
+ * work in a row the poller tells the task to park, i.e. to wait blocking for input. With adaptation
+ * enabled, a park that input ended sooner than the spin phase would have lasted doubles the idle
+ * polls (spinning would have caught it without a wakeup), a park that outlasted the spin phase many
+ * times halves them, so a quiet task gives its core back faster.
+ * @note The poller belongs to one task and is not thread-safe.
+ */
+class BusyPoller {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @brief constructor
+   * @param config The configuration.
+   */
+  explicit BusyPoller(const BusyPollConfig& config = {});
+
+  /**
+   * @brief Records a non-blocking poll.
+   * @param productive true if the poll found work.
+   * @return true if the task should park now.
+   */
+  [[nodiscard]] bool polled(bool productive) {
+    m_statistics.polls++;
+    if (productive) {
+      m_statistics.productivePolls++;
+      m_idlePolls = 0;
+      return false;
+    }
+    return ++m_idlePolls >= m_idleSpins;
+  }
+
+  /**
+   * @brief Records the end of a park, the task resumes polling.
+   * @param parkStart The time the park started.
+   */
+  void parked(Clock::time_point parkStart);
+
+  /**
+   * @brief Marks the start of polling, the time until the next park counts as spin time.
+   */
+  void start();
+
+  /**
+   * @brief Gets the current number of idle polls before parking.
+   * @return The number of idle polls.
+   */
+  [[nodiscard]] uint32_t idle_spins() const {
+    return m_idleSpins;
+  }
+
+  /**
+   * @brief Gets the statistics.
+   * @return The statistics.
+   */
+  [[nodiscard]] const BusyPollStatistics& statistics() const {
+    return m_statistics;
+  }
+
+  /**
+   * @brief Hints the CPU that the caller spins, which saves power and frees the sibling hyperthread.
+   */
+  static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+  }
+
+ private:
+  BusyPollConfig m_config;          ///< configuration
+  uint32_t m_idleSpins{0};          ///< current idle polls before parking
+  uint32_t m_idlePolls{0};          ///< idle polls in a row
+  uint64_t m_spinStartPolls{0};     ///< polls before the current spin phase
+  Clock::time_point m_spinStart;    ///< start of the current spin phase
+  BusyPollStatistics m_statistics;  ///< statistics
+};
+
+}  // namespace app
@@ -0,0 +1,220 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the checksums of protocol frames, journals and snapshots
+ * \ingroup Application Common
+ *
+ * The algorithms are the CRC of Modbus RTU frames (CRC-16/MODBUS), the checksum of IEC 60870-5-101
+ * FT1.2 frames (arithmetic sum modulo 256), CRC-32 (IEEE 802.3, as zlib) and CRC-32C (Castagnoli,
+ * as iSCSI and ext4) for journals and snapshots. A CRC has up to three paths:
+ * - bytewise: one table lookup per byte, the reference;
+ * - slicing8: eight bytes per step with eight tables;
+ * - hardware: on x86-64 16-byte blocks folded with carry-less multiplication (PCLMULQDQ), the
+ *   rest of a CRC-32C with the SSE 4.2 CRC32 instruction; on ARMv8 the CRC32 and CRC32C
+ *   instructions.
+ * The sum has only the bytewise path, a loop the compiler vectorizes.
+ * A checksum takes the fastest path the CPU supports unless a path is requested; a CPU level forced
+ * to scalar with app::CpuDispatch disables the hardware path.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The checksum algorithms.
+ */
+enum class ChecksumAlgorithm : uint8_t {
+  crc16Modbus,  ///< CRC-16/MODBUS of RTU frames, sent low byte first
+  iec101Sum,    ///< sum modulo 256 of the user data of IEC 60870-5-101 FT1.2 frames
+  crc32,        ///< CRC-32 of IEEE 802.3 and zlib
+  crc32c,       ///< CRC-32C (Castagnoli) of iSCSI and ext4
+};
+
+/**
+ * @brief The implementations of an algorithm.
+ */
+enum class ChecksumPath : uint8_t {
+  bytewise,  ///< one byte per step
+  slicing8,  ///< eight bytes per step
+  hardware,  ///< instructions of the CPU
+};
+
+/**
+ * @brief Gets the name of an algorithm.
+ * @param algorithm The algorithm.
+ * @return The name.
+ */
+std::string_view to_string(ChecksumAlgorithm algorithm);
+
+/**
+ * @brief Gets the name of a path, for the hardware path the instructions of this CPU.
+ * @param path The path.
+ * @return The name.
+ */
+std::string_view to_string(ChecksumPath path);
+
+/**
+ * @brief The Checksum class computes a checksum incrementally, over data that arrives in parts.
+ *
+ * Usage: update() with every part, value() for the checksum of all parts so far; reset() starts
+ * over. The result is independent of the split into parts and of the path.
+ */
+class Checksum {
+ public:
+  /**
+   * @brief constructor, with the fastest path of the CPU.
+   * @param algorithm The algorithm.
+   */
+  explicit Checksum(ChecksumAlgorithm algorithm) : Checksum(algorithm, best_path(algorithm)) {}
+
+  /**
+   * @brief constructor, with a path, e.g. to compare the paths.
+   * @param algorithm The algorithm.
+   * @param path The path, the fastest path if the CPU or the algorithm doesn't support it.
+   */
+  Checksum(ChecksumAlgorithm algorithm, ChecksumPath path);
+
+  /**
+   * @brief Adds data.
+   * @param data The data.
+   * @param size The number of bytes.
+   */
+  void update(const void* data, size_t size) {
+    m_state = m_update(m_state, static_cast<const uint8_t*>(data), size);
+  }
+
+  /**
+   * @brief Adds data.
+   * @param data The data.
+   */
+  void update(std::span<const uint8_t> data) {
+    update(data.data(), data.size());
+  }
+
+  /**
+   * @brief Gets the checksum of the data added since the construction or the reset.
+   * @return The checksum, 16 bits for CRC-16 and 8 bits for the sum.
+   */
+  [[nodiscard]] uint32_t value() const {
+    return m_state ^ m_finalXor;
+  }
+
+  /**
+   * @brief Starts over.
+   */
+  void reset() {
+    m_state = m_initial;
+  }
+
+  /**
+   * @brief Gets the algorithm.
+   * @return The algorithm.
+   */
+  [[nodiscard]] ChecksumAlgorithm algorithm() const {
+    return m_algorithm;
+  }
+
+  /**
+   * @brief Gets the path.
+   * @return The path.
+   */
+  [[nodiscard]] ChecksumPath path() const {
+    return m_path;
+  }
+
+  /**
+   * @brief Computes the checksum of data in one go.
+   * @param algorithm The algorithm.
+   * @param data The data.
+   * @return The checksum.
+   */
+  [[nodiscard]] static uint32_t compute(ChecksumAlgorithm algorithm, std::span<const uint8_t> data) {
+    Checksum checksum(algorithm);
+    checksum.update(data);
+    return checksum.value();
+  }
+
+  /**
+   * @brief Checks whether the CPU supports a path of an algorithm.
+   * @param algorithm The algorithm.
+   * @param path The path.
+   * @return true if supported, otherwise false.
+   */
+  [[nodiscard]] static bool is_supported(ChecksumAlgorithm algorithm, ChecksumPath path);
+
+  /**
+   * @brief Gets the fastest path of an algorithm the CPU supports.
+   * @param algorithm The algorithm.
+   * @return The path.
+   */
+  [[nodiscard]] static ChecksumPath best_path(ChecksumAlgorithm algorithm);
+
+ private:
+  /// Adds bytes to the state of a path
+  using Update = uint32_t (*)(uint32_t state, const uint8_t* data, size_t size);
+
+  Update m_update{nullptr};                                 ///< update of the path
+  uint32_t m_state{0};                                      ///< state after the added data
+  uint32_t m_initial{0};                                    ///< state of no data
+  uint32_t m_finalXor{0};                                   ///< applied to the state for the value
+  ChecksumAlgorithm m_algorithm{ChecksumAlgorithm::crc32};  ///< algorithm
+  ChecksumPath m_path{ChecksumPath::bytewise};              ///< path
+};
+
+/**
+ * @brief Computes the CRC of a Modbus RTU frame.
+ * @param frame The address, function code and data.
+ * @return The CRC, sent low byte first.
+ */
+inline uint16_t crc16_modbus(std::span<const uint8_t> frame) {
+  return static_cast<uint16_t>(Checksum::compute(ChecksumAlgorithm::crc16Modbus, frame));
+}
+
+/**
+ * @brief Computes the checksum of an IEC 60870-5-101 FT1.2 frame.
+ * @param userData The user data, from the control field to the end of the ASDU.
+ * @return The checksum.
+ */
+inline uint8_t iec101_checksum(std::span<const uint8_t> userData) {
+  return static_cast<uint8_t>(Checksum::compute(ChecksumAlgorithm::iec101Sum, userData));
+}
+
+/**
+ * @brief Computes the CRC-32 of data.
+ * @param data The data.
+ * @return The CRC.
+ */
+inline uint32_t crc32(std::span<const uint8_t> data) {
+  return Checksum::compute(ChecksumAlgorithm::crc32, data);
+}
+
+/**
+ * @brief Computes the CRC-32C of data.
+ * @param data The data.
+ * @return The CRC.
+ */
+inline uint32_t crc32c(std::span<const uint8_t> data) {
+  return Checksum::compute(ChecksumAlgorithm::crc32c, data);
+}
+
+}  // namespace app
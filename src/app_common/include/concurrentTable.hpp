@@ -0,0 +1,525 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the concurrent session table with lock-free reads
+ * \ingroup Application Common
+ *
+ * The registries of the connections and sessions (peer address, link id, common address) are looked
+ * up for every received frame, by several worker threads, and change only when a session opens or
+ * closes. A map behind a reader-writer lock makes every lookup write the lock word, so the readers
+ * of all cores fight for one cache line. The table reads without a lock:
+ * - reads walk the chain of a bucket with acquire loads, a node is never changed once published;
+ * - writes lock one of the stripes of the buckets, an update replaces the node (copy on write);
+ * - an unlinked node is freed only when no reader can hold it any more (epoch-based reclamation):
+ *   a reader announces the global epoch while it reads, the epoch advances when all readers
+ *   announced the current one, and a node unlinked in epoch e is freed from epoch e + 2 on.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "objectPool.hpp"
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The EpochDomain class tells when no reader can hold an unlinked object any more.
+ *
+ * Every thread that reads gets a record on its first pin, the records are reused by later threads
+ * and kept for the lifetime of the process. The domain is shared by all tables.
+ */
+class EpochDomain {
+ public:
+  /**
+   * @brief Announces a read: objects unlinked from now on stay allocated until the unpin.
+   * Pins nest, only the outermost one announces.
+   */
+  static void pin() noexcept;
+
+  /**
+   * @brief Ends a read.
+   */
+  static void unpin() noexcept;
+
+  /**
+   * @brief Gets the epoch of an object that was unlinked before the call.
+   * @return The epoch the object is retired in.
+   */
+  [[nodiscard]] static uint64_t retire_epoch() noexcept;
+
+  /**
+   * @brief Advances the global epoch if all pinned threads announced the current one.
+   * @return The global epoch after the attempt.
+   */
+  static uint64_t try_advance() noexcept;
+
+  /**
+   * @brief Checks whether an object retired in an epoch can be freed.
+   * @param retired The epoch the object was retired in.
+   * @param current The global epoch, e.g. of try_advance().
+   * @return true if no reader can hold it, otherwise false.
+   */
+  [[nodiscard]] static bool is_reclaimable(uint64_t retired, uint64_t current) noexcept {
+    return current >= retired + 2;
+  }
+};
+
+/**
+ * @brief The EpochGuard class pins the calling thread for its scope.
+ */
+class EpochGuard {
+ public:
+  EpochGuard() noexcept {
+    EpochDomain::pin();
+  }
+  ~EpochGuard() {
+    EpochDomain::unpin();
+  }
+  EpochGuard(const EpochGuard&) = delete;
+  EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+/**
+ * @brief The configuration of a concurrent table.
+ */
+struct ConcurrentTableConfig {
+  size_t buckets{1024};    ///< initial buckets, rounded up to a power of two and at least the stripes
+  size_t stripes{64};      ///< locks of the writers, rounded up to a power of two
+  size_t retireBatch{64};  ///< unlinked nodes of a stripe that start a reclamation
+};
+
+/**
+ * @brief The counters of a concurrent table.
+ */
+struct ConcurrentTableStatistics {
+  uint64_t inserts{0};    ///< inserted keys
+  uint64_t updates{0};    ///< replaced values
+  uint64_t erases{0};     ///< erased keys
+  uint64_t grows{0};      ///< doublings of the buckets
+  uint64_t retired{0};    ///< unlinked nodes and bucket arrays
+  uint64_t reclaimed{0};  ///< freed nodes and bucket arrays
+};
+
+/**
+ * @brief The ConcurrentTable class maps 64-bit keys to values for many reading threads.
+ *
+ * Usage: find() or visit() from any thread without locking; insert(), insert_or_assign() and erase()
+ * from any thread, writers of different stripes don't wait for each other. The buckets double when
+ * the table holds more keys than buckets; the growing writer locks all stripes, the readers go on
+ * in the old buckets until they see the new ones.
+ * @note A value is copied for every update, the table suits registries that are read far more often
+ * than written. The destructor must not run concurrently with other calls.
+ */
+template <typename Value>
+class ConcurrentTable {
+ public:
+  /**
+   * @brief constructor.
+   * @param config The configuration.
+   */
+  explicit ConcurrentTable(const ConcurrentTableConfig& config = {})
+      : m_stripeCount(std::bit_ceil(std::max<size_t>(config.stripes, 1))),
+        m_stripes(std::make_unique<Stripe[]>(m_stripeCount)),
+        m_retireBatch(std::max<size_t>(config.retireBatch, 1)),
+        m_buckets(new Buckets(std::bit_ceil(std::max(config.buckets, m_stripeCount)))) {}
+
+  /// destructor frees all nodes, no reader may run
+  ~ConcurrentTable() {
+    auto* buckets = m_buckets.load(std::memory_order_relaxed);
+    for (size_t index = 0; index <= buckets->mask; ++index) {
+      for (auto* node = buckets->heads[index].load(std::memory_order_relaxed); node != nullptr;) {
+        auto* next = node->next.load(std::memory_order_relaxed);
+        destroy_node(node);
+        node = next;
+      }
+    }
+    delete buckets;
+    for (size_t index = 0; index < m_stripeCount; ++index) {
+      for (const auto& retired : m_stripes[index].retired) {
+        retired.destroy(retired.object);
+      }
+    }
+  }
+
+  ConcurrentTable(const ConcurrentTable&) = delete;
+  ConcurrentTable& operator=(const ConcurrentTable&) = delete;
+
+  /**
+   * @brief Calls a function with the value of a key, without a lock.
+   * @param key The key.
+   * @param function Called as void(const Value&) while the value can't be freed, must not block.
+   * @return true if the key was found, otherwise false.
+   */
+  template <typename Visit>
+  bool visit(uint64_t key, Visit&& function) const {
+    EpochGuard guard;
+    const auto hash = mix(key);
+    const auto* buckets = m_buckets.load(std::memory_order_acquire);
+    for (const auto* node = buckets->heads[hash & buckets->mask].load(std::memory_order_acquire); node != nullptr;
+         node = node->next.load(std::memory_order_acquire)) {
+      if (node->key == key) {
+        function(node->value);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Gets a copy of the value of a key, without a lock.
+   * @param key The key.
+   * @return The value, none if the key isn't found.
+   */
+  [[nodiscard]] std::optional<Value> find(uint64_t key) const {
+    std::optional<Value> result;
+    visit(key, [&](const Value& value) { result.emplace(value); });
+    return result;
+  }
+
+  /**
+   * @brief Checks whether a key is in the table, without a lock.
+   * @param key The key.
+   * @return true if found, otherwise false.
+   */
+  [[nodiscard]] bool contains(uint64_t key) const {
+    return visit(key, [](const Value&) {});
+  }
+
+  /**
+   * @brief Inserts a key unless it is in the table.
+   * @param key The key.
+   * @param value The value.
+   * @return true if inserted, false if the key was found.
+   */
+  bool insert(uint64_t key, const Value& value) {
+    return store(key, value, false);
+  }
+
+  /**
+   * @brief Inserts a key or replaces its value; a reader sees the old or the new value, never a mix.
+   * @param key The key.
+   * @param value The value.
+   * @return true if inserted, false if replaced.
+   */
+  bool insert_or_assign(uint64_t key, const Value& value) {
+    return store(key, value, true);
+  }
+
+  /**
+   * @brief Erases a key, readers that found it keep the value until they finish.
+   * @param key The key.
+   * @return true if erased, false if not found.
+   */
+  bool erase(uint64_t key) {
+    const auto hash = mix(key);
+    auto& stripe = m_stripes[hash & (m_stripeCount - 1)];
+    std::lock_guard lock(stripe.mutex);
+    auto* buckets = m_buckets.load(std::memory_order_acquire);
+    auto* link = &buckets->heads[hash & buckets->mask];
+    for (auto* node = link->load(std::memory_order_relaxed); node != nullptr;
+         link = &node->next, node = link->load(std::memory_order_relaxed)) {
+      if (node->key == key) {
+        link->store(node->next.load(std::memory_order_relaxed), std::memory_order_release);
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+        ++stripe.statistics.erases;
+        retire(stripe, node, destroy_node);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Erases all keys.
+   */
+  void clear() {
+    auto locks = lock_all();
+    auto* buckets = m_buckets.load(std::memory_order_relaxed);
+    for (size_t index = 0; index <= buckets->mask; ++index) {
+      auto* node = buckets->heads[index].exchange(nullptr, std::memory_order_release);
+      while (node != nullptr) {
+        auto* next = node->next.load(std::memory_order_relaxed);
+        auto& stripe = m_stripes[mix(node->key) & (m_stripeCount - 1)];
+        ++stripe.statistics.erases;
+        retire(stripe, node, destroy_node);
+        node = next;
+      }
+    }
+    m_size.store(0, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Frees the unlinked nodes no reader can hold any more, e.g. when the writers are idle.
+   */
+  void reclaim() {
+    for (size_t index = 0; index < m_stripeCount; ++index) {
+      std::lock_guard lock(m_stripes[index].mutex);
+      reclaim_stripe(m_stripes[index]);
+    }
+  }
+
+  /**
+   * @brief Gets the number of keys, exact while no writer runs.
+   * @return The number of keys.
+   */
+  [[nodiscard]] size_t size() const {
+    return m_size.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Gets the number of buckets.
+   * @return The number of buckets.
+   */
+  [[nodiscard]] size_t buckets() const {
+    return m_buckets.load(std::memory_order_acquire)->mask + 1;
+  }
+
+  /**
+   * @brief Gets the number of stripes.
+   * @return The number of stripes.
+   */
+  [[nodiscard]] size_t stripes() const {
+    return m_stripeCount;
+  }
+
+  /**
+   * @brief Gets the counters, summed over the stripes.
+   * @return The counters.
+   */
+  [[nodiscard]] ConcurrentTableStatistics statistics() const {
+    ConcurrentTableStatistics sum;
+    for (size_t index = 0; index < m_stripeCount; ++index) {
+      std::lock_guard lock(m_stripes[index].mutex);
+      const auto& stripe = m_stripes[index].statistics;
+      sum.inserts += stripe.inserts;
+      sum.updates += stripe.updates;
+      sum.erases += stripe.erases;
+      sum.grows += stripe.grows;
+      sum.retired += stripe.retired;
+      sum.reclaimed += stripe.reclaimed;
+    }
+    return sum;
+  }
+
+ private:
+  /**
+   * @brief An entry, immutable once published but for the link to the next one.
+   */
+  struct Node {
+    Node(uint64_t nodeKey, const Value& nodeValue) : key(nodeKey), value(nodeValue) {}
+
+    const uint64_t key;                ///< the key
+    const Value value;                 ///< the value
+    std::atomic<Node*> next{nullptr};  ///< next entry of the bucket
+  };
+
+  /**
+   * @brief The heads of the bucket chains.
+   */
+  struct Buckets {
+    explicit Buckets(size_t count) : mask(count - 1), heads(std::make_unique<std::atomic<Node*>[]>(count)) {}
+
+    const size_t mask;                            ///< buckets - 1
+    std::unique_ptr<std::atomic<Node*>[]> heads;  ///< first entries of the buckets
+  };
+
+  /**
+   * @brief An unlinked object waiting for the readers.
+   */
+  struct Retired {
+    void* object;            ///< the node or bucket array
+    void (*destroy)(void*);  ///< frees the object
+    uint64_t epoch;          ///< epoch it was unlinked in
+  };
+
+  /**
+   * @brief The lock of the buckets whose index has the stripe in its low bits, on its own cache line.
+   */
+  struct alignas(64) Stripe {
+    mutable std::mutex mutex;              ///< lock of the writers
+    std::vector<Retired> retired;          ///< unlinked objects, oldest first
+    ConcurrentTableStatistics statistics;  ///< counters of the stripe
+  };
+
+  /**
+   * @brief Mixes the bits of a key, addresses and ids differ in few bits.
+   * @param key The key.
+   * @return The hash.
+   */
+  static uint64_t mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+  }
+
+  /**
+   * @brief Allocates a node from the object pool.
+   */
+  static Node* make_node(uint64_t key, const Value& value) {
+    return make_pooled<Node>(key, value).release();
+  }
+
+  /**
+   * @brief Frees a retired node.
+   */
+  static void destroy_node(void* node) {
+    PoolDeleter<Node>{}(static_cast<Node*>(node));
+  }
+
+  /**
+   * @brief Frees a retired bucket array.
+   */
+  static void destroy_buckets(void* buckets) {
+    delete static_cast<Buckets*>(buckets);
+  }
+
+  /**
+   * @brief Inserts or replaces the node of a key under the lock of its stripe, grows afterwards.
+   * @param key The key.
+   * @param value The value.
+   * @param assign Replaces the value of a found key.
+   * @return true if inserted, otherwise false.
+   */
+  bool store(uint64_t key, const Value& value, bool assign) {
+    const auto hash = mix(key);
+    auto& stripe = m_stripes[hash & (m_stripeCount - 1)];
+    size_t full = 0;
+    {
+      std::lock_guard lock(stripe.mutex);
+      auto* buckets = m_buckets.load(std::memory_order_acquire);
+      auto& head = buckets->heads[hash & buckets->mask];
+      auto* link = &head;
+      for (auto* node = link->load(std::memory_order_relaxed); node != nullptr;
+           link = &node->next, node = link->load(std::memory_order_relaxed)) {
+        if (node->key == key) {
+          if (!assign) {
+            return false;
+          }
+          auto* copy = make_node(key, value);
+          copy->next.store(node->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+          link->store(copy, std::memory_order_release);
+          ++stripe.statistics.updates;
+          retire(stripe, node, destroy_node);
+          return false;
+        }
+      }
+      auto* node = make_node(key, value);
+      node->next.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      head.store(node, std::memory_order_release);
+      ++stripe.statistics.inserts;
+      if (m_size.fetch_add(1, std::memory_order_relaxed) + 1 > buckets->mask + 1) {
+        full = buckets->mask + 1;
+      }
+    }
+    if (full > 0) {
+      grow(full);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Doubles the buckets: copies the nodes into new chains and retires the old ones, whose
+   * links readers in the old buckets still follow.
+   * @param buckets The number of buckets that was found full.
+   */
+  void grow(size_t buckets) {
+    auto locks = lock_all();
+    auto* old = m_buckets.load(std::memory_order_relaxed);
+    if (old->mask + 1 != buckets) {
+      return;
+    }
+    auto* next = new Buckets(buckets * 2);
+    for (size_t index = 0; index <= old->mask; ++index) {
+      for (auto* node = old->heads[index].load(std::memory_order_relaxed); node != nullptr;
+           node = node->next.load(std::memory_order_relaxed)) {
+        auto& head = next->heads[mix(node->key) & next->mask];
+        auto* copy = make_node(node->key, node->value);
+        copy->next.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        head.store(copy, std::memory_order_relaxed);
+      }
+    }
+    m_buckets.store(next, std::memory_order_release);
+
+    for (size_t index = 0; index <= old->mask; ++index) {
+      for (auto* node = old->heads[index].load(std::memory_order_relaxed); node != nullptr;) {
+        auto* following = node->next.load(std::memory_order_relaxed);
+        retire(m_stripes[mix(node->key) & (m_stripeCount - 1)], node, destroy_node);
+        node = following;
+      }
+    }
+    ++m_stripes[0].statistics.grows;
+    retire(m_stripes[0], old, destroy_buckets);
+  }
+
+  /**
+   * @brief Queues an unlinked object in its stripe, reclaims the stripe when the batch is full.
+   */
+  void retire(Stripe& stripe, void* object, void (*destroy)(void*)) {
+    stripe.retired.push_back({object, destroy, EpochDomain::retire_epoch()});
+    ++stripe.statistics.retired;
+    if (stripe.retired.size() >= m_retireBatch) {
+      reclaim_stripe(stripe);
+    }
+  }
+
+  /**
+   * @brief Frees the objects of a locked stripe that no reader can hold.
+   */
+  void reclaim_stripe(Stripe& stripe) {
+    const auto current = EpochDomain::try_advance();
+    std::erase_if(stripe.retired, [&](const Retired& retired) {
+      if (!EpochDomain::is_reclaimable(retired.epoch, current)) {
+        return false;
+      }
+      retired.destroy(retired.object);
+      ++stripe.statistics.reclaimed;
+      return true;
+    });
+  }
+
+  /**
+   * @brief Locks all stripes in their order.
+   */
+  std::vector<std::unique_lock<std::mutex>> lock_all() const {
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(m_stripeCount);
+    for (size_t index = 0; index < m_stripeCount; ++index) {
+      locks.emplace_back(m_stripes[index].mutex);
+    }
+    return locks;
+  }
+
+  const size_t m_stripeCount;                 ///< number of stripes, a power of two
+  std::unique_ptr<Stripe[]> m_stripes;        ///< locks, unlinked objects and counters of the writers
+  const size_t m_retireBatch;                 ///< unlinked objects of a stripe that start a reclamation
+  std::atomic<Buckets*> m_buckets;            ///< current buckets, replaced by a grow
+  alignas(64) std::atomic<size_t> m_size{0};  ///< number of keys, on its own cache line
+};
+
+}  // namespace app
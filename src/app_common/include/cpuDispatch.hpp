@@ -0,0 +1,242 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the runtime dispatch of SIMD kernels to the features of the CPU
+ * \ingroup Application Common
+ *
+ * One binary per architecture runs on every CPU of the fleet: a kernel is compiled in variants for
+ * several instruction set levels and the dispatch binds a function pointer to the best variant the
+ * CPU supports. The levels are
+ * - scalar: the baseline of the build, every CPU;
+ * - sse42: x86-64-v2 (SSE4.2, POPCNT) with PCLMULQDQ;
+ * - avx2: x86-64-v3 (AVX2, FMA, BMI1/2);
+ * - avx512: x86-64-v4 (AVX-512 F, BW, DQ, VL);
+ * - neon: Advanced SIMD of ARMv8, or of ARMv7 with NEON.
+ * The features are read once, from cpuid and the enabled register state (XCR0) on x86, from the
+ * hardware capabilities of the auxiliary vector (AT_HWCAP) on ARM.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The instruction set levels of the kernel variants, the x86 levels in ascending order.
+ */
+enum class CpuLevel : uint8_t {
+  scalar,  ///< baseline of the build
+  sse42,   ///< x86-64-v2 with PCLMULQDQ
+  avx2,    ///< x86-64-v3
+  avx512,  ///< x86-64-v4
+  neon,    ///< ARM Advanced SIMD
+};
+
+/**
+ * @brief Gets the name of a level.
+ * @param level The level.
+ * @return The name.
+ */
+std::string_view to_string(CpuLevel level);
+
+/**
+ * @brief Parses the name of a level.
+ * @param text The name, e.g. "avx2".
+ * @return The level, none if unknown.
+ */
+std::optional<CpuLevel> parse_cpu_level(std::string_view text);
+
+/**
+ * @brief The features of the CPU the kernels use.
+ */
+struct CpuFeatures {
+  bool sse42{false};     ///< SSE4.2, with SSE3, SSSE3 and SSE4.1
+  bool popcnt{false};    ///< POPCNT
+  bool pclmul{false};    ///< carry-less multiplication
+  bool avx{false};       ///< AVX, enabled by the OS
+  bool avx2{false};      ///< AVX2, enabled by the OS
+  bool fma{false};       ///< FMA3
+  bool bmi2{false};      ///< BMI1 and BMI2
+  bool avx512f{false};   ///< AVX-512 foundation, enabled by the OS
+  bool avx512bw{false};  ///< AVX-512 byte and word
+  bool avx512dq{false};  ///< AVX-512 doubleword and quadword
+  bool avx512vl{false};  ///< AVX-512 vector length
+  bool neon{false};      ///< Advanced SIMD
+  bool crc32{false};     ///< ARMv8 CRC32 instructions
+  bool pmull{false};     ///< ARMv8 polynomial multiplication
+
+  /**
+   * @brief Reads the features of the CPU.
+   * @return The features.
+   */
+  static CpuFeatures detect();
+
+  /**
+   * @brief Gets the highest level of the features.
+   * @return The level.
+   */
+  [[nodiscard]] CpuLevel level() const;
+
+  /**
+   * @brief Describes the features.
+   * @return The names of the present features, e.g. "sse4.2 popcnt pclmul avx avx2".
+   */
+  [[nodiscard]] std::string to_string() const;
+};
+
+/**
+ * @brief The variant of a kernel for a level.
+ */
+template <typename Function>
+struct KernelVariant {
+  CpuLevel level;      ///< level the variant needs
+  Function* function;  ///< the variant
+};
+
+/**
+ * @brief The CpuDispatch class binds the kernels to their best variants.
+ *
+ * A kernel registers its variants with add_kernel(), usually from a static initializer of its
+ * translation unit, and is bound at once to the best variant up to the level. The level is the
+ * detected one unless force_level() lowers it, e.g. to compare the variants in a benchmark. The
+ * daemon binds before process_start(): the registration and the binding aren't thread-safe, the
+ * calls through the bound pointers are.
+ */
+class CpuDispatch {
+ public:
+  /**
+   * @brief The binding of a kernel.
+   */
+  struct Binding {
+    std::string name;  ///< name of the kernel
+    CpuLevel level;    ///< level of the bound variant
+  };
+
+  /**
+   * @brief Gets the dispatch of the process, detects the features on the first call.
+   * @return The dispatch.
+   */
+  static CpuDispatch& instance();
+
+  /**
+   * @brief Gets the features of the CPU.
+   * @return The features.
+   */
+  [[nodiscard]] const CpuFeatures& features() const {
+    return m_features;
+  }
+
+  /**
+   * @brief Gets the highest level the CPU supports.
+   * @return The level.
+   */
+  [[nodiscard]] CpuLevel detected_level() const {
+    return m_detected;
+  }
+
+  /**
+   * @brief Gets the level the kernels are bound to.
+   * @return The level.
+   */
+  [[nodiscard]] CpuLevel level() const {
+    return m_level;
+  }
+
+  /**
+   * @brief Checks whether the CPU supports a level.
+   * @param level The level.
+   * @return true if supported, otherwise false.
+   */
+  [[nodiscard]] bool supports(CpuLevel level) const;
+
+  /**
+   * @brief Checks whether the variants of a level may run, supported and not above the level.
+   * @param level The level.
+   * @return true if enabled, otherwise false.
+   */
+  [[nodiscard]] bool enabled(CpuLevel level) const {
+    // the ARM level is above the x86 levels, but a CPU supports only the levels of its architecture
+    return supports(level) && level <= m_level;
+  }
+
+  /**
+   * @brief Sets the level and binds the kernels again.
+   * @param level The level, scalar for the baseline of the build.
+   * @return false if the CPU doesn't support the level, the level stays.
+   */
+  bool force_level(CpuLevel level);
+
+  /**
+   * @brief Registers a kernel and binds it.
+   * @param name The name of the kernel, for the log.
+   * @param target The function pointer the callers go through.
+   * @param variants The variants, the scalar one is required.
+   */
+  template <typename Function>
+  void add_kernel(std::string_view name, Function*& target, std::initializer_list<KernelVariant<Function>> variants) {
+    Kernel kernel;
+    kernel.name = name;
+    std::vector<KernelVariant<Function>> table(variants);
+    for (const auto& variant : table) {
+      kernel.levels.push_back(variant.level);
+    }
+    kernel.bind = [&target, table = std::move(table)](size_t index) { target = table[index].function; };
+    m_kernels.push_back(std::move(kernel));
+    bind(m_kernels.back());
+  }
+
+  /**
+   * @brief Binds the kernels to the best variants up to the level.
+   */
+  void bind();
+
+  /**
+   * @brief Gets the bindings of the kernels.
+   * @return The name and the level of the bound variant of every kernel.
+   */
+  [[nodiscard]] std::vector<Binding> bindings() const;
+
+ private:
+  /**
+   * @brief A registered kernel.
+   */
+  struct Kernel {
+    std::string name;                  ///< name for the log
+    std::vector<CpuLevel> levels;      ///< levels of the variants
+    std::function<void(size_t)> bind;  ///< binds the target to a variant
+    CpuLevel bound{CpuLevel::scalar};  ///< level of the bound variant
+  };
+
+  CpuDispatch();
+
+  void bind(Kernel& kernel);
+
+  CpuFeatures m_features;         ///< features of the CPU
+  CpuLevel m_detected;            ///< highest supported level
+  CpuLevel m_level;               ///< level of the bindings
+  std::vector<Kernel> m_kernels;  ///< registered kernels
+};
+
+}  // namespace app
@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the discovery of the CPUs the process may use
+ * \ingroup Application Common
+ *
+ * The limits come from the CPU affinity mask of the process and from the cgroup v2 files of its
+ * cgroup: cpu.max (bandwidth quota, the tightest along the hierarchy), cpuset.cpus.effective and
+ * cpu.stat (throttling). On hosts without cgroup v2 only the affinity mask is used.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The CPU limits of the process.
+ */
+struct CpuLimits {
+  size_t onlineCpus{0};             ///< CPUs online in the system
+  size_t affinityCpus{0};           ///< CPUs in the affinity mask of the process
+  size_t cpusetCpus{0};             ///< CPUs in cpuset.cpus.effective, 0 if unknown
+  std::optional<double> quotaCpus;  ///< CPUs granted by cpu.max, none if unlimited
+
+  /**
+   * @brief Gets the number of workers that keep the CPUs busy without being throttled: the smallest
+   * of the affinity mask, the cpuset and the whole CPUs of the quota, at least one.
+   * @return The number of workers.
+   */
+  [[nodiscard]] size_t workers() const;
+
+  bool operator==(const CpuLimits& other) const = default;
+};
+
+/**
+ * @brief The counters of cpu.stat, cumulative since the cgroup was created.
+ */
+struct CpuThrottling {
+  uint64_t usageUsec{0};         ///< CPU time used
+  uint64_t periods{0};           ///< enforcement periods with runnable tasks
+  uint64_t throttledPeriods{0};  ///< periods in which the quota was exhausted
+  uint64_t throttledUsec{0};     ///< time the tasks were throttled
+
+  /**
+   * @brief Gets the counters since an earlier reading.
+   * @param earlier The earlier reading.
+   * @return The difference.
+   */
+  [[nodiscard]] CpuThrottling operator-(const CpuThrottling& earlier) const;
+};
+
+/**
+ * @brief The CpuResources class reads the CPU limits and the throttling counters of the process.
+ * The files are read on every call, so callers see changed limits when they poll.
+ */
+class CpuResources {
+ public:
+  /**
+   * @brief constructor, finds the cgroup v2 mount in /proc/self/mountinfo.
+   */
+  CpuResources();
+
+  /**
+   * @brief constructor with explicit paths.
+   * @param cgroupMount The mount point of the cgroup v2 hierarchy.
+   * @param procCgroup The cgroup membership file of the process.
+   */
+  CpuResources(std::filesystem::path cgroupMount, std::filesystem::path procCgroup);
+
+  /**
+   * @brief Reads the current limits.
+   * @return The limits.
+   */
+  [[nodiscard]] CpuLimits limits() const;
+
+  /**
+   * @brief Reads the throttling counters of the cgroup.
+   * @return The counters, none without cgroup v2.
+   */
+  [[nodiscard]] std::optional<CpuThrottling> throttling() const;
+
+  /**
+   * @brief Gets the cgroup directory of the process.
+   * @return The directory, empty without cgroup v2.
+   */
+  [[nodiscard]] std::filesystem::path cgroup() const;
+
+  /**
+   * @brief Counts the CPUs of a cpuset list like "0-3,6,8-9".
+   * @param list The list.
+   * @return The number of CPUs.
+   */
+  static size_t count_cpu_list(std::string_view list);
+
+  /**
+   * @brief Parses a cpuset list like "0-3,6,8-9", malformed items are skipped.
+   * @param list The list.
+   * @return The CPUs in ascending order without duplicates.
+   */
+  static std::vector<size_t> parse_cpu_list(std::string_view list);
+
+ private:
+  std::filesystem::path m_mount;       ///< mount point of the cgroup v2 hierarchy
+  std::filesystem::path m_mountRoot;   ///< cgroup the mount point shows as its root
+  std::filesystem::path m_procCgroup;  ///< cgroup membership file of the process
+};
+
+}  // namespace app
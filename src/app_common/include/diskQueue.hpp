@@ -0,0 +1,247 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the store-and-forward queue of a context for link outages
+ * \ingroup Application Common
+ *
+ * The queue is a FIFO of records in fixed-size segments. The newest segments stay in RAM up to a
+ * threshold, so a short outage costs neither flash writes nor system calls; beyond it the oldest
+ * RAM segment is copied through a shared mapping into a segment file, and the reader maps the
+ * files in turn when the link is back. When the files reach the disk budget the oldest segment is
+ * dropped, so an outage of any length costs bounded RAM and bounded flash.
+ *
+ * A segment file starts with a 32 byte header in host byte order: magic "DQSG", 16-bit version,
+ * 16-bit reserved field, 64-bit sequence number, the write cursor (end of the records), the number
+ * of records, the CRC-32C of these fields and the read cursor, which the reader updates in the
+ * mapping and which the checksum doesn't cover. Each record follows 8-byte aligned as 32-bit size,
+ * CRC-32C of the payload and the payload. open() takes over the files of a previous run: records
+ * after a bad checksum are dropped, a read cursor off a record boundary restarts the segment, so a
+ * crash repeats records rather than losing them. The records in RAM are written to files by close().
+ *
+ * A segment file and its directory entry are synced to the medium when the segment spills, so the
+ * spilled records survive a power cut as well. The read cursor is synced by close() only: after a
+ * power cut the records read since the last close() are sent again. The records in RAM are lost.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The configuration of a disk queue.
+ */
+struct DiskQueueConfig {
+  std::filesystem::path directory;           ///< directory of the segment files, empty to keep the queue in RAM
+  size_t segmentSize{size_t{4} << 20};       ///< bytes of a segment, the header included
+  size_t memoryLimit{size_t{8} << 20};       ///< bytes of the segments in RAM before the oldest spills
+  uint64_t diskBudget{uint64_t{256} << 20};  ///< bytes of the segment files before the oldest are dropped
+};
+
+/**
+ * @brief The counters of a disk queue.
+ */
+struct DiskQueueStatistics {
+  uint64_t pushed{0};           ///< records queued
+  uint64_t popped{0};           ///< records taken by the reader
+  uint64_t rejected{0};         ///< records larger than a segment
+  uint64_t spilled{0};          ///< segments written to files
+  uint64_t dropped{0};          ///< unread records of dropped segments
+  uint64_t droppedSegments{0};  ///< segments dropped at the budget or on a failed spill
+  uint64_t recovered{0};        ///< unread records of the files taken over by open()
+  uint64_t corrupt{0};          ///< records dropped for a bad checksum
+};
+
+/**
+ * @brief The DiskQueue class buffers the outgoing records of a context while its link is down.
+ *
+ * Usage: push() every record; while the link is up the reader sends front() and pop()s it once
+ * sent, or drain()s a batch. A record read from a file is checked against its CRC-32C.
+ * @note The queue is not thread-safe, it runs on the thread of the context.
+ */
+class DiskQueue {
+ public:
+  static constexpr uint32_t Magic = 0x47535144;  ///< "DQSG" in little-endian byte order
+  static constexpr uint16_t Version = 1;         ///< format version
+  static constexpr size_t HeaderSize = 32;       ///< size of the segment header
+  static constexpr size_t RecordHeaderSize = 8;  ///< size and checksum of a record
+
+  /**
+   * @brief constructor.
+   * @param config The configuration.
+   */
+  explicit DiskQueue(const DiskQueueConfig& config = {});
+
+  /// destructor writes the records in RAM to files
+  ~DiskQueue();
+
+  DiskQueue(const DiskQueue&) = delete;
+  DiskQueue& operator=(const DiskQueue&) = delete;
+
+  /**
+   * @brief Creates the directory and takes over the segment files of a previous run.
+   * @return true if the queue is usable, otherwise false with last_error().
+   */
+  [[nodiscard]] bool open();
+
+  /**
+   * @brief Writes the records in RAM to files, if there is a directory, and empties the queue.
+   */
+  void close();
+
+  /**
+   * @brief Queues a record.
+   * @param record The record.
+   * @return false if the record doesn't fit into a segment.
+   */
+  bool push(std::span<const uint8_t> record);
+
+  /**
+   * @brief Gets the oldest record without removing it.
+   * @return The record, valid until pop() or push(); none if the queue is empty.
+   */
+  [[nodiscard]] std::optional<std::span<const uint8_t>> front();
+
+  /**
+   * @brief Removes the oldest record, the one front() returned.
+   */
+  void pop();
+
+  /**
+   * @brief Hands the oldest records to a sink until it refuses one.
+   * @param maxRecords The maximal number of records.
+   * @param sink Called as bool(std::span<const uint8_t>), false if the record wasn't taken.
+   * @return The number of records taken.
+   */
+  template <typename Sink>
+  size_t drain(size_t maxRecords, Sink&& sink) {
+    size_t taken = 0;
+    for (; taken < maxRecords; ++taken) {
+      auto record = front();
+      if (!record || !sink(*record)) {
+        break;
+      }
+      pop();
+    }
+    return taken;
+  }
+
+  /**
+   * @brief Checks whether the queue is empty.
+   * @return true if empty, otherwise false.
+   */
+  [[nodiscard]] bool empty() const {
+    return m_records == 0;
+  }
+
+  /**
+   * @brief Gets the number of queued records.
+   * @return The number of records.
+   */
+  [[nodiscard]] uint64_t size() const {
+    return m_records;
+  }
+
+  /**
+   * @brief Gets the RAM of the segments in RAM.
+   * @return The bytes.
+   */
+  [[nodiscard]] size_t memory_bytes() const {
+    return m_memorySegments * m_config.segmentSize;
+  }
+
+  /**
+   * @brief Gets the size of the segment files.
+   * @return The bytes.
+   */
+  [[nodiscard]] uint64_t disk_bytes() const {
+    return m_diskBytes;
+  }
+
+  /**
+   * @brief Gets the counters.
+   * @return The counters.
+   */
+  [[nodiscard]] const DiskQueueStatistics& statistics() const {
+    return m_statistics;
+  }
+
+  /**
+   * @brief Gets the configuration.
+   * @return The configuration.
+   */
+  [[nodiscard]] const DiskQueueConfig& config() const {
+    return m_config;
+  }
+
+  /**
+   * @brief Gets the reason of the last failure.
+   * @return The reason.
+   */
+  [[nodiscard]] const std::string& last_error() const {
+    return m_lastError;
+  }
+
+ private:
+  /**
+   * @brief A segment in RAM or in a file.
+   */
+  struct Segment {
+    uint64_t sequence{0};         ///< number of the segment, names the file
+    std::vector<uint8_t> memory;  ///< the segment in RAM, empty if in a file
+    uint8_t* mapped{nullptr};     ///< mapping of the file while it is read
+    size_t fileSize{0};           ///< size of the file
+    size_t writeCursor{0};        ///< end of the records
+    size_t readCursor{0};         ///< next record to read
+    uint64_t records{0};          ///< unread records
+    uint32_t written{0};          ///< records written
+
+    [[nodiscard]] bool in_memory() const {
+      return !memory.empty();
+    }
+  };
+
+  [[nodiscard]] std::filesystem::path segment_path(uint64_t sequence) const;
+  void add_memory_segment();
+  void limit_memory();
+  bool spill(Segment& segment);
+  void drop_segment(size_t index);
+  void release(Segment& segment, bool removeFile);
+  bool map(Segment& segment);
+  void recover(const std::filesystem::path& path, uint64_t sequence);
+
+  DiskQueueConfig m_config;          ///< configuration
+  std::deque<Segment> m_segments;    ///< segments, the files before the ones in RAM
+  std::vector<uint8_t> m_spare;      ///< buffer of a retired RAM segment for the next one
+  size_t m_memorySegments{0};        ///< segments in RAM, the last ones
+  uint64_t m_diskBytes{0};           ///< size of the segment files
+  uint64_t m_records{0};             ///< queued records
+  uint64_t m_nextSequence{0};        ///< sequence number of the next segment
+  bool m_frontChecked{false};        ///< the checksum of the front record was verified
+  DiskQueueStatistics m_statistics;  ///< counters
+  std::string m_lastError;           ///< reason of the last failure
+};
+
+}  // namespace app
@@ -0,0 +1,210 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the engine of the computed points
+ * \ingroup Application Common
+ *
+ * A computed point is a formula over other points: a sum of phases, an average, a limit check,
+ * an interlock. The engine compiles every formula into the bytecode of a small register machine
+ * and groups the formulas of the same shape, f.e. all "pA + pB + pC" of the bays, which differ
+ * only in their points and constants. A group runs each instruction over a batch of up to 64
+ * formulas, the registers are arrays of 64 values (structure of arrays), so the loops of the
+ * instructions vectorize and the dispatch is paid once per batch instead of once per formula.
+ *
+ * Only formulas with a changed input are evaluated: the engine takes the changed bits of the point
+ * database, marks the formulas that read the changed points and evaluates the groups in the order
+ * of their level, a formula over computed points runs after the formulas that compute them.
+ *
+ * A formula file has one formula per line, '#' starts a comment:
+ *   p<destination> = <formula>
+ * The formulas know the points p<index>, numbers, true and false, the operators
+ *   || && == != < <= > >= + - * / ! and unary -
+ * with the usual precedence, parentheses and the functions
+ *   min(a, b, ...) max(a, b, ...) sum(a, ...) avg(a, ...) abs(a) limit(x, low, high) if(c, a, b)
+ * A comparison or logic operator yields 1 or 0, a value other than 0 is true.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "pointDatabase.hpp"
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The operation of an instruction of the expression bytecode.
+ */
+enum class ExpressionOpcode : uint8_t {
+  input,         ///< destination = value of the input point a
+  constant,      ///< destination = constant a
+  add,           ///< destination = a + b
+  subtract,      ///< destination = a - b
+  multiply,      ///< destination = a * b
+  divide,        ///< destination = a / b
+  minimum,       ///< destination = min(a, b)
+  maximum,       ///< destination = max(a, b)
+  negate,        ///< destination = -a
+  absolute,      ///< destination = |a|
+  less,          ///< destination = a < b
+  lessEqual,     ///< destination = a <= b
+  greater,       ///< destination = a > b
+  greaterEqual,  ///< destination = a >= b
+  equal,         ///< destination = a == b
+  notEqual,      ///< destination = a != b
+  logicalAnd,    ///< destination = a && b
+  logicalOr,     ///< destination = a || b
+  logicalNot,    ///< destination = !a
+  select,        ///< destination = a ? b : c
+};
+
+/**
+ * @brief An instruction of the expression bytecode, the operands are registers or for input and
+ * constant the slot of the formula.
+ */
+struct ExpressionInstruction {
+  ExpressionOpcode opcode;  ///< operation
+  uint8_t destination;      ///< register of the result
+  uint8_t a;                ///< first operand
+  uint8_t b;                ///< second operand
+  uint8_t c;                ///< third operand
+};
+
+/**
+ * @brief A computed point.
+ */
+struct ExpressionDefinition {
+  uint32_t destination{0};  ///< computed point
+  std::string formula;      ///< formula of the point
+};
+
+/**
+ * @brief The ExpressionEngine class evaluates the computed points whose inputs changed.
+ * @note The engine is not thread-safe, it runs on the thread that owns the point database.
+ */
+class ExpressionEngine {
+ public:
+  static constexpr size_t Lanes = 64;         ///< formulas of a batch, values of a register
+  static constexpr size_t MaxRegisters = 32;  ///< registers of a formula
+
+  /**
+   * @brief Compiles the formulas, all of them are evaluated by the next evaluate().
+   * @param definitions The computed points.
+   * @return true if compiled, otherwise false with last_error(); the engine is empty then.
+   */
+  [[nodiscard]] bool compile(std::span<const ExpressionDefinition> definitions);
+
+  /**
+   * @brief Parses a formula file and compiles it.
+   * @param path The formula file.
+   * @return true if loaded, otherwise false with last_error(); the engine is empty then.
+   */
+  [[nodiscard]] bool load(const std::filesystem::path& path);
+
+  /**
+   * @brief Evaluates the formulas with a changed input and updates their points if the value or
+   * the quality changed. The quality of a computed point is the union of the input qualities, its
+   * timestamp the newest input timestamp.
+   * @param points The point database, at least required_points() points. The changed bits are
+   * read, the owner clears them after it consumed them.
+   * @return The number of evaluated formulas.
+   */
+  size_t evaluate(PointDatabase& points);
+
+  /**
+   * @brief Marks all formulas to be evaluated by the next evaluate().
+   */
+  void invalidate();
+
+  /**
+   * @brief Gets the number of formulas.
+   * @return The number of formulas.
+   */
+  [[nodiscard]] size_t size() const {
+    return m_size;
+  }
+
+  /**
+   * @brief Gets the number of groups of formulas with the same bytecode.
+   * @return The number of groups.
+   */
+  [[nodiscard]] size_t groups() const {
+    return m_groups.size();
+  }
+
+  /**
+   * @brief Gets the number of points the formulas use.
+   * @return The largest point index plus one, 0 without formulas.
+   */
+  [[nodiscard]] size_t required_points() const {
+    return m_requiredPoints;
+  }
+
+  /**
+   * @brief Gets the number of evaluations of formulas since the compile.
+   * @return The number of evaluations.
+   */
+  [[nodiscard]] uint64_t evaluated() const {
+    return m_evaluated;
+  }
+
+  /**
+   * @brief Gets the reason the last compile or load failed.
+   * @return The reason, empty after a success.
+   */
+  [[nodiscard]] const std::string& last_error() const {
+    return m_error;
+  }
+
+ private:
+  /**
+   * @brief Formulas of the same bytecode and level, their slots as structure of arrays.
+   */
+  struct Group {
+    std::vector<ExpressionInstruction> code;  ///< bytecode, the result ends in register 0
+    size_t inputs{0};                         ///< input slots of a formula
+    size_t first{0};                          ///< number of the first formula
+    size_t count{0};                          ///< number of formulas
+    uint32_t level{0};                        ///< 0 for formulas over received points only
+    std::vector<uint32_t> inputPoints;        ///< point of input slot i of formula j at i * count + j
+    std::vector<double> constants;            ///< constant i of formula j at i * count + j
+    std::vector<uint32_t> destinations;       ///< computed point of each formula
+  };
+
+  void evaluate_batch(const Group& group, std::span<uint32_t> lanes, PointDatabase& points);
+  void mark_dependents(size_t point);
+  void clear();
+  bool fail(std::string error);
+
+  std::vector<Group> m_groups;             ///< groups in the order of their level
+  std::vector<uint32_t> m_dependents;      ///< formulas reading a point, from m_dependentStart
+  std::vector<uint32_t> m_dependentStart;  ///< first dependent of each point, one more entry
+  std::vector<uint64_t> m_computed;        ///< one bit per computed point
+  std::vector<uint64_t> m_dirty;           ///< one bit per formula to evaluate
+  std::vector<double> m_registers;         ///< MaxRegisters registers of Lanes values
+  size_t m_size{0};                        ///< number of formulas
+  size_t m_requiredPoints{0};              ///< largest point plus one
+  uint64_t m_evaluated{0};                 ///< evaluations since the compile
+  std::string m_error;                     ///< reason of the last failure
+};
+
+}  // namespace app
@@ -0,0 +1,231 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the export of consistent snapshots from a forked child process
+ * \ingroup Application Common
+ *
+ * The thread that owns the state calls start() between two processing steps. fork() copies only
+ * the page tables, so the thread is paused for milliseconds per GiB of resident memory, much less
+ * for memory in huge pages. The child sees the memory frozen at that instant and serializes it to
+ * a file or socket while the parent continues. Every page the parent writes afterwards is copied
+ * by the kernel (copy on write); the child reports these copies as its private memory when it
+ * finishes.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+
+#include "checksum.hpp"
+#include "threadRoles.hpp"
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The output of a snapshot writer in the child process. Writes with plain system calls,
+ * without allocations.
+ */
+class SnapshotSink {
+ public:
+  /**
+   * @brief constructor
+   * @param fd The file or socket.
+   */
+  explicit SnapshotSink(int fd) : m_fd(fd) {}
+
+  /**
+   * @brief Writes all bytes.
+   * @param data The bytes.
+   * @param size The number of bytes.
+   * @return true if written, otherwise false.
+   */
+  bool write(const void* data, size_t size);
+
+  /**
+   * @brief Writes the bytes of a trivially copyable value.
+   * @param value The value.
+   * @return true if written, otherwise false.
+   */
+  template <typename T>
+  bool write_value(const T& value) {
+    return write(&value, sizeof(value));
+  }
+
+  /**
+   * @brief Gets the number of bytes written.
+   * @return The number of bytes.
+   */
+  [[nodiscard]] uint64_t bytes() const {
+    return m_bytes;
+  }
+
+  /**
+   * @brief Gets the CRC-32C of the bytes written, e.g. for a trailer that proves the snapshot
+   * complete and intact.
+   * @return The CRC.
+   */
+  [[nodiscard]] uint32_t checksum() const {
+    return m_checksum.value();
+  }
+
+  /**
+   * @brief Gets the error of the failed write.
+   * @return The errno value, 0 if all writes succeeded.
+   */
+  [[nodiscard]] int error() const {
+    return m_error;
+  }
+
+ private:
+  int m_fd;                                        ///< file or socket
+  uint64_t m_bytes{0};                             ///< bytes written
+  int m_error{0};                                  ///< errno of the failed write
+  Checksum m_checksum{ChecksumAlgorithm::crc32c};  ///< CRC-32C of the bytes written
+};
+
+/**
+ * @brief The ForkSnapshot class forks a child that serializes the copy-on-write frozen memory of
+ * the process and reports the result to the parent.
+ * @note The child runs only the writer and _exit(). The writer must not take locks other threads
+ * may have held at the fork, e.g. of the logger; reading the state and SnapshotSink are safe.
+ * A copy of a hugetlb page needs a free huge page; without one the kernel takes the page from the
+ * child, which then ends with SIGBUS and the snapshot fails.
+ */
+class ForkSnapshot {
+ public:
+  /**
+   * @brief Writer of the snapshot, runs in the child.
+   * @param sink The output.
+   * @return true if the snapshot is complete.
+   */
+  using Writer = std::function<bool(SnapshotSink& sink)>;
+
+  /**
+   * @brief The result of a snapshot.
+   */
+  struct Result {
+    bool success{false};                   ///< the snapshot is complete
+    std::string target;                    ///< file of the snapshot, empty for a socket
+    std::string error;                     ///< reason of a failure
+    std::chrono::nanoseconds pause{0};     ///< time the calling thread was stopped by fork()
+    std::chrono::nanoseconds duration{0};  ///< time from the fork to the end of the child
+    uint64_t bytes{0};                     ///< bytes written
+    uint64_t copiedBytes{0};               ///< memory copied on write while the child ran
+    uint64_t residentBytes{0};             ///< resident memory of the parent at the fork
+  };
+
+  /// constructor
+  ForkSnapshot() = default;
+
+  /// destructor waits for a running child
+  ~ForkSnapshot();
+
+  ForkSnapshot(const ForkSnapshot&) = delete;
+  ForkSnapshot& operator=(const ForkSnapshot&) = delete;
+
+  /**
+   * @brief Sets the CPUs and scheduling of the child, e.g. the housekeeping role, so the child
+   * doesn't compete with the critical thread that forked it.
+   * @param settings The settings.
+   */
+  void set_child_settings(RoleSettings settings) {
+    m_childSettings = std::move(settings);
+  }
+
+  /**
+   * @brief Forks a child that writes the snapshot to a file. The child writes "<path>.tmp", the
+   * parent renames it to the path when the child succeeded.
+   * @param path The file.
+   * @param writer The writer.
+   * @return true if the child runs, otherwise false; see last_error().
+   */
+  [[nodiscard]] bool start(const std::filesystem::path& path, Writer writer);
+
+  /**
+   * @brief Forks a child that writes the snapshot to an open file or connected socket. The
+   * descriptor is closed when the snapshot ends.
+   * @param fd The descriptor, owned by the snapshot.
+   * @param writer The writer.
+   * @return true if the child runs, otherwise false; see last_error().
+   */
+  [[nodiscard]] bool start(int fd, Writer writer);
+
+  /**
+   * @brief Checks if a child runs.
+   * @return true if running, otherwise false.
+   */
+  [[nodiscard]] bool is_running() const {
+    return m_child > 0;
+  }
+
+  /**
+   * @brief Collects the result of a finished child without blocking.
+   * @return The result once the child ended, none while it runs or if none was started.
+   */
+  std::optional<Result> poll();
+
+  /**
+   * @brief Waits for the child to end.
+   * @return The result, none if no child was started.
+   */
+  std::optional<Result> wait();
+
+  /**
+   * @brief Gets the reason the last start failed.
+   * @return The reason.
+   */
+  [[nodiscard]] const std::string& last_error() const {
+    return m_lastError;
+  }
+
+ private:
+  /**
+   * @brief The report of the child, written into the pipe before it exits.
+   */
+  struct ChildReport {
+    uint64_t bytes{0};        ///< bytes written
+    uint64_t copiedBytes{0};  ///< private memory of the child
+    int32_t error{0};         ///< errno of the failed write, 0 on success
+    uint8_t success{0};       ///< the writer completed
+  };
+
+  using Clock = std::chrono::steady_clock;
+
+  bool fork_child(int fd, Writer& writer);
+  [[noreturn]] void run_child(int fd, int report, Writer& writer);
+  Result finish(int status);
+
+  std::optional<RoleSettings> m_childSettings;  ///< CPUs and scheduling of the child
+  pid_t m_child{-1};                            ///< running child
+  int m_fd{-1};                                 ///< output of the running child
+  int m_pipe{-1};                               ///< read end of the report pipe
+  std::filesystem::path m_path;                 ///< final file, empty for a socket
+  Clock::time_point m_forked;                   ///< time of the fork
+  std::chrono::nanoseconds m_pause{0};          ///< duration of the fork
+  uint64_t m_residentBytes{0};                  ///< resident memory at the fork
+  std::string m_lastError;                      ///< reason the last start failed
+};
+
+}  // namespace app
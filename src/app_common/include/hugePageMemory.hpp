@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the huge-page-backed memory region and buffer pool
+ * \ingroup Application Common
+ *
+ * Explicit huge pages come from the hugetlbfs pool of the kernel (vm.nr_hugepages), transparent
+ * huge pages are requested with madvise and depend on /sys/kernel/mm/transparent_hugepage/enabled
+ * being "always" or "madvise". Without either the region falls back to normal pages.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The pages a region was obtained with.
+ */
+enum class PageBacking {
+  none,                  ///< no memory reserved
+  explicitHugePages,     ///< MAP_HUGETLB from the hugetlbfs pool
+  transparentHugePages,  ///< anonymous memory advised with MADV_HUGEPAGE
+  normalPages            ///< anonymous memory with base pages
+};
+
+/**
+ * @brief The backings a region may try, the best one first.
+ */
+enum class HugePagePolicy {
+  automatic,    ///< explicit huge pages, then transparent huge pages, then normal pages
+  transparent,  ///< transparent huge pages, then normal pages
+  normal        ///< normal pages only
+};
+
+/**
+ * @brief Gets the name of a backing.
+ * @param backing The backing.
+ * @return The name.
+ */
+std::string_view to_string(PageBacking backing);
+
+/**
+ * @brief The HugePageRegion class reserves a prefaulted anonymous memory region, preferably backed by
+ * huge pages. Large point tables and buffer pools then need far fewer TLB entries.
+ */
+class HugePageRegion {
+ public:
+  /// constructor
+  HugePageRegion() = default;
+
+  /// destructor releases the region
+  ~HugePageRegion();
+
+  HugePageRegion(const HugePageRegion&) = delete;
+  HugePageRegion& operator=(const HugePageRegion&) = delete;
+  HugePageRegion(HugePageRegion&& other) noexcept;
+  HugePageRegion& operator=(HugePageRegion&& other) noexcept;
+
+  /**
+   * @brief Reserves the region, trying the backings of the policy in order. The size is rounded up to
+   * the huge page size and all pages are faulted in, so no page fault hits the process later.
+   * @param bytes The minimal size of the region.
+   * @param policy The backings to try.
+   * @return true if memory is reserved with any backing, otherwise false.
+   */
+  [[nodiscard]] bool reserve(size_t bytes, HugePagePolicy policy = HugePagePolicy::automatic);
+
+  /**
+   * @brief Releases the region.
+   */
+  void release();
+
+  /**
+   * @brief Gets the start of the region.
+   * @return The start, nullptr if nothing is reserved.
+   */
+  [[nodiscard]] std::byte* data() const {
+    return m_data;
+  }
+
+  /**
+   * @brief Gets the size of the region.
+   * @return The size in bytes.
+   */
+  [[nodiscard]] size_t size() const {
+    return m_size;
+  }
+
+  /**
+   * @brief Gets the backing the region was obtained with.
+   * @return The backing.
+   */
+  [[nodiscard]] PageBacking backing() const {
+    return m_backing;
+  }
+
+  /**
+   * @brief Gets the bytes of the region the kernel backs with huge pages right now. Transparent huge
+   * pages are advisory, so this shows whether the advice was followed.
+   * @return The bytes, read from /proc/self/smaps.
+   */
+  [[nodiscard]] size_t huge_page_bytes() const;
+
+  /**
+   * @brief Gets the default huge page size of the system.
+   * @return The size in bytes, 2 MiB if the system does not report it.
+   */
+  static size_t huge_page_size();
+
+ private:
+  std::byte* m_data{nullptr};                ///< start of the region
+  size_t m_size{0};                          ///< size of the region
+  PageBacking m_backing{PageBacking::none};  ///< backing of the region
+};
+
+/**
+ * @brief The BufferPool class provides fixed-size I/O buffers from one huge-page region.
+ * @note The pool is not thread-safe, every endpoint thread owns its pool.
+ */
+class BufferPool {
+ public:
+  static constexpr size_t BufferAlignment = 64;  ///< buffers start on cache lines
+
+  /**
+   * @brief Reserves the buffers.
+   * @param bufferSize The size of a buffer, rounded up to BufferAlignment.
+   * @param count The number of buffers.
+   * @param policy The backings to try.
+   * @return true if the buffers are reserved, otherwise false.
+   */
+  [[nodiscard]] bool reserve(size_t bufferSize, size_t count, HugePagePolicy policy = HugePagePolicy::automatic);
+
+  /**
+   * @brief Takes a buffer from the pool.
+   * @return The buffer, empty if all buffers are in use.
+   */
+  [[nodiscard]] std::span<std::byte> acquire();
+
+  /**
+   * @brief Returns a buffer to the pool.
+   * @param buffer The buffer taken with acquire.
+   */
+  void release(std::span<std::byte> buffer);
+
+  /**
+   * @brief Gets the size of a buffer.
+   * @return The size in bytes.
+   */
+  [[nodiscard]] size_t buffer_size() const {
+    return m_bufferSize;
+  }
+
+  /**
+   * @brief Gets the number of buffers not in use.
+   * @return The number of free buffers.
+   */
+  [[nodiscard]] size_t available() const {
+    return m_free.size();
+  }
+
+  /**
+   * @brief Gets the memory region of the buffers.
+   * @return The region.
+   */
+  [[nodiscard]] const HugePageRegion& region() const {
+    return m_region;
+  }
+
+ private:
+  HugePageRegion m_region;       ///< memory of all buffers
+  size_t m_bufferSize{0};        ///< size of a buffer
+  std::vector<uint32_t> m_free;  ///< indexes of the free buffers, used as a stack
+};
+
+}  // namespace app
@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the latency histogram with logarithmic buckets
+ * \ingroup Application Common
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The LatencyHistogram class records values in HDR style buckets.
+ *
+ * Values below 128 are counted exactly. Above, every power of two range is split into 64 linear
+ * sub-buckets, so the relative error of a reported value is below 1/64 over the full 64-bit range.
+ * Recording is constant time and the histogram has a fixed size, so it can be used in hot paths.
+ */
+class LatencyHistogram {
+ public:
+  static constexpr unsigned SubBucketBits = 6;                         ///< bits of the sub-bucket index
+  static constexpr uint64_t SubBucketHalf = 1ULL << SubBucketBits;     ///< sub-buckets per power of two
+  static constexpr uint64_t LinearLimit = 2 * SubBucketHalf;           ///< values below are counted exactly
+  static constexpr size_t BucketCount = LinearLimit + (64 - SubBucketBits - 1) * SubBucketHalf;  ///< buckets
+
+  /**
+   * @brief Records a value.
+   * @param value The value, for latencies in nanoseconds.
+   * @param count The number of occurrences.
+   */
+  void record(uint64_t value, uint64_t count = 1) {
+    m_counts[index_of(value)] += count;
+    m_total += count;
+    m_sum += static_cast<double>(value) * static_cast<double>(count);
+    if (value < m_min) {
+      m_min = value;
+    }
+    if (value > m_max) {
+      m_max = value;
+    }
+  }
+
+  /**
+   * @brief Records a duration in nanoseconds.
+   * @param duration The duration, negative durations are recorded as 0.
+   */
+  void record(std::chrono::nanoseconds duration) {
+    record(duration.count() > 0 ? static_cast<uint64_t>(duration.count()) : 0);
+  }
+
+  /**
+   * @brief Adds all values of another histogram.
+   * @param other The other histogram.
+   */
+  void merge(const LatencyHistogram& other);
+
+  /**
+   * @brief Removes all values.
+   */
+  void reset();
+
+  /**
+   * @brief Gets the value at a percentile.
+   * @param percentile The percentile in the range 0 to 100.
+   * @return The highest value equivalent to the bucket of the percentile, 0 if the histogram is empty.
+   */
+  [[nodiscard]] uint64_t percentile(double percentile) const;
+
+  /**
+   * @brief Gets the number of recorded values.
+   * @return The number of values.
+   */
+  [[nodiscard]] uint64_t count() const {
+    return m_total;
+  }
+
+  /**
+   * @brief Gets the smallest recorded value.
+   * @return The smallest value, 0 if the histogram is empty.
+   */
+  [[nodiscard]] uint64_t min() const {
+    return m_total ? m_min : 0;
+  }
+
+  /**
+   * @brief Gets the largest recorded value.
+   * @return The largest value.
+   */
+  [[nodiscard]] uint64_t max() const {
+    return m_max;
+  }
+
+  /**
+   * @brief Gets the mean of the recorded values.
+   * @return The mean, 0 if the histogram is empty.
+   */
+  [[nodiscard]] double mean() const {
+    return m_total ? m_sum / static_cast<double>(m_total) : 0.0;
+  }
+
+  /**
+   * @brief Gets the bucket index of a value.
+   * @param value The value.
+   * @return The bucket index.
+   */
+  [[nodiscard]] static size_t index_of(uint64_t value) {
+    if (value < LinearLimit) {
+      return static_cast<size_t>(value);
+    }
+    auto msb = 63U - static_cast<unsigned>(__builtin_clzll(value));
+    auto shift = msb - SubBucketBits;
+    return static_cast<size_t>(LinearLimit + (shift - 1) * SubBucketHalf + ((value >> shift) - SubBucketHalf));
+  }
+
+  /**
+   * @brief Gets the highest value counted in a bucket.
+   * @param index The bucket index.
+   * @return The highest value of the bucket.
+   */
+  [[nodiscard]] static uint64_t highest_of(size_t index) {
+    if (index < LinearLimit) {
+      return index;
+    }
+    auto offset = index - LinearLimit;
+    auto shift = offset / SubBucketHalf + 1;
+    auto sub = offset % SubBucketHalf + SubBucketHalf;
+    return (sub << shift) + ((1ULL << shift) - 1);
+  }
+
+ private:
+  std::array<uint64_t, BucketCount> m_counts{};  ///< counts per bucket
+  uint64_t m_total{0};                           ///< number of values
+  uint64_t m_min{UINT64_MAX};                    ///< smallest value
+  uint64_t m_max{0};                             ///< largest value
+  double m_sum{0};                               ///< sum of all values
+};
+
+}  // namespace app
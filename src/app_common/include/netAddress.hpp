@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains helpers for IPv4 socket addresses
+ * \ingroup Application Common
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <netinet/in.h>
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief Parses an address in the form "[host:]port".
+ * @param text The address text.
+ * @param defaultHost The host used if the text contains only the port.
+ * @return The socket address or std::nullopt if the text is not a valid IPv4 address.
+ */
+[[nodiscard]] std::optional<sockaddr_in> parse_ipv4_address(std::string_view text,
+                                                            std::string_view defaultHost = "0.0.0.0");
+
+/**
+ * @brief Formats a socket address as "host:port".
+ * @param address The socket address.
+ * @return The address text.
+ */
+[[nodiscard]] std::string format_ipv4_address(const sockaddr_in& address);
+
+}  // namespace app
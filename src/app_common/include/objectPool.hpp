@@ -0,0 +1,180 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the thread-caching slab allocator for fixed-size objects
+ * \ingroup Application Common
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The SlabPool class provides fixed-size blocks carved from large slabs.
+ *
+ * Every thread keeps a local free list, so allocation and release are a few instructions without
+ * locking. A thread takes and returns blocks in batches from the global free list of the pool, so
+ * objects allocated on one thread and released on another flow back without a lock per object.
+ * Slabs are taken from the system with mmap and kept for the lifetime of the process: a freed block
+ * can be reused by any object of the same size class, so short-lived objects don't scatter holes
+ * between long-lived ones as in a general heap. The pool doesn't shrink, however: it keeps the
+ * footprint of its peak, after a burst of churn the idle blocks stay reserved for the next one.
+ */
+class SlabPool {
+ public:
+  static constexpr size_t BatchSize = 64;             ///< blocks moved between a thread and the pool at once
+  static constexpr size_t SlabSize = 256 * 1024;      ///< bytes requested from the system at once
+  static constexpr size_t BlockAlignment = 16;        ///< alignment of every block
+  static constexpr size_t MaxBlockSize = 4096;        ///< largest block size served by a pool
+
+  /**
+   * @brief Statistics of the pool.
+   */
+  struct Statistics {
+    size_t blockSize{0};      ///< size of a block
+    size_t slabs{0};          ///< slabs taken from the system
+    size_t reservedBytes{0};  ///< bytes taken from the system
+    size_t globalFree{0};     ///< free blocks in the global free list
+    size_t threadHeld{0};     ///< blocks held by threads, in use or in their local free lists
+  };
+
+  /**
+   * @brief Gets the pool of a block size. Pools are created on first use and never destroyed.
+   * @param blockSize The block size, rounded up to BlockAlignment.
+   * @return The pool.
+   */
+  static SlabPool& for_size(size_t blockSize);
+
+  /**
+   * @brief Allocates a block.
+   * @return The block, never nullptr.
+   * @throws std::bad_alloc if the system has no memory left.
+   */
+  [[nodiscard]] void* allocate();
+
+  /**
+   * @brief Releases a block of this pool.
+   * @param block The block.
+   */
+  void deallocate(void* block) noexcept;
+
+  /**
+   * @brief Gets the statistics of the pool.
+   * @return The statistics.
+   */
+  [[nodiscard]] Statistics statistics() const;
+
+  /**
+   * @brief Gets the size of a block.
+   * @return The block size.
+   */
+  [[nodiscard]] size_t block_size() const {
+    return m_blockSize;
+  }
+
+  SlabPool(const SlabPool&) = delete;
+  SlabPool& operator=(const SlabPool&) = delete;
+
+ private:
+  friend struct SlabThreadCache;
+
+  /**
+   * @brief A free block links the next free block in its first bytes.
+   */
+  struct FreeBlock {
+    FreeBlock* next;  ///< next free block
+  };
+
+  /**
+   * @brief A batch of free blocks in the global free list.
+   */
+  struct Batch {
+    FreeBlock* head{nullptr};  ///< first block
+    size_t count{0};           ///< number of blocks
+  };
+
+  explicit SlabPool(size_t blockSize, size_t index);
+
+  Batch take_batch();
+  void return_batch(Batch batch) noexcept;
+  Batch carve_slab();
+
+  size_t m_blockSize;                    ///< size of a block
+  size_t m_index;                        ///< index of the pool in the thread caches
+  mutable std::mutex m_mutex;            ///< protects the global free list and the slabs
+  std::vector<Batch> m_batches;          ///< global free list in batches
+  std::vector<void*> m_slabs;            ///< slabs taken from the system
+  std::atomic<size_t> m_inUse{0};        ///< blocks held by threads, updated per batch
+};
+
+/**
+ * @brief The PoolDeleter class destroys an object and returns its block to the slab pool.
+ */
+template <typename T>
+struct PoolDeleter {
+  void operator()(T* object) const noexcept {
+    if (object != nullptr) {
+      object->~T();
+      pool().deallocate(object);
+    }
+  }
+
+  /**
+   * @brief Gets the pool of the type.
+   * @return The pool.
+   */
+  static SlabPool& pool() {
+    static_assert(alignof(T) <= SlabPool::BlockAlignment, "over-aligned types are not supported by the pool");
+    static_assert(sizeof(T) <= SlabPool::MaxBlockSize, "large types are not supported by the pool");
+    static SlabPool& instance = SlabPool::for_size(sizeof(T));
+    return instance;
+  }
+};
+
+/**
+ * @brief Owning handle of an object allocated from the slab pool of its size.
+ */
+template <typename T>
+using pool_ptr = std::unique_ptr<T, PoolDeleter<T>>;
+
+/**
+ * @brief Creates an object in the slab pool of its size.
+ * @param args The constructor arguments.
+ * @return The owning handle.
+ */
+template <typename T, typename... Args>
+[[nodiscard]] pool_ptr<T> make_pooled(Args&&... args) {
+  auto& pool = PoolDeleter<T>::pool();
+  void* block = pool.allocate();
+  try {
+    return pool_ptr<T>(new (block) T(std::forward<Args>(args)...));
+  } catch (...) {
+    pool.deallocate(block);
+    throw;
+  }
+}
+
+}  // namespace app
@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the write-coalescing outbound queue of a connection
+ * \ingroup Application Common
+ *
+ * A context that emits many small spontaneous messages per tick costs a send per message: the
+ * system call, the locking of the socket and a TCP segment each. The queue gathers the messages of
+ * a connection and writes them with one gathering sendmsg, the writev of a socket with
+ * MSG_NOSIGNAL. A flush is triggered by
+ * - the size: the queued bytes reach the flush size, inside send();
+ * - the tick: the owner flushes when it finished a batch of events, before it blocks;
+ * - the budget: the oldest queued byte waited the latency budget, e.g. while busy-polling;
+ * - explicitly, e.g. for a message that must not wait.
+ * The bytes are copied into 4 KiB chunks of the slab pool; a flush passes one iovec per chunk, so
+ * neither a flush nor a short write moves queued bytes.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <span>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The configuration of an outbound queue.
+ */
+struct OutboundQueueConfig {
+  size_t flushBytes{size_t{64} << 10};         ///< queued bytes that are written at once
+  std::chrono::microseconds latencyBudget{0};  ///< longest wait of a byte, 0 for the end of the tick
+  size_t maxPending{size_t{4} << 20};          ///< queued bytes of a peer that doesn't read
+};
+
+/**
+ * @brief The trigger of a flush.
+ */
+enum class FlushReason : uint8_t {
+  size,      ///< the queued bytes reached the flush size
+  tick,      ///< the owner finished a batch of events
+  budget,    ///< the oldest byte waited the latency budget
+  writable,  ///< the socket accepts the bytes a previous flush left
+  request,   ///< the owner asked for it
+};
+
+/**
+ * @brief The outcome of a flush.
+ */
+enum class FlushResult : uint8_t {
+  written,  ///< the queue is empty
+  blocked,  ///< the socket buffer is full, the rest stays queued until the socket is writable
+  failed,   ///< the connection failed, errno tells why
+};
+
+/**
+ * @brief The counters of an outbound queue.
+ */
+struct OutboundStatistics {
+  uint64_t messages{0};       ///< messages queued
+  uint64_t bytes{0};          ///< bytes queued
+  uint64_t written{0};        ///< bytes written
+  uint64_t writes{0};         ///< sendmsg calls
+  uint64_t blocked{0};        ///< flushes that left bytes queued
+  uint64_t sizeFlushes{0};    ///< flushes at the flush size
+  uint64_t tickFlushes{0};    ///< flushes at the end of a tick
+  uint64_t budgetFlushes{0};  ///< flushes at the latency budget
+  uint64_t otherFlushes{0};   ///< flushes of a writable socket or on request
+};
+
+/**
+ * @brief The OutboundQueue class gathers the outgoing bytes of a connection.
+ *
+ * Usage: send() the messages of a tick, flush() at its end; if the flush is blocked, watch the socket
+ * for EPOLLOUT and flush() again when it is writable.
+ * @note The queue is not thread-safe, it runs on the thread of the connection.
+ */
+class OutboundQueue {
+ public:
+  static constexpr size_t ChunkSize = 4096;  ///< bytes of a chunk, a block of the slab pool
+  static constexpr size_t MaxIovecs = 64;    ///< chunks written by one sendmsg
+
+  /**
+   * @brief constructor.
+   * @param config The configuration.
+   */
+  explicit OutboundQueue(const OutboundQueueConfig& config = {}) : m_config(config) {}
+
+  /// destructor returns the chunks
+  ~OutboundQueue();
+
+  OutboundQueue(const OutboundQueue&) = delete;
+  OutboundQueue& operator=(const OutboundQueue&) = delete;
+  OutboundQueue(OutboundQueue&& other) noexcept;
+  OutboundQueue& operator=(OutboundQueue&& other) noexcept;
+
+  /**
+   * @brief Queues a message and writes the queue when it reaches the flush size.
+   * @param fd The socket.
+   * @param data The message.
+   * @param now The time in nanoseconds, starts the latency budget of an empty queue.
+   * @return false if the connection failed or the peer doesn't read, the owner closes it then.
+   */
+  [[nodiscard]] bool send(int fd, std::span<const std::byte> data, int64_t now);
+
+  /**
+   * @brief Writes the queued bytes.
+   * @param fd The socket.
+   * @param reason The trigger of the flush, for the counters.
+   * @return The outcome.
+   */
+  FlushResult flush(int fd, FlushReason reason = FlushReason::request);
+
+  /**
+   * @brief Checks whether the queue should be written: at the end of the tick without a latency
+   * budget, otherwise when its oldest byte waited the budget.
+   * @param now The time in nanoseconds.
+   * @return true if due, otherwise false.
+   */
+  [[nodiscard]] bool due(int64_t now) const {
+    return m_bytes > 0 && !m_blocked && now - m_oldest >= m_config.latencyBudget.count() * 1000;
+  }
+
+  /**
+   * @brief Checks whether the last flush left bytes queued.
+   * @return true if the queue waits for a writable socket, otherwise false.
+   */
+  [[nodiscard]] bool blocked() const {
+    return m_blocked;
+  }
+
+  /**
+   * @brief Checks whether the queue is empty.
+   * @return true if empty, otherwise false.
+   */
+  [[nodiscard]] bool empty() const {
+    return m_bytes == 0;
+  }
+
+  /**
+   * @brief Gets the number of queued bytes.
+   * @return The bytes.
+   */
+  [[nodiscard]] size_t bytes() const {
+    return m_bytes;
+  }
+
+  /**
+   * @brief Gets the configuration.
+   * @return The configuration.
+   */
+  [[nodiscard]] const OutboundQueueConfig& config() const {
+    return m_config;
+  }
+
+  /**
+   * @brief Gets the counters.
+   * @return The counters.
+   */
+  [[nodiscard]] const OutboundStatistics& statistics() const {
+    return m_statistics;
+  }
+
+ private:
+  void append(std::span<const std::byte> data);
+  void consume(size_t bytes);
+  void release();
+
+  OutboundQueueConfig m_config;     ///< configuration
+  std::deque<std::byte*> m_chunks;  ///< chunks of the queued bytes, oldest first
+  size_t m_readOffset{0};           ///< first unwritten byte of the first chunk
+  size_t m_writeOffset{ChunkSize};  ///< end of the bytes in the last chunk
+  size_t m_bytes{0};                ///< queued bytes
+  int64_t m_oldest{0};              ///< time the oldest queued byte was queued
+  bool m_blocked{false};            ///< the last flush left bytes queued
+  OutboundStatistics m_statistics;  ///< counters
+};
+
+}  // namespace app
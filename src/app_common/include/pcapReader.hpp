@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the reader of pcap and pcapng capture files
+ * \ingroup Application Common
+ *
+ * The reader maps the file and returns the frames as views into the mapping, so offline ingestion
+ * runs without copies. Classic pcap files are accepted with microsecond and nanosecond timestamps in
+ * either byte order. pcapng files may contain several sections and interfaces; enhanced and simple
+ * packet blocks are returned, all other blocks are skipped.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The format of a capture file.
+ */
+enum class PcapFormat {
+  none,    ///< no file open
+  pcap,    ///< classic libpcap format
+  pcapng,  ///< pcap next generation block format
+};
+
+/**
+ * @brief Gets the name of a capture format.
+ * @param format The format.
+ * @return The name.
+ */
+std::string_view to_string(PcapFormat format);
+
+/**
+ * @brief One frame of a capture file.
+ */
+struct PcapFrame {
+  std::chrono::nanoseconds timestamp{0};  ///< capture time since epoch, 0 for simple packet blocks
+  uint32_t interface{0};                  ///< interface of a pcapng file, 0 for pcap
+  uint16_t linkType{0};                   ///< link type, 1 for Ethernet
+  uint32_t originalLength{0};             ///< length on the wire, larger than the data if truncated
+  std::span<const std::byte> data;        ///< captured bytes in the mapped file
+};
+
+/**
+ * @brief The PcapReader class iterates the frames of a pcap or pcapng file without copying them.
+ */
+class PcapReader {
+ public:
+  static constexpr uint16_t LinkTypeEthernet = 1;  ///< link type of Ethernet frames
+
+  /// constructor
+  PcapReader() = default;
+
+  /// destructor unmaps the file
+  ~PcapReader();
+
+  PcapReader(const PcapReader&) = delete;
+  PcapReader& operator=(const PcapReader&) = delete;
+
+  /**
+   * @brief Maps the capture file and detects the format.
+   * @param path The path of the capture file.
+   * @return true if the file is a pcap or pcapng capture, otherwise false.
+   */
+  [[nodiscard]] bool open(const std::filesystem::path& path);
+
+  /**
+   * @brief Unmaps the capture file.
+   */
+  void close();
+
+  /**
+   * @brief Gets the next frame. The data refers to the mapped file and stays valid until close().
+   * @return The frame or std::nullopt at the end of the file or on a truncated block.
+   */
+  [[nodiscard]] std::optional<PcapFrame> next();
+
+  /**
+   * @brief Restarts the iteration at the first frame.
+   */
+  void rewind();
+
+  /**
+   * @brief Gets the format of the open file.
+   * @return The format.
+   */
+  [[nodiscard]] PcapFormat format() const {
+    return m_format;
+  }
+
+  /**
+   * @brief Checks if the iteration stopped at a truncated or malformed block.
+   * @return true if the capture is truncated, otherwise false.
+   */
+  [[nodiscard]] bool is_truncated() const {
+    return m_truncated;
+  }
+
+  /**
+   * @brief Gets the size of the mapped file.
+   * @return The size in bytes.
+   */
+  [[nodiscard]] size_t size() const {
+    return m_size;
+  }
+
+ private:
+  /**
+   * @brief An interface of a pcapng section or the link of a pcap file.
+   */
+  struct Interface {
+    uint16_t linkType{0};                ///< link type
+    uint32_t snapLength{0};              ///< maximal captured length
+    uint64_t unitsPerSecond{1'000'000};  ///< timestamp resolution
+  };
+
+  std::optional<PcapFrame> next_pcap();
+  std::optional<PcapFrame> next_pcapng();
+  bool read_section_header(size_t offset);
+  void read_interface(size_t offset, size_t length);
+  uint16_t get16(size_t offset) const;
+  uint32_t get32(size_t offset) const;
+  std::chrono::nanoseconds to_nanoseconds(uint64_t timestamp, const Interface& interface) const;
+  std::optional<PcapFrame> stop();
+
+  const std::byte* m_data{nullptr};       ///< mapped file
+  size_t m_size{0};                       ///< size of the mapped file
+  size_t m_offset{0};                     ///< offset of the next record or block
+  PcapFormat m_format{PcapFormat::none};  ///< format of the file
+  bool m_swapped{false};                  ///< the file has the other byte order than the host
+  bool m_truncated{false};                ///< stopped at a malformed block
+  std::vector<Interface> m_interfaces;    ///< interfaces of the current section
+};
+
+}  // namespace app
@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the point database of the process image
+ * \ingroup Application Common
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "hugePageMemory.hpp"
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The PointDatabase class holds the current value, quality and timestamp of every data point
+ * as separate arrays (structure of arrays) in one huge-page region, plus one changed bit per point.
+ *
+ * Protocol handlers update points by index, consumers scan the changed bits and clear them.
+ * @note The database is not thread-safe, updates and scans run on the thread that owns it.
+ */
+class PointDatabase {
+ public:
+  static constexpr size_t ArrayAlignment = 64;  ///< every array starts on a cache line
+
+  /**
+   * @brief Reserves the arrays for a number of points, all values zero and unchanged.
+   * @param points The number of points.
+   * @param policy The backings to try.
+   * @return true if the arrays are reserved, otherwise false.
+   */
+  [[nodiscard]] bool reserve(size_t points, HugePagePolicy policy = HugePagePolicy::automatic);
+
+  /**
+   * @brief Gets the number of points.
+   * @return The number of points.
+   */
+  [[nodiscard]] size_t size() const {
+    return m_size;
+  }
+
+  /**
+   * @brief Updates a point and marks it changed.
+   * @param index The point, less than size().
+   * @param value The value.
+   * @param quality The quality flags.
+   * @param timestamp The timestamp in nanoseconds since epoch.
+   */
+  void update(size_t index, double value, uint32_t quality, int64_t timestamp) {
+    m_values[index] = value;
+    m_qualities[index] = quality;
+    m_timestamps[index] = timestamp;
+    m_changed[index / 64] |= uint64_t{1} << (index % 64);
+  }
+
+  /**
+   * @brief Checks whether a point changed since the changed bits were cleared.
+   * @param index The point.
+   * @return true if the point changed.
+   */
+  [[nodiscard]] bool is_changed(size_t index) const {
+    return (m_changed[index / 64] >> (index % 64) & 1) != 0;
+  }
+
+  /**
+   * @brief Calls a function for every changed point in index order.
+   * @param function The function, called with the index of the point.
+   */
+  template <typename Function>
+  void for_each_changed(Function&& function) const {
+    for (size_t word = 0; word < m_changedWords; ++word) {
+      for (auto bits = m_changed[word]; bits != 0; bits &= bits - 1) {
+        function(word * 64 + static_cast<size_t>(std::countr_zero(bits)));
+      }
+    }
+  }
+
+  /**
+   * @brief Counts the changed points.
+   * @return The number of changed points.
+   */
+  [[nodiscard]] size_t count_changed() const;
+
+  /**
+   * @brief Clears all changed bits.
+   */
+  void clear_changed();
+
+  /**
+   * @brief Gets the values of all points.
+   * @return The values.
+   */
+  [[nodiscard]] std::span<double> values() const {
+    return {m_values, m_size};
+  }
+
+  /**
+   * @brief Gets the quality flags of all points.
+   * @return The quality flags.
+   */
+  [[nodiscard]] std::span<uint32_t> qualities() const {
+    return {m_qualities, m_size};
+  }
+
+  /**
+   * @brief Gets the timestamps of all points.
+   * @return The timestamps in nanoseconds since epoch.
+   */
+  [[nodiscard]] std::span<int64_t> timestamps() const {
+    return {m_timestamps, m_size};
+  }
+
+  /**
+   * @brief Gets the changed bits, bit i of word i / 64 belongs to point i.
+   * @return The changed bits.
+   */
+  [[nodiscard]] std::span<uint64_t> changed() const {
+    return {m_changed, m_changedWords};
+  }
+
+  /**
+   * @brief Gets the memory region of the arrays.
+   * @return The region.
+   */
+  [[nodiscard]] const HugePageRegion& region() const {
+    return m_region;
+  }
+
+ private:
+  HugePageRegion m_region;         ///< memory of all arrays
+  size_t m_size{0};                ///< number of points
+  size_t m_changedWords{0};        ///< number of words of changed bits
+  double* m_values{nullptr};       ///< values
+  int64_t* m_timestamps{nullptr};  ///< timestamps
+  uint32_t* m_qualities{nullptr};  ///< quality flags
+  uint64_t* m_changed{nullptr};    ///< changed bits
+};
+
+}  // namespace app
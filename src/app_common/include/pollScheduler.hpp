@@ -0,0 +1,384 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the scheduler of the periodic polls of a context
+ * \ingroup Application Common
+ *
+ * A context polls thousands of devices, each every few seconds. Started together, e.g. after the
+ * startup or a reload, the polls of a period fire at the same instant and the burst of requests
+ * and responses costs CPU peaks, full socket buffers and timeouts, repeated every period. The
+ * scheduler places every task at a phase of its period on the time line:
+ * - aligned: the phase of the first run, the polls of a period fire together as before;
+ * - hashed: a hash of the task key, the polls spread randomly and a task keeps its phase;
+ * - staggered: the tasks of a period are ordered by the hash and spaced evenly across it; an added
+ *   or removed task rebalances the spacing, which moves every task by at most one slot.
+ * The polls are counted in fixed windows: the peak against the mean polls of a window is the
+ * burst, the lateness of a poll and the deviation of its interval from the period the jitter.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "latencyHistogram.hpp"
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The placement of the tasks in their period.
+ */
+enum class PollPolicy : uint8_t {
+  aligned,    ///< phase of the first run
+  hashed,     ///< phase from a hash of the key
+  staggered,  ///< evenly spaced in the order of the hashes
+};
+
+/**
+ * @brief Gets the name of a policy.
+ * @param policy The policy.
+ * @return The name.
+ */
+std::string_view to_string(PollPolicy policy);
+
+/**
+ * @brief Parses the name of a policy.
+ * @param text The name, e.g. "staggered".
+ * @return The policy, none if unknown.
+ */
+std::optional<PollPolicy> parse_poll_policy(std::string_view text);
+
+/**
+ * @brief The configuration of the scheduler.
+ */
+struct PollSchedulerConfig {
+  PollPolicy policy{PollPolicy::staggered};                             ///< placement of the tasks
+  std::chrono::nanoseconds burstWindow{std::chrono::milliseconds(10)};  ///< window of the burst meter
+};
+
+/**
+ * @brief The counters of the scheduler.
+ */
+struct PollStatistics {
+  uint64_t added{0};       ///< tasks added
+  uint64_t removed{0};     ///< tasks removed
+  uint64_t polls{0};       ///< polls of the tasks
+  uint64_t missed{0};      ///< periods skipped by polls later than a period
+  uint64_t rebalances{0};  ///< placements after added or removed tasks
+  uint64_t moved{0};       ///< phases changed by the rebalances
+};
+
+/**
+ * @brief The BurstMeter class counts events in fixed windows of the time line.
+ */
+class BurstMeter {
+ public:
+  /**
+   * @brief constructor.
+   * @param window The window.
+   */
+  explicit BurstMeter(std::chrono::nanoseconds window = std::chrono::milliseconds(10))
+      : m_window(window.count() > 0 ? window.count() : 1) {}
+
+  /**
+   * @brief Counts an event.
+   * @param now The time of the event in nanoseconds, not before the previous event.
+   */
+  void record(int64_t now) {
+    const int64_t window = now / m_window;
+    if (m_events == 0) {
+      m_first = window;
+      m_current = window;
+    } else if (window != m_current) {
+      m_peak = std::max(m_peak, m_count);
+      m_count = 0;
+      m_current = window;
+    }
+    ++m_count;
+    ++m_events;
+  }
+
+  /**
+   * @brief Gets the most events of a window.
+   * @return The events.
+   */
+  [[nodiscard]] uint64_t peak() const {
+    return std::max(m_peak, m_count);
+  }
+
+  /**
+   * @brief Gets the mean events of the windows from the first to the last event.
+   * @return The mean, 0 without events.
+   */
+  [[nodiscard]] double mean() const {
+    return m_events == 0 ? 0.0 : static_cast<double>(m_events) / static_cast<double>(m_current - m_first + 1);
+  }
+
+  /**
+   * @brief Gets the burst, the peak against the mean.
+   * @return The ratio, 1 for a flat load, 0 without events.
+   */
+  [[nodiscard]] double burst() const {
+    return m_events == 0 ? 0.0 : static_cast<double>(peak()) / mean();
+  }
+
+  /**
+   * @brief Gets the window.
+   * @return The window.
+   */
+  [[nodiscard]] std::chrono::nanoseconds window() const {
+    return std::chrono::nanoseconds(m_window);
+  }
+
+  /**
+   * @brief Clears the counts.
+   */
+  void reset() {
+    m_first = 0;
+    m_current = 0;
+    m_count = 0;
+    m_peak = 0;
+    m_events = 0;
+  }
+
+ private:
+  int64_t m_window;      ///< window in nanoseconds
+  int64_t m_first{0};    ///< window of the first event
+  int64_t m_current{0};  ///< window of the last event
+  uint64_t m_count{0};   ///< events of the current window
+  uint64_t m_peak{0};    ///< most events of the finished windows
+  uint64_t m_events{0};  ///< events
+};
+
+/**
+ * @brief The PollScheduler class runs periodic tasks at their phases.
+ *
+ * Usage: add() a task per device with its period, e.g. when its session opens, and remove() it
+ * when the session closes. process_executing() runs the due tasks and waits no longer than the
+ * returned delay: run() polls the due tasks and returns the earlier of the limit and the time
+ * until the next one, the next-delay contract of the context tasks. The placement of added tasks
+ * and the rebalancing are deferred to the next run, so a reload of a thousand tasks rebalances once.
+ * @note The scheduler is not thread-safe, it runs on the thread of the context.
+ */
+class PollScheduler {
+ public:
+  /**
+   * @brief constructor.
+   * @param config The configuration.
+   */
+  explicit PollScheduler(const PollSchedulerConfig& config = {});
+
+  /**
+   * @brief Adds a task, placed by the next run.
+   * @param key The key of the task, e.g. the session or the device address.
+   * @param period The period.
+   * @return false if the key is known or the period isn't positive.
+   */
+  bool add(uint64_t key, std::chrono::nanoseconds period);
+
+  /**
+   * @brief Removes a task.
+   * @param key The key of the task.
+   * @return false if the key is unknown.
+   */
+  bool remove(uint64_t key);
+
+  /**
+   * @brief Removes all tasks, the counters stay.
+   */
+  void clear();
+
+  /**
+   * @brief Checks whether a task is scheduled.
+   * @param key The key of the task.
+   * @return true if known, otherwise false.
+   */
+  [[nodiscard]] bool contains(uint64_t key) const {
+    return m_index.contains(key);
+  }
+
+  /**
+   * @brief Gets the number of tasks.
+   * @return The number of tasks.
+   */
+  [[nodiscard]] size_t size() const {
+    return m_index.size();
+  }
+
+  /**
+   * @brief Polls the due tasks.
+   * @param now The time in nanoseconds.
+   * @param limit The longest delay to return.
+   * @param poll Called as void(uint64_t key) for every due task, may add and remove tasks.
+   * @return The earlier of the limit and the time until the next due task, rounded up.
+   */
+  template <typename Poll>
+  std::chrono::milliseconds run(int64_t now, std::chrono::milliseconds limit, Poll&& poll) {
+    while (auto key = next_due(now)) {
+      poll(*key);
+    }
+    return next_delay(now, limit);
+  }
+
+  /**
+   * @brief Takes the next due task and schedules its next poll.
+   * @param now The time in nanoseconds.
+   * @return The key of the task, none if no task is due.
+   */
+  std::optional<uint64_t> next_due(int64_t now);
+
+  /**
+   * @brief Gets the time until the next due task.
+   * @param now The time in nanoseconds.
+   * @param limit The longest delay to return.
+   * @return The earlier of the limit and the time until the next due task, rounded up.
+   */
+  std::chrono::milliseconds next_delay(int64_t now, std::chrono::milliseconds limit);
+
+  /**
+   * @brief Gets the phase of a task.
+   * @param key The key of the task.
+   * @return The offset of the polls in the period in nanoseconds, none if unknown or not yet placed.
+   */
+  [[nodiscard]] std::optional<int64_t> phase(uint64_t key) const;
+
+  /**
+   * @brief Gets the policy.
+   * @return The policy.
+   */
+  [[nodiscard]] PollPolicy policy() const {
+    return m_config.policy;
+  }
+
+  /**
+   * @brief Gets the counters.
+   * @return The counters.
+   */
+  [[nodiscard]] const PollStatistics& statistics() const {
+    return m_statistics;
+  }
+
+  /**
+   * @brief Gets the polls per window.
+   * @return The meter.
+   */
+  [[nodiscard]] const BurstMeter& burst() const {
+    return m_burst;
+  }
+
+  /**
+   * @brief Gets the lateness of the polls behind their due time.
+   * @return The histogram in nanoseconds.
+   */
+  [[nodiscard]] const LatencyHistogram& lateness() const {
+    return m_lateness;
+  }
+
+  /**
+   * @brief Gets the deviation of the intervals between two polls of a task from its period.
+   * @return The histogram in nanoseconds.
+   */
+  [[nodiscard]] const LatencyHistogram& jitter() const {
+    return m_jitter;
+  }
+
+  /**
+   * @brief Clears the burst meter and the histograms, e.g. after a warm-up.
+   */
+  void reset_metrics();
+
+ private:
+  static constexpr uint32_t NoGroup = UINT32_MAX;  ///< group of a free task slot
+  static constexpr uint32_t NoTask = UINT32_MAX;   ///< task of a removed group member
+
+  /**
+   * @brief A scheduled task.
+   */
+  struct Task {
+    uint64_t key{0};          ///< key of the task
+    uint64_t hash{0};         ///< hash of the key, orders the staggered tasks
+    int64_t period{0};        ///< period in nanoseconds
+    int64_t phase{0};         ///< offset of the polls in the period
+    int64_t due{0};           ///< time of the next poll
+    int64_t last{0};          ///< time of the last poll
+    uint32_t group{NoGroup};  ///< group of the period
+    uint32_t slot{0};         ///< position of the member in the group
+    uint32_t generation{0};   ///< changed on removal, invalidates the heap entries
+    bool placed{false};       ///< the phase and the due time are set
+    bool polled{false};       ///< the last poll time is set
+  };
+
+  /**
+   * @brief A task of a group, with the sort key of the staggered order.
+   */
+  struct Member {
+    uint64_t hash;  ///< hash of the key
+    uint64_t key;   ///< key of the task, orders equal hashes
+    uint32_t task;  ///< the task, NoTask if removed
+
+    bool operator<(const Member& other) const {
+      return hash < other.hash || (hash == other.hash && key < other.key);
+    }
+  };
+
+  /**
+   * @brief The tasks of a period.
+   */
+  struct Group {
+    int64_t period{0};            ///< period in nanoseconds
+    std::vector<Member> members;  ///< the tasks, the placed ones in staggered order, then the added ones
+    size_t sorted{0};             ///< members in staggered order
+    size_t removed{0};            ///< removed members, not yet dropped
+    bool dirty{false};            ///< tasks added or removed since the placement
+  };
+
+  /**
+   * @brief An entry of the heap of due times.
+   */
+  struct Entry {
+    int64_t due;          ///< time of the poll
+    uint32_t task;        ///< the task
+    uint32_t generation;  ///< generation of the task at the push
+  };
+
+  void place(int64_t now);
+  void place(Group& group, int64_t now);
+  void compact(Group& group);
+  void push(uint32_t task);
+  void rebuild_heap();
+  [[nodiscard]] bool is_current(const Entry& entry) const;
+
+  PollSchedulerConfig m_config;                     ///< configuration
+  std::vector<Task> m_tasks;                        ///< tasks, free slots included
+  std::vector<uint32_t> m_free;                     ///< free task slots
+  std::vector<Group> m_groups;                      ///< groups of the periods
+  std::unordered_map<uint64_t, uint32_t> m_index;   ///< tasks of the keys
+  std::vector<Entry> m_heap;                        ///< due times, earliest first
+  bool m_dirty{false};                              ///< a group waits for its placement
+  PollStatistics m_statistics;                      ///< counters
+  BurstMeter m_burst;                               ///< polls per window
+  LatencyHistogram m_lateness;                      ///< lateness of the polls
+  LatencyHistogram m_jitter;                        ///< deviation of the intervals from the period
+};
+
+}  // namespace app
@@ -0,0 +1,315 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the reconnect manager of the outgoing connections of a context
+ * \ingroup Application Common
+ *
+ * When a master station restarts, thousands of connections break at the same instant. Retried at a
+ * fixed interval, or with a backoff without jitter, they hit the master again at the same instant,
+ * overflow its listen backlog and fail together, round after round: a reconnect storm. The manager
+ * schedules the attempts of the connections:
+ * - fixed: every retry after the base delay, the storm of a plain timer;
+ * - exponential: the delay doubles per failure up to the cap, the retries stay synchronized;
+ * - decorrelated: the delay is drawn between the base and three times the previous delay, capped,
+ *   so the retries of the connections spread and drift apart with every failure.
+ * A global limit of the attempts in flight bounds the half-open connections of the context; due
+ * attempts beyond it wait for a free slot. The latency of the established connections and the time
+ * from a loss to the connection are recorded.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "latencyHistogram.hpp"
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The delays between the attempts of a connection.
+ */
+enum class BackoffPolicy : uint8_t {
+  fixed,         ///< the base delay
+  exponential,   ///< doubled per failure up to the cap
+  decorrelated,  ///< drawn between the base and three times the previous delay, up to the cap
+};
+
+/**
+ * @brief Gets the name of a policy.
+ * @param policy The policy.
+ * @return The name.
+ */
+std::string_view to_string(BackoffPolicy policy);
+
+/**
+ * @brief Parses the name of a policy.
+ * @param text The name, e.g. "decorrelated".
+ * @return The policy, none if unknown.
+ */
+std::optional<BackoffPolicy> parse_backoff_policy(std::string_view text);
+
+/**
+ * @brief The configuration of the reconnect manager.
+ */
+struct ReconnectConfig {
+  BackoffPolicy policy{BackoffPolicy::decorrelated};                 ///< delays between the attempts
+  std::chrono::nanoseconds base{std::chrono::milliseconds(100)};     ///< shortest delay
+  std::chrono::nanoseconds cap{std::chrono::seconds(30)};            ///< longest delay
+  std::chrono::nanoseconds connectTimeout{std::chrono::seconds(5)};  ///< longest attempt
+  size_t maxConnecting{64};                                          ///< attempts in flight, 0 for no limit
+  uint64_t seed{0};                                                  ///< seed of the jitter, 0 for a random one
+};
+
+/**
+ * @brief The counters of the reconnect manager.
+ */
+struct ReconnectStatistics {
+  uint64_t added{0};      ///< connections added
+  uint64_t removed{0};    ///< connections removed
+  uint64_t attempts{0};   ///< attempts started
+  uint64_t connected{0};  ///< attempts that established the connection
+  uint64_t failed{0};     ///< attempts that failed, timeouts included
+  uint64_t timeouts{0};   ///< attempts that exceeded the connect timeout
+  uint64_t lost{0};       ///< established connections that broke
+  uint64_t peak{0};       ///< most attempts in flight
+};
+
+/**
+ * @brief The ReconnectManager class schedules the connection attempts of many peers.
+ *
+ * Usage: add() a connection, e.g. per configured outstation. run() starts the due attempts, the
+ * owner opens a non-blocking connect per key, and reports the outcome with connected() or failed();
+ * a broken connection is reported with lost(). next_expired() hands out the attempts beyond the
+ * connect timeout, the owner closes their sockets. The delay run() returns follows the next-delay
+ * contract of the context tasks. The manager only schedules: it opens no socket.
+ * @note The manager is not thread-safe, it runs on the thread of the context.
+ */
+class ReconnectManager {
+ public:
+  /**
+   * @brief constructor.
+   * @param config The configuration.
+   */
+  explicit ReconnectManager(const ReconnectConfig& config = {});
+
+  /**
+   * @brief Adds a connection, its first attempt is due at once.
+   * @param key The key of the connection, e.g. the session or the peer address.
+   * @param now The time in nanoseconds.
+   * @return false if the key is known.
+   */
+  bool add(uint64_t key, int64_t now);
+
+  /**
+   * @brief Removes a connection, a running attempt is forgotten.
+   * @param key The key of the connection.
+   * @return false if the key is unknown.
+   */
+  bool remove(uint64_t key);
+
+  /**
+   * @brief Starts the due attempts.
+   * @param now The time in nanoseconds.
+   * @param limit The longest delay to return.
+   * @param connect Called as void(uint64_t key) for every started attempt, may report its outcome.
+   * @return The earlier of the limit and the time until the next attempt or timeout, rounded up.
+   */
+  template <typename Connect>
+  std::chrono::milliseconds run(int64_t now, std::chrono::milliseconds limit, Connect&& connect) {
+    while (auto key = next_attempt(now)) {
+      connect(*key);
+    }
+    return next_delay(now, limit);
+  }
+
+  /**
+   * @brief Starts the next due attempt if the limit has a free slot.
+   * @param now The time in nanoseconds.
+   * @return The key of the connection, none if no attempt is due or the limit is reached.
+   */
+  std::optional<uint64_t> next_attempt(int64_t now);
+
+  /**
+   * @brief Fails the next attempt beyond the connect timeout and schedules its retry.
+   * @param now The time in nanoseconds.
+   * @return The key of the connection, none if no attempt expired.
+   */
+  std::optional<uint64_t> next_expired(int64_t now);
+
+  /**
+   * @brief Gets the time until the next attempt or timeout.
+   * @param now The time in nanoseconds.
+   * @param limit The longest delay to return.
+   * @return The earlier of the limit and the time, rounded up; a due attempt waiting for a slot
+   * doesn't count, a slot frees with an outcome or a timeout.
+   */
+  std::chrono::milliseconds next_delay(int64_t now, std::chrono::milliseconds limit);
+
+  /**
+   * @brief Reports an established connection, its backoff starts over.
+   * @param key The key of the connection.
+   * @param now The time in nanoseconds.
+   * @return false if no attempt of the key runs.
+   */
+  bool connected(uint64_t key, int64_t now);
+
+  /**
+   * @brief Reports a failed attempt and schedules the retry.
+   * @param key The key of the connection.
+   * @param now The time in nanoseconds.
+   * @return false if no attempt of the key runs.
+   */
+  bool failed(uint64_t key, int64_t now);
+
+  /**
+   * @brief Reports a broken connection and schedules the first attempt after a backoff delay.
+   * @param key The key of the connection.
+   * @param now The time in nanoseconds.
+   * @return false if the key isn't connected.
+   */
+  bool lost(uint64_t key, int64_t now);
+
+  /**
+   * @brief Checks whether a connection is established.
+   * @param key The key of the connection.
+   * @return true if connected, otherwise false.
+   */
+  [[nodiscard]] bool is_connected(uint64_t key) const;
+
+  /**
+   * @brief Gets the number of connections.
+   * @return The number of connections.
+   */
+  [[nodiscard]] size_t size() const {
+    return m_index.size();
+  }
+
+  /**
+   * @brief Gets the number of established connections.
+   * @return The number of connections.
+   */
+  [[nodiscard]] size_t established() const {
+    return m_established;
+  }
+
+  /**
+   * @brief Gets the number of attempts in flight.
+   * @return The number of attempts.
+   */
+  [[nodiscard]] size_t connecting() const {
+    return m_connecting;
+  }
+
+  /**
+   * @brief Gets the configuration.
+   * @return The configuration.
+   */
+  [[nodiscard]] const ReconnectConfig& config() const {
+    return m_config;
+  }
+
+  /**
+   * @brief Gets the counters.
+   * @return The counters.
+   */
+  [[nodiscard]] const ReconnectStatistics& statistics() const {
+    return m_statistics;
+  }
+
+  /**
+   * @brief Gets the latency of the attempts that established a connection.
+   * @return The histogram in nanoseconds.
+   */
+  [[nodiscard]] const LatencyHistogram& connect_latency() const {
+    return m_connectLatency;
+  }
+
+  /**
+   * @brief Gets the time from the addition or the loss of a connection to its establishment.
+   * @return The histogram in nanoseconds.
+   */
+  [[nodiscard]] const LatencyHistogram& recovery() const {
+    return m_recovery;
+  }
+
+  /**
+   * @brief Clears the histograms, e.g. after the start.
+   */
+  void reset_metrics();
+
+ private:
+  /**
+   * @brief The state of a connection.
+   */
+  enum class State : uint8_t {
+    free,        ///< slot without connection
+    waiting,     ///< the next attempt is scheduled
+    connecting,  ///< an attempt runs
+    connected,   ///< established
+  };
+
+  /**
+   * @brief A managed connection.
+   */
+  struct Peer {
+    uint64_t key{0};           ///< key of the connection
+    int64_t due{0};            ///< time of the next attempt
+    int64_t started{0};        ///< time the running attempt started
+    int64_t since{0};          ///< time of the addition or the loss
+    int64_t delay{0};          ///< previous backoff delay in nanoseconds
+    uint32_t failures{0};      ///< failed attempts since the connection was established
+    uint32_t generation{0};    ///< changed with every state, invalidates the entries
+    State state{State::free};  ///< state of the connection
+  };
+
+  /**
+   * @brief An entry of the heap of the attempts or of the queue of the timeouts.
+   */
+  struct Entry {
+    int64_t due;          ///< time of the attempt or of its timeout
+    uint32_t peer;        ///< the peer
+    uint32_t generation;  ///< generation of the peer at the push
+  };
+
+  void schedule(uint32_t index, int64_t now);
+  void finish_attempt(Peer& peer);
+  [[nodiscard]] int64_t backoff(Peer& peer);
+  [[nodiscard]] uint64_t next_random();
+  [[nodiscard]] bool is_current(const Entry& entry, State state) const;
+
+  ReconnectConfig m_config;                        ///< configuration
+  std::vector<Peer> m_peers;                       ///< connections, free slots included
+  std::vector<uint32_t> m_free;                    ///< free slots
+  std::unordered_map<uint64_t, uint32_t> m_index;  ///< slots of the keys
+  std::vector<Entry> m_attempts;                   ///< heap of the scheduled attempts, earliest first
+  std::deque<Entry> m_timeouts;                    ///< timeouts of the running attempts, in start order
+  size_t m_connecting{0};                          ///< attempts in flight
+  size_t m_established{0};                         ///< established connections
+  uint64_t m_random;                               ///< xorshift state of the jitter, never zero
+  ReconnectStatistics m_statistics;                ///< counters
+  LatencyHistogram m_connectLatency;               ///< latency of the established connections
+  LatencyHistogram m_recovery;                     ///< time from the addition or loss to the connection
+};
+
+}  // namespace app
@@ -0,0 +1,324 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the hot-standby link between two redundant daemons
+ * \ingroup Application Common
+ *
+ * The active node streams the changed points of its point database and its context state to the
+ * standby node over one TCP connection. The standby applies them, so it can take over with current
+ * state. Both nodes send a message every heartbeat interval.
+ *
+ * Role arbitration is lease based. Every heartbeat of the active node grants it the role for the
+ * lease time. The standby promotes itself only after the lease expired without a heartbeat, so the
+ * failover time is at most the lease plus one poll interval. A node starting without a peer becomes
+ * active after the startup window. When two active nodes meet, e.g. after the link between them was
+ * broken, the node with the higher epoch stays active, on equal epochs the lower node id; the other
+ * node becomes standby and receives a full snapshot.
+ *
+ * Frames are a type byte, a little-endian 32-bit length and the payload. Point entries are encoded
+ * as deltas to the previous entry: varint index distance, raw value, varint quality, zigzag varint
+ * timestamp distance.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <netinet/in.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "pointDatabase.hpp"
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The role of a redundant node.
+ */
+enum class RedundancyRole : uint8_t {
+  starting,  ///< waiting for the peer or the end of the startup window
+  active,    ///< serving and streaming its state
+  standby,   ///< applying the state of the active node
+};
+
+/**
+ * @brief Gets the name of a role.
+ * @param role The role.
+ * @return The name.
+ */
+std::string_view to_string(RedundancyRole role);
+
+/**
+ * @brief The configuration of the redundancy link.
+ */
+struct RedundancyConfig {
+  uint32_t nodeId{1};                            ///< id of this node
+  std::string listenAddress;                     ///< address the peer connects to, "[host:]port"
+  uint32_t peerId{2};                            ///< id of the peer, the lower id connects and wins ties
+  std::string peerAddress;                       ///< address of the peer, "[host:]port"
+  std::chrono::milliseconds heartbeat{10};       ///< interval of heartbeats and reconnects
+  std::chrono::milliseconds lease{50};           ///< time a heartbeat grants the active role
+  std::chrono::milliseconds startupWindow{500};  ///< time a starting node waits for an active peer
+
+  /**
+   * @brief Parses "id@[host:]port,peer id@[host:]port[,heartbeat ms[,lease ms]]", e.g.
+   * "1@:2501,2@127.0.0.1:2502" for node 1 and "2@:2502,1@127.0.0.1:2501" for its peer.
+   * @param text The text.
+   * @return The configuration, none if the text is invalid.
+   */
+  static std::optional<RedundancyConfig> parse(std::string_view text);
+};
+
+/**
+ * @brief The RedundancyLink class connects a node to its peer, arbitrates the roles and replicates
+ * the point database and the context state from the active to the standby node.
+ *
+ * The link is polled from the application task. On the active node poll() sends the points changed
+ * since the previous poll; the link consumes the changed flags of the point database while it
+ * streams them, streamed_points() tells the owner whether it has to clear them itself. On the
+ * standby node the received points are written into the point database.
+ */
+class RedundancyLink {
+ public:
+  /**
+   * @brief Handler of role changes.
+   * @param previous The previous role.
+   * @param role The new role.
+   */
+  using RoleHandler = std::function<void(RedundancyRole previous, RedundancyRole role)>;
+
+  /**
+   * @brief Handler of connection events for the log.
+   * @param message The description of the event.
+   */
+  using EventHandler = std::function<void(std::string_view message)>;
+
+  /**
+   * @brief Statistics of the link.
+   */
+  struct Statistics {
+    uint64_t connections{0};               ///< established connections
+    uint64_t deltas{0};                    ///< delta frames sent
+    uint64_t pointsSent{0};                ///< points sent, snapshots included
+    uint64_t pointsApplied{0};             ///< points received and applied
+    uint64_t bytesSent{0};                 ///< bytes sent
+    uint64_t bytesReceived{0};             ///< bytes received
+    uint64_t snapshots{0};                 ///< full snapshots sent
+    uint64_t promotions{0};                ///< changes to the active role
+    std::chrono::nanoseconds failover{0};  ///< time from the last heartbeat of the peer to the last promotion
+  };
+
+  /**
+   * @brief constructor
+   * @param points The point database to replicate.
+   */
+  explicit RedundancyLink(PointDatabase& points) : m_points(points) {}
+
+  /// destructor closes the link
+  ~RedundancyLink();
+
+  RedundancyLink(const RedundancyLink&) = delete;
+  RedundancyLink& operator=(const RedundancyLink&) = delete;
+
+  /**
+   * @brief Opens the listener and starts in the starting role.
+   * @param config The configuration.
+   * @return true if the listener is open, otherwise false.
+   */
+  [[nodiscard]] bool open(const RedundancyConfig& config);
+
+  /**
+   * @brief Closes the connection and the listener.
+   */
+  void close();
+
+  /**
+   * @brief Checks if the link is open.
+   * @return true if open, otherwise false.
+   */
+  [[nodiscard]] bool is_open() const {
+    return m_listenFd >= 0;
+  }
+
+  /**
+   * @brief Processes the connection: accepts and connects, reads and applies frames, sends heartbeats
+   * and the changed points, and arbitrates the role.
+   * @param timeout The maximal time to wait for input.
+   * @return The number of processed frames and connection events.
+   */
+  size_t poll(std::chrono::milliseconds timeout);
+
+  /**
+   * @brief Checks whether the last poll streamed the points and cleared their changed flags, only
+   * an active node with a connected standby that said hello does.
+   * @return true if the flags were consumed, otherwise false.
+   */
+  [[nodiscard]] bool streamed_points() const {
+    return m_streamedPoints;
+  }
+
+  /**
+   * @brief Gets the time until the link must be polled again.
+   * @return The time until the next heartbeat or lease expiry.
+   */
+  [[nodiscard]] std::chrono::milliseconds next_timeout() const;
+
+  /**
+   * @brief Sets a context state entry, replicated with the next poll while active.
+   * @param key The key.
+   * @param value The value.
+   */
+  void set_state(const std::string& key, std::span<const std::byte> value);
+
+  /**
+   * @brief Gets the context state, set locally or received from the active node.
+   * @return The entries.
+   */
+  [[nodiscard]] const std::map<std::string, std::vector<std::byte>>& state() const {
+    return m_state;
+  }
+
+  /**
+   * @brief Sets the handler of role changes.
+   * @param handler The handler.
+   */
+  void set_role_handler(RoleHandler handler) {
+    m_roleHandler = std::move(handler);
+  }
+
+  /**
+   * @brief Sets the handler of connection events.
+   * @param handler The handler.
+   */
+  void set_event_handler(EventHandler handler) {
+    m_eventHandler = std::move(handler);
+  }
+
+  /**
+   * @brief Gets the role of this node.
+   * @return The role.
+   */
+  [[nodiscard]] RedundancyRole role() const {
+    return m_role;
+  }
+
+  /**
+   * @brief Gets the epoch, incremented by every promotion of either node.
+   * @return The epoch.
+   */
+  [[nodiscard]] uint64_t epoch() const {
+    return m_epoch;
+  }
+
+  /**
+   * @brief Checks if the peer is connected.
+   * @return true if connected, otherwise false.
+   */
+  [[nodiscard]] bool is_connected() const {
+    return m_peerFd >= 0 && !m_connecting;
+  }
+
+  /**
+   * @brief Gets the statistics.
+   * @return The statistics.
+   */
+  [[nodiscard]] const Statistics& statistics() const {
+    return m_statistics;
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @brief The frame types.
+   */
+  enum class FrameType : uint8_t {
+    hello = 1,      ///< node id, epoch and role
+    heartbeat = 2,  ///< epoch and role, renews the lease of an active node
+    points = 3,     ///< sequence, snapshot flag and point entries
+    state = 4,      ///< sequence, key and value of a context state entry
+  };
+
+  static constexpr size_t FrameHeaderSize = 5;                  ///< type and length
+  static constexpr size_t MaxFrameSize = 1024 * 1024;           ///< larger frames break the connection
+  static constexpr size_t MaxPendingOutput = 64 * 1024 * 1024;  ///< queued bytes before a resync
+  static constexpr size_t MaxPointsPerFrame = 4096;             ///< point entries of one frame
+
+  void accept_peer();
+  void install_peer(int fd);
+  void connect_peer();
+  void drop_peer(std::string_view reason);
+  void read_pending(size_t& events);
+  void close_pending();
+  void read_peer(size_t& events);
+  void handle_input(size_t& events);
+  void write_peer();
+  bool handle_frame(FrameType type, std::span<const uint8_t> payload);
+  void handle_peer_role(RedundancyRole peerRole, uint64_t peerEpoch, uint32_t peerId);
+  void change_role(RedundancyRole role);
+  void promote(std::string_view reason);
+  void begin_frame(FrameType type);
+  void end_frame();
+  void send_hello();
+  void send_heartbeat();
+  void send_points(bool snapshot);
+  void send_state(const std::string& key);
+  void send_snapshot();
+  bool apply_points(std::span<const uint8_t> payload);
+  void check_timers();
+  void report(const std::string& message) const;
+
+  PointDatabase& m_points;                                ///< replicated point database
+  RedundancyConfig m_config;                              ///< configuration
+  sockaddr_in m_peerAddress{};                            ///< address of the peer
+  int m_listenFd{-1};                                     ///< listener of the peer connection
+  int m_peerFd{-1};                                       ///< connection to the peer
+  bool m_connecting{false};                               ///< the connection is not yet established
+  int m_pendingFd{-1};                                    ///< new connection before its hello
+  Clock::time_point m_pendingSince;                       ///< acceptance of the new connection
+  std::vector<uint8_t> m_pendingInput;                    ///< received bytes of the new connection
+  bool m_helloReceived{false};                            ///< the peer introduced itself on the connection
+  RedundancyRole m_role{RedundancyRole::starting};        ///< role of this node
+  uint64_t m_epoch{0};                                    ///< epoch of the current active node
+  uint64_t m_sequence{0};                                 ///< sequence of the frames with state
+  Clock::time_point m_started;                            ///< start of the startup window
+  Clock::time_point m_lastReceived;                       ///< last frame of the peer
+  Clock::time_point m_lastLease;                          ///< last heartbeat of an active peer
+  Clock::time_point m_lastHeartbeat;                      ///< last heartbeat sent
+  Clock::time_point m_lastConnect;                        ///< last connection attempt
+  std::vector<uint8_t> m_input;                           ///< received bytes of incomplete frames
+  std::vector<uint8_t> m_output;                          ///< bytes not yet accepted by the socket
+  std::vector<uint8_t> m_frame;                           ///< frame under construction
+  std::map<std::string, std::vector<std::byte>> m_state;  ///< context state
+  std::set<std::string> m_dirtyState;                     ///< state entries changed since the last poll
+  bool m_needSnapshot{false};                             ///< the standby needs a full snapshot
+  bool m_streamedPoints{false};                           ///< the last poll consumed the changed flags
+  std::optional<RedundancyRole> m_peerRole;               ///< role the peer reported last
+  RoleHandler m_roleHandler;                              ///< handler of role changes
+  EventHandler m_eventHandler;                            ///< handler of connection events
+  Statistics m_statistics;                                ///< statistics
+};
+
+}  // namespace app
@@ -0,0 +1,162 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the decoder of IEC 61850-9-2 Sampled Values frames
+ * \ingroup Application Common
+ *
+ * A Sampled Values frame is an Ethernet frame, optionally VLAN tagged, with EtherType 0x88BA, an
+ * 8 byte header (APPID, length, two reserved fields) and a BER encoded savPdu. The savPdu holds
+ * one or more ASDUs; each ASDU carries the stream name svID, the sample counter, the configuration
+ * revision, the synchronization state and the dataset seqData as pairs of a 32-bit value and a
+ * 32-bit quality per channel (8 channels, 4 currents and 4 voltages, in the 9-2LE profile).
+ *
+ * The decoder appends the ASDUs of many frames to a batch in structure-of-arrays form and writes
+ * the batch into a point database in one pass. The first ASDU of a stream reserves a range of
+ * points after the streams seen before: channel c of the stream is point first + c, the value is
+ * the raw INT32 of the dataset (9-2LE: currents in mA, voltages in 10 mV).
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "pointDatabase.hpp"
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief Decoded ASDUs in structure-of-arrays form. The arrays keep their capacity when cleared, so
+ * a batch decodes without allocations once it reached its working size.
+ */
+struct SampledValuesBatch {
+  std::vector<uint32_t> stream;                 ///< stream of each ASDU
+  std::vector<uint16_t> sampleCount;            ///< smpCnt of each ASDU
+  std::vector<uint32_t> configurationRevision;  ///< confRev of each ASDU
+  std::vector<uint8_t> synchronized;            ///< smpSynch of each ASDU
+  std::vector<int64_t> timestamp;               ///< capture time of the frame in nanoseconds since epoch
+  std::vector<uint32_t> firstChannel;           ///< index of the first channel in values and qualities
+  std::vector<uint16_t> channels;               ///< number of channels of each ASDU
+  std::vector<int32_t> values;                  ///< channel values of all ASDUs
+  std::vector<uint32_t> qualities;              ///< channel qualities of all ASDUs
+
+  /**
+   * @brief Gets the number of ASDUs.
+   * @return The number of ASDUs.
+   */
+  [[nodiscard]] size_t size() const {
+    return stream.size();
+  }
+
+  /**
+   * @brief Removes all ASDUs, the capacity stays.
+   */
+  void clear();
+};
+
+/**
+ * @brief The SampledValuesDecoder class decodes Sampled Values frames into batches and applies
+ * them to a point database.
+ * @note The decoder is not thread-safe; one decoder per context.
+ */
+class SampledValuesDecoder {
+ public:
+  static constexpr uint16_t EtherType = 0x88BA;  ///< EtherType of Sampled Values
+  static constexpr size_t MaxChannels = 64;      ///< largest dataset of an ASDU
+
+  /**
+   * @brief A stream, identified by its svID.
+   */
+  struct Stream {
+    std::string svId;             ///< name of the stream
+    uint16_t appId{0};            ///< APPID of the first frame
+    uint16_t channels{0};         ///< channels of the dataset
+    uint32_t firstPoint{0};       ///< point of channel 0
+    uint16_t lastSampleCount{0};  ///< smpCnt of the last ASDU
+    uint64_t asdus{0};            ///< decoded ASDUs
+    uint64_t sampleGaps{0};       ///< ASDUs whose smpCnt doesn't follow the previous one
+  };
+
+  /**
+   * @brief The statistics of the decoder.
+   */
+  struct Statistics {
+    uint64_t frames{0};      ///< frames passed to the decoder
+    uint64_t svFrames{0};    ///< Sampled Values frames
+    uint64_t asdus{0};       ///< decoded ASDUs
+    uint64_t malformed{0};   ///< frames with a malformed header, savPdu or ASDU
+    uint64_t unmapped{0};    ///< ASDUs of streams without space in the point database
+    uint64_t mismatched{0};  ///< ASDUs whose dataset size differs from the first ASDU of the stream
+  };
+
+  /**
+   * @brief Decodes an Ethernet frame and appends its ASDUs to the batch. Other frames are counted
+   * and ignored.
+   * @param frame The frame, starting with the destination MAC address.
+   * @param timestamp The capture time in nanoseconds since epoch.
+   * @return The number of appended ASDUs.
+   */
+  size_t decode_frame(std::span<const std::byte> frame, int64_t timestamp);
+
+  /**
+   * @brief Writes the batch into the point database and clears it. ASDUs of streams whose points
+   * lie beyond the size of the database are counted as unmapped.
+   * @param points The point database.
+   * @return The number of updated points.
+   */
+  size_t apply(PointDatabase& points);
+
+  /**
+   * @brief Gets the batch of decoded, not yet applied ASDUs.
+   * @return The batch.
+   */
+  [[nodiscard]] const SampledValuesBatch& batch() const {
+    return m_batch;
+  }
+
+  /**
+   * @brief Gets the streams in the order they appeared.
+   * @return The streams.
+   */
+  [[nodiscard]] const std::vector<Stream>& streams() const {
+    return m_streams;
+  }
+
+  /**
+   * @brief Gets the statistics.
+   * @return The statistics.
+   */
+  [[nodiscard]] const Statistics& statistics() const {
+    return m_statistics;
+  }
+
+ private:
+  bool decode_pdu(std::span<const std::byte> pdu, uint16_t appId, int64_t timestamp, size_t& asdus);
+  bool decode_asdu(std::span<const std::byte> asdu, uint16_t appId, int64_t timestamp);
+  uint32_t find_stream(std::string_view svId, uint16_t appId, uint16_t channels);
+
+  SampledValuesBatch m_batch;     ///< decoded, not yet applied ASDUs
+  std::vector<Stream> m_streams;  ///< known streams
+  uint32_t m_nextPoint{0};        ///< first point of the next stream
+  Statistics m_statistics;        ///< statistics
+};
+
+}  // namespace app
@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the sockets passed by a socket activation
+ * \ingroup Application Common
+ *
+ * A daemon that binds its own ports at the end of its start makes every dependent wait for it. With
+ * socket activation a launcher (systemd, or the socketActivate tool) binds the ports first, starts all
+ * daemons in parallel and passes the listening sockets to them; a client connecting before the daemon
+ * accepts waits in the kernel backlog instead of being refused. The sockets are inherited by the
+ * exec as the descriptors from 3 on, announced by the environment:
+ * - LISTEN_PID: the process the sockets are meant for, other processes ignore them;
+ * - LISTEN_FDS: the number of sockets;
+ * - LISTEN_FDNAMES: their names, separated by colons, several sockets may share a name.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief A socket passed by the activation.
+ */
+struct ActivatedSocket {
+  int fd{-1};             ///< descriptor of the socket
+  std::string name;       ///< name of the socket, "unknown" without names
+  int type{0};            ///< SOCK_STREAM, SOCK_DGRAM, ..., 0 for no socket
+  bool listening{false};  ///< a listening stream socket
+};
+
+/**
+ * @brief The SocketActivation class owns the sockets passed by the activation until they are taken.
+ *
+ * Usage: read the environment once at the start, before a fork or a thread changes the process;
+ * take() the sockets of every context by its name and close the unclaimed ones. The environment is
+ * cleared, so children of the daemon don't take the sockets for theirs.
+ * @note The class is not thread-safe.
+ */
+class SocketActivation {
+ public:
+  static constexpr int FirstFd = 3;  ///< descriptor of the first socket, SD_LISTEN_FDS_START
+
+  SocketActivation() = default;
+
+  /// destructor closes the sockets not taken
+  ~SocketActivation();
+
+  SocketActivation(const SocketActivation&) = delete;
+  SocketActivation& operator=(const SocketActivation&) = delete;
+  SocketActivation(SocketActivation&& other) noexcept;
+  SocketActivation& operator=(SocketActivation&& other) noexcept;
+
+  /**
+   * @brief Reads the sockets passed to this process and clears the environment.
+   * @return The sockets, none without an activation or if LISTEN_PID names another process.
+   */
+  [[nodiscard]] static SocketActivation from_environment();
+
+  /**
+   * @brief Passes sockets to the next exec: moves them to the descriptors from 3 on, keeps them
+   * open across the exec and sets the environment for the calling process, which keeps its id.
+   * @param sockets The sockets, their descriptors are updated.
+   * @return false if a descriptor can't be moved, errno tells why.
+   */
+  [[nodiscard]] static bool pass(std::vector<ActivatedSocket>& sockets);
+
+  /**
+   * @brief Duplicates sockets, e.g. for an owner that closes them while the originals stay open.
+   * @param sockets The sockets.
+   * @return The duplicates, the caller owns them; empty if a descriptor can't be duplicated, errno tells why.
+   */
+  [[nodiscard]] static std::vector<ActivatedSocket> duplicate(const std::vector<ActivatedSocket>& sockets);
+
+  /**
+   * @brief Takes the sockets of a name, the caller owns them.
+   * @param name The name.
+   * @return The sockets in the passed order, empty if none has the name.
+   */
+  [[nodiscard]] std::vector<ActivatedSocket> take(std::string_view name);
+
+  /**
+   * @brief Closes the sockets no one has taken.
+   * @return The names of the closed sockets.
+   */
+  std::vector<std::string> close_unclaimed();
+
+  /**
+   * @brief Gets the sockets not yet taken.
+   * @return The sockets.
+   */
+  [[nodiscard]] const std::vector<ActivatedSocket>& sockets() const {
+    return m_sockets;
+  }
+
+  /**
+   * @brief Checks whether no socket waits to be taken.
+   * @return true if empty, otherwise false.
+   */
+  [[nodiscard]] bool empty() const {
+    return m_sockets.empty();
+  }
+
+  /**
+   * @brief Gets the error of an invalid environment.
+   * @return The error, empty if the environment was valid or absent.
+   */
+  [[nodiscard]] const std::string& last_error() const {
+    return m_error;
+  }
+
+ private:
+  std::vector<ActivatedSocket> m_sockets;  ///< sockets not yet taken
+  std::string m_error;                     ///< error of the environment
+};
+
+}  // namespace app
@@ -0,0 +1,259 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the sequence-of-events merge of many ordered sources
+ * \ingroup Application Common
+ *
+ * Every link delivers its events in timestamp order, but the links lag each other, so the
+ * northbound side sees the union out of order. The merger keeps one queue per source and a heap
+ * over the sources keyed by the oldest queued event, so the heap has one entry per source with
+ * events, however many events are queued. An event is released when no source can still deliver
+ * an older one: when its timestamp is at or below the watermark, the lowest progress of the open
+ * sources (their newest event or the time a heartbeat promised). A silent source holds the merge
+ * back at most for the reorder window: an event is released at the latest when its timestamp is
+ * the window older than the current time.
+ *
+ * An event older than the last released event is late. It is dropped or forwarded out of order
+ * with the late flag at the next release, as configured.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "latencyHistogram.hpp"
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief An event of the sequence of events.
+ */
+struct SoeEvent {
+  int64_t timestamp{0};  ///< time of the event at its source in nanoseconds
+  int64_t arrival{0};    ///< time the event was pushed, set by push()
+  double value{0.0};     ///< value of the point
+  uint32_t point{0};     ///< point of the event
+  uint32_t quality{0};   ///< quality flags of the value
+  uint16_t source{0};    ///< source of the event, set by push()
+  bool late{false};      ///< forwarded out of order, older than an event released before
+};
+
+/**
+ * @brief What the merger does with a late event.
+ */
+enum class SoeLatePolicy : uint8_t {
+  drop,     ///< count and discard it
+  forward,  ///< release it with the late flag at the next release
+};
+
+/**
+ * @brief The configuration of the merger.
+ */
+struct SoeMergeConfig {
+  std::chrono::nanoseconds window{std::chrono::milliseconds(10)};  ///< longest wait for a silent source
+  SoeLatePolicy latePolicy{SoeLatePolicy::forward};                ///< handling of late events
+};
+
+/**
+ * @brief Statistics of the merger.
+ */
+struct SoeMergeStatistics {
+  uint64_t received{0};   ///< events pushed
+  uint64_t released{0};   ///< events released, in order or late
+  uint64_t late{0};       ///< late events, forwarded or dropped
+  uint64_t dropped{0};    ///< late events dropped
+  uint64_t reordered{0};  ///< events a source delivered out of its own order, sorted into its queue
+};
+
+/**
+ * @brief The SoeMerger class merges the ordered event streams of many sources into one stream
+ * in timestamp order.
+ * @note The merger belongs to one task and is not thread-safe.
+ */
+class SoeMerger {
+ public:
+  static constexpr size_t MaxSources = std::numeric_limits<uint16_t>::max();  ///< sources of a merger
+
+  /**
+   * @brief constructor
+   * @param config The configuration.
+   */
+  explicit SoeMerger(const SoeMergeConfig& config = {}) : m_config(config) {}
+
+  /**
+   * @brief Adds a source, open and without progress.
+   * @return The identifier of the source, MaxSources if there are too many.
+   */
+  size_t add_source();
+
+  /**
+   * @brief Queues an event of a source and opens a closed source.
+   * @param source The source.
+   * @param event The event, the arrival and the source are set.
+   * @param now The time in nanoseconds on the time line of the event timestamps.
+   * @return true if queued, false if the event is late and dropped.
+   */
+  bool push(size_t source, const SoeEvent& event, int64_t now);
+
+  /**
+   * @brief Advances the progress of a source without an event, e.g. on a heartbeat or an idle
+   * poll: the source won't deliver events older than the timestamp.
+   * @param source The source.
+   * @param timestamp The timestamp in nanoseconds.
+   */
+  void advance(size_t source, int64_t timestamp);
+
+  /**
+   * @brief Closes a source, e.g. when its link is down. Its queued events are still released,
+   * but it no longer holds the watermark back until it pushes again.
+   * @param source The source.
+   */
+  void close(size_t source);
+
+  /**
+   * @brief Gets the timestamp up to which all events can be released.
+   * @param now The time in nanoseconds.
+   * @return The progress of the slowest open source, at least the window before now.
+   */
+  [[nodiscard]] int64_t watermark(int64_t now) const;
+
+  /**
+   * @brief Releases the late events, then the queued events up to the watermark in timestamp
+   * order; events with equal timestamps in the order of their sources.
+   * @param now The time in nanoseconds.
+   * @param sink Called with every released event.
+   * @return The number of released events.
+   */
+  template <typename Sink>
+  size_t release(int64_t now, Sink&& sink) {
+    return release_until(watermark(now), now, sink);
+  }
+
+  /**
+   * @brief Releases all queued events, e.g. at shutdown.
+   * @param now The time in nanoseconds.
+   * @param sink Called with every released event.
+   * @return The number of released events.
+   */
+  template <typename Sink>
+  size_t flush(int64_t now, Sink&& sink) {
+    return release_until(std::numeric_limits<int64_t>::max(), now, sink);
+  }
+
+  /**
+   * @brief Gets the number of queued events.
+   * @return The number of events.
+   */
+  [[nodiscard]] size_t queued() const {
+    return m_queued;
+  }
+
+  /**
+   * @brief Gets the number of sources.
+   * @return The number of sources.
+   */
+  [[nodiscard]] size_t sources() const {
+    return m_sources.size();
+  }
+
+  /**
+   * @brief Gets the statistics.
+   * @return The statistics.
+   */
+  [[nodiscard]] const SoeMergeStatistics& statistics() const {
+    return m_statistics;
+  }
+
+  /**
+   * @brief Gets the time the released events were held, from their push to their release.
+   * @return The histogram of the hold times in nanoseconds.
+   */
+  [[nodiscard]] const LatencyHistogram& hold_time() const {
+    return m_holdTime;
+  }
+
+ private:
+  static constexpr uint32_t NotQueued = std::numeric_limits<uint32_t>::max();  ///< heap index of an idle source
+
+  /**
+   * @brief The queue of a source, a ring of a power of two capacity.
+   */
+  struct Source {
+    std::vector<SoeEvent> ring;                             ///< queued events, oldest at head
+    size_t head{0};                                         ///< index of the oldest event
+    size_t count{0};                                        ///< number of queued events
+    int64_t progress{std::numeric_limits<int64_t>::min()};  ///< no older events will come
+    uint32_t heapIndex{NotQueued};                          ///< position in the heap
+    bool open{true};                                        ///< holds the watermark back
+
+    [[nodiscard]] const SoeEvent& front() const {
+      return ring[head];
+    }
+  };
+
+  template <typename Sink>
+  size_t release_until(int64_t limit, int64_t now, Sink& sink) {
+    size_t released = 0;
+    for (auto& event : m_late) {
+      m_holdTime.record(std::chrono::nanoseconds(now - event.arrival));
+      sink(static_cast<const SoeEvent&>(event));
+    }
+    released += m_late.size();
+    m_late.clear();
+    while (!m_heap.empty()) {
+      auto& source = m_sources[m_heap.front()];
+      const auto& event = source.front();
+      if (event.timestamp > limit) {
+        break;
+      }
+      m_lastReleased = event.timestamp;
+      m_holdTime.record(std::chrono::nanoseconds(now - event.arrival));
+      sink(event);
+      ++released;
+      source.head = (source.head + 1) & (source.ring.size() - 1);
+      --m_queued;
+      if (--source.count == 0) {
+        remove_top();
+      } else {
+        sift_down(0);
+      }
+    }
+    m_statistics.released += released;
+    return released;
+  }
+
+  void enqueue(Source& source, const SoeEvent& event);
+  [[nodiscard]] bool before(uint16_t a, uint16_t b) const;
+  void sift_up(size_t index);
+  void sift_down(size_t index);
+  void remove_top();
+
+  SoeMergeConfig m_config;                                      ///< configuration
+  std::vector<Source> m_sources;                                ///< queue of each source
+  std::vector<uint16_t> m_heap;                                 ///< sources with events, oldest front first
+  std::vector<SoeEvent> m_late;                                 ///< late events to forward
+  int64_t m_lastReleased{std::numeric_limits<int64_t>::min()};  ///< timestamp of the last released event
+  size_t m_queued{0};                                           ///< queued events of all sources
+  SoeMergeStatistics m_statistics;                              ///< statistics
+  LatencyHistogram m_holdTime;                                  ///< hold time of the released events
+};
+
+}  // namespace app
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the helpers of the line-based configuration files
+ * \ingroup Application Common
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <charconv>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief Parses a number, the whole text.
+ * @param text The text.
+ * @param value Receives the number.
+ * @return true if the text is a number, otherwise false.
+ */
+template <typename T>
+[[nodiscard]] bool parse_number(std::string_view text, T& value) {
+  auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  return ec == std::errc() && ptr == text.data() + text.size();
+}
+
+/**
+ * @brief Splits a line into tokens separated by blanks.
+ * @param line The line without comment.
+ * @return The tokens, views into the line.
+ */
+[[nodiscard]] std::vector<std::string_view> split_tokens(std::string_view line);
+
+}  // namespace app
@@ -0,0 +1,169 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the partitioning of threads into housekeeping and latency-critical roles
+ * \ingroup Application Common
+ *
+ * Every thread of a daemon takes a role when it starts. Housekeeping threads (signal handling,
+ * console, reload, log flushing, metrics) run on the housekeeping CPUs, latency-critical threads
+ * (protocol tasks) on the critical CPUs, each with its own scheduling policy. Without configuration
+ * the critical CPUs are the CPUs the kernel isolates with isolcpus= or nohz_full=.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <sys/types.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The role of a thread.
+ */
+enum class ThreadRole {
+  housekeeping,  ///< logging, metrics, configuration, administration
+  critical,      ///< latency-critical protocol processing
+};
+
+/**
+ * @brief Gets the name of a thread role.
+ * @param role The role.
+ * @return The name.
+ */
+std::string_view to_string(ThreadRole role);
+
+/**
+ * @brief The CPUs and the scheduling of a role.
+ */
+struct RoleSettings {
+  std::vector<size_t> cpus;  ///< CPUs of the role, empty for no restriction
+  int policy{0};             ///< scheduling policy, SCHED_OTHER by default
+  int priority{0};           ///< static priority of SCHED_FIFO and SCHED_RR
+  int nice{0};               ///< nice value of SCHED_OTHER and SCHED_BATCH
+
+  /**
+   * @brief Parses the scheduling "other[:nice]", "batch[:nice]", "fifo:priority" or "rr:priority".
+   * @param text The text.
+   * @return true if the text is valid, the settings are unchanged otherwise.
+   */
+  bool parse_scheduling(std::string_view text);
+
+  /**
+   * @brief Formats the settings for the log.
+   * @return The text, e.g. "cpus 2-3, fifo:50".
+   */
+  [[nodiscard]] std::string describe() const;
+
+  /**
+   * @brief Applies the settings to the calling thread.
+   * @return The error of the first setting that failed, none on success.
+   */
+  [[nodiscard]] std::optional<std::string> apply() const;
+};
+
+/**
+ * @brief The settings of both roles.
+ */
+struct ThreadPartition {
+  RoleSettings housekeeping;   ///< settings of housekeeping threads
+  RoleSettings critical;       ///< settings of latency-critical threads
+  std::string origin{"none"};  ///< where the CPU sets come from: isolcpus, nohz_full, configured or none
+
+  /**
+   * @brief Gets the settings of a role.
+   * @param role The role.
+   * @return The settings.
+   */
+  [[nodiscard]] const RoleSettings& settings(ThreadRole role) const {
+    return role == ThreadRole::critical ? critical : housekeeping;
+  }
+
+  /**
+   * @brief Detects the partition from the isolated and the nohz_full CPUs of the kernel. The critical
+   * CPUs are the isolated ones, the housekeeping CPUs the other online CPUs.
+   * @param cpuSysfs The CPU directory in sysfs.
+   * @param cmdline The kernel command line, read if sysfs doesn't list isolated CPUs.
+   * @return The partition, without CPU sets if no CPU is isolated.
+   */
+  static ThreadPartition detect(const std::filesystem::path& cpuSysfs = "/sys/devices/system/cpu",
+                                const std::filesystem::path& cmdline = "/proc/cmdline");
+};
+
+/**
+ * @brief The ThreadRoles class assigns roles to the threads of the process and keeps the list of
+ * tagged threads for the log.
+ * @note The kernel doesn't balance threads across isolated CPUs. A critical role with several
+ * isolated CPUs therefore suits one thread per CPU, pinned inside the role.
+ */
+class ThreadRoles {
+ public:
+  /**
+   * @brief The information of a tagged thread.
+   */
+  struct ThreadInfo {
+    std::string name;   ///< thread name
+    ThreadRole role;    ///< role
+    pid_t tid;          ///< kernel thread id
+    std::string error;  ///< error of the settings, empty if applied
+  };
+
+  /**
+   * @brief Gets the roles of the process.
+   * @return The roles.
+   */
+  static ThreadRoles& instance();
+
+  /**
+   * @brief Sets the partition used for later assignments.
+   * @param partition The partition.
+   */
+  void configure(ThreadPartition partition);
+
+  /**
+   * @brief Gets the partition.
+   * @return The partition.
+   */
+  [[nodiscard]] ThreadPartition partition() const;
+
+  /**
+   * @brief Tags the calling thread, names it and applies the settings of its role.
+   * @param role The role.
+   * @param name The thread name, truncated to 15 characters by the kernel.
+   * @return The error of the settings, none if applied.
+   */
+  std::optional<std::string> assign(ThreadRole role, std::string_view name);
+
+  /**
+   * @brief Gets the tagged threads.
+   * @return The threads in the order of their assignment.
+   */
+  [[nodiscard]] std::vector<ThreadInfo> threads() const;
+
+ private:
+  mutable std::mutex m_mutex;         ///< guards the members
+  ThreadPartition m_partition;        ///< settings of the roles
+  std::vector<ThreadInfo> m_threads;  ///< tagged threads
+};
+
+}  // namespace app
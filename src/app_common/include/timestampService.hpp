@@ -0,0 +1,218 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the timestamp service for logs, metrics and point updates
+ * \ingroup Application Common
+ *
+ * Timestamps are nanoseconds on the CLOCK_MONOTONIC time line, so they compare with
+ * std::chrono::steady_clock and convert to wall-clock time on demand. Three modes trade precision
+ * for cost:
+ * - tsc: the invariant time stamp counter (x86) or the virtual counter (ARMv8), calibrated against
+ *   CLOCK_MONOTONIC and scaled with a multiply and shift.
+ * - vdso: clock_gettime(CLOCK_MONOTONIC), answered by the vDSO without a system call.
+ * - cached: the value the event loop stored with the last update(), a single load.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The source of the precise timestamps.
+ */
+enum class TimestampSource {
+  tsc,   ///< calibrated time stamp counter
+  vdso,  ///< clock_gettime through the vDSO
+};
+
+/**
+ * @brief Gets the name of a timestamp source.
+ * @param source The source.
+ * @return The name.
+ */
+std::string_view to_string(TimestampSource source);
+
+/**
+ * @brief The TimestampService class provides cheap monotonic timestamps.
+ *
+ * now() and cached() may be called from any thread. update() refreshes the cached timestamp and the
+ * conversion to wall-clock time; it is called by the event loop of a task. While the counter is used,
+ * update() also refines the calibration with the growing distance to the first calibration point and
+ * moves the conversion forward, never backwards, so successive timestamps of a thread stay ordered.
+ */
+class TimestampService {
+ public:
+  /**
+   * @brief Gets the service shared by the process, it uses the counter if it is invariant.
+   * @return The service.
+   */
+  static TimestampService& instance();
+
+  /**
+   * @brief constructor, calibrates the counter.
+   * @param preferred The preferred source, the vDSO is used if the counter is not invariant.
+   */
+  explicit TimestampService(TimestampSource preferred = TimestampSource::tsc);
+
+  TimestampService(const TimestampService&) = delete;
+  TimestampService& operator=(const TimestampService&) = delete;
+
+  /**
+   * @brief Gets the current monotonic timestamp.
+   * @return The time since the monotonic epoch.
+   */
+  [[nodiscard]] std::chrono::nanoseconds now() const {
+    if (m_source != TimestampSource::tsc) {
+      return monotonic_now();
+    }
+    auto ticks = read_ticks();
+    for (;;) {
+      auto sequence = m_sequence.load(std::memory_order_acquire);
+      auto baseTicks = m_baseTicks.load(std::memory_order_relaxed);
+      auto baseNs = m_baseNs.load(std::memory_order_relaxed);
+      auto mult = m_mult.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if ((sequence & 1) == 0 && m_sequence.load(std::memory_order_relaxed) == sequence) {
+        // ticks read before a concurrent update lie before the new base, hence the signed delta
+        return std::chrono::nanoseconds(baseNs + scale(static_cast<int64_t>(ticks - baseTicks), mult));
+      }
+    }
+  }
+
+  /**
+   * @brief Gets the timestamp of the last update().
+   * @return The time since the monotonic epoch, exact to the update interval of the event loop.
+   */
+  [[nodiscard]] std::chrono::nanoseconds cached() const {
+    return std::chrono::nanoseconds(m_cachedNs.load(std::memory_order_relaxed));
+  }
+
+  /**
+   * @brief Refreshes the cached timestamp, the wall-clock offset and the calibration.
+   * @return The new cached timestamp.
+   */
+  std::chrono::nanoseconds update();
+
+  /**
+   * @brief Converts a timestamp to a steady clock time point.
+   * @param timestamp The timestamp.
+   * @return The time point.
+   */
+  [[nodiscard]] static std::chrono::steady_clock::time_point to_steady(std::chrono::nanoseconds timestamp) {
+    return std::chrono::steady_clock::time_point(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(timestamp));
+  }
+
+  /**
+   * @brief Converts a timestamp to wall-clock time with the offset of the last update().
+   * @param timestamp The timestamp.
+   * @return The time point.
+   */
+  [[nodiscard]] std::chrono::system_clock::time_point to_system(std::chrono::nanoseconds timestamp) const {
+    auto wall = timestamp + std::chrono::nanoseconds(m_wallOffsetNs.load(std::memory_order_relaxed));
+    return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(wall));
+  }
+
+  /**
+   * @brief Gets the source of now().
+   * @return The source.
+   */
+  [[nodiscard]] TimestampSource source() const {
+    return m_source;
+  }
+
+  /**
+   * @brief Gets the calibrated counter frequency.
+   * @return The frequency in Hz, 0 without counter.
+   */
+  [[nodiscard]] double counter_hz() const;
+
+  /**
+   * @brief Checks if the CPU has a counter with constant rate in all power states.
+   * @return true if the counter is invariant.
+   */
+  static bool counter_invariant();
+
+  /**
+   * @brief Reads the monotonic clock through the vDSO.
+   * @return The time since the monotonic epoch.
+   */
+  static std::chrono::nanoseconds monotonic_now() {
+    timespec time{};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+  }
+
+  /**
+   * @brief Reads the counter.
+   * @return The counter value.
+   */
+  static uint64_t read_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return 0;
+#endif
+  }
+
+ private:
+  static constexpr int Shift = 32;  ///< fixed point of the multiplier
+
+  /**
+   * @brief Scales ticks to nanoseconds, (ticks * mult) >> Shift from 32-bit halves, so 32-bit
+   * targets without 128-bit integers get the same result.
+   * @param ticks The ticks, negative before the base.
+   * @param mult The nanoseconds per tick, shifted by Shift.
+   * @return The nanoseconds.
+   */
+  static int64_t scale(int64_t ticks, uint64_t mult) {
+    static_assert(Shift == 32, "the halves of the product are split at the fixed point");
+    auto magnitude = ticks < 0 ? uint64_t{0} - static_cast<uint64_t>(ticks) : static_cast<uint64_t>(ticks);
+    uint64_t high = magnitude >> 32;
+    uint64_t low = magnitude & UINT32_MAX;
+    uint64_t multHigh = mult >> 32;
+    uint64_t multLow = mult & UINT32_MAX;
+    auto ns = static_cast<int64_t>((high * multHigh << 32) + high * multLow + low * multHigh + (low * multLow >> 32));
+    return ticks < 0 ? -ns : ns;
+  }
+
+  void calibrate();
+
+  TimestampSource m_source;                ///< source of now()
+  std::atomic<uint32_t> m_sequence{0};     ///< odd while the conversion changes
+  std::atomic<uint64_t> m_baseTicks{0};    ///< counter value at the base timestamp
+  std::atomic<int64_t> m_baseNs{0};        ///< base timestamp of the conversion
+  std::atomic<uint64_t> m_mult{0};         ///< nanoseconds per tick, shifted by Shift
+  std::atomic<int64_t> m_cachedNs{0};      ///< timestamp of the last update
+  std::atomic<int64_t> m_wallOffsetNs{0};  ///< wall-clock time minus monotonic time
+  uint64_t m_firstTicks{0};                ///< counter value of the first calibration point
+  int64_t m_firstNs{0};                    ///< timestamp of the first calibration point
+  std::atomic<int64_t> m_calibratedNs{0};  ///< timestamp of the last calibration
+};
+
+}  // namespace app
@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the traffic capture writer and reader
+ * \ingroup Application Common
+ *
+ * The capture file starts with a 16 byte header: magic "DCAP", 16-bit format version,
+ * 16-bit reserved field and the wall-clock start time in nanoseconds since epoch.
+ * Each record follows as LEB128 varints: delta time in nanoseconds to the previous record,
+ * endpoint id, session id, payload length, followed by the payload bytes.
+ * All fixed-size fields are little-endian.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief One received chunk of bytes recorded in a capture file.
+ */
+struct CaptureRecord {
+  std::chrono::nanoseconds timestamp{0};  ///< time since the start of the capture
+  uint32_t endpoint{0};                   ///< endpoint id the bytes were received on
+  uint32_t session{0};                    ///< session (connection or peer) id within the endpoint
+  std::span<const std::byte> payload;     ///< received bytes
+};
+
+/**
+ * @brief The TrafficCaptureWriter class records received bytes with timestamps into a capture file.
+ * @note The writer is thread-safe, so several endpoints may record into the same file.
+ */
+class TrafficCaptureWriter {
+ public:
+  static constexpr uint32_t Magic = 0x50414344;  ///< "DCAP" in little-endian byte order
+  static constexpr uint16_t Version = 1;         ///< format version
+  static constexpr size_t HeaderSize = 16;       ///< size of the file header
+
+  /// constructor
+  TrafficCaptureWriter() = default;
+
+  /// destructor flushes and closes the file
+  ~TrafficCaptureWriter();
+
+  TrafficCaptureWriter(const TrafficCaptureWriter&) = delete;
+  TrafficCaptureWriter& operator=(const TrafficCaptureWriter&) = delete;
+
+  /**
+   * @brief Creates the capture file and writes the header.
+   * @param path The path of the capture file.
+   * @return true if the file is created, otherwise false.
+   */
+  [[nodiscard]] bool open(const std::filesystem::path& path);
+
+  /**
+   * @brief Flushes the buffered records and closes the file.
+   */
+  void close();
+
+  /**
+   * @brief Checks if the capture file is open.
+   * @return true if open, otherwise false.
+   */
+  [[nodiscard]] bool is_open() const;
+
+  /**
+   * @brief Records received bytes with the current timestamp.
+   * @param endpoint The endpoint id.
+   * @param session The session id within the endpoint.
+   * @param data The received bytes.
+   */
+  void record(uint32_t endpoint, uint32_t session, std::span<const std::byte> data);
+
+  /**
+   * @brief Writes buffered records to the file.
+   */
+  void flush();
+
+  /**
+   * @brief Gets the number of recorded records.
+   * @return The number of records.
+   */
+  [[nodiscard]] uint64_t records() const;
+
+  /**
+   * @brief Gets the number of recorded payload bytes.
+   * @return The number of payload bytes.
+   */
+  [[nodiscard]] uint64_t bytes() const;
+
+ private:
+  void flush_locked();
+
+  static constexpr size_t FlushThreshold = 64 * 1024;  ///< buffered bytes before writing to the file
+
+  mutable std::mutex m_mutex;                         ///< protects all members
+  int m_fd{-1};                                       ///< capture file descriptor
+  std::vector<uint8_t> m_buffer;                      ///< buffered, not yet written records
+  std::chrono::steady_clock::time_point m_start;      ///< monotonic start time of the capture
+  std::chrono::nanoseconds m_last{0};                 ///< timestamp of the last record
+  uint64_t m_records{0};                              ///< number of records
+  uint64_t m_bytes{0};                                ///< number of payload bytes
+};
+
+/**
+ * @brief The TrafficCaptureReader class iterates the records of a capture file without copying payloads.
+ */
+class TrafficCaptureReader {
+ public:
+  /// constructor
+  TrafficCaptureReader() = default;
+
+  /// destructor unmaps the file
+  ~TrafficCaptureReader();
+
+  TrafficCaptureReader(const TrafficCaptureReader&) = delete;
+  TrafficCaptureReader& operator=(const TrafficCaptureReader&) = delete;
+
+  /**
+   * @brief Maps the capture file and validates the header.
+   * @param path The path of the capture file.
+   * @return true if the file is a valid capture, otherwise false.
+   */
+  [[nodiscard]] bool open(const std::filesystem::path& path);
+
+  /**
+   * @brief Unmaps the capture file.
+   */
+  void close();
+
+  /**
+   * @brief Gets the next record. The payload refers to the mapped file and stays valid until close().
+   * @return The record or std::nullopt at the end of the file or on a truncated record.
+   */
+  [[nodiscard]] std::optional<CaptureRecord> next();
+
+  /**
+   * @brief Restarts the iteration at the first record.
+   */
+  void rewind();
+
+  /**
+   * @brief Checks if the iteration stopped at a truncated or malformed record.
+   * @return true if the capture is truncated, otherwise false.
+   */
+  [[nodiscard]] bool is_truncated() const {
+    return m_truncated;
+  }
+
+  /**
+   * @brief Gets the wall-clock time the capture was started.
+   * @return The start time.
+   */
+  [[nodiscard]] std::chrono::system_clock::time_point start_time() const {
+    return m_startTime;
+  }
+
+ private:
+  const std::byte* m_data{nullptr};                  ///< mapped file
+  size_t m_size{0};                                  ///< size of the mapped file
+  size_t m_offset{0};                                ///< offset of the next record
+  std::chrono::nanoseconds m_last{0};                ///< timestamp of the previous record
+  std::chrono::system_clock::time_point m_startTime; ///< wall-clock start time
+  bool m_truncated{false};                           ///< stopped at a malformed record
+};
+
+}  // namespace app
@@ -0,0 +1,303 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "addressMap.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+
+#include "textParsing.hpp"
+// clang-format on
+
+namespace {
+constexpr uint64_t DenseSpread = 2;                      ///< largest range of a dense map per mapping
+constexpr uint32_t BucketSize = 4;                       ///< average addresses per bucket of the perfect hash
+constexpr uint32_t SpareSlots = 50;                      ///< one spare slot per this many addresses
+constexpr uint32_t MaxPilot = 0xFFFF;                    ///< largest pilot of a bucket
+constexpr uint64_t MaxSeeds = 16;                        ///< seeds tried before the compiler gives up
+constexpr uint64_t AddressMask = 0x00FF'FFFF'FFFF'FFFF;  ///< address bits below the space
+
+/**
+ * @brief Parses the two numbers of "first.second".
+ * @param text The text.
+ * @param first Receives the first number.
+ * @param second Receives the second number.
+ * @return true if both are numbers, otherwise false.
+ */
+bool parse_pair(std::string_view text, uint64_t& first, uint64_t& second) {
+  auto dot = text.find('.');
+  return dot != std::string_view::npos && app::parse_number(text.substr(0, dot), first) &&
+         app::parse_number(text.substr(dot + 1), second);
+}
+}  // namespace
+
+/**
+ * @brief Builds the source address of an object reference from a 56-bit hash of the text. The
+ * compiler rejects a map in which two references collide.
+ * @param reference The object reference, f.e. "LD0/MMXU1.TotW.mag.f".
+ * @return The source address.
+ */
+uint64_t app::make_reference_address(std::string_view reference) {
+  // FNV-1a, folded to the address bits
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (auto c : reference) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001B3ULL;
+  }
+  return make_address(AddressSpace::reference, (hash ^ (hash >> 56)) & AddressMask);
+}
+
+/**
+ * @brief Parses a source address of a mapping file.
+ * @param text The address: a number, "ioa:ca.ioa", "mb:unit.register" or "ref:reference".
+ * @return The source address or std::nullopt if the text is invalid.
+ */
+std::optional<uint64_t> app::parse_address(std::string_view text) {
+  uint64_t first{0};
+  uint64_t second{0};
+  if (text.starts_with("ioa:")) {
+    // common address of 16 bits, IOA of 24 bits
+    if (!parse_pair(text.substr(4), first, second) || first > 0xFFFF || second > 0xFFFFFF) {
+      return std::nullopt;
+    }
+    return make_address(AddressSpace::iec104, (first << 24) | second);
+  }
+  if (text.starts_with("mb:")) {
+    if (!parse_pair(text.substr(3), first, second) || first > 0xFF || second > 0xFFFF) {
+      return std::nullopt;
+    }
+    return make_address(AddressSpace::modbus, (first << 16) | second);
+  }
+  if (text.starts_with("ref:")) {
+    return text.size() > 4 ? std::optional(make_reference_address(text.substr(4))) : std::nullopt;
+  }
+  if (!parse_number(text, first) || first > AddressMask) {
+    return std::nullopt;
+  }
+  return make_address(AddressSpace::raw, first);
+}
+
+/**
+ * @brief Gets the name of an address map layout.
+ * @param layout The layout.
+ * @return The name.
+ */
+std::string_view app::to_string(AddressMapLayout layout) {
+  switch (layout) {
+    case AddressMapLayout::empty:
+      return "empty";
+    case AddressMapLayout::dense:
+      return "dense";
+    case AddressMapLayout::perfectHash:
+      return "perfect hash";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Compiles the mappings into the layout that suits their source addresses.
+ * @param mappings The mappings.
+ * @return true if compiled, otherwise false with last_error(); the map is empty then.
+ */
+bool app::AddressMap::compile(std::span<const AddressMapping> mappings) {
+  clear();
+  m_error.clear();
+  if (mappings.empty()) {
+    return true;
+  }
+  if (mappings.size() > UINT32_MAX / 2) {
+    return fail("too many mappings");
+  }
+
+  std::vector<uint64_t> sources(mappings.size());
+  std::transform(mappings.begin(), mappings.end(), sources.begin(), [](const auto& m) { return m.source; });
+  std::sort(sources.begin(), sources.end());
+  if (auto duplicate = std::adjacent_find(sources.begin(), sources.end()); duplicate != sources.end()) {
+    return fail("duplicate source address " + std::to_string(*duplicate));
+  }
+  if (sources.back() == NoSource) {
+    return fail("invalid source address " + std::to_string(NoSource));
+  }
+
+  m_size = mappings.size();
+  bool compiled = sources.back() - sources.front() < DenseSpread * mappings.size()
+                      ? compile_dense(mappings, sources.front(), sources.back())
+                      : compile_perfect_hash(mappings);
+  if (!compiled) {
+    clear();
+  }
+  return compiled;
+}
+
+/**
+ * @brief Places every mapping at its source address minus the first one.
+ * @param mappings The mappings.
+ * @param first The smallest source address.
+ * @param last The largest source address.
+ * @return true.
+ */
+bool app::AddressMap::compile_dense(std::span<const AddressMapping> mappings, uint64_t first, uint64_t last) {
+  AddressMapping unused;
+  unused.source = NoSource;
+  m_entries.assign(last - first + 1, unused);
+  for (const auto& mapping : mappings) {
+    m_entries[mapping.source - first] = mapping;
+  }
+  m_base = first;
+  m_layout = AddressMapLayout::dense;
+  return true;
+}
+
+/**
+ * @brief Builds the perfect hash: the addresses are distributed into buckets, the buckets are
+ * placed from the largest to the smallest, each with the first pilot that moves all of its
+ * addresses into free slots.
+ * @param mappings The mappings.
+ * @return true if a seed led to a placement, otherwise false.
+ */
+bool app::AddressMap::compile_perfect_hash(std::span<const AddressMapping> mappings) {
+  const auto count = static_cast<uint32_t>(mappings.size());
+  m_buckets = count / BucketSize + 1;
+  m_slots = count + count / SpareSlots + 1;
+
+  std::vector<uint64_t> hashes(count);
+  std::vector<uint32_t> bucketStart(m_buckets + 1);
+  std::vector<uint32_t> members(count);
+  std::vector<uint32_t> order(m_buckets);
+  std::vector<uint64_t> taken((m_slots + 63) / 64);
+  std::vector<uint32_t> positions;
+
+  for (uint64_t attempt = 0; attempt < MaxSeeds; ++attempt) {
+    m_seed = hash_address(attempt, 0x5EED);
+    // counting sort of the addresses by bucket
+    std::fill(bucketStart.begin(), bucketStart.end(), 0);
+    for (uint32_t i = 0; i < count; ++i) {
+      hashes[i] = hash_address(mappings[i].source, m_seed);
+      bucketStart[reduce(hashes[i] >> 32, m_buckets) + 1]++;
+    }
+    std::partial_sum(bucketStart.begin(), bucketStart.end(), bucketStart.begin());
+    std::vector<uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+    for (uint32_t i = 0; i < count; ++i) {
+      members[fill[reduce(hashes[i] >> 32, m_buckets)]++] = i;
+    }
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      return bucketStart[a + 1] - bucketStart[a] > bucketStart[b + 1] - bucketStart[b];
+    });
+
+    m_pilots.assign(m_buckets, 0);
+    std::fill(taken.begin(), taken.end(), 0);
+    bool placed = true;
+    for (auto bucket : order) {
+      auto first = bucketStart[bucket];
+      auto size = bucketStart[bucket + 1] - first;
+      if (size == 0) {
+        break;
+      }
+      bool found = false;
+      for (uint32_t pilot = 0; pilot <= MaxPilot && !found; ++pilot) {
+        positions.clear();
+        found = true;
+        for (uint32_t i = 0; i < size && found; ++i) {
+          auto position = slot(hashes[members[first + i]], static_cast<uint16_t>(pilot));
+          found = (taken[position / 64] & (uint64_t{1} << (position % 64))) == 0 &&
+                  std::find(positions.begin(), positions.end(), position) == positions.end();
+          positions.push_back(position);
+        }
+        if (found) {
+          m_pilots[bucket] = static_cast<uint16_t>(pilot);
+          for (auto position : positions) {
+            taken[position / 64] |= uint64_t{1} << (position % 64);
+          }
+        }
+      }
+      if (!found) {
+        placed = false;
+        break;
+      }
+    }
+    if (!placed) {
+      continue;
+    }
+
+    AddressMapping unused;
+    unused.source = NoSource;
+    m_entries.assign(m_slots, unused);
+    for (uint32_t i = 0; i < count; ++i) {
+      auto pilot = m_pilots[reduce(hashes[i] >> 32, m_buckets)];
+      m_entries[slot(hashes[i], pilot)] = mappings[i];
+    }
+    m_layout = AddressMapLayout::perfectHash;
+    return true;
+  }
+  return fail("no perfect hash found for " + std::to_string(count) + " addresses");
+}
+
+/**
+ * @brief Parses a mapping file and compiles it.
+ * @param path The mapping file.
+ * @return true if loaded, otherwise false with last_error(); the map is empty then.
+ */
+bool app::AddressMap::load(const std::filesystem::path& path) {
+  std::ifstream file(path);
+  if (!file) {
+    clear();
+    return fail("can't open " + path.string());
+  }
+  std::vector<AddressMapping> mappings;
+  std::string line;
+  for (size_t number = 1; std::getline(file, line); ++number) {
+    auto tokens = split_tokens(std::string_view(line).substr(0, line.find('#')));
+    if (tokens.empty()) {
+      continue;
+    }
+    AddressMapping mapping;
+    auto source = tokens.size() >= 2 ? parse_address(tokens[0]) : std::nullopt;
+    bool valid = source.has_value() && parse_number(tokens[1], mapping.destination);
+    if (valid && tokens.size() >= 3 && tokens[2] == "bit") {
+      mapping.transform = AddressTransform::bit;
+      valid = tokens.size() == 4 && parse_number(tokens[3], mapping.bit) && mapping.bit < 64;
+    } else if (valid && tokens.size() >= 3 && tokens[2] == "invert") {
+      mapping.transform = AddressTransform::invert;
+      valid = tokens.size() == 3;
+    } else if (valid) {
+      valid = tokens.size() <= 4 && (tokens.size() < 3 || parse_number(tokens[2], mapping.scale)) &&
+              (tokens.size() < 4 || parse_number(tokens[3], mapping.offset));
+    }
+    if (!valid) {
+      clear();
+      return fail(path.string() + ":" + std::to_string(number) + ": invalid mapping \"" + line + "\"");
+    }
+    mapping.source = *source;
+    mappings.push_back(mapping);
+  }
+  return compile(mappings);
+}
+
+/**
+ * @brief Removes all mappings.
+ */
+void app::AddressMap::clear() {
+  m_entries.clear();
+  m_pilots.clear();
+  m_layout = AddressMapLayout::empty;
+  m_base = 0;
+  m_size = 0;
+}
+
+/**
+ * @brief Sets the reason of a failure.
+ * @param error The reason.
+ * @return Always false.
+ */
+bool app::AddressMap::fail(std::string error) {
+  m_error = std::move(error);
+  return false;
+}
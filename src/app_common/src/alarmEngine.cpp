@@ -0,0 +1,390 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "alarmEngine.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <fstream>
+#include <utility>
+
+#include "cpuDispatch.hpp"
+#include "textParsing.hpp"
+// clang-format on
+
+namespace {
+constexpr size_t LaneBlock = 4;  ///< a batch is padded to a multiple of this many lanes
+
+/**
+ * @brief The gathered lanes of a batch.
+ */
+struct AlarmLanes {
+  alignas(64) std::array<double, app::AlarmEngine::Lanes> value;     ///< values of the points
+  alignas(64) std::array<double, app::AlarmEngine::Lanes> highHigh;  ///< high-high limits
+  alignas(64) std::array<double, app::AlarmEngine::Lanes> high;      ///< high limits
+  alignas(64) std::array<double, app::AlarmEngine::Lanes> low;       ///< low limits
+  alignas(64) std::array<double, app::AlarmEngine::Lanes> lowLow;    ///< low-low limits
+  alignas(64) std::array<double, app::AlarmEngine::Lanes> deadband;  ///< deadbands
+  alignas(64) std::array<double, app::AlarmEngine::Lanes> current;   ///< current levels
+  alignas(64) std::array<double, app::AlarmEngine::Lanes> next;      ///< computed levels
+};
+
+/// Computes the levels of the gathered lanes
+using ComputeLevels = void(AlarmLanes& lanes, size_t count);
+
+/**
+ * @brief Computes the levels of the gathered lanes, inlined into a variant per level.
+ * @param lanes The lanes.
+ * @param count The number of lanes, a multiple of LaneBlock.
+ */
+__attribute__((always_inline)) inline void compute_levels(AlarmLanes& lanes, size_t count) {
+  // a side rises to the limits the value reached and falls only to the limits it left by the deadband
+  for (size_t i = 0; i < count; ++i) {
+    double v = lanes.value[i];
+    double up = (v >= lanes.highHigh[i] ? 1.0 : 0.0) + (v >= lanes.high[i] ? 1.0 : 0.0);
+    double holdUp =
+        (v > lanes.highHigh[i] - lanes.deadband[i] ? 1.0 : 0.0) + (v > lanes.high[i] - lanes.deadband[i] ? 1.0 : 0.0);
+    double down = (v <= lanes.lowLow[i] ? 1.0 : 0.0) + (v <= lanes.low[i] ? 1.0 : 0.0);
+    double holdDown =
+        (v < lanes.lowLow[i] + lanes.deadband[i] ? 1.0 : 0.0) + (v < lanes.low[i] + lanes.deadband[i] ? 1.0 : 0.0);
+    double upper = std::max(up, std::min(std::max(lanes.current[i], 0.0), holdUp));
+    double lower = std::max(down, std::min(std::max(-lanes.current[i], 0.0), holdDown));
+    lanes.next[i] = upper > 0.0 ? upper : -lower;
+  }
+}
+
+/**
+ * @brief Computes the levels with the instructions of the baseline, SSE2 on x86-64 and Advanced
+ * SIMD on ARMv8.
+ * @param lanes The lanes.
+ * @param count The number of lanes.
+ */
+void compute_levels_scalar(AlarmLanes& lanes, size_t count) {
+  compute_levels(lanes, count);
+}
+
+#if defined(__x86_64__)
+/**
+ * @brief Computes the levels four lanes per instruction.
+ * @param lanes The lanes.
+ * @param count The number of lanes.
+ */
+__attribute__((target("avx2,fma"))) void compute_levels_avx2(AlarmLanes& lanes, size_t count) {
+  compute_levels(lanes, count);
+}
+
+/**
+ * @brief Computes the levels eight lanes per instruction, the comparisons into mask registers.
+ * @param lanes The lanes.
+ * @param count The number of lanes.
+ */
+__attribute__((target("avx512f,avx512dq,avx512vl"))) void compute_levels_avx512(AlarmLanes& lanes, size_t count) {
+  compute_levels(lanes, count);
+}
+#endif
+
+ComputeLevels* g_computeLevels = compute_levels_scalar;  ///< bound variant
+
+/// Registers the variants with the dispatch
+[[maybe_unused]] const bool ComputeLevelsRegistered = [] {
+  app::CpuDispatch::instance().add_kernel<ComputeLevels>("alarm levels", g_computeLevels,
+                                                         {{app::CpuLevel::scalar, compute_levels_scalar},
+#if defined(__x86_64__)
+                                                          {app::CpuLevel::avx2, compute_levels_avx2},
+                                                          {app::CpuLevel::avx512, compute_levels_avx512},
+#endif
+                                                         });
+  return true;
+}();
+}  // namespace
+
+/**
+ * @brief Gets the name of an alarm level.
+ * @param level The level.
+ * @return The name.
+ */
+std::string_view app::to_string(AlarmLevel level) {
+  switch (level) {
+    case AlarmLevel::lowLow:
+      return "LL";
+    case AlarmLevel::low:
+      return "L";
+    case AlarmLevel::normal:
+      return "normal";
+    case AlarmLevel::high:
+      return "H";
+    case AlarmLevel::highHigh:
+      return "HH";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Reserves the arrays for a number of points, all without limits and normal.
+ * @param points The number of points.
+ */
+void app::AlarmEngine::reserve(size_t points) {
+  const auto words = (points + 63) / 64;
+  m_alarms.assign(points, PointAlarm());
+  m_enabled.assign(words, 0);
+  m_latching.assign(words, 0);
+  m_latched.assign(words, 0);
+  m_pending.assign(words, 0);
+  m_events.clear();
+  m_configured = 0;
+  m_evaluated = 0;
+}
+
+/**
+ * @brief Sets the limits of a point and resets its alarm to normal.
+ * @param point The point, less than the reserved points.
+ * @param limits The limits.
+ * @return true if set, false if the limits aren't ordered LL <= L < H <= HH or the deadband is
+ * negative.
+ */
+bool app::AlarmEngine::configure(size_t point, const AlarmLimits& limits) {
+  if (!(limits.lowLow <= limits.low && limits.low < limits.high && limits.high <= limits.highHigh) ||
+      !(limits.deadband >= 0.0) || limits.delay.count() < 0) {
+    return false;
+  }
+  bool enabled = std::isfinite(limits.highHigh) || std::isfinite(limits.high) || std::isfinite(limits.low) ||
+                 std::isfinite(limits.lowLow);
+  bool wasEnabled = (m_enabled[point / 64] >> (point % 64) & 1) != 0;
+  m_configured = m_configured - (wasEnabled ? 1 : 0) + (enabled ? 1 : 0);
+  auto& alarm = m_alarms[point];
+  alarm.highHigh = limits.highHigh;
+  alarm.high = limits.high;
+  alarm.low = limits.low;
+  alarm.lowLow = limits.lowLow;
+  alarm.deadband = limits.deadband;
+  alarm.delay = std::chrono::duration_cast<std::chrono::nanoseconds>(limits.delay).count();
+  alarm.level = 0;
+  set_bit(m_enabled, point, enabled);
+  set_bit(m_latching, point, limits.latching);
+  set_bit(m_latched, point, false);
+  set_bit(m_pending, point, false);
+  return true;
+}
+
+/**
+ * @brief Parses an alarm file and configures its points, the other points have no limits.
+ * @param path The alarm file.
+ * @return true if loaded, otherwise false with last_error(); no point is configured then.
+ */
+bool app::AlarmEngine::load(const std::filesystem::path& path) {
+  const auto points = m_alarms.size();
+  reserve(points);
+  std::ifstream file(path);
+  if (!file) {
+    return fail("can't open " + path.string());
+  }
+  std::vector<std::pair<size_t, AlarmLimits>> configurations;
+  std::string line;
+  for (size_t number = 1; std::getline(file, line); ++number) {
+    auto tokens = split_tokens(std::string_view(line).substr(0, line.find('#')));
+    if (tokens.empty()) {
+      continue;
+    }
+    size_t point{0};
+    AlarmLimits limits;
+    bool valid = parse_number(tokens[0], point) && point < points;
+    for (size_t i = 1; i < tokens.size() && valid; ++i) {
+      auto equal = tokens[i].find('=');
+      auto key = tokens[i].substr(0, equal);
+      auto value = equal == std::string_view::npos ? std::string_view() : tokens[i].substr(equal + 1);
+      int64_t delay{0};
+      if (key == "latch") {
+        limits.latching = equal == std::string_view::npos;
+        valid = limits.latching;
+      } else if (key == "delay") {
+        valid = parse_number(value, delay) && delay >= 0;
+        limits.delay = std::chrono::milliseconds(delay);
+      } else {
+        double* target = key == "hh" ? &limits.highHigh : key == "h" ? &limits.high : key == "l" ? &limits.low
+                         : key == "ll" ? &limits.lowLow : key == "deadband" ? &limits.deadband : nullptr;
+        valid = target != nullptr && parse_number(value, *target);
+      }
+    }
+    if (!valid) {
+      reserve(points);
+      return fail(path.string() + ":" + std::to_string(number) + ": invalid alarm \"" + line + "\"");
+    }
+    configurations.emplace_back(point, limits);
+  }
+  for (const auto& [point, limits] : configurations) {
+    if (!configure(point, limits)) {
+      reserve(points);
+      return fail(path.string() + ": the limits of point " + std::to_string(point) + " aren't ordered");
+    }
+  }
+  m_error.clear();
+  return true;
+}
+
+/**
+ * @brief Evaluates the changed points and the points with a delayed change pending, then
+ * delivers the transitions and acknowledgements to the subscribers.
+ * @param points The point database, at least the reserved points. The changed bits are read,
+ * the owner clears them after it consumed them.
+ * @param now The time in nanoseconds since epoch, for the delays.
+ * @return The number of transitions.
+ */
+size_t app::AlarmEngine::evaluate(const PointDatabase& points, int64_t now) {
+  auto changed = points.changed();
+  const auto acknowledgements = m_events.size();
+  std::array<uint32_t, Lanes> batch;
+  size_t count{0};
+  for (size_t word = 0; word < m_enabled.size(); ++word) {
+    for (auto bits = (changed[word] | m_pending[word]) & m_enabled[word]; bits != 0; bits &= bits - 1) {
+      batch[count++] = static_cast<uint32_t>(word * 64 + static_cast<size_t>(std::countr_zero(bits)));
+      if (count == Lanes) {
+        evaluate_batch(batch, points, now);
+        count = 0;
+      }
+    }
+  }
+  if (count > 0) {
+    evaluate_batch(std::span(batch.data(), count), points, now);
+  }
+
+  auto transitions = m_events.size() - acknowledgements;
+  if (!m_events.empty()) {
+    for (const auto& subscriber : m_subscribers) {
+      if (subscriber) {
+        subscriber(m_events);
+      }
+    }
+    m_events.clear();
+  }
+  return transitions;
+}
+
+/**
+ * @brief Computes the levels of a batch of points and takes the transitions.
+ * @param batch The points, at most Lanes.
+ * @param points The point database.
+ * @param now The time in nanoseconds since epoch.
+ */
+void app::AlarmEngine::evaluate_batch(std::span<const uint32_t> batch, const PointDatabase& points, int64_t now) {
+  // the gathered lanes are contiguous, the padding repeats the first point
+  AlarmLanes lanes;
+  const size_t count = (batch.size() + LaneBlock - 1) / LaneBlock * LaneBlock;
+  const double* values = points.values().data();
+  for (size_t i = 0; i < count; ++i) {
+    auto point = batch[i < batch.size() ? i : 0];
+    const auto& alarm = m_alarms[point];
+    lanes.value[i] = values[point];
+    lanes.highHigh[i] = alarm.highHigh;
+    lanes.high[i] = alarm.high;
+    lanes.low[i] = alarm.low;
+    lanes.lowLow[i] = alarm.lowLow;
+    lanes.deadband[i] = alarm.deadband;
+    lanes.current[i] = alarm.level;
+  }
+  g_computeLevels(lanes, count);
+
+  auto timestamps = points.timestamps();
+  for (size_t i = 0; i < batch.size(); ++i) {
+    auto point = batch[i];
+    auto& alarm = m_alarms[point];
+    auto level = static_cast<int8_t>(lanes.next[i]);
+    bool pending = (m_pending[point / 64] >> (point % 64) & 1) != 0;
+    if (level == alarm.level) {
+      // the value returned before the delay elapsed
+      if (pending) {
+        set_bit(m_pending, point, false);
+      }
+      continue;
+    }
+    auto timestamp = timestamps[point];
+    if (alarm.delay > 0) {
+      if (!pending || alarm.pendingLevel != level) {
+        set_bit(m_pending, point, true);
+        alarm.pendingLevel = level;
+        alarm.pendingSince = now;
+        continue;
+      }
+      if (now - alarm.pendingSince < alarm.delay) {
+        continue;
+      }
+      set_bit(m_pending, point, false);
+      timestamp = now;
+    }
+    if (level != 0 && (m_latching[point / 64] >> (point % 64) & 1) != 0) {
+      set_bit(m_latched, point, true);
+    }
+    m_events.push_back({point, static_cast<AlarmLevel>(alarm.level), static_cast<AlarmLevel>(level),
+                        is_latched(point), lanes.value[i], timestamp});
+    alarm.level = level;
+  }
+  m_evaluated += batch.size();
+}
+
+/**
+ * @brief Acknowledges a latched alarm, the subscribers get the acknowledgement with the
+ * transitions of the next evaluate().
+ * @param point The point.
+ * @param now The time in nanoseconds since epoch.
+ * @return true if the alarm was latched, otherwise false.
+ */
+bool app::AlarmEngine::acknowledge(size_t point, int64_t now) {
+  if (point >= m_alarms.size() || !is_latched(point)) {
+    return false;
+  }
+  set_bit(m_latched, point, false);
+  // acknowledgements precede the transitions of the next tick
+  auto level = static_cast<AlarmLevel>(m_alarms[point].level);
+  m_events.push_back({static_cast<uint32_t>(point), level, level, false, 0.0, now});
+  return true;
+}
+
+/**
+ * @brief Adds a subscriber of the transitions.
+ * @param subscriber The subscriber.
+ * @return The identifier of the subscription.
+ */
+size_t app::AlarmEngine::subscribe(Subscriber subscriber) {
+  m_subscribers.push_back(std::move(subscriber));
+  return m_subscribers.size() - 1;
+}
+
+/**
+ * @brief Removes a subscriber.
+ * @param id The identifier of the subscription.
+ */
+void app::AlarmEngine::unsubscribe(size_t id) {
+  if (id < m_subscribers.size()) {
+    // the identifiers of the other subscriptions stay valid
+    m_subscribers[id] = nullptr;
+  }
+}
+
+/**
+ * @brief Sets or clears the bit of a point.
+ * @param bits The bits.
+ * @param point The point.
+ * @param value The value of the bit.
+ */
+void app::AlarmEngine::set_bit(std::vector<uint64_t>& bits, size_t point, bool value) {
+  auto mask = uint64_t{1} << (point % 64);
+  bits[point / 64] = value ? bits[point / 64] | mask : bits[point / 64] & ~mask;
+}
+
+/**
+ * @brief Sets the reason of a failure.
+ * @param error The reason.
+ * @return Always false.
+ */
+bool app::AlarmEngine::fail(std::string error) {
+  m_error = std::move(error);
+  return false;
+}
@@ -0,0 +1,397 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "berCodec.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+// clang-format on
+
+namespace {
+constexpr uint8_t ExponentWidthSingle = 8;               ///< FloatingPoint of MMS in single precision
+constexpr uint8_t ExponentWidthDouble = 11;              ///< FloatingPoint of MMS in double precision
+constexpr int64_t NanosecondsPerSecond = 1'000'000'000;  ///< scale of the UtcTime seconds
+
+/**
+ * @brief Reverses the bit order of an octet: BER strings start with the most significant bit.
+ * @param octet The octet.
+ * @return The reversed octet.
+ */
+constexpr uint8_t reverse_bits(uint8_t octet) {
+  octet = static_cast<uint8_t>(((octet & 0xF0) >> 4) | ((octet & 0x0F) << 4));
+  octet = static_cast<uint8_t>(((octet & 0xCC) >> 2) | ((octet & 0x33) << 2));
+  return static_cast<uint8_t>(((octet & 0xAA) >> 1) | ((octet & 0x55) << 1));
+}
+
+/**
+ * @brief Reads a big-endian unsigned integer.
+ * @param data The octets, at most eight.
+ * @return The value.
+ */
+uint64_t get_big_endian(std::span<const std::byte> data) {
+  uint64_t value{0};
+  for (auto octet : data) {
+    value = (value << 8) | std::to_integer<uint8_t>(octet);
+  }
+  return value;
+}
+
+/**
+ * @brief Gets the number of octets of a value without leading zero octets.
+ * @param value The value.
+ * @return The number of octets, at least one.
+ */
+size_t octets_of(uint64_t value) {
+  return value == 0 ? 1 : static_cast<size_t>((std::bit_width(value) + 7) / 8);
+}
+}  // namespace
+
+/**
+ * @brief Gets the name of a BER error.
+ * @param error The error.
+ * @return The name.
+ */
+std::string_view app::to_string(BerError error) {
+  switch (error) {
+    case BerError::none:
+      return "none";
+    case BerError::truncated:
+      return "truncated";
+    case BerError::tag:
+      return "tag too long";
+    case BerError::length:
+      return "length too long";
+    case BerError::indefinite:
+      return "indefinite length";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Checks if the contents are a sequence of elements.
+ * @return true for constructed contents, otherwise false.
+ */
+bool app::BerElement::is_constructed() const {
+  auto first = tag;
+  while (first > 0xFF) {
+    first >>= 8;
+  }
+  return (first & 0x20) != 0;
+}
+
+/**
+ * @brief Decodes a BOOLEAN.
+ * @param result Receives the value.
+ * @return false if the contents are not one octet.
+ */
+bool app::BerElement::to_boolean(bool& result) const {
+  if (value.size() != 1) {
+    return false;
+  }
+  result = std::to_integer<uint8_t>(value[0]) != 0;
+  return true;
+}
+
+/**
+ * @brief Decodes an INTEGER in two's complement.
+ * @param result Receives the value.
+ * @return false if the contents are empty or longer than eight octets.
+ */
+bool app::BerElement::to_integer(int64_t& result) const {
+  if (value.empty() || value.size() > 8) {
+    return false;
+  }
+  // the first octet carries the sign, the shifts fill in the others
+  auto unsignedValue = static_cast<uint64_t>(static_cast<int64_t>(std::to_integer<int8_t>(value[0])));
+  for (auto octet : value.subspan(1)) {
+    unsignedValue = (unsignedValue << 8) | std::to_integer<uint8_t>(octet);
+  }
+  result = static_cast<int64_t>(unsignedValue);
+  return true;
+}
+
+/**
+ * @brief Decodes an unsigned INTEGER, such as Unsigned of MMS, with an optional leading zero octet.
+ * @param result Receives the value.
+ * @return false if the contents are empty, negative or don't fit 64 bits.
+ */
+bool app::BerElement::to_unsigned(uint64_t& result) const {
+  if (value.empty() || (std::to_integer<uint8_t>(value[0]) & 0x80) != 0) {
+    return false;
+  }
+  auto octets = value;
+  if (octets.size() == 9 && std::to_integer<uint8_t>(octets[0]) == 0) {
+    octets = octets.subspan(1);
+  }
+  if (octets.size() > 8) {
+    return false;
+  }
+  result = get_big_endian(octets);
+  return true;
+}
+
+/**
+ * @brief Decodes a BIT STRING of at most 64 bits. Bit 0 of the result is the first bit of the
+ * string, as in the quality and option fields of IEC 61850.
+ * @param bits Receives the bits.
+ * @param count Receives the number of bits.
+ * @return false if the contents are empty, the unused bits exceed 7 or the string is longer.
+ */
+bool app::BerElement::to_bit_string(uint64_t& bits, size_t& count) const {
+  if (value.empty() || value.size() > 9) {
+    return false;
+  }
+  size_t unused = std::to_integer<uint8_t>(value[0]);
+  size_t octets = value.size() - 1;
+  if (unused > 7 || (octets == 0 && unused != 0)) {
+    return false;
+  }
+  bits = 0;
+  for (size_t i = 0; i < octets; ++i) {
+    bits |= static_cast<uint64_t>(reverse_bits(std::to_integer<uint8_t>(value[1 + i]))) << (8 * i);
+  }
+  count = octets * 8 - unused;
+  if (count < 64) {
+    bits &= (uint64_t{1} << count) - 1;
+  }
+  return true;
+}
+
+/**
+ * @brief Decodes a FloatingPoint of MMS: the exponent width followed by an IEEE 754 value.
+ * @param result Receives the value.
+ * @return false if the contents are neither single nor double precision.
+ */
+bool app::BerElement::to_float(double& result) const {
+  if (value.size() == 5 && std::to_integer<uint8_t>(value[0]) == ExponentWidthSingle) {
+    result = std::bit_cast<float>(static_cast<uint32_t>(get_big_endian(value.subspan(1))));
+    return true;
+  }
+  if (value.size() == 9 && std::to_integer<uint8_t>(value[0]) == ExponentWidthDouble) {
+    result = std::bit_cast<double>(get_big_endian(value.subspan(1)));
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Decodes a UtcTime of MMS: seconds since epoch, a binary fraction of 24 bits and the
+ * time quality.
+ * @param nanoseconds Receives the time in nanoseconds since epoch.
+ * @param quality Receives the time quality.
+ * @return false if the contents are not eight octets.
+ */
+bool app::BerElement::to_utc_time(int64_t& nanoseconds, uint8_t& quality) const {
+  if (value.size() != 8) {
+    return false;
+  }
+  auto seconds = static_cast<int64_t>(get_big_endian(value.first(4)));
+  auto fraction = static_cast<int64_t>(get_big_endian(value.subspan(4, 3)));
+  nanoseconds = seconds * NanosecondsPerSecond + ((fraction * NanosecondsPerSecond) >> 24);
+  quality = std::to_integer<uint8_t>(value[7]);
+  return true;
+}
+
+/**
+ * @brief Writes the header of a constructed element around the elements written since a mark.
+ * @param tag The tag.
+ * @param mark The size() before the contents were written.
+ */
+void app::BerWriter::close(uint32_t tag, size_t mark) {
+  put_header(tag, size() - mark);
+}
+
+/**
+ * @brief Writes an element with the given contents.
+ * @param tag The tag.
+ * @param contents The contents.
+ */
+void app::BerWriter::put_octets(uint32_t tag, std::span<const std::byte> contents) {
+  if (!reserve(contents.size())) {
+    return;
+  }
+  if (!contents.empty()) {
+    std::memcpy(m_position, contents.data(), contents.size());
+  }
+  put_header(tag, contents.size());
+}
+
+/**
+ * @brief Writes an element with text contents.
+ * @param tag The tag.
+ * @param text The text.
+ */
+void app::BerWriter::put_string(uint32_t tag, std::string_view text) {
+  put_octets(tag, std::as_bytes(std::span{text.data(), text.size()}));
+}
+
+/**
+ * @brief Writes a BOOLEAN.
+ * @param tag The tag.
+ * @param value The value.
+ */
+void app::BerWriter::put_boolean(uint32_t tag, bool value) {
+  put_big_endian(value ? 0xFF : 0x00, 1);
+  put_header(tag, 1);
+}
+
+/**
+ * @brief Writes an INTEGER in the fewest octets.
+ * @param tag The tag.
+ * @param value The value.
+ */
+void app::BerWriter::put_integer(uint32_t tag, int64_t value) {
+  // drop leading octets while the next one still carries the sign
+  size_t octets = 8;
+  while (octets > 1) {
+    auto top = value >> (8 * (octets - 1) - 1);
+    if (top != 0 && top != -1) {
+      break;
+    }
+    octets--;
+  }
+  put_big_endian(static_cast<uint64_t>(value), octets);
+  put_header(tag, octets);
+}
+
+/**
+ * @brief Writes an unsigned INTEGER in the fewest octets, with a leading zero octet if the high
+ * bit is set.
+ * @param tag The tag.
+ * @param value The value.
+ */
+void app::BerWriter::put_unsigned(uint32_t tag, uint64_t value) {
+  auto octets = octets_of(value);
+  put_big_endian(value, octets);
+  if ((value >> (8 * octets - 1)) != 0) {
+    put_big_endian(0, 1);
+    octets++;
+  }
+  put_header(tag, octets);
+}
+
+/**
+ * @brief Writes a BIT STRING; bit 0 of the value is the first bit of the string.
+ * @param tag The tag.
+ * @param bits The bits.
+ * @param count The number of bits, at most 64.
+ */
+void app::BerWriter::put_bit_string(uint32_t tag, uint64_t bits, size_t count) {
+  count = std::min<size_t>(count, 64);
+  size_t octets = (count + 7) / 8;
+  if (!reserve(octets + 1)) {
+    return;
+  }
+  if (count < 64) {
+    bits &= (uint64_t{1} << count) - 1;
+  }
+  m_position[0] = static_cast<std::byte>(octets * 8 - count);
+  for (size_t i = 0; i < octets; ++i) {
+    m_position[1 + i] = static_cast<std::byte>(reverse_bits(static_cast<uint8_t>(bits >> (8 * i))));
+  }
+  put_header(tag, octets + 1);
+}
+
+/**
+ * @brief Writes a single precision FloatingPoint of MMS.
+ * @param tag The tag.
+ * @param value The value.
+ */
+void app::BerWriter::put_float(uint32_t tag, float value) {
+  put_big_endian(std::bit_cast<uint32_t>(value), 4);
+  put_big_endian(ExponentWidthSingle, 1);
+  put_header(tag, 5);
+}
+
+/**
+ * @brief Writes a double precision FloatingPoint of MMS.
+ * @param tag The tag.
+ * @param value The value.
+ */
+void app::BerWriter::put_double(uint32_t tag, double value) {
+  put_big_endian(std::bit_cast<uint64_t>(value), 8);
+  put_big_endian(ExponentWidthDouble, 1);
+  put_header(tag, 9);
+}
+
+/**
+ * @brief Writes a UtcTime of MMS.
+ * @param tag The tag.
+ * @param nanoseconds The time in nanoseconds since epoch.
+ * @param quality The time quality.
+ */
+void app::BerWriter::put_utc_time(uint32_t tag, int64_t nanoseconds, uint8_t quality) {
+  auto seconds = nanoseconds / NanosecondsPerSecond;
+  auto remainder = nanoseconds % NanosecondsPerSecond;
+  if (remainder < 0) {
+    seconds--;
+    remainder += NanosecondsPerSecond;
+  }
+  // round the fraction up so decoding doesn't return an earlier time, except in the last 60 ns of a second
+  auto fraction = std::min<int64_t>(((remainder << 24) + NanosecondsPerSecond - 1) / NanosecondsPerSecond, 0xFFFFFF);
+  put_big_endian(quality, 1);
+  put_big_endian(static_cast<uint64_t>(fraction), 3);
+  put_big_endian(static_cast<uint64_t>(seconds), 4);
+  put_header(tag, 8);
+}
+
+/**
+ * @brief Writes an element without contents, f.e. NULL.
+ * @param tag The tag.
+ */
+void app::BerWriter::put_empty(uint32_t tag) {
+  put_header(tag, 0);
+}
+
+/**
+ * @brief Writes the tag and the length in front of the contents.
+ * @param tag The tag.
+ * @param length The length of the contents.
+ */
+void app::BerWriter::put_header(uint32_t tag, size_t length) {
+  if (length < 0x80) {
+    put_big_endian(length, 1);
+  } else {
+    auto octets = octets_of(length);
+    put_big_endian(length, octets);
+    put_big_endian(0x80 | octets, 1);
+  }
+  put_big_endian(tag, octets_of(tag));
+}
+
+/**
+ * @brief Writes a big-endian integer in front of the encoding.
+ * @param value The value.
+ * @param bytes The number of bytes.
+ */
+void app::BerWriter::put_big_endian(uint64_t value, size_t bytes) {
+  if (!reserve(bytes)) {
+    return;
+  }
+  for (size_t i = bytes; i-- > 0;) {
+    m_position[i] = static_cast<std::byte>(value);
+    value >>= 8;
+  }
+}
+
+/**
+ * @brief Moves the start of the encoding to make room for bytes.
+ * @param bytes The number of bytes.
+ * @return false on overflow.
+ */
+bool app::BerWriter::reserve(size_t bytes) {
+  if (m_overflow || static_cast<size_t>(m_position - m_begin) < bytes) {
+    m_overflow = true;
+    return false;
+  }
+  m_position -= bytes;
+  return true;
+}
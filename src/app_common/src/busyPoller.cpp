@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "busyPoller.hpp"
+
+#include <algorithm>
+// clang-format on
+
+namespace {
+
+/// A park this many times longer than the spin phase shows a quiet input, spinning is wasted there.
+constexpr int64_t LongParkFactor = 8;
+
+}  // namespace
+
+/**
+ * @brief constructor
+ * @param config The configuration.
+ */
+app::BusyPoller::BusyPoller(const BusyPollConfig& config) : m_config(config), m_spinStart(Clock::now()) {
+  // the bounds widen to the configured start value
+  m_idleSpins = std::max<uint32_t>(m_config.idleSpins, 1);
+  m_config.minIdleSpins = std::clamp<uint32_t>(m_config.minIdleSpins, 1, m_idleSpins);
+  m_config.maxIdleSpins = std::max(m_config.maxIdleSpins, m_idleSpins);
+}
+
+/**
+ * @brief Marks the start of polling, the time until the next park counts as spin time.
+ */
+void app::BusyPoller::start() {
+  m_idlePolls = 0;
+  m_spinStartPolls = m_statistics.polls;
+  m_spinStart = Clock::now();
+}
+
+/**
+ * @brief Records the end of a park, the task resumes polling.
+ * @param parkStart The time the park started.
+ */
+void app::BusyPoller::parked(Clock::time_point parkStart) {
+  auto now = Clock::now();
+  auto spin = parkStart - m_spinStart;
+  auto park = now - parkStart;
+  m_statistics.parks++;
+  m_statistics.spinTime += spin;
+  m_statistics.parkTime += park;
+
+  // the idle spins took the same time per poll as the whole spin phase
+  auto polls = m_statistics.polls - m_spinStartPolls;
+  if (polls > 0) {
+    auto idleWindow = spin * m_idleSpins / static_cast<int64_t>(polls);
+    if (park < idleWindow) {
+      m_statistics.shortParks++;
+      if (m_config.adaptive) {
+        m_idleSpins = std::min(m_idleSpins * 2, m_config.maxIdleSpins);
+      }
+    } else if (m_config.adaptive && park > idleWindow * LongParkFactor) {
+      m_idleSpins = std::max(m_idleSpins / 2, m_config.minIdleSpins);
+    }
+  }
+  start();
+}
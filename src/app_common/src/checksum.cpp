@@ -0,0 +1,411 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "checksum.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+#include "cpuDispatch.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#endif
+// clang-format on
+
+namespace {
+
+/// The tables of a reflected CRC, the first advances the CRC by one byte, table k by k+1 bytes
+template <typename T>
+using SlicingTables = std::array<std::array<T, 256>, 8>;
+
+/**
+ * @brief Generates the slicing tables of a reflected CRC at compile time.
+ * @param polynomial The reflected polynomial.
+ * @return The tables.
+ */
+template <typename T>
+constexpr SlicingTables<T> make_tables(T polynomial) {
+  SlicingTables<T> tables{};
+  for (uint32_t byte = 0; byte < 256; ++byte) {
+    auto crc = static_cast<T>(byte);
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = static_cast<T>((crc & 1) != 0 ? (crc >> 1) ^ polynomial : crc >> 1);
+    }
+    tables[0][byte] = crc;
+  }
+  for (size_t k = 1; k < tables.size(); ++k) {
+    for (size_t byte = 0; byte < 256; ++byte) {
+      auto previous = tables[k - 1][byte];
+      tables[k][byte] = static_cast<T>((previous >> 8) ^ tables[0][previous & 0xFF]);
+    }
+  }
+  return tables;
+}
+
+constexpr auto Crc16ModbusTables = make_tables<uint16_t>(0xA001);  ///< polynomial 0x8005 reflected
+constexpr auto Crc32Tables = make_tables<uint32_t>(0xEDB88320);    ///< polynomial 0x04C11DB7 reflected
+constexpr auto Crc32cTables = make_tables<uint32_t>(0x82F63B78);   ///< polynomial 0x1EDC6F41 reflected
+constexpr size_t HardwareMinimum = 64;                             ///< bytes below which folding doesn't pay
+
+/**
+ * @brief Advances a reflected CRC byte by byte.
+ * @param state The CRC register.
+ * @param data The data.
+ * @param size The number of bytes.
+ * @return The CRC register.
+ */
+template <typename T, const SlicingTables<T>& Tables>
+uint32_t update_bytewise(uint32_t state, const uint8_t* data, size_t size) {
+  auto crc = static_cast<T>(state);
+  for (size_t i = 0; i < size; ++i) {
+    crc = static_cast<T>((crc >> 8) ^ Tables[0][(crc ^ data[i]) & 0xFF]);
+  }
+  return crc;
+}
+
+/**
+ * @brief Advances a reflected CRC eight bytes per step: the CRC is added to the next eight bytes,
+ * and each byte is advanced by the bytes that follow it with one lookup.
+ * @param state The CRC register.
+ * @param data The data.
+ * @param size The number of bytes.
+ * @return The CRC register.
+ */
+template <typename T, const SlicingTables<T>& Tables>
+uint32_t update_slicing8(uint32_t state, const uint8_t* data, size_t size) {
+  uint64_t crc = state;
+  for (; size >= 8; data += 8, size -= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    if constexpr (std::endian::native == std::endian::big) {
+      word = __builtin_bswap64(word);
+    }
+    word ^= crc;
+    crc = Tables[7][word & 0xFF] ^ Tables[6][(word >> 8) & 0xFF] ^ Tables[5][(word >> 16) & 0xFF] ^
+          Tables[4][(word >> 24) & 0xFF] ^ Tables[3][(word >> 32) & 0xFF] ^ Tables[2][(word >> 40) & 0xFF] ^
+          Tables[1][(word >> 48) & 0xFF] ^ Tables[0][word >> 56];
+  }
+  return update_bytewise<T, Tables>(static_cast<uint32_t>(crc), data, size);
+}
+
+/**
+ * @brief Adds bytes to a sum modulo 256; the compiler vectorizes the loop.
+ * @param state The sum.
+ * @param data The data.
+ * @param size The number of bytes.
+ * @return The sum.
+ */
+uint32_t update_sum_bytewise(uint32_t state, const uint8_t* data, size_t size) {
+  auto sum = static_cast<uint8_t>(state);
+  for (size_t i = 0; i < size; ++i) {
+    sum = static_cast<uint8_t>(sum + data[i]);
+  }
+  return sum;
+}
+
+#if defined(__x86_64__)
+/**
+ * @brief Folds 128 bits of a CRC-32 forward by the distance of the constants onto the next block.
+ * @param x The bits to fold.
+ * @param constants The constants of the distance, high and low half.
+ * @param next The next block.
+ * @return The folded bits.
+ */
+__attribute__((target("pclmul"))) inline __m128i fold(__m128i x, __m128i constants, __m128i next) {
+  return _mm_xor_si128(
+      _mm_xor_si128(_mm_clmulepi64_si128(x, constants, 0x11), _mm_clmulepi64_si128(x, constants, 0x00)), next);
+}
+
+/**
+ * @brief The constants of the folding of a reflected CRC-32: x^n mod P for n = 4*128+32,
+ * 4*128-32, 128+32, 128-32 and 64, then P and floor(x^64 / P), all bit-reflected (33 bits).
+ */
+struct FoldConstants {
+  int64_t fold4Low;   ///< x^(4*128+32) mod P, four blocks ahead
+  int64_t fold4High;  ///< x^(4*128-32) mod P
+  int64_t fold1Low;   ///< x^(128+32) mod P, one block ahead
+  int64_t fold1High;  ///< x^(128-32) mod P
+  int64_t fold64;     ///< x^64 mod P
+  int64_t poly;       ///< P
+  int64_t mu;         ///< floor(x^64 / P) of the Barrett reduction
+};
+
+constexpr FoldConstants Crc32Fold{0x0154442bd4, 0x01c6e41596, 0x01751997d0, 0x00ccaa009e,
+                                  0x0163cd6124, 0x01db710641, 0x01f7011641};  ///< CRC-32
+constexpr FoldConstants Crc32cFold{0x00740eef02, 0x009e4addf8, 0x00f20c0dfe, 0x014cd00bd6,
+                                   0x00dd45aab8, 0x0105ec76f1, 0x00dea713f1};  ///< CRC-32C
+
+/**
+ * @brief Folds 16-byte blocks into a reflected CRC-32 with carry-less multiplication, four blocks
+ * in parallel, then reduces the remainder to 32 bits (Barrett); after Gopal et al., "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction", Intel 2009.
+ * @param state The CRC register.
+ * @param data The data.
+ * @param size The number of bytes, at least 64 and a multiple of 16.
+ * @return The CRC register.
+ */
+template <const FoldConstants& Constants>
+__attribute__((target("pclmul,sse4.1"))) uint32_t fold_pclmul(uint32_t state, const uint8_t* data, size_t size) {
+  const __m128i fold4 = _mm_set_epi64x(Constants.fold4High, Constants.fold4Low);
+  const __m128i fold1 = _mm_set_epi64x(Constants.fold1High, Constants.fold1Low);
+  const __m128i fold64 = _mm_set_epi64x(0, Constants.fold64);
+  const __m128i barrett = _mm_set_epi64x(Constants.mu, Constants.poly);
+  const __m128i low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  auto load = [data](size_t offset) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset)); };
+
+  __m128i x1 = _mm_xor_si128(load(0), _mm_cvtsi32_si128(static_cast<int>(state)));
+  __m128i x2 = load(16);
+  __m128i x3 = load(32);
+  __m128i x4 = load(48);
+  size_t offset = 64;
+  for (; size - offset >= 64; offset += 64) {
+    x1 = fold(x1, fold4, load(offset));
+    x2 = fold(x2, fold4, load(offset + 16));
+    x3 = fold(x3, fold4, load(offset + 32));
+    x4 = fold(x4, fold4, load(offset + 48));
+  }
+  x1 = fold(x1, fold1, x2);
+  x1 = fold(x1, fold1, x3);
+  x1 = fold(x1, fold1, x4);
+  for (; offset < size; offset += 16) {
+    x1 = fold(x1, fold1, load(offset));
+  }
+
+  // 128 to 64 bits, 64 to 32 bits, then the Barrett reduction
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, fold1, 0x10));
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 4), _mm_clmulepi64_si128(_mm_and_si128(x1, low32), fold64, 0x00));
+  __m128i reduced = _mm_clmulepi64_si128(_mm_and_si128(x1, low32), barrett, 0x10);
+  reduced = _mm_clmulepi64_si128(_mm_and_si128(reduced, low32), barrett, 0x00);
+  return static_cast<uint32_t>(_mm_extract_epi32(_mm_xor_si128(x1, reduced), 1));
+}
+
+/**
+ * @brief Advances a CRC-32, the 16-byte blocks folded with PCLMULQDQ, the rest sliced.
+ * @param state The CRC register.
+ * @param data The data.
+ * @param size The number of bytes.
+ * @return The CRC register.
+ */
+uint32_t update_crc32_hardware(uint32_t state, const uint8_t* data, size_t size) {
+  if (size >= HardwareMinimum) {
+    auto blocks = size & ~size_t{15};
+    state = fold_pclmul<Crc32Fold>(state, data, blocks);
+    data += blocks;
+    size -= blocks;
+  }
+  return update_slicing8<uint32_t, Crc32Tables>(state, data, size);
+}
+
+/**
+ * @brief Advances a CRC-32C, the 16-byte blocks folded with PCLMULQDQ, the rest with the CRC32
+ * instruction of SSE 4.2; a single chain of CRC32 instructions is bound by their latency.
+ * @param state The CRC register.
+ * @param data The data.
+ * @param size The number of bytes.
+ * @return The CRC register.
+ */
+__attribute__((target("sse4.2"))) uint32_t update_crc32c_hardware(uint32_t state, const uint8_t* data, size_t size) {
+  if (size >= HardwareMinimum) {
+    auto blocks = size & ~size_t{15};
+    state = fold_pclmul<Crc32cFold>(state, data, blocks);
+    data += blocks;
+    size -= blocks;
+  }
+  uint64_t crc = state;
+  for (; size >= 8; data += 8, size -= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    crc = _mm_crc32_u64(crc, word);
+  }
+  auto crc32 = static_cast<uint32_t>(crc);
+  for (size_t i = 0; i < size; ++i) {
+    crc32 = _mm_crc32_u8(crc32, data[i]);
+  }
+  return crc32;
+}
+
+/**
+ * @brief Checks the instructions of the hardware paths, PCLMULQDQ and SSE 4.2 of the sse4.2 level.
+ * @param algorithm The algorithm.
+ * @return true if the CPU has them and the dispatch level enables them.
+ */
+bool has_hardware(app::ChecksumAlgorithm algorithm) {
+  return (algorithm == app::ChecksumAlgorithm::crc32 || algorithm == app::ChecksumAlgorithm::crc32c) &&
+         app::CpuDispatch::instance().enabled(app::CpuLevel::sse42);
+}
+#elif defined(__aarch64__)
+/**
+ * @brief Advances a CRC-32 with the CRC32 instructions of ARMv8.
+ * @param state The CRC register.
+ * @param data The data.
+ * @param size The number of bytes.
+ * @return The CRC register.
+ */
+__attribute__((target("+crc"))) uint32_t update_crc32_hardware(uint32_t state, const uint8_t* data, size_t size) {
+  for (; size >= 8; data += 8, size -= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    state = __crc32d(state, word);
+  }
+  for (size_t i = 0; i < size; ++i) {
+    state = __crc32b(state, data[i]);
+  }
+  return state;
+}
+
+/**
+ * @brief Advances a CRC-32C with the CRC32C instructions of ARMv8.
+ * @param state The CRC register.
+ * @param data The data.
+ * @param size The number of bytes.
+ * @return The CRC register.
+ */
+__attribute__((target("+crc"))) uint32_t update_crc32c_hardware(uint32_t state, const uint8_t* data, size_t size) {
+  for (; size >= 8; data += 8, size -= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    state = __crc32cd(state, word);
+  }
+  for (size_t i = 0; i < size; ++i) {
+    state = __crc32cb(state, data[i]);
+  }
+  return state;
+}
+
+/**
+ * @brief Checks the instructions of the hardware paths.
+ * @param algorithm The algorithm.
+ * @return true if the CPU has them and the dispatch level isn't forced to scalar.
+ */
+bool has_hardware(app::ChecksumAlgorithm algorithm) {
+  const auto& dispatch = app::CpuDispatch::instance();
+  return (algorithm == app::ChecksumAlgorithm::crc32 || algorithm == app::ChecksumAlgorithm::crc32c) &&
+         dispatch.enabled(app::CpuLevel::neon) && dispatch.features().crc32;
+}
+#else
+/**
+ * @brief Checks the instructions of the hardware paths.
+ * @return false, no hardware path on this architecture.
+ */
+bool has_hardware(app::ChecksumAlgorithm /*algorithm*/) {
+  return false;
+}
+#endif
+}  // namespace
+
+/**
+ * @brief Gets the name of an algorithm.
+ * @param algorithm The algorithm.
+ * @return The name.
+ */
+std::string_view app::to_string(ChecksumAlgorithm algorithm) {
+  switch (algorithm) {
+    case ChecksumAlgorithm::crc16Modbus:
+      return "CRC-16/MODBUS";
+    case ChecksumAlgorithm::iec101Sum:
+      return "IEC 101 sum";
+    case ChecksumAlgorithm::crc32:
+      return "CRC-32";
+    case ChecksumAlgorithm::crc32c:
+      return "CRC-32C";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Gets the name of a path, for the hardware path the instructions of this CPU.
+ * @param path The path.
+ * @return The name.
+ */
+std::string_view app::to_string(ChecksumPath path) {
+  switch (path) {
+    case ChecksumPath::bytewise:
+      return "bytewise";
+    case ChecksumPath::slicing8:
+      return "slicing-by-8";
+    case ChecksumPath::hardware:
+#if defined(__x86_64__)
+      return "pclmul/sse4.2";
+#elif defined(__aarch64__)
+      return "armv8 crc";
+#else
+      return "hardware";
+#endif
+  }
+  return "unknown";
+}
+
+/**
+ * @brief constructor, with a path.
+ * @param algorithm The algorithm.
+ * @param path The path, the fastest path if the CPU or the algorithm doesn't support it.
+ */
+app::Checksum::Checksum(ChecksumAlgorithm algorithm, ChecksumPath path) : m_algorithm(algorithm) {
+  m_path = is_supported(algorithm, path) ? path : best_path(algorithm);
+  switch (algorithm) {
+    case ChecksumAlgorithm::crc16Modbus:
+      m_initial = 0xFFFF;
+      m_update = m_path == ChecksumPath::bytewise ? update_bytewise<uint16_t, Crc16ModbusTables>
+                                                  : update_slicing8<uint16_t, Crc16ModbusTables>;
+      break;
+    case ChecksumAlgorithm::iec101Sum:
+      m_update = update_sum_bytewise;
+      break;
+    case ChecksumAlgorithm::crc32:
+      m_initial = m_finalXor = 0xFFFFFFFF;
+      m_update = m_path == ChecksumPath::bytewise ? update_bytewise<uint32_t, Crc32Tables>
+                                                  : update_slicing8<uint32_t, Crc32Tables>;
+      break;
+    case ChecksumAlgorithm::crc32c:
+      m_initial = m_finalXor = 0xFFFFFFFF;
+      m_update = m_path == ChecksumPath::bytewise ? update_bytewise<uint32_t, Crc32cTables>
+                                                  : update_slicing8<uint32_t, Crc32cTables>;
+      break;
+  }
+#if defined(__x86_64__) || defined(__aarch64__)
+  if (m_path == ChecksumPath::hardware) {
+    m_update = algorithm == ChecksumAlgorithm::crc32 ? update_crc32_hardware : update_crc32c_hardware;
+  }
+#endif
+  m_state = m_initial;
+}
+
+/**
+ * @brief Checks whether the CPU supports a path of an algorithm.
+ * @param algorithm The algorithm.
+ * @param path The path.
+ * @return true if supported, otherwise false.
+ */
+bool app::Checksum::is_supported(ChecksumAlgorithm algorithm, ChecksumPath path) {
+  if (algorithm == ChecksumAlgorithm::iec101Sum) {
+    return path == ChecksumPath::bytewise;
+  }
+  return path != ChecksumPath::hardware || has_hardware(algorithm);
+}
+
+/**
+ * @brief Gets the fastest path of an algorithm the CPU supports.
+ *
+ * The hardware path follows the level of app::CpuDispatch, bound before the threads start, so a
+ * forked snapshot child may construct checksums.
+ * @param algorithm The algorithm.
+ * @return The path.
+ */
+app::ChecksumPath app::Checksum::best_path(ChecksumAlgorithm algorithm) {
+  if (algorithm == ChecksumAlgorithm::iec101Sum) {
+    return ChecksumPath::bytewise;
+  }
+  return has_hardware(algorithm) ? ChecksumPath::hardware : ChecksumPath::slicing8;
+}
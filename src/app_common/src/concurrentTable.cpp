@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "concurrentTable.hpp"
+// clang-format on
+
+namespace {
+/**
+ * @brief The epoch a thread announced, on its own cache line.
+ */
+struct alignas(64) EpochRecord {
+  std::atomic<uint64_t> epoch{0};  ///< announced epoch, 0 while the thread doesn't read
+  std::atomic<bool> used{false};   ///< claimed by a thread
+  uint32_t nesting{0};             ///< pins of the owning thread
+  EpochRecord* next{nullptr};      ///< next record, set before the record is published
+};
+
+/// The global epoch, starts at 1 because 0 marks a thread that doesn't read
+std::atomic<uint64_t> globalEpoch{1};
+
+/// The records of all threads that ever read, the list only grows
+std::atomic<EpochRecord*> records{nullptr};
+
+/**
+ * @brief Claims a free record or adds a new one to the list.
+ * @return The record.
+ */
+EpochRecord* claim_record() {
+  for (auto* record = records.load(std::memory_order_acquire); record != nullptr; record = record->next) {
+    bool expected = false;
+    if (!record->used.load(std::memory_order_relaxed) &&
+        record->used.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+      return record;
+    }
+  }
+  // kept for the lifetime of the process, a scan may read it at any time
+  auto* record = new EpochRecord;
+  record->used.store(true, std::memory_order_relaxed);
+  record->next = records.load(std::memory_order_relaxed);
+  while (!records.compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed)) {
+  }
+  return record;
+}
+
+thread_local EpochRecord* threadRecord{nullptr};  ///< record of this thread, claimed by its first pin
+
+/**
+ * @brief Releases the record of a thread on its exit for the next thread.
+ */
+struct RecordRelease {
+  ~RecordRelease() {
+    if (threadRecord != nullptr && threadRecord->nesting == 0) {
+      threadRecord->epoch.store(0, std::memory_order_release);
+      threadRecord->used.store(false, std::memory_order_release);
+      threadRecord = nullptr;
+    }
+  }
+};
+
+thread_local RecordRelease recordRelease;  ///< releases the record of this thread
+
+/**
+ * @brief Gets the record of the calling thread.
+ * @return The record.
+ */
+EpochRecord* thread_record() {
+  if (threadRecord == nullptr) {
+    // a pin in a thread-local destructor after the release claims a record the thread keeps
+    threadRecord = claim_record();
+    static_cast<void>(&recordRelease);
+  }
+  return threadRecord;
+}
+}  // namespace
+
+/**
+ * @brief Announces a read.
+ *
+ * The fence orders the announcement before the loads of the read: a writer that unlinks an object
+ * after the fence either sees the announcement in its scan or the reader sees the object unlinked.
+ */
+void app::EpochDomain::pin() noexcept {
+  auto* record = thread_record();
+  if (record->nesting++ == 0) {
+    record->epoch.store(globalEpoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+}
+
+/**
+ * @brief Ends a read, the loads of the read happen before the objects they saw are freed.
+ */
+void app::EpochDomain::unpin() noexcept {
+  auto* record = threadRecord;
+  if (--record->nesting == 0) {
+    record->epoch.store(0, std::memory_order_release);
+  }
+}
+
+/**
+ * @brief Gets the epoch of an object that was unlinked before the call.
+ * @return The epoch the object is retired in.
+ */
+uint64_t app::EpochDomain::retire_epoch() noexcept {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  return globalEpoch.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Advances the global epoch if all pinned threads announced the current one.
+ *
+ * A thread pinned in an older epoch may still hold an object unlinked in it, the epoch stays.
+ * @return The global epoch after the attempt.
+ */
+uint64_t app::EpochDomain::try_advance() noexcept {
+  auto current = globalEpoch.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  for (auto* record = records.load(std::memory_order_acquire); record != nullptr; record = record->next) {
+    auto announced = record->epoch.load(std::memory_order_relaxed);
+    if (announced != 0 && announced != current) {
+      return current;
+    }
+  }
+  // the reads of the threads that unpinned happen before the objects are freed
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (globalEpoch.compare_exchange_strong(current, current + 1, std::memory_order_acq_rel,
+                                          std::memory_order_acquire)) {
+    return current + 1;
+  }
+  return current;
+}
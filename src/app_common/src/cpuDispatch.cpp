@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "cpuDispatch.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__aarch64__) || defined(__arm__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+// clang-format on
+
+namespace {
+/// The levels, for the parser
+constexpr app::CpuLevel Levels[] = {app::CpuLevel::scalar, app::CpuLevel::sse42, app::CpuLevel::avx2,
+                                    app::CpuLevel::avx512, app::CpuLevel::neon};
+
+#if defined(__x86_64__) || defined(__i386__)
+constexpr uint64_t XcrAvxState = 0x06;     ///< SSE and AVX registers saved by the OS
+constexpr uint64_t XcrAvx512State = 0xE6;  ///< plus the opmask and the upper ZMM registers
+
+/**
+ * @brief Reads the register state the OS saves on a context switch.
+ * @return XCR0.
+ */
+uint64_t read_xcr0() {
+  uint32_t low = 0;
+  uint32_t high = 0;
+  __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+  return static_cast<uint64_t>(high) << 32 | low;
+}
+#endif
+}  // namespace
+
+/**
+ * @brief Gets the name of a level.
+ * @param level The level.
+ * @return The name.
+ */
+std::string_view app::to_string(CpuLevel level) {
+  switch (level) {
+    case CpuLevel::scalar:
+      return "scalar";
+    case CpuLevel::sse42:
+      return "sse4.2";
+    case CpuLevel::avx2:
+      return "avx2";
+    case CpuLevel::avx512:
+      return "avx512";
+    case CpuLevel::neon:
+      return "neon";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Parses the name of a level.
+ * @param text The name, also "sse42".
+ * @return The level, none if unknown.
+ */
+std::optional<app::CpuLevel> app::parse_cpu_level(std::string_view text) {
+  if (text == "sse42") {
+    return CpuLevel::sse42;
+  }
+  for (auto level : Levels) {
+    if (text == to_string(level)) {
+      return level;
+    }
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief Reads the features of the CPU: cpuid on x86, where a register extension also needs the
+ * OS to save its state, the hardware capabilities on ARM.
+ * @return The features.
+ */
+app::CpuFeatures app::CpuFeatures::detect() {
+  CpuFeatures features;
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int eax = 0;
+  unsigned int ebx = 0;
+  unsigned int ecx = 0;
+  unsigned int edx = 0;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+    return features;
+  }
+  features.sse42 = (ecx & bit_SSE4_2) != 0 && (ecx & bit_SSE4_1) != 0 && (ecx & bit_SSSE3) != 0;
+  features.popcnt = (ecx & bit_POPCNT) != 0;
+  features.pclmul = (ecx & bit_PCLMUL) != 0;
+  const uint64_t xcr0 = (ecx & bit_OSXSAVE) != 0 ? read_xcr0() : 0;
+  const bool avxState = (xcr0 & XcrAvxState) == XcrAvxState;
+  const bool avx512State = (xcr0 & XcrAvx512State) == XcrAvx512State;
+  features.avx = avxState && (ecx & bit_AVX) != 0;
+  features.fma = features.avx && (ecx & bit_FMA) != 0;
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) != 0) {
+    features.avx2 = features.avx && (ebx & bit_AVX2) != 0;
+    features.bmi2 = (ebx & bit_BMI) != 0 && (ebx & bit_BMI2) != 0;
+    features.avx512f = avx512State && (ebx & bit_AVX512F) != 0;
+    features.avx512bw = features.avx512f && (ebx & bit_AVX512BW) != 0;
+    features.avx512dq = features.avx512f && (ebx & bit_AVX512DQ) != 0;
+    features.avx512vl = features.avx512f && (ebx & bit_AVX512VL) != 0;
+  }
+#elif defined(__aarch64__)
+  const auto hwcap = getauxval(AT_HWCAP);
+  features.neon = (hwcap & HWCAP_ASIMD) != 0;
+  features.crc32 = (hwcap & HWCAP_CRC32) != 0;
+  features.pmull = (hwcap & HWCAP_PMULL) != 0;
+#elif defined(__arm__)
+  const auto hwcap2 = getauxval(AT_HWCAP2);
+  features.neon = (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+  features.crc32 = (hwcap2 & HWCAP2_CRC32) != 0;
+  features.pmull = (hwcap2 & HWCAP2_PMULL) != 0;
+#endif
+  return features;
+}
+
+/**
+ * @brief Gets the highest level of the features.
+ * @return The level.
+ */
+app::CpuLevel app::CpuFeatures::level() const {
+  if (neon) {
+    return CpuLevel::neon;
+  }
+  if (!sse42 || !popcnt || !pclmul) {
+    return CpuLevel::scalar;
+  }
+  if (!avx2 || !fma || !bmi2) {
+    return CpuLevel::sse42;
+  }
+  if (!avx512f || !avx512bw || !avx512dq || !avx512vl) {
+    return CpuLevel::avx2;
+  }
+  return CpuLevel::avx512;
+}
+
+/**
+ * @brief Describes the features.
+ * @return The names of the present features, "none" without any.
+ */
+std::string app::CpuFeatures::to_string() const {
+  const std::pair<bool, const char*> names[] = {
+      {sse42, "sse4.2"}, {popcnt, "popcnt"}, {pclmul, "pclmul"}, {avx, "avx"}, {avx2, "avx2"},
+      {fma, "fma"}, {bmi2, "bmi2"}, {avx512f, "avx512f"}, {avx512bw, "avx512bw"}, {avx512dq, "avx512dq"},
+      {avx512vl, "avx512vl"}, {neon, "neon"}, {crc32, "crc32"}, {pmull, "pmull"}};
+  std::string text;
+  for (const auto& [present, name] : names) {
+    if (present) {
+      text += text.empty() ? "" : " ";
+      text += name;
+    }
+  }
+  return text.empty() ? "none" : text;
+}
+
+/**
+ * @brief Gets the dispatch of the process.
+ *
+ * The daemon creates it before its threads, so a forked snapshot child reads it without locks.
+ * @return The dispatch.
+ */
+app::CpuDispatch& app::CpuDispatch::instance() {
+  static CpuDispatch dispatch;
+  return dispatch;
+}
+
+/**
+ * @brief constructor, detects the features, the level is the highest supported.
+ */
+app::CpuDispatch::CpuDispatch() : m_features(CpuFeatures::detect()) {
+  m_detected = m_features.level();
+  m_level = m_detected;
+}
+
+/**
+ * @brief Checks whether the CPU supports a level.
+ * @param level The level.
+ * @return true if supported, otherwise false.
+ */
+bool app::CpuDispatch::supports(CpuLevel level) const {
+  if (level == CpuLevel::scalar) {
+    return true;
+  }
+  if (level == CpuLevel::neon || m_detected == CpuLevel::neon) {
+    return level == m_detected;
+  }
+  return level <= m_detected;
+}
+
+/**
+ * @brief Sets the level and binds the kernels again.
+ * @param level The level.
+ * @return false if the CPU doesn't support the level.
+ */
+bool app::CpuDispatch::force_level(CpuLevel level) {
+  if (!supports(level)) {
+    return false;
+  }
+  m_level = level;
+  bind();
+  return true;
+}
+
+/**
+ * @brief Binds the kernels to the best variants up to the level.
+ */
+void app::CpuDispatch::bind() {
+  for (auto& kernel : m_kernels) {
+    bind(kernel);
+  }
+}
+
+/**
+ * @brief Binds a kernel to its best enabled variant, the first one if none is enabled.
+ * @param kernel The kernel.
+ */
+void app::CpuDispatch::bind(Kernel& kernel) {
+  if (kernel.levels.empty()) {
+    return;
+  }
+  size_t best = 0;
+  for (size_t i = 0; i < kernel.levels.size(); ++i) {
+    if (enabled(kernel.levels[i]) && (!enabled(kernel.levels[best]) || kernel.levels[i] > kernel.levels[best])) {
+      best = i;
+    }
+  }
+  kernel.bind(best);
+  kernel.bound = kernel.levels[best];
+}
+
+/**
+ * @brief Gets the bindings of the kernels.
+ * @return The name and the level of the bound variant of every kernel.
+ */
+std::vector<app::CpuDispatch::Binding> app::CpuDispatch::bindings() const {
+  std::vector<Binding> bindings;
+  bindings.reserve(m_kernels.size());
+  for (const auto& kernel : m_kernels) {
+    bindings.push_back({kernel.name, kernel.bound});
+  }
+  return bindings;
+}
@@ -0,0 +1,260 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "cpuResources.hpp"
+
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+// clang-format on
+
+namespace {
+
+/**
+ * @brief Reads the first line of a file.
+ * @param path The file.
+ * @return The line, none if the file cannot be read.
+ */
+std::optional<std::string> read_line(const std::filesystem::path& path) {
+  std::ifstream file(path);
+  std::string line;
+  if (!file || !std::getline(file, line)) {
+    return std::nullopt;
+  }
+  return line;
+}
+
+/**
+ * @brief Parses cpu.max: "max 100000" or "<quota> <period>" in microseconds.
+ * @param line The content of the file.
+ * @return The granted CPUs, none if unlimited.
+ */
+std::optional<double> parse_cpu_max(const std::string& line) {
+  std::istringstream stream(line);
+  std::string quota;
+  double period{0};
+  if (!(stream >> quota >> period) || quota == "max" || period <= 0) {
+    return std::nullopt;
+  }
+  try {
+    return std::stod(quota) / period;
+  } catch (const std::exception&) {
+    return std::nullopt;
+  }
+}
+
+/**
+ * @brief Counts the CPUs in the affinity mask of the process.
+ * @return The number of CPUs, 0 if the mask cannot be read.
+ */
+size_t count_affinity() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+    return 0;
+  }
+  return static_cast<size_t>(CPU_COUNT(&set));
+}
+
+}  // namespace
+
+/**
+ * @brief Gets the number of workers that keep the CPUs busy without being throttled.
+ * @return The number of workers.
+ */
+size_t app::CpuLimits::workers() const {
+  size_t workers = affinityCpus > 0 ? affinityCpus : std::max<size_t>(onlineCpus, 1);
+  if (cpusetCpus > 0) {
+    workers = std::min(workers, cpusetCpus);
+  }
+  if (quotaCpus) {
+    // a fractional CPU is not worth a worker: it would spend the rest of every period throttled
+    workers = std::min(workers, static_cast<size_t>(std::floor(*quotaCpus)));
+  }
+  return std::max<size_t>(workers, 1);
+}
+
+/**
+ * @brief Gets the counters since an earlier reading.
+ * @param earlier The earlier reading.
+ * @return The difference.
+ */
+app::CpuThrottling app::CpuThrottling::operator-(const CpuThrottling& earlier) const {
+  auto delta = [](uint64_t now, uint64_t before) { return now >= before ? now - before : now; };
+  return {delta(usageUsec, earlier.usageUsec), delta(periods, earlier.periods),
+          delta(throttledPeriods, earlier.throttledPeriods), delta(throttledUsec, earlier.throttledUsec)};
+}
+
+/**
+ * @brief constructor, finds the cgroup v2 mount in /proc/self/mountinfo.
+ */
+app::CpuResources::CpuResources() : m_procCgroup("/proc/self/cgroup") {
+  std::ifstream mountinfo("/proc/self/mountinfo");
+  std::string line;
+  while (std::getline(mountinfo, line)) {
+    // "<id> <parent> <major:minor> <root> <mount point> <options> [optional fields] - <type> <source> ..."
+    auto separator = line.find(" - ");
+    if (separator == std::string::npos || line.compare(separator + 3, 8, "cgroup2 ") != 0) {
+      continue;
+    }
+    std::istringstream fields(line.substr(0, separator));
+    std::string id;
+    std::string parent;
+    std::string device;
+    std::string root;
+    std::string mountPoint;
+    if (fields >> id >> parent >> device >> root >> mountPoint) {
+      m_mount = mountPoint;
+      m_mountRoot = root;
+      return;
+    }
+  }
+}
+
+/**
+ * @brief constructor with explicit paths.
+ * @param cgroupMount The mount point of the cgroup v2 hierarchy.
+ * @param procCgroup The cgroup membership file of the process.
+ */
+app::CpuResources::CpuResources(std::filesystem::path cgroupMount, std::filesystem::path procCgroup)
+    : m_mount(std::move(cgroupMount)), m_mountRoot("/"), m_procCgroup(std::move(procCgroup)) {}
+
+/**
+ * @brief Gets the cgroup directory of the process.
+ * @return The directory, empty without cgroup v2.
+ */
+std::filesystem::path app::CpuResources::cgroup() const {
+  if (m_mount.empty()) {
+    return {};
+  }
+  std::ifstream membership(m_procCgroup);
+  std::string line;
+  while (std::getline(membership, line)) {
+    // the unified hierarchy is the line "0::<path>"
+    if (line.rfind("0::", 0) != 0) {
+      continue;
+    }
+    std::filesystem::path path = line.substr(3);
+    auto relative = path.lexically_relative(m_mountRoot);
+    if (relative.empty() || relative == "." || *relative.begin() == "..") {
+      // the root of the mount, or a cgroup outside of the mounted subtree as in containers without cgroup namespace
+      return m_mount;
+    }
+    auto directory = (m_mount / relative).lexically_normal();
+    std::error_code error;
+    return std::filesystem::is_directory(directory, error) ? directory : m_mount;
+  }
+  return {};
+}
+
+/**
+ * @brief Reads the current limits.
+ * @return The limits.
+ */
+app::CpuLimits app::CpuResources::limits() const {
+  CpuLimits limits;
+  auto online = sysconf(_SC_NPROCESSORS_ONLN);
+  limits.onlineCpus = online > 0 ? static_cast<size_t>(online) : 1;
+  limits.affinityCpus = count_affinity();
+
+  auto directory = cgroup();
+  if (directory.empty()) {
+    return limits;
+  }
+  if (auto cpus = read_line(directory / "cpuset.cpus.effective")) {
+    limits.cpusetCpus = count_cpu_list(*cpus);
+  }
+  // a quota of a parent limits all of its children, so the tightest quota up to the mount point counts
+  for (auto current = directory;; current = current.parent_path()) {
+    if (auto line = read_line(current / "cpu.max")) {
+      if (auto quota = parse_cpu_max(*line); quota && (!limits.quotaCpus || *quota < *limits.quotaCpus)) {
+        limits.quotaCpus = quota;
+      }
+    }
+    if (current == m_mount || !current.has_relative_path()) {
+      break;
+    }
+  }
+  return limits;
+}
+
+/**
+ * @brief Reads the throttling counters of the cgroup.
+ * @return The counters, none without cgroup v2.
+ */
+std::optional<app::CpuThrottling> app::CpuResources::throttling() const {
+  auto directory = cgroup();
+  if (directory.empty()) {
+    return std::nullopt;
+  }
+  std::ifstream file(directory / "cpu.stat");
+  if (!file) {
+    return std::nullopt;
+  }
+  CpuThrottling throttling;
+  std::string key;
+  uint64_t value{0};
+  while (file >> key >> value) {
+    if (key == "usage_usec") {
+      throttling.usageUsec = value;
+    } else if (key == "nr_periods") {
+      throttling.periods = value;
+    } else if (key == "nr_throttled") {
+      throttling.throttledPeriods = value;
+    } else if (key == "throttled_usec") {
+      throttling.throttledUsec = value;
+    }
+  }
+  return throttling;
+}
+
+/**
+ * @brief Counts the CPUs of a cpuset list like "0-3,6,8-9".
+ * @param list The list.
+ * @return The number of CPUs.
+ */
+size_t app::CpuResources::count_cpu_list(std::string_view list) {
+  return parse_cpu_list(list).size();
+}
+
+/**
+ * @brief Parses a cpuset list like "0-3,6,8-9", malformed items are skipped.
+ * @param list The list.
+ * @return The CPUs in ascending order without duplicates.
+ */
+std::vector<size_t> app::CpuResources::parse_cpu_list(std::string_view list) {
+  std::vector<size_t> cpus;
+  while (!list.empty()) {
+    auto comma = list.find(',');
+    auto item = list.substr(0, comma);
+    list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+
+    auto dash = item.find('-');
+    try {
+      auto first = std::stoul(std::string(item.substr(0, dash)));
+      auto last = dash == std::string_view::npos ? first : std::stoul(std::string(item.substr(dash + 1)));
+      for (auto cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    } catch (const std::exception&) {
+      // empty or malformed item, e.g. the empty file of a cgroup without cpuset controller or a
+      // flag like "domain" in the isolcpus= kernel parameter
+    }
+  }
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
@@ -0,0 +1,558 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "diskQueue.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+#include "checksum.hpp"
+// clang-format on
+
+namespace {
+constexpr size_t MinSegmentSize = 4096;              ///< smallest segment, one page
+constexpr size_t MaxSegmentSize = 1ULL << 30;        ///< largest segment, the cursors are 32-bit
+constexpr size_t ReadCursorOffset = 28;              ///< position of the read cursor in the header
+constexpr std::string_view FilePrefix = "segment-";  ///< start of a segment file name
+constexpr std::string_view FileSuffix = ".dq";       ///< end of a segment file name
+
+/**
+ * @brief The header of a segment file.
+ */
+struct SegmentHeader {
+  uint32_t magic;        ///< "DQSG"
+  uint16_t version;      ///< format version
+  uint16_t reserved;     ///< zero
+  uint64_t sequence;     ///< number of the segment
+  uint32_t writeCursor;  ///< end of the records
+  uint32_t records;      ///< records written
+  uint32_t checksum;     ///< CRC-32C of the fields before
+  uint32_t readCursor;   ///< next record to read, updated by the reader
+};
+static_assert(sizeof(SegmentHeader) == app::DiskQueue::HeaderSize);
+static_assert(offsetof(SegmentHeader, readCursor) == ReadCursorOffset);
+
+/**
+ * @brief Gets the space of a record in a segment.
+ * @param size The size of the payload.
+ * @return The bytes, 8-byte aligned.
+ */
+constexpr size_t record_space(size_t size) {
+  return (app::DiskQueue::RecordHeaderSize + size + 7) & ~size_t{7};
+}
+
+/**
+ * @brief Computes the checksum of a segment header.
+ * @param header The header.
+ * @return The CRC-32C of the fields before the checksum.
+ */
+uint32_t header_checksum(const SegmentHeader& header) {
+  return app::crc32c({reinterpret_cast<const uint8_t*>(&header), offsetof(SegmentHeader, checksum)});
+}
+
+/**
+ * @brief Formats the reason of a failed system call.
+ * @param what The operation.
+ * @param path The file.
+ * @return The reason.
+ */
+std::string system_error(std::string_view what, const std::filesystem::path& path) {
+  return std::string(what) + " " + path.string() + ": " + std::system_category().message(errno);
+}
+
+/**
+ * @brief Writes the entries of a directory to the medium, so created and removed files survive a
+ * power cut.
+ * @param directory The directory.
+ * @return true if synced, otherwise false with errno.
+ */
+bool sync_directory(const std::filesystem::path& directory) {
+  int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  bool synced = ::fsync(fd) == 0;
+  ::close(fd);
+  return synced;
+}
+}  // namespace
+
+/**
+ * @brief constructor, the segment size is bounded to a page and 1 GiB.
+ * @param config The configuration.
+ */
+app::DiskQueue::DiskQueue(const DiskQueueConfig& config) : m_config(config) {
+  m_config.segmentSize = (std::clamp(m_config.segmentSize, MinSegmentSize, MaxSegmentSize) + 7) & ~size_t{7};
+}
+
+/**
+ * @brief destructor, writes the records in RAM to files.
+ */
+app::DiskQueue::~DiskQueue() {
+  close();
+}
+
+/**
+ * @brief Creates the directory and takes over the segment files of a previous run, oldest first.
+ * @return true if the queue is usable, otherwise false with last_error().
+ */
+bool app::DiskQueue::open() {
+  m_lastError.clear();
+  if (!m_segments.empty()) {
+    m_lastError = "the queue holds records";
+    return false;
+  }
+  if (m_config.directory.empty()) {
+    return true;
+  }
+  std::error_code error;
+  if (std::filesystem::create_directories(m_config.directory, error)) {
+    // the entry of the new directory in its parent
+    std::error_code ignored;
+    sync_directory(std::filesystem::absolute(m_config.directory, ignored).parent_path());
+  }
+  if (error) {
+    m_lastError = "can't create " + m_config.directory.string() + ": " + error.message();
+    return false;
+  }
+
+  std::vector<std::pair<uint64_t, std::filesystem::path>> files;
+  for (const auto& entry : std::filesystem::directory_iterator(m_config.directory, error)) {
+    auto name = entry.path().filename().string();
+    if (name.size() != FilePrefix.size() + 16 + FileSuffix.size() || !name.starts_with(FilePrefix) ||
+        !name.ends_with(FileSuffix)) {
+      continue;
+    }
+    uint64_t sequence = 0;
+    const char* digits = name.data() + FilePrefix.size();
+    auto [ptr, ec] = std::from_chars(digits, digits + 16, sequence, 16);
+    if (ec == std::errc() && ptr == digits + 16) {
+      files.emplace_back(sequence, entry.path());
+    }
+  }
+  if (error) {
+    m_lastError = "can't list " + m_config.directory.string() + ": " + error.message();
+    return false;
+  }
+  std::sort(files.begin(), files.end());
+  for (const auto& [sequence, path] : files) {
+    recover(path, sequence);
+    m_nextSequence = sequence + 1;
+  }
+  return true;
+}
+
+/**
+ * @brief Writes the segments in RAM with unread records to files and empties the queue; the files
+ * stay for the next open(). The read cursors and the directory are synced, so the next open() after
+ * a power cut doesn't repeat the records read before.
+ */
+void app::DiskQueue::close() {
+  while (m_memorySegments > 0) {
+    auto index = m_segments.size() - m_memorySegments;
+    auto& segment = m_segments[index];
+    if (segment.records == 0) {
+      release(segment, false);
+      m_segments.erase(m_segments.begin() + static_cast<ptrdiff_t>(index));
+    } else if (m_config.directory.empty() || !spill(segment)) {
+      drop_segment(index);
+    }
+  }
+  for (auto& segment : m_segments) {
+    if (segment.mapped != nullptr && segment.records > 0) {
+      ::msync(segment.mapped, HeaderSize, MS_SYNC);
+    }
+    release(segment, segment.records == 0);
+  }
+  if (!m_config.directory.empty() && !m_segments.empty()) {
+    sync_directory(m_config.directory);
+  }
+  m_segments.clear();
+  m_diskBytes = 0;
+  m_records = 0;
+  m_frontChecked = false;
+}
+
+/**
+ * @brief Queues a record at the end of the segment in RAM, a full segment is followed by a new
+ * one. The checksum is computed when the segment spills, a record read from RAM doesn't need it.
+ * @param record The record.
+ * @return false if the record doesn't fit into a segment.
+ */
+bool app::DiskQueue::push(std::span<const uint8_t> record) {
+  const auto space = record_space(record.size());
+  if (space > m_config.segmentSize - HeaderSize) {
+    ++m_statistics.rejected;
+    return false;
+  }
+  if (m_memorySegments == 0 || m_segments.back().writeCursor + space > m_config.segmentSize) {
+    add_memory_segment();
+  }
+  auto& tail = m_segments.back();
+  auto* at = tail.memory.data() + tail.writeCursor;
+  const auto size = static_cast<uint32_t>(record.size());
+  std::memcpy(at, &size, sizeof(size));
+  if (!record.empty()) {
+    std::memcpy(at + RecordHeaderSize, record.data(), record.size());
+  }
+  tail.writeCursor += space;
+  ++tail.records;
+  ++tail.written;
+  ++m_records;
+  ++m_statistics.pushed;
+  return true;
+}
+
+/**
+ * @brief Gets the oldest record. A file is mapped when its first record is read and its records
+ * are checked against their checksums; a bad record drops the rest of its segment.
+ * @return The record, none if the queue is empty.
+ */
+std::optional<std::span<const uint8_t>> app::DiskQueue::front() {
+  while (!m_segments.empty()) {
+    auto& head = m_segments.front();
+    if (head.records == 0) {
+      if (m_segments.size() == 1 && head.in_memory()) {
+        return std::nullopt;
+      }
+      release(head, true);
+      m_segments.pop_front();
+      continue;
+    }
+    if (head.in_memory()) {
+      uint32_t size = 0;
+      std::memcpy(&size, head.memory.data() + head.readCursor, sizeof(size));
+      return std::span<const uint8_t>(head.memory.data() + head.readCursor + RecordHeaderSize, size);
+    }
+    if (head.mapped == nullptr && !map(head)) {
+      drop_segment(0);
+      continue;
+    }
+    uint32_t size = 0;
+    uint32_t checksum = 0;
+    std::memcpy(&size, head.mapped + head.readCursor, sizeof(size));
+    std::memcpy(&checksum, head.mapped + head.readCursor + sizeof(size), sizeof(checksum));
+    std::span<const uint8_t> record(head.mapped + head.readCursor + RecordHeaderSize, size);
+    if (!m_frontChecked) {
+      if (head.readCursor + record_space(size) > head.writeCursor || crc32c(record) != checksum) {
+        m_statistics.corrupt += head.records;
+        m_records -= head.records;
+        head.records = 0;
+        continue;
+      }
+      m_frontChecked = true;
+    }
+    return record;
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief Removes the oldest record. A file keeps the read cursor in its mapped header and is removed
+ * when drained; a drained segment in RAM that is the only one starts over, so a queue with its link
+ * up stays in one segment.
+ */
+void app::DiskQueue::pop() {
+  auto record = front();
+  if (!record) {
+    return;
+  }
+  auto& head = m_segments.front();
+  head.readCursor += record_space(record->size());
+  --head.records;
+  --m_records;
+  ++m_statistics.popped;
+  m_frontChecked = false;
+  if (head.mapped != nullptr) {
+    const auto cursor = static_cast<uint32_t>(head.readCursor);
+    std::memcpy(head.mapped + ReadCursorOffset, &cursor, sizeof(cursor));
+  }
+  if (head.records == 0) {
+    if (head.in_memory() && m_segments.size() == 1) {
+      head.readCursor = head.writeCursor = HeaderSize;
+      head.written = 0;
+    } else {
+      release(head, true);
+      m_segments.pop_front();
+    }
+  }
+}
+
+/**
+ * @brief Gets the path of a segment file.
+ * @param sequence The sequence number of the segment.
+ * @return The path, the name sorts in sequence order.
+ */
+std::filesystem::path app::DiskQueue::segment_path(uint64_t sequence) const {
+  char digits[17];
+  std::snprintf(digits, sizeof(digits), "%016llx", static_cast<unsigned long long>(sequence));
+  return m_config.directory / (std::string(FilePrefix) + digits + std::string(FileSuffix));
+}
+
+/**
+ * @brief Appends a segment in RAM, with the buffer of a retired one if there is one, and spills
+ * the oldest segments in RAM beyond the memory limit.
+ */
+void app::DiskQueue::add_memory_segment() {
+  Segment segment;
+  segment.sequence = m_nextSequence++;
+  if (m_spare.size() == m_config.segmentSize) {
+    segment.memory = std::move(m_spare);
+    m_spare = {};
+  } else {
+    segment.memory.resize(m_config.segmentSize);
+  }
+  segment.writeCursor = segment.readCursor = HeaderSize;
+  m_segments.push_back(std::move(segment));
+  ++m_memorySegments;
+  limit_memory();
+}
+
+/**
+ * @brief Spills the oldest segments in RAM beyond the memory limit, the one being written stays.
+ * Without a directory, or if the spill fails, the segment is dropped: RAM is bounded in any case.
+ */
+void app::DiskQueue::limit_memory() {
+  while (m_memorySegments > 1 && memory_bytes() > m_config.memoryLimit) {
+    auto index = m_segments.size() - m_memorySegments;
+    if (m_config.directory.empty() || !spill(m_segments[index])) {
+      drop_segment(index);
+    }
+  }
+}
+
+/**
+ * @brief Writes a segment in RAM to its file, after dropping the oldest files beyond the budget.
+ *
+ * The blocks are allocated before the copy into the mapping, so a full disk fails here and not
+ * with SIGBUS in the copy. The file and its directory entry are synced before the RAM is released,
+ * a spilled segment survives a power cut.
+ * @param segment The segment.
+ * @return true if written, otherwise false with last_error().
+ */
+bool app::DiskQueue::spill(Segment& segment) {
+  const auto size = segment.writeCursor;
+  while (m_diskBytes + size > m_config.diskBudget && m_segments.size() > m_memorySegments) {
+    drop_segment(0);
+  }
+  if (m_diskBytes + size > m_config.diskBudget) {
+    m_lastError = "the disk budget is smaller than a segment";
+    return false;
+  }
+
+  for (size_t offset = HeaderSize; offset < segment.writeCursor;) {
+    uint32_t length = 0;
+    std::memcpy(&length, segment.memory.data() + offset, sizeof(length));
+    auto checksum = crc32c({segment.memory.data() + offset + RecordHeaderSize, length});
+    std::memcpy(segment.memory.data() + offset + sizeof(length), &checksum, sizeof(checksum));
+    offset += record_space(length);
+  }
+  SegmentHeader header{Magic,
+                       Version,
+                       0,
+                       segment.sequence,
+                       static_cast<uint32_t>(segment.writeCursor),
+                       segment.written,
+                       0,
+                       static_cast<uint32_t>(segment.readCursor)};
+  header.checksum = header_checksum(header);
+  std::memcpy(segment.memory.data(), &header, sizeof(header));
+
+  auto path = segment_path(segment.sequence);
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    m_lastError = system_error("can't create", path);
+    return false;
+  }
+  if (int result = ::posix_fallocate(fd, 0, static_cast<off_t>(size)); result != 0) {
+    errno = result;
+    m_lastError = system_error("can't allocate", path);
+    ::close(fd);
+    ::unlink(path.c_str());
+    return false;
+  }
+  void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    m_lastError = system_error("can't map", path);
+    ::unlink(path.c_str());
+    return false;
+  }
+  std::memcpy(mapping, segment.memory.data(), size);
+  bool synced = ::msync(mapping, size, MS_SYNC) == 0;
+  ::munmap(mapping, size);
+  if (!synced || !sync_directory(m_config.directory)) {
+    m_lastError = system_error("can't sync", path);
+    ::unlink(path.c_str());
+    return false;
+  }
+
+  release(segment, false);
+  segment.fileSize = size;
+  m_diskBytes += size;
+  ++m_statistics.spilled;
+  return true;
+}
+
+/**
+ * @brief Drops a segment with its unread records.
+ * @param index The position of the segment.
+ */
+void app::DiskQueue::drop_segment(size_t index) {
+  auto& segment = m_segments[index];
+  m_statistics.dropped += segment.records;
+  ++m_statistics.droppedSegments;
+  m_records -= segment.records;
+  release(segment, true);
+  m_segments.erase(m_segments.begin() + static_cast<ptrdiff_t>(index));
+  if (index == 0) {
+    m_frontChecked = false;
+  }
+}
+
+/**
+ * @brief Releases the RAM or the mapping of a segment, the buffer is kept for the next segment.
+ * @param segment The segment.
+ * @param removeFile Removes the file of a segment on disk.
+ */
+void app::DiskQueue::release(Segment& segment, bool removeFile) {
+  if (segment.in_memory()) {
+    --m_memorySegments;
+    if (m_spare.empty()) {
+      m_spare = std::move(segment.memory);
+    }
+    segment.memory = {};
+    return;
+  }
+  if (segment.mapped != nullptr) {
+    ::munmap(segment.mapped, segment.fileSize);
+    segment.mapped = nullptr;
+  }
+  if (removeFile) {
+    ::unlink(segment_path(segment.sequence).c_str());
+    m_diskBytes -= segment.fileSize;
+  }
+}
+
+/**
+ * @brief Maps the file of a segment for reading and reads the next file ahead, so the drain
+ * doesn't wait for flash at the switch.
+ * @param segment The segment.
+ * @return true if mapped, otherwise false with last_error().
+ */
+bool app::DiskQueue::map(Segment& segment) {
+  auto path = segment_path(segment.sequence);
+  int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    m_lastError = system_error("can't open", path);
+    return false;
+  }
+  void* mapping = ::mmap(nullptr, segment.fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    m_lastError = system_error("can't map", path);
+    return false;
+  }
+  ::madvise(mapping, segment.fileSize, MADV_SEQUENTIAL);
+  ::madvise(mapping, segment.fileSize, MADV_WILLNEED);
+  segment.mapped = static_cast<uint8_t*>(mapping);
+
+  if (m_segments.size() > 1 && !m_segments[1].in_memory()) {
+    if (int next = ::open(segment_path(m_segments[1].sequence).c_str(), O_RDONLY | O_CLOEXEC); next >= 0) {
+      ::posix_fadvise(next, 0, 0, POSIX_FADV_WILLNEED);
+      ::close(next);
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Takes over a segment file of a previous run. The records are checked up to the write
+ * cursor; a file without unread records, or with a bad header, is removed.
+ * @param path The path of the file.
+ * @param sequence The sequence number of the segment.
+ */
+void app::DiskQueue::recover(const std::filesystem::path& path, uint64_t sequence) {
+  int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    m_lastError = system_error("can't open", path);
+    return;
+  }
+  struct stat status {};
+  void* mapping = MAP_FAILED;
+  if (::fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= HeaderSize) {
+    mapping = ::mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    ::unlink(path.c_str());
+    return;
+  }
+  const auto fileSize = static_cast<size_t>(status.st_size);
+  const auto* data = static_cast<const uint8_t*>(mapping);
+  SegmentHeader header{};
+  std::memcpy(&header, data, sizeof(header));
+  if (header.magic != Magic || header.version != Version || header.checksum != header_checksum(header) ||
+      header.sequence != sequence || header.writeCursor < HeaderSize || header.writeCursor > fileSize) {
+    ::munmap(mapping, fileSize);
+    ::unlink(path.c_str());
+    return;
+  }
+
+  Segment segment;
+  segment.sequence = sequence;
+  segment.fileSize = fileSize;
+  segment.readCursor = HeaderSize;
+  bool cursorValid = header.readCursor == HeaderSize;
+  uint64_t unread = 0;
+  size_t offset = HeaderSize;
+  while (offset + RecordHeaderSize <= header.writeCursor) {
+    uint32_t size = 0;
+    uint32_t checksum = 0;
+    std::memcpy(&size, data + offset, sizeof(size));
+    std::memcpy(&checksum, data + offset + sizeof(size), sizeof(checksum));
+    if (size > header.writeCursor - offset - RecordHeaderSize ||
+        crc32c({data + offset + RecordHeaderSize, size}) != checksum) {
+      break;
+    }
+    offset += record_space(size);
+    ++segment.written;
+    unread += offset > header.readCursor ? 1 : 0;
+    cursorValid = cursorValid || offset == header.readCursor;
+  }
+  ::munmap(mapping, fileSize);
+  segment.writeCursor = offset;
+  m_statistics.corrupt += header.records > segment.written ? header.records - segment.written : 0;
+  if (cursorValid) {
+    segment.readCursor = header.readCursor;
+    segment.records = unread;
+  } else {
+    segment.records = segment.written;
+  }
+  if (segment.records == 0) {
+    ::unlink(path.c_str());
+    return;
+  }
+  m_diskBytes += fileSize;
+  m_records += segment.records;
+  m_statistics.recovered += segment.records;
+  m_segments.push_back(std::move(segment));
+}
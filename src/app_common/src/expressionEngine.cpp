@@ -0,0 +1,694 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "expressionEngine.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <string_view>
+// clang-format on
+
+namespace {
+constexpr size_t MaxSlots = 256;  ///< inputs or constants of a formula, an operand byte
+constexpr size_t LaneBlock = 4;   ///< a batch is padded to a multiple of this many lanes
+constexpr uint8_t Unvisited = 0;  ///< state of a formula whose level is unknown
+constexpr uint8_t Visiting = 1;   ///< state of a formula on the current path
+constexpr uint8_t Visited = 2;    ///< state of a formula whose level is known
+
+/**
+ * @brief The bytecode and the slots of one formula.
+ */
+struct Program {
+  std::vector<app::ExpressionInstruction> code;  ///< bytecode, the result ends in register 0
+  std::vector<uint32_t> inputs;                  ///< point of each input slot
+  std::vector<double> constants;                 ///< value of each constant slot
+};
+
+/**
+ * @brief Recursive descent parser of a formula, emits the bytecode while it parses. The operands
+ * live on a stack of registers: every operand pushes a register, an operation pops its operands
+ * and pushes its result into the register of the first one.
+ */
+class Parser {
+ public:
+  /**
+   * @brief Creates the parser.
+   * @param text The formula.
+   * @param program Receives the bytecode.
+   */
+  Parser(std::string_view text, Program& program) : m_text(text), m_program(program) {}
+
+  /**
+   * @brief Parses the formula.
+   * @return The reason of a failure, empty if parsed.
+   */
+  std::string parse() {
+    if (parse_or() && (skip(), m_position != m_text.size())) {
+      fail("unexpected \"" + std::string(m_text.substr(m_position)) + "\"");
+    }
+    return m_error;
+  }
+
+ private:
+  bool parse_or() {
+    if (!parse_and()) {
+      return false;
+    }
+    while (accept("||")) {
+      if (!parse_and()) {
+        return false;
+      }
+      binary(app::ExpressionOpcode::logicalOr);
+    }
+    return true;
+  }
+
+  bool parse_and() {
+    if (!parse_comparison()) {
+      return false;
+    }
+    while (accept("&&")) {
+      if (!parse_comparison()) {
+        return false;
+      }
+      binary(app::ExpressionOpcode::logicalAnd);
+    }
+    return true;
+  }
+
+  bool parse_comparison() {
+    static constexpr std::pair<std::string_view, app::ExpressionOpcode> Operators[] = {
+        {"<=", app::ExpressionOpcode::lessEqual}, {">=", app::ExpressionOpcode::greaterEqual},
+        {"==", app::ExpressionOpcode::equal},     {"!=", app::ExpressionOpcode::notEqual},
+        {"<", app::ExpressionOpcode::less},       {">", app::ExpressionOpcode::greater},
+    };
+    if (!parse_sum()) {
+      return false;
+    }
+    for (const auto& [token, opcode] : Operators) {
+      if (accept(token)) {
+        if (!parse_sum()) {
+          return false;
+        }
+        binary(opcode);
+        break;
+      }
+    }
+    return true;
+  }
+
+  bool parse_sum() {
+    if (!parse_term()) {
+      return false;
+    }
+    for (;;) {
+      app::ExpressionOpcode opcode;
+      if (accept("+")) {
+        opcode = app::ExpressionOpcode::add;
+      } else if (accept("-")) {
+        opcode = app::ExpressionOpcode::subtract;
+      } else {
+        return true;
+      }
+      if (!parse_term()) {
+        return false;
+      }
+      binary(opcode);
+    }
+  }
+
+  bool parse_term() {
+    if (!parse_unary()) {
+      return false;
+    }
+    for (;;) {
+      app::ExpressionOpcode opcode;
+      if (accept("*")) {
+        opcode = app::ExpressionOpcode::multiply;
+      } else if (accept("/")) {
+        opcode = app::ExpressionOpcode::divide;
+      } else {
+        return true;
+      }
+      if (!parse_unary()) {
+        return false;
+      }
+      binary(opcode);
+    }
+  }
+
+  bool parse_unary() {
+    if (accept("-")) {
+      return parse_unary() && unary(app::ExpressionOpcode::negate);
+    }
+    if (accept("!")) {
+      return parse_unary() && unary(app::ExpressionOpcode::logicalNot);
+    }
+    return parse_primary();
+  }
+
+  bool parse_primary() {
+    skip();
+    if (accept("(")) {
+      return parse_or() && expect(")");
+    }
+    if (m_position < m_text.size() &&
+        (std::isdigit(static_cast<unsigned char>(m_text[m_position])) != 0 || m_text[m_position] == '.')) {
+      double value{0};
+      auto [ptr, ec] = std::from_chars(m_text.data() + m_position, m_text.data() + m_text.size(), value);
+      if (ec != std::errc()) {
+        return fail("invalid number");
+      }
+      m_position = static_cast<size_t>(ptr - m_text.data());
+      return push_constant(value);
+    }
+    auto start = m_position;
+    while (m_position < m_text.size() && (std::isalnum(static_cast<unsigned char>(m_text[m_position])) != 0)) {
+      ++m_position;
+    }
+    auto name = m_text.substr(start, m_position - start);
+    uint32_t point{0};
+    if (name.size() > 1 && name[0] == 'p' &&
+        std::from_chars(name.data() + 1, name.data() + name.size(), point).ptr == name.data() + name.size()) {
+      return push_input(point);
+    }
+    if (name == "true" || name == "false") {
+      return push_constant(name == "true" ? 1.0 : 0.0);
+    }
+    if (name.empty() || !accept("(")) {
+      return fail(name.empty() ? "operand expected" : "unknown name \"" + std::string(name) + "\"");
+    }
+    return parse_function(name);
+  }
+
+  bool parse_function(std::string_view name) {
+    // the variadic functions fold from the left, like the operators
+    size_t arguments{0};
+    app::ExpressionOpcode fold{app::ExpressionOpcode::add};
+    if (name == "min" || name == "max" || name == "sum" || name == "avg") {
+      fold = name == "min"   ? app::ExpressionOpcode::minimum
+             : name == "max" ? app::ExpressionOpcode::maximum
+                             : app::ExpressionOpcode::add;
+      do {
+        if (!parse_or()) {
+          return false;
+        }
+        if (++arguments > 1) {
+          binary(fold);
+        }
+      } while (accept(","));
+      if ((name == "min" || name == "max") && arguments < 2) {
+        return fail(std::string(name) + " needs two arguments");
+      }
+      if (name == "avg" && !(push_constant(static_cast<double>(arguments)) && binary(app::ExpressionOpcode::divide))) {
+        return false;
+      }
+      return expect(")");
+    }
+    if (name == "abs") {
+      return parse_or() && expect(")") && unary(app::ExpressionOpcode::absolute);
+    }
+    if (name == "limit") {
+      // min(max(x, low), high)
+      return parse_or() && expect(",") && parse_or() && binary(app::ExpressionOpcode::maximum) && expect(",") &&
+             parse_or() && binary(app::ExpressionOpcode::minimum) && expect(")");
+    }
+    if (name == "if") {
+      if (!(parse_or() && expect(",") && parse_or() && expect(",") && parse_or() && expect(")"))) {
+        return false;
+      }
+      m_top -= 2;
+      emit(app::ExpressionOpcode::select, m_top - 1, m_top - 1, m_top, m_top + 1);
+      return true;
+    }
+    return fail("unknown function \"" + std::string(name) + "\"");
+  }
+
+  bool push_input(uint32_t point) {
+    if (m_program.inputs.size() == MaxSlots) {
+      return fail("too many points");
+    }
+    m_program.inputs.push_back(point);
+    return push(app::ExpressionOpcode::input, m_program.inputs.size() - 1);
+  }
+
+  bool push_constant(double value) {
+    if (m_program.constants.size() == MaxSlots) {
+      return fail("too many constants");
+    }
+    m_program.constants.push_back(value);
+    return push(app::ExpressionOpcode::constant, m_program.constants.size() - 1);
+  }
+
+  bool push(app::ExpressionOpcode opcode, size_t slot) {
+    if (m_top == app::ExpressionEngine::MaxRegisters) {
+      return fail("formula too deep");
+    }
+    emit(opcode, m_top, slot, 0, 0);
+    ++m_top;
+    return true;
+  }
+
+  bool binary(app::ExpressionOpcode opcode) {
+    --m_top;
+    emit(opcode, m_top - 1, m_top - 1, m_top, 0);
+    return true;
+  }
+
+  bool unary(app::ExpressionOpcode opcode) {
+    emit(opcode, m_top - 1, m_top - 1, 0, 0);
+    return true;
+  }
+
+  void emit(app::ExpressionOpcode opcode, size_t destination, size_t a, size_t b, size_t c) {
+    m_program.code.push_back({opcode, static_cast<uint8_t>(destination), static_cast<uint8_t>(a),
+                              static_cast<uint8_t>(b), static_cast<uint8_t>(c)});
+  }
+
+  void skip() {
+    while (m_position < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_position])) != 0) {
+      ++m_position;
+    }
+  }
+
+  bool accept(std::string_view token) {
+    skip();
+    if (!m_text.substr(m_position).starts_with(token)) {
+      return false;
+    }
+    m_position += token.size();
+    return true;
+  }
+
+  bool expect(std::string_view token) {
+    return accept(token) || fail("\"" + std::string(token) + "\" expected");
+  }
+
+  bool fail(std::string error) {
+    if (m_error.empty()) {
+      m_error = std::move(error);
+    }
+    return false;
+  }
+
+  std::string_view m_text;  ///< formula
+  Program& m_program;       ///< bytecode
+  size_t m_position{0};     ///< parse position in the formula
+  size_t m_top{0};          ///< next free register
+  std::string m_error;      ///< reason of the failure
+};
+
+/**
+ * @brief Runs an operation over the values of a batch, the loop the compiler vectorizes.
+ * @param count The number of values, a multiple of LaneBlock.
+ * @param operation The operation of a value.
+ */
+template <typename Operation>
+inline void for_lanes(size_t count, Operation&& operation) {
+  for (size_t i = 0; i < count; ++i) {
+    operation(i);
+  }
+}
+}  // namespace
+
+/**
+ * @brief Compiles the formulas, all of them are evaluated by the next evaluate().
+ * @param definitions The computed points.
+ * @return true if compiled, otherwise false with last_error(); the engine is empty then.
+ */
+bool app::ExpressionEngine::compile(std::span<const ExpressionDefinition> definitions) {
+  clear();
+  m_error.clear();
+
+  std::vector<Program> programs(definitions.size());
+  std::map<uint32_t, size_t> producers;
+  for (size_t i = 0; i < definitions.size(); ++i) {
+    const auto& definition = definitions[i];
+    if (auto error = Parser(definition.formula, programs[i]).parse(); !error.empty()) {
+      clear();
+      return fail("p" + std::to_string(definition.destination) + ": " + error + " in \"" + definition.formula + "\"");
+    }
+    if (!producers.emplace(definition.destination, i).second) {
+      clear();
+      return fail("p" + std::to_string(definition.destination) + " computed twice");
+    }
+    m_requiredPoints = std::max<size_t>(m_requiredPoints, definition.destination + size_t{1});
+    for (auto point : programs[i].inputs) {
+      m_requiredPoints = std::max<size_t>(m_requiredPoints, point + size_t{1});
+    }
+  }
+
+  // the level of a formula is one more than the highest level of the formulas computing its inputs
+  std::vector<uint32_t> levels(definitions.size());
+  std::vector<uint8_t> states(definitions.size(), Unvisited);
+  std::vector<std::pair<size_t, size_t>> path;
+  for (size_t root = 0; root < definitions.size(); ++root) {
+    if (states[root] == Visited) {
+      continue;
+    }
+    states[root] = Visiting;
+    path.emplace_back(root, 0);
+    while (!path.empty()) {
+      auto& [formula, next] = path.back();
+      if (next == programs[formula].inputs.size()) {
+        states[formula] = Visited;
+        path.pop_back();
+        continue;
+      }
+      auto producer = producers.find(programs[formula].inputs[next++]);
+      if (producer == producers.end()) {
+        continue;
+      }
+      if (states[producer->second] == Visiting) {
+        clear();
+        return fail("p" + std::to_string(producer->first) + " depends on itself");
+      }
+      if (states[producer->second] == Unvisited) {
+        // the formula is revisited for this input once the producer has its level
+        --next;
+        states[producer->second] = Visiting;
+        path.emplace_back(producer->second, 0);
+        continue;
+      }
+      levels[formula] = std::max(levels[formula], levels[producer->second] + 1);
+    }
+  }
+
+  // the formulas of a group share the bytecode and the level, the slots differ
+  std::map<std::pair<uint32_t, std::string>, std::vector<size_t>> shapes;
+  for (size_t i = 0; i < definitions.size(); ++i) {
+    std::string code(programs[i].code.size() * sizeof(ExpressionInstruction), '\0');
+    std::memcpy(code.data(), programs[i].code.data(), code.size());
+    shapes[{levels[i], std::move(code)}].push_back(i);
+  }
+  std::vector<uint32_t> numbers(definitions.size());
+  for (const auto& [shape, members] : shapes) {
+    Group group;
+    group.level = shape.first;
+    group.code = programs[members.front()].code;
+    group.inputs = programs[members.front()].inputs.size();
+    group.first = m_size;
+    group.count = members.size();
+    group.inputPoints.resize(group.inputs * group.count);
+    group.constants.resize(programs[members.front()].constants.size() * group.count);
+    for (size_t j = 0; j < members.size(); ++j) {
+      const auto& program = programs[members[j]];
+      for (size_t i = 0; i < program.inputs.size(); ++i) {
+        group.inputPoints[i * group.count + j] = program.inputs[i];
+      }
+      for (size_t i = 0; i < program.constants.size(); ++i) {
+        group.constants[i * group.count + j] = program.constants[i];
+      }
+      group.destinations.push_back(definitions[members[j]].destination);
+      numbers[members[j]] = static_cast<uint32_t>(m_size + j);
+    }
+    m_size += group.count;
+    m_groups.push_back(std::move(group));
+  }
+
+  // the formulas reading a point, by point
+  m_dependentStart.assign(m_requiredPoints + 1, 0);
+  for (const auto& program : programs) {
+    for (auto point : program.inputs) {
+      m_dependentStart[point + 1]++;
+    }
+  }
+  std::partial_sum(m_dependentStart.begin(), m_dependentStart.end(), m_dependentStart.begin());
+  m_dependents.resize(m_dependentStart.back());
+  std::vector<uint32_t> fill(m_dependentStart.begin(), m_dependentStart.end() - 1);
+  for (size_t i = 0; i < programs.size(); ++i) {
+    for (auto point : programs[i].inputs) {
+      m_dependents[fill[point]++] = numbers[i];
+    }
+  }
+  m_computed.assign((m_requiredPoints + 63) / 64, 0);
+  for (const auto& definition : definitions) {
+    m_computed[definition.destination / 64] |= uint64_t{1} << (definition.destination % 64);
+  }
+  m_registers.assign(MaxRegisters * Lanes, 0.0);
+  m_dirty.assign((m_size + 63) / 64, 0);
+  invalidate();
+  return true;
+}
+
+/**
+ * @brief Parses a formula file and compiles it.
+ * @param path The formula file.
+ * @return true if loaded, otherwise false with last_error(); the engine is empty then.
+ */
+bool app::ExpressionEngine::load(const std::filesystem::path& path) {
+  std::ifstream file(path);
+  if (!file) {
+    clear();
+    return fail("can't open " + path.string());
+  }
+  std::vector<ExpressionDefinition> definitions;
+  std::string line;
+  for (size_t number = 1; std::getline(file, line); ++number) {
+    std::string_view text(line);
+    text = text.substr(0, text.find('#'));
+    auto begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos) {
+      continue;
+    }
+    text.remove_prefix(begin);
+    auto equal = text.find('=');
+    ExpressionDefinition definition;
+    auto [ptr, ec] = std::from_chars(text.data() + 1, text.data() + text.size(), definition.destination);
+    if (text[0] != 'p' || ec != std::errc() || equal == std::string_view::npos ||
+        text.substr(static_cast<size_t>(ptr - text.data()), equal - static_cast<size_t>(ptr - text.data()))
+                .find_first_not_of(" \t") != std::string_view::npos) {
+      clear();
+      return fail(path.string() + ":" + std::to_string(number) + ": invalid computed point \"" + line + "\"");
+    }
+    auto formula = text.substr(equal + 1);
+    formula.remove_prefix(std::min(formula.size(), formula.find_first_not_of(" \t")));
+    definition.formula = formula.substr(0, formula.find_last_not_of(" \t\r") + 1);
+    definitions.push_back(std::move(definition));
+  }
+  if (!compile(definitions)) {
+    m_error = path.string() + ": " + m_error;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Evaluates the formulas with a changed input and updates their points if the value or
+ * the quality changed. The quality of a computed point is the union of the input qualities, its
+ * timestamp the newest input timestamp.
+ * @param points The point database, at least required_points() points. The changed bits are
+ * read, the owner clears them after it consumed them.
+ * @return The number of evaluated formulas.
+ */
+size_t app::ExpressionEngine::evaluate(PointDatabase& points) {
+  if (m_size == 0) {
+    return 0;
+  }
+  // the changes of computed points were passed on when they were computed
+  points.for_each_changed([this](size_t point) {
+    if (point < m_requiredPoints && (m_computed[point / 64] >> (point % 64) & 1) == 0) {
+      mark_dependents(point);
+    }
+  });
+
+  size_t evaluated{0};
+  std::array<uint32_t, Lanes> lanes{};
+  for (const auto& group : m_groups) {
+    // a group marks only groups of a higher level, so its bits are final when it runs
+    size_t count{0};
+    size_t end = group.first + group.count;
+    for (size_t word = group.first / 64; word * 64 < end; ++word) {
+      auto bits = m_dirty[word];
+      if (word * 64 < group.first) {
+        bits &= ~uint64_t{0} << (group.first % 64);
+      }
+      if ((word + 1) * 64 > end) {
+        bits &= (uint64_t{1} << (end % 64)) - 1;
+      }
+      m_dirty[word] &= ~bits;
+      for (; bits != 0; bits &= bits - 1) {
+        lanes[count++] = static_cast<uint32_t>(word * 64 + static_cast<size_t>(std::countr_zero(bits)) - group.first);
+        if (count == Lanes) {
+          evaluate_batch(group, lanes, points);
+          evaluated += count;
+          count = 0;
+        }
+      }
+    }
+    if (count > 0) {
+      evaluate_batch(group, std::span(lanes.data(), count), points);
+      evaluated += count;
+    }
+  }
+  m_evaluated += evaluated;
+  return evaluated;
+}
+
+/**
+ * @brief Marks all formulas to be evaluated by the next evaluate().
+ */
+void app::ExpressionEngine::invalidate() {
+  std::fill(m_dirty.begin(), m_dirty.end(), ~uint64_t{0});
+  if (m_size % 64 != 0) {
+    m_dirty.back() = (uint64_t{1} << (m_size % 64)) - 1;
+  }
+}
+
+/**
+ * @brief Runs the bytecode of a group over a batch of its formulas and updates the points.
+ * @param group The group.
+ * @param lanes The formulas of the batch, numbered in the group, at most Lanes.
+ * @param points The point database.
+ */
+void app::ExpressionEngine::evaluate_batch(const Group& group, std::span<uint32_t> lanes, PointDatabase& points) {
+  // the padding lanes repeat the first formula, the loops run over whole blocks
+  std::array<uint32_t, Lanes> padded;
+  std::copy(lanes.begin(), lanes.end(), padded.begin());
+  const size_t count = (lanes.size() + LaneBlock - 1) / LaneBlock * LaneBlock;
+  std::fill(padded.begin() + static_cast<ptrdiff_t>(lanes.size()), padded.begin() + static_cast<ptrdiff_t>(count),
+            lanes[0]);
+
+  const double* values = points.values().data();
+  for (const auto& instruction : group.code) {
+    double* r = m_registers.data() + instruction.destination * Lanes;
+    const double* a = m_registers.data() + instruction.a * Lanes;
+    const double* b = m_registers.data() + instruction.b * Lanes;
+    const double* c = m_registers.data() + instruction.c * Lanes;
+    switch (instruction.opcode) {
+      case ExpressionOpcode::input: {
+        const uint32_t* slot = group.inputPoints.data() + instruction.a * group.count;
+        for_lanes(count, [&](size_t i) { r[i] = values[slot[padded[i]]]; });
+        break;
+      }
+      case ExpressionOpcode::constant: {
+        const double* slot = group.constants.data() + instruction.a * group.count;
+        for_lanes(count, [&](size_t i) { r[i] = slot[padded[i]]; });
+        break;
+      }
+      case ExpressionOpcode::add:
+        for_lanes(count, [&](size_t i) { r[i] = a[i] + b[i]; });
+        break;
+      case ExpressionOpcode::subtract:
+        for_lanes(count, [&](size_t i) { r[i] = a[i] - b[i]; });
+        break;
+      case ExpressionOpcode::multiply:
+        for_lanes(count, [&](size_t i) { r[i] = a[i] * b[i]; });
+        break;
+      case ExpressionOpcode::divide:
+        for_lanes(count, [&](size_t i) { r[i] = a[i] / b[i]; });
+        break;
+      case ExpressionOpcode::minimum:
+        for_lanes(count, [&](size_t i) { r[i] = b[i] < a[i] ? b[i] : a[i]; });
+        break;
+      case ExpressionOpcode::maximum:
+        for_lanes(count, [&](size_t i) { r[i] = a[i] < b[i] ? b[i] : a[i]; });
+        break;
+      case ExpressionOpcode::negate:
+        for_lanes(count, [&](size_t i) { r[i] = -a[i]; });
+        break;
+      case ExpressionOpcode::absolute:
+        for_lanes(count, [&](size_t i) { r[i] = std::fabs(a[i]); });
+        break;
+      case ExpressionOpcode::less:
+        for_lanes(count, [&](size_t i) { r[i] = a[i] < b[i] ? 1.0 : 0.0; });
+        break;
+      case ExpressionOpcode::lessEqual:
+        for_lanes(count, [&](size_t i) { r[i] = a[i] <= b[i] ? 1.0 : 0.0; });
+        break;
+      case ExpressionOpcode::greater:
+        for_lanes(count, [&](size_t i) { r[i] = a[i] > b[i] ? 1.0 : 0.0; });
+        break;
+      case ExpressionOpcode::greaterEqual:
+        for_lanes(count, [&](size_t i) { r[i] = a[i] >= b[i] ? 1.0 : 0.0; });
+        break;
+      case ExpressionOpcode::equal:
+        for_lanes(count, [&](size_t i) { r[i] = a[i] == b[i] ? 1.0 : 0.0; });
+        break;
+      case ExpressionOpcode::notEqual:
+        for_lanes(count, [&](size_t i) { r[i] = a[i] != b[i] ? 1.0 : 0.0; });
+        break;
+      case ExpressionOpcode::logicalAnd:
+        for_lanes(count, [&](size_t i) { r[i] = (a[i] != 0.0) & (b[i] != 0.0) ? 1.0 : 0.0; });
+        break;
+      case ExpressionOpcode::logicalOr:
+        for_lanes(count, [&](size_t i) { r[i] = (a[i] != 0.0) | (b[i] != 0.0) ? 1.0 : 0.0; });
+        break;
+      case ExpressionOpcode::logicalNot:
+        for_lanes(count, [&](size_t i) { r[i] = a[i] == 0.0 ? 1.0 : 0.0; });
+        break;
+      case ExpressionOpcode::select:
+        for_lanes(count, [&](size_t i) { r[i] = a[i] != 0.0 ? b[i] : c[i]; });
+        break;
+    }
+  }
+
+  // the quality and the timestamp follow the inputs, a point changes only with its value or quality
+  auto qualities = points.qualities();
+  auto timestamps = points.timestamps();
+  for (size_t i = 0; i < lanes.size(); ++i) {
+    uint32_t quality{0};
+    int64_t timestamp{0};
+    for (size_t input = 0; input < group.inputs; ++input) {
+      auto point = group.inputPoints[input * group.count + lanes[i]];
+      quality |= qualities[point];
+      timestamp = std::max(timestamp, timestamps[point]);
+    }
+    auto destination = group.destinations[lanes[i]];
+    auto value = m_registers[i];
+    if (std::bit_cast<uint64_t>(value) != std::bit_cast<uint64_t>(points.values()[destination]) ||
+        quality != qualities[destination]) {
+      points.update(destination, value, quality, timestamp);
+      mark_dependents(destination);
+    }
+  }
+}
+
+/**
+ * @brief Marks the formulas reading a point.
+ * @param point The point.
+ */
+void app::ExpressionEngine::mark_dependents(size_t point) {
+  for (auto i = m_dependentStart[point]; i < m_dependentStart[point + 1]; ++i) {
+    m_dirty[m_dependents[i] / 64] |= uint64_t{1} << (m_dependents[i] % 64);
+  }
+}
+
+/**
+ * @brief Removes all formulas.
+ */
+void app::ExpressionEngine::clear() {
+  m_groups.clear();
+  m_dependents.clear();
+  m_dependentStart.clear();
+  m_computed.clear();
+  m_dirty.clear();
+  m_size = 0;
+  m_requiredPoints = 0;
+  m_evaluated = 0;
+}
+
+/**
+ * @brief Sets the reason of a failure.
+ * @param error The reason.
+ * @return Always false.
+ */
+bool app::ExpressionEngine::fail(std::string error) {
+  m_error = std::move(error);
+  return false;
+}
@@ -0,0 +1,317 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "forkSnapshot.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+// clang-format on
+
+namespace {
+
+/**
+ * @brief Reads the resident memory of the process.
+ * @return The resident bytes, 0 if unknown.
+ */
+uint64_t read_resident_bytes() {
+  int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+  char buffer[128]{};
+  auto length = read(fd, buffer, sizeof(buffer) - 1);
+  close(fd);
+  if (length <= 0) {
+    return 0;
+  }
+  // "size resident shared ..." in pages
+  char* end = nullptr;
+  std::strtoull(buffer, &end, 10);
+  return std::strtoull(end, nullptr, 10) * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+/**
+ * @brief Reads the private memory of the process from smaps_rollup without allocating. In the child
+ * these are the pages the parent wrote since the fork, plus the few pages of the child itself.
+ * @return The private bytes, 0 if unknown.
+ */
+uint64_t read_private_bytes() {
+  int fd = open("/proc/self/smaps_rollup", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+  char buffer[4096]{};
+  size_t length{0};
+  for (ssize_t received; length < sizeof(buffer) - 1 &&
+                         (received = read(fd, buffer + length, sizeof(buffer) - 1 - length)) > 0;) {
+    length += static_cast<size_t>(received);
+  }
+  close(fd);
+
+  uint64_t kibibytes{0};
+  for (char* line = buffer; line != nullptr && *line != '\0';) {
+    for (const char* key : {"Private_Clean:", "Private_Dirty:"}) {
+      if (std::strncmp(line, key, std::strlen(key)) == 0) {
+        kibibytes += std::strtoull(line + std::strlen(key), nullptr, 10);
+      }
+    }
+    line = std::strchr(line, '\n');
+    line = line != nullptr ? line + 1 : nullptr;
+  }
+  return kibibytes * 1024;
+}
+
+/**
+ * @brief Gets the temporary file the child writes.
+ * @param path The final file.
+ * @return The temporary file.
+ */
+std::filesystem::path temporary_path(const std::filesystem::path& path) {
+  auto temporary = path;
+  temporary += ".tmp";
+  return temporary;
+}
+
+}  // namespace
+
+/**
+ * @brief Writes all bytes.
+ * @param data The bytes.
+ * @param size The number of bytes.
+ * @return true if written, otherwise false.
+ */
+bool app::SnapshotSink::write(const void* data, size_t size) {
+  auto bytes = static_cast<const char*>(data);
+  while (size > 0 && m_error == 0) {
+    auto written = ::write(m_fd, bytes, size);
+    if (written < 0) {
+      if (errno != EINTR) {
+        m_error = errno;
+      }
+      continue;
+    }
+    m_checksum.update(bytes, static_cast<size_t>(written));
+    bytes += written;
+    size -= static_cast<size_t>(written);
+    m_bytes += static_cast<uint64_t>(written);
+  }
+  return m_error == 0;
+}
+
+/**
+ * @brief Destructor waits for a running child.
+ */
+app::ForkSnapshot::~ForkSnapshot() {
+  wait();
+}
+
+/**
+ * @brief Forks a child that writes the snapshot to a file. The child writes "<path>.tmp", the
+ * parent renames it to the path when the child succeeded.
+ * @param path The file.
+ * @param writer The writer.
+ * @return true if the child runs, otherwise false; see last_error().
+ */
+bool app::ForkSnapshot::start(const std::filesystem::path& path, Writer writer) {
+  if (is_running()) {
+    m_lastError = "a snapshot is running";
+    return false;
+  }
+  auto temporary = temporary_path(path);
+  int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    m_lastError = "can't create " + temporary.string() + ": " + std::system_category().message(errno);
+    return false;
+  }
+  m_path = path;
+  if (!fork_child(fd, writer)) {
+    std::filesystem::remove(temporary);
+    m_path.clear();
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Forks a child that writes the snapshot to an open file or connected socket. The
+ * descriptor is closed when the snapshot ends.
+ * @param fd The descriptor, owned by the snapshot.
+ * @param writer The writer.
+ * @return true if the child runs, otherwise false; see last_error().
+ */
+bool app::ForkSnapshot::start(int fd, Writer writer) {
+  if (is_running()) {
+    m_lastError = "a snapshot is running";
+    close(fd);
+    return false;
+  }
+  m_path.clear();
+  return fork_child(fd, writer);
+}
+
+/**
+ * @brief Collects the result of a finished child without blocking.
+ * @return The result once the child ended, none while it runs or if none was started.
+ */
+std::optional<app::ForkSnapshot::Result> app::ForkSnapshot::poll() {
+  if (!is_running()) {
+    return std::nullopt;
+  }
+  int status{0};
+  auto pid = waitpid(m_child, &status, WNOHANG);
+  if (pid == 0 || (pid < 0 && errno == EINTR)) {
+    return std::nullopt;
+  }
+  return finish(pid < 0 ? -1 : status);
+}
+
+/**
+ * @brief Waits for the child to end.
+ * @return The result, none if no child was started.
+ */
+std::optional<app::ForkSnapshot::Result> app::ForkSnapshot::wait() {
+  if (!is_running()) {
+    return std::nullopt;
+  }
+  int status{0};
+  pid_t pid;
+  while ((pid = waitpid(m_child, &status, 0)) < 0 && errno == EINTR) {
+  }
+  return finish(pid < 0 ? -1 : status);
+}
+
+/**
+ * @brief Creates the report pipe and forks the child.
+ * @param fd The output, closed on failure.
+ * @param writer The writer.
+ * @return true if the child runs, otherwise false.
+ */
+bool app::ForkSnapshot::fork_child(int fd, Writer& writer) {
+  int report[2];
+  if (pipe2(report, O_CLOEXEC) < 0) {
+    m_lastError = "can't create the report pipe: " + std::system_category().message(errno);
+    close(fd);
+    return false;
+  }
+  m_residentBytes = read_resident_bytes();
+
+  // the pause of the calling thread: fork() copies the page tables and marks all pages copy on write
+  auto begin = Clock::now();
+  auto pid = fork();
+  if (pid == 0) {
+    close(report[0]);
+    run_child(fd, report[1], writer);
+  }
+  m_forked = Clock::now();
+  m_pause = m_forked - begin;
+
+  close(report[1]);
+  if (pid < 0) {
+    m_lastError = "can't fork: " + std::system_category().message(errno);
+    close(report[0]);
+    close(fd);
+    return false;
+  }
+  m_child = pid;
+  m_fd = fd;
+  m_pipe = report[0];
+  return true;
+}
+
+/**
+ * @brief Runs the writer in the child and reports the result.
+ * @param fd The output.
+ * @param report The write end of the report pipe.
+ * @param writer The writer.
+ */
+void app::ForkSnapshot::run_child(int fd, int report, Writer& writer) {
+  // a signal for the daemon must not run its handlers in the child, a closed socket fails the write
+  for (int signal : {SIGINT, SIGTERM, SIGHUP, SIGUSR1, SIGUSR2}) {
+    std::signal(signal, SIG_DFL);
+  }
+  std::signal(SIGPIPE, SIG_IGN);
+  if (m_childSettings) {
+    [[maybe_unused]] auto error = m_childSettings->apply();
+  }
+
+  SnapshotSink sink(fd);
+  ChildReport result;
+  result.success = writer(sink) ? 1 : 0;
+  result.error = sink.error();
+  struct stat info {};
+  if (result.success && fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && fdatasync(fd) < 0) {
+    result.success = 0;
+    result.error = errno;
+  }
+  result.bytes = sink.bytes();
+  result.copiedBytes = read_private_bytes();
+  [[maybe_unused]] auto written = write(report, &result, sizeof(result));
+  _exit(result.success ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/**
+ * @brief Collects the report of the ended child, closes the descriptors and publishes the file.
+ * @param status The wait status, -1 if waitpid failed.
+ * @return The result.
+ */
+app::ForkSnapshot::Result app::ForkSnapshot::finish(int status) {
+  Result result;
+  result.pause = m_pause;
+  result.duration = Clock::now() - m_forked;
+  result.residentBytes = m_residentBytes;
+
+  ChildReport report;
+  bool reported = read(m_pipe, &report, sizeof(report)) == static_cast<ssize_t>(sizeof(report));
+  close(m_pipe);
+  close(m_fd);
+  m_pipe = -1;
+  m_fd = -1;
+  m_child = -1;
+
+  if (reported) {
+    result.bytes = report.bytes;
+    result.copiedBytes = report.copiedBytes;
+  }
+  result.success = reported && report.success && status >= 0 && WIFEXITED(status) &&
+                   WEXITSTATUS(status) == EXIT_SUCCESS;
+  if (!result.success) {
+    if (reported && report.error != 0) {
+      result.error = std::system_category().message(report.error);
+    } else if (status >= 0 && WIFSIGNALED(status)) {
+      result.error = "child killed by signal " + std::to_string(WTERMSIG(status));
+    } else {
+      result.error = "snapshot incomplete";
+    }
+  }
+
+  if (!m_path.empty()) {
+    std::error_code error;
+    if (result.success) {
+      std::filesystem::rename(temporary_path(m_path), m_path, error);
+      if (error) {
+        result.success = false;
+        result.error = "can't rename to " + m_path.string() + ": " + error.message();
+      }
+    }
+    if (!result.success) {
+      std::filesystem::remove(temporary_path(m_path), error);
+    }
+    result.target = m_path.string();
+  }
+  return result;
+}
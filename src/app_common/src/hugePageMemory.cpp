@@ -0,0 +1,284 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "hugePageMemory.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+// clang-format on
+
+namespace {
+
+/**
+ * @brief Rounds a size up to a multiple of the alignment.
+ * @param size The size.
+ * @param alignment The alignment, a power of two.
+ * @return The rounded size.
+ */
+size_t round_up(size_t size, size_t alignment) {
+  return (size + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * @brief Faults in all pages of a region, so the first access in the process does not.
+ * @param data The start of the region.
+ * @param size The size of the region.
+ */
+void prefault(std::byte* data, size_t size) {
+#ifdef MADV_POPULATE_WRITE
+  if (madvise(data, size, MADV_POPULATE_WRITE) == 0) {
+    return;
+  }
+#endif
+  const auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  for (size_t offset = 0; offset < size; offset += pageSize) {
+    *reinterpret_cast<volatile std::byte*>(data + offset) = std::byte{0};
+  }
+}
+
+/**
+ * @brief Maps a region aligned to the huge page size, so the kernel can back all of it with huge pages.
+ * @param size The size, a multiple of the alignment.
+ * @param alignment The huge page size.
+ * @return The region, nullptr if the system has no memory left.
+ */
+std::byte* map_aligned(size_t size, size_t alignment) {
+  void* mapping = mmap(nullptr, size + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED) {
+    return nullptr;
+  }
+  auto* start = static_cast<std::byte*>(mapping);
+  auto* aligned = reinterpret_cast<std::byte*>(round_up(reinterpret_cast<uintptr_t>(start), alignment));
+  if (aligned > start) {
+    munmap(start, static_cast<size_t>(aligned - start));
+  }
+  auto tail = static_cast<size_t>(start + size + alignment - (aligned + size));
+  if (tail > 0) {
+    munmap(aligned + size, tail);
+  }
+  return aligned;
+}
+
+}  // namespace
+
+/**
+ * @brief Gets the name of a backing.
+ * @param backing The backing.
+ * @return The name.
+ */
+std::string_view app::to_string(PageBacking backing) {
+  switch (backing) {
+    case PageBacking::explicitHugePages:
+      return "explicit huge pages";
+    case PageBacking::transparentHugePages:
+      return "transparent huge pages";
+    case PageBacking::normalPages:
+      return "normal pages";
+    case PageBacking::none:
+      break;
+  }
+  return "none";
+}
+
+/**
+ * @brief destructor releases the region
+ */
+app::HugePageRegion::~HugePageRegion() {
+  release();
+}
+
+/**
+ * @brief move constructor
+ * @param other The region to take over.
+ */
+app::HugePageRegion::HugePageRegion(HugePageRegion&& other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)),
+      m_backing(std::exchange(other.m_backing, PageBacking::none)) {}
+
+/**
+ * @brief move assignment
+ * @param other The region to take over.
+ * @return This region.
+ */
+app::HugePageRegion& app::HugePageRegion::operator=(HugePageRegion&& other) noexcept {
+  if (this != &other) {
+    release();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+    m_backing = std::exchange(other.m_backing, PageBacking::none);
+  }
+  return *this;
+}
+
+/**
+ * @brief Reserves the region, trying the backings of the policy in order.
+ * @param bytes The minimal size of the region.
+ * @param policy The backings to try.
+ * @return true if memory is reserved with any backing, otherwise false.
+ */
+bool app::HugePageRegion::reserve(size_t bytes, HugePagePolicy policy) {
+  release();
+  if (bytes == 0) {
+    return false;
+  }
+  const auto hugePageSize = huge_page_size();
+  const auto size = round_up(bytes, hugePageSize);
+
+  if (policy == HugePagePolicy::automatic) {
+    // the huge pages are reserved by the mmap, so a short hugetlbfs pool fails here instead of with SIGBUS
+    // later; MAP_POPULATE only prefaults the reserved pages, its failures are ignored
+    void* mapping =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (mapping != MAP_FAILED) {
+      m_data = static_cast<std::byte*>(mapping);
+      m_size = size;
+      m_backing = PageBacking::explicitHugePages;
+      return true;
+    }
+  }
+
+  auto* data = map_aligned(size, hugePageSize);
+  if (data == nullptr) {
+    return false;
+  }
+  m_data = data;
+  m_size = size;
+  m_backing = PageBacking::normalPages;
+  if (policy != HugePagePolicy::normal && madvise(data, size, MADV_HUGEPAGE) == 0) {
+    m_backing = PageBacking::transparentHugePages;
+  } else {
+#ifdef MADV_NOHUGEPAGE
+    // keeps "always" THP from backing a region that asked for normal pages
+    madvise(data, size, MADV_NOHUGEPAGE);
+#endif
+  }
+  prefault(data, size);
+  return true;
+}
+
+/**
+ * @brief Releases the region.
+ */
+void app::HugePageRegion::release() {
+  if (m_data != nullptr) {
+    munmap(m_data, m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_backing = PageBacking::none;
+}
+
+/**
+ * @brief Gets the bytes of the region the kernel backs with huge pages right now.
+ * @return The bytes, read from /proc/self/smaps.
+ */
+size_t app::HugePageRegion::huge_page_bytes() const {
+  if (m_data == nullptr) {
+    return 0;
+  }
+  if (m_backing == PageBacking::explicitHugePages) {
+    return m_size;
+  }
+
+  const auto begin = reinterpret_cast<uintptr_t>(m_data);
+  const auto end = begin + m_size;
+  std::ifstream smaps("/proc/self/smaps");
+  std::string line;
+  bool inside{false};
+  size_t bytes{0};
+  while (std::getline(smaps, line)) {
+    uintptr_t first{0};
+    uintptr_t last{0};
+    if (std::sscanf(line.c_str(), "%" SCNxPTR "-%" SCNxPTR " ", &first, &last) == 2) {
+      // mappings overlapping the region, a neighbour merged into the same mapping is counted as well
+      inside = first < end && last > begin;
+      continue;
+    }
+    size_t kilobytes{0};
+    if (inside && std::sscanf(line.c_str(), "AnonHugePages: %zu kB", &kilobytes) == 1) {
+      bytes += kilobytes * 1024;
+    }
+  }
+  return std::min(bytes, m_size);
+}
+
+/**
+ * @brief Gets the default huge page size of the system.
+ * @return The size in bytes, 2 MiB if the system does not report it.
+ */
+size_t app::HugePageRegion::huge_page_size() {
+  static const size_t size = []() {
+    std::ifstream meminfo("/proc/meminfo");
+    std::string line;
+    while (std::getline(meminfo, line)) {
+      size_t kilobytes{0};
+      if (std::sscanf(line.c_str(), "Hugepagesize: %zu kB", &kilobytes) == 1 && kilobytes > 0) {
+        return kilobytes * 1024;
+      }
+    }
+    return size_t{2 * 1024 * 1024};
+  }();
+  return size;
+}
+
+/**
+ * @brief Reserves the buffers.
+ * @param bufferSize The size of a buffer, rounded up to BufferAlignment.
+ * @param count The number of buffers.
+ * @param policy The backings to try.
+ * @return true if the buffers are reserved, otherwise false.
+ */
+bool app::BufferPool::reserve(size_t bufferSize, size_t count, HugePagePolicy policy) {
+  m_free.clear();
+  m_bufferSize = round_up(bufferSize, BufferAlignment);
+  if (m_bufferSize == 0 || count == 0 || count > UINT32_MAX || !m_region.reserve(m_bufferSize * count, policy)) {
+    m_bufferSize = 0;
+    return false;
+  }
+  m_free.reserve(count);
+  // the lowest buffers on top of the stack, so a lightly used pool touches few pages
+  for (auto index = static_cast<uint32_t>(count); index-- > 0;) {
+    m_free.push_back(index);
+  }
+  return true;
+}
+
+/**
+ * @brief Takes a buffer from the pool.
+ * @return The buffer, empty if all buffers are in use.
+ */
+std::span<std::byte> app::BufferPool::acquire() {
+  if (m_free.empty()) {
+    return {};
+  }
+  auto index = m_free.back();
+  m_free.pop_back();
+  return {m_region.data() + static_cast<size_t>(index) * m_bufferSize, m_bufferSize};
+}
+
+/**
+ * @brief Returns a buffer to the pool.
+ * @param buffer The buffer taken with acquire.
+ */
+void app::BufferPool::release(std::span<std::byte> buffer) {
+  if (buffer.data() == nullptr) {
+    return;
+  }
+  m_free.push_back(static_cast<uint32_t>(static_cast<size_t>(buffer.data() - m_region.data()) / m_bufferSize));
+}
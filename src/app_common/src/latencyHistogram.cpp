@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "latencyHistogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+// clang-format on
+
+/**
+ * @brief Adds all values of another histogram.
+ * @param other The other histogram.
+ */
+void app::LatencyHistogram::merge(const LatencyHistogram& other) {
+  for (size_t i = 0; i < BucketCount; ++i) {
+    m_counts[i] += other.m_counts[i];
+  }
+  m_total += other.m_total;
+  m_sum += other.m_sum;
+  m_min = std::min(m_min, other.m_min);
+  m_max = std::max(m_max, other.m_max);
+}
+
+/**
+ * @brief Removes all values.
+ */
+void app::LatencyHistogram::reset() {
+  m_counts.fill(0);
+  m_total = 0;
+  m_sum = 0;
+  m_min = UINT64_MAX;
+  m_max = 0;
+}
+
+/**
+ * @brief Gets the value at a percentile.
+ *
+ * The result is the highest value of the bucket holding the percentile, limited to the largest
+ * recorded value, so a reported percentile is never below the true one.
+ *
+ * @param percentile The percentile in the range 0 to 100.
+ * @return The value at the percentile, 0 if the histogram is empty.
+ */
+uint64_t app::LatencyHistogram::percentile(double percentile) const {
+  if (m_total == 0) {
+    return 0;
+  }
+
+  percentile = std::clamp(percentile, 0.0, 100.0);
+  auto rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(m_total)));
+  rank = std::max<uint64_t>(rank, 1);
+
+  uint64_t seen{0};
+  for (size_t i = 0; i < BucketCount; ++i) {
+    seen += m_counts[i];
+    if (seen >= rank) {
+      return std::min(highest_of(i), m_max);
+    }
+  }
+  return m_max;
+}
@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "netAddress.hpp"
+
+#include <arpa/inet.h>
+
+#include <charconv>
+// clang-format on
+
+/**
+ * @brief Parses an address in the form "[host:]port".
+ * @param text The address text.
+ * @param defaultHost The host used if the text contains only the port.
+ * @return The socket address or std::nullopt if the text is not a valid IPv4 address.
+ */
+std::optional<sockaddr_in> app::parse_ipv4_address(std::string_view text, std::string_view defaultHost) {
+  std::string host{defaultHost};
+  std::string_view port = text;
+
+  if (auto pos = text.rfind(':'); pos != std::string_view::npos) {
+    host.assign(text.substr(0, pos));
+    port = text.substr(pos + 1);
+  }
+  if (host.empty() || host == "*") {
+    host = "0.0.0.0";
+  } else if (host == "localhost") {
+    host = "127.0.0.1";
+  }
+
+  unsigned portNumber{0};
+  auto [ptr, ec] = std::from_chars(port.data(), port.data() + port.size(), portNumber);
+  if (ec != std::errc() || ptr != port.data() + port.size() || portNumber > 65535) {
+    return std::nullopt;
+  }
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(static_cast<uint16_t>(portNumber));
+  if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+    return std::nullopt;
+  }
+  return address;
+}
+
+/**
+ * @brief Formats a socket address as "host:port".
+ * @param address The socket address.
+ * @return The address text.
+ */
+std::string app::format_ipv4_address(const sockaddr_in& address) {
+  char host[INET_ADDRSTRLEN]{};
+  inet_ntop(AF_INET, &address.sin_addr, host, sizeof(host));
+  return std::string(host) + ":" + std::to_string(ntohs(address.sin_port));
+}
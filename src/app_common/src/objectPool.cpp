@@ -0,0 +1,246 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "objectPool.hpp"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+// clang-format on
+
+namespace {
+constexpr size_t SizeClasses = app::SlabPool::MaxBlockSize / app::SlabPool::BlockAlignment;  ///< number of pools
+
+std::mutex registryMutex;                                     ///< protects the creation of pools
+std::array<std::atomic<app::SlabPool*>, SizeClasses> registry{};  ///< pools by size class, never destroyed
+
+thread_local bool threadCacheDestroyed{false};  ///< the thread cache of this thread is gone (thread exit)
+}  // namespace
+
+namespace app {
+
+/**
+ * @brief The per-thread free lists of all pools.
+ *
+ * On thread exit all cached blocks are returned to their pools, so no block is lost when
+ * short-lived threads allocate.
+ */
+struct SlabThreadCache {
+  struct List {
+    SlabPool::FreeBlock* head{nullptr};  ///< first free block
+    size_t count{0};                     ///< number of free blocks
+  };
+
+  std::array<List, SizeClasses> lists{};  ///< free list per pool
+
+  ~SlabThreadCache() {
+    for (size_t i = 0; i < SizeClasses; ++i) {
+      if (lists[i].count > 0) {
+        registry[i].load(std::memory_order_acquire)->return_batch({lists[i].head, lists[i].count});
+      }
+    }
+    threadCacheDestroyed = true;
+  }
+};
+
+}  // namespace app
+
+namespace {
+thread_local app::SlabThreadCache threadCache;  ///< free lists of this thread
+}  // namespace
+
+/**
+ * @brief Gets the pool of a block size. Pools are created on first use and never destroyed,
+ * so blocks can be released by any thread at any time, including static destruction.
+ * @param blockSize The block size, rounded up to BlockAlignment.
+ * @return The pool.
+ * @throws std::invalid_argument if the block size is larger than MaxBlockSize.
+ */
+app::SlabPool& app::SlabPool::for_size(size_t blockSize) {
+  if (blockSize > MaxBlockSize) {
+    throw std::invalid_argument("slab pool block size too large");
+  }
+  blockSize = std::max(blockSize, sizeof(FreeBlock));
+  auto index = (blockSize + BlockAlignment - 1) / BlockAlignment - 1;
+
+  if (auto* pool = registry[index].load(std::memory_order_acquire)) {
+    return *pool;
+  }
+
+  std::lock_guard lock(registryMutex);
+  auto* pool = registry[index].load(std::memory_order_relaxed);
+  if (pool == nullptr) {
+    pool = new SlabPool((index + 1) * BlockAlignment, index);
+    registry[index].store(pool, std::memory_order_release);
+  }
+  return *pool;
+}
+
+/**
+ * @brief constructor
+ * @param blockSize The size of a block.
+ * @param index The size class of the pool.
+ */
+app::SlabPool::SlabPool(size_t blockSize, size_t index) : m_blockSize(blockSize), m_index(index) {}
+
+/**
+ * @brief Allocates a block from the free list of the calling thread, refilled by a batch from the pool.
+ * @return The block.
+ */
+void* app::SlabPool::allocate() {
+  if (threadCacheDestroyed) {
+    auto batch = take_batch();
+    if (batch.count > 1) {
+      return_batch({batch.head->next, batch.count - 1});
+    }
+    return batch.head;
+  }
+
+  auto& list = threadCache.lists[m_index];
+  if (list.head == nullptr) {
+    auto batch = take_batch();
+    list.head = batch.head;
+    list.count = batch.count;
+  }
+
+  auto* block = list.head;
+  list.head = block->next;
+  list.count--;
+  return block;
+}
+
+/**
+ * @brief Releases a block into the free list of the calling thread. If the list holds two batches,
+ * one batch goes back to the pool, so a thread that only releases does not hoard blocks.
+ * @param block The block.
+ */
+void app::SlabPool::deallocate(void* block) noexcept {
+  auto* freeBlock = static_cast<FreeBlock*>(block);
+
+  if (threadCacheDestroyed) {
+    freeBlock->next = nullptr;
+    return_batch({freeBlock, 1});
+    return;
+  }
+
+  auto& list = threadCache.lists[m_index];
+  freeBlock->next = list.head;
+  list.head = freeBlock;
+  list.count++;
+
+  if (list.count >= 2 * BatchSize) {
+    auto* head = list.head;
+    auto* last = head;
+    for (size_t i = 1; i < BatchSize; ++i) {
+      last = last->next;
+    }
+    list.head = last->next;
+    list.count -= BatchSize;
+    last->next = nullptr;
+    return_batch({head, BatchSize});
+  }
+}
+
+/**
+ * @brief Takes a batch from the global free list, carving a new slab if the list is empty.
+ * @return The batch, holding at least one block.
+ */
+app::SlabPool::Batch app::SlabPool::take_batch() {
+  std::lock_guard lock(m_mutex);
+  if (m_batches.empty()) {
+    m_batches.push_back(carve_slab());
+  }
+  auto batch = m_batches.back();
+  m_batches.pop_back();
+  m_inUse.fetch_add(batch.count, std::memory_order_relaxed);
+  return batch;
+}
+
+/**
+ * @brief Returns a batch to the global free list.
+ * @param batch The batch.
+ */
+void app::SlabPool::return_batch(Batch batch) noexcept {
+  std::lock_guard lock(m_mutex);
+  m_inUse.fetch_sub(batch.count, std::memory_order_relaxed);
+  try {
+    m_batches.push_back(batch);
+  } catch (const std::bad_alloc&) {
+    // keep the blocks reachable by chaining them in front of an existing batch
+    if (!m_batches.empty()) {
+      auto* last = batch.head;
+      while (last->next != nullptr) {
+        last = last->next;
+      }
+      last->next = m_batches.back().head;
+      m_batches.back().head = batch.head;
+      m_batches.back().count += batch.count;
+    }
+  }
+}
+
+/**
+ * @brief Takes a slab from the system and splits it into batches. The mutex must be held.
+ * @return The first batch, the other batches are added to the global free list.
+ * @throws std::bad_alloc if the system has no memory left.
+ */
+app::SlabPool::Batch app::SlabPool::carve_slab() {
+  void* slab = mmap(nullptr, SlabSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (slab == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  m_slabs.push_back(slab);
+
+  auto* bytes = static_cast<std::byte*>(slab);
+  auto blocks = SlabSize / m_blockSize;
+
+  Batch first;
+  Batch current;
+  for (size_t i = blocks; i-- > 0;) {
+    auto* block = reinterpret_cast<FreeBlock*>(bytes + i * m_blockSize);
+    block->next = current.head;
+    current.head = block;
+    if (++current.count == BatchSize) {
+      if (first.head == nullptr) {
+        first = current;
+      } else {
+        m_batches.push_back(current);
+      }
+      current = Batch{};
+    }
+  }
+  if (current.count > 0) {
+    if (first.head == nullptr) {
+      first = current;
+    } else {
+      m_batches.push_back(current);
+    }
+  }
+  return first;
+}
+
+/**
+ * @brief Gets the statistics of the pool.
+ * @return The statistics.
+ */
+app::SlabPool::Statistics app::SlabPool::statistics() const {
+  std::lock_guard lock(m_mutex);
+  Statistics stats;
+  stats.blockSize = m_blockSize;
+  stats.slabs = m_slabs.size();
+  stats.reservedBytes = m_slabs.size() * SlabSize;
+  for (const auto& batch : m_batches) {
+    stats.globalFree += batch.count;
+  }
+  stats.threadHeld = m_inUse.load(std::memory_order_relaxed);
+  return stats;
+}
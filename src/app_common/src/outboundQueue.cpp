@@ -0,0 +1,224 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "outboundQueue.hpp"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include "objectPool.hpp"
+// clang-format on
+
+namespace {
+/**
+ * @brief Gets the pool of the chunks.
+ * @return The pool.
+ */
+app::SlabPool& chunk_pool() {
+  static auto& pool = app::SlabPool::for_size(app::OutboundQueue::ChunkSize);
+  return pool;
+}
+}  // namespace
+
+/**
+ * @brief destructor returns the chunks.
+ */
+app::OutboundQueue::~OutboundQueue() {
+  release();
+}
+
+/**
+ * @brief move constructor, takes the chunks.
+ * @param other The queue, empty afterwards.
+ */
+app::OutboundQueue::OutboundQueue(OutboundQueue&& other) noexcept
+    : m_config(other.m_config),
+      m_chunks(std::move(other.m_chunks)),
+      m_readOffset(std::exchange(other.m_readOffset, 0)),
+      m_writeOffset(std::exchange(other.m_writeOffset, ChunkSize)),
+      m_bytes(std::exchange(other.m_bytes, 0)),
+      m_oldest(other.m_oldest),
+      m_blocked(std::exchange(other.m_blocked, false)),
+      m_statistics(other.m_statistics) {
+  other.m_chunks.clear();
+}
+
+/**
+ * @brief move assignment, returns the own chunks and takes the chunks of the other queue.
+ * @param other The queue, empty afterwards.
+ * @return This queue.
+ */
+app::OutboundQueue& app::OutboundQueue::operator=(OutboundQueue&& other) noexcept {
+  if (this != &other) {
+    release();
+    m_config = other.m_config;
+    m_chunks = std::move(other.m_chunks);
+    other.m_chunks.clear();
+    m_readOffset = std::exchange(other.m_readOffset, 0);
+    m_writeOffset = std::exchange(other.m_writeOffset, ChunkSize);
+    m_bytes = std::exchange(other.m_bytes, 0);
+    m_oldest = other.m_oldest;
+    m_blocked = std::exchange(other.m_blocked, false);
+    m_statistics = other.m_statistics;
+  }
+  return *this;
+}
+
+/**
+ * @brief Queues a message and writes the queue when it reaches the flush size.
+ *
+ * A blocked queue only grows: the socket is full and the owner waits for it to be writable.
+ * @param fd The socket.
+ * @param data The message.
+ * @param now The time in nanoseconds.
+ * @return false if the connection failed or the queued bytes exceed the limit.
+ */
+bool app::OutboundQueue::send(int fd, std::span<const std::byte> data, int64_t now) {
+  if (m_bytes + data.size() > m_config.maxPending) {
+    return false;
+  }
+  if (m_bytes == 0) {
+    m_oldest = now;
+  }
+  append(data);
+  ++m_statistics.messages;
+  m_statistics.bytes += data.size();
+  if (m_bytes >= m_config.flushBytes && !m_blocked) {
+    return flush(fd, FlushReason::size) != FlushResult::failed;
+  }
+  return true;
+}
+
+/**
+ * @brief Writes the queued bytes with one sendmsg per MaxIovecs chunks. A short write means a full
+ * socket buffer, the rest waits for a writable socket without another call.
+ * @param fd The socket.
+ * @param reason The trigger of the flush.
+ * @return The outcome.
+ */
+app::FlushResult app::OutboundQueue::flush(int fd, FlushReason reason) {
+  if (m_bytes == 0) {
+    m_blocked = false;
+    return FlushResult::written;
+  }
+  switch (reason) {
+    case FlushReason::size:
+      ++m_statistics.sizeFlushes;
+      break;
+    case FlushReason::tick:
+      ++m_statistics.tickFlushes;
+      break;
+    case FlushReason::budget:
+      ++m_statistics.budgetFlushes;
+      break;
+    case FlushReason::writable:
+    case FlushReason::request:
+      ++m_statistics.otherFlushes;
+      break;
+  }
+
+  std::array<iovec, MaxIovecs> iovecs{};
+  while (m_bytes > 0) {
+    size_t count = 0;
+    size_t requested = 0;
+    for (; count < MaxIovecs && count < m_chunks.size(); ++count) {
+      const size_t begin = count == 0 ? m_readOffset : 0;
+      const size_t end = count + 1 == m_chunks.size() ? m_writeOffset : ChunkSize;
+      iovecs[count] = {m_chunks[count] + begin, end - begin};
+      requested += end - begin;
+    }
+    msghdr message{};
+    message.msg_iov = iovecs.data();
+    message.msg_iovlen = count;
+    auto sent = sendmsg(fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+    ++m_statistics.writes;
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        m_blocked = true;
+        ++m_statistics.blocked;
+        return FlushResult::blocked;
+      }
+      return FlushResult::failed;
+    }
+    consume(static_cast<size_t>(sent));
+    if (static_cast<size_t>(sent) < requested) {
+      m_blocked = true;
+      ++m_statistics.blocked;
+      return FlushResult::blocked;
+    }
+  }
+  m_blocked = false;
+  return FlushResult::written;
+}
+
+/**
+ * @brief Copies bytes behind the queued ones, into new chunks where the last is full.
+ * @param data The bytes.
+ */
+void app::OutboundQueue::append(std::span<const std::byte> data) {
+  while (!data.empty()) {
+    if (m_writeOffset == ChunkSize) {
+      m_chunks.push_back(static_cast<std::byte*>(chunk_pool().allocate()));
+      m_writeOffset = 0;
+    }
+    const size_t count = std::min(data.size(), ChunkSize - m_writeOffset);
+    std::memcpy(m_chunks.back() + m_writeOffset, data.data(), count);
+    m_writeOffset += count;
+    m_bytes += count;
+    data = data.subspan(count);
+  }
+}
+
+/**
+ * @brief Removes written bytes and returns the chunks written completely.
+ * @param bytes The written bytes.
+ */
+void app::OutboundQueue::consume(size_t bytes) {
+  m_statistics.written += bytes;
+  m_bytes -= bytes;
+  while (!m_chunks.empty()) {
+    const size_t end = m_chunks.size() == 1 ? m_writeOffset : ChunkSize;
+    const size_t count = std::min(bytes, end - m_readOffset);
+    m_readOffset += count;
+    bytes -= count;
+    if (m_readOffset < end) {
+      break;
+    }
+    chunk_pool().deallocate(m_chunks.front());
+    m_chunks.pop_front();
+    m_readOffset = 0;
+    if (m_chunks.empty()) {
+      m_writeOffset = ChunkSize;
+    }
+  }
+}
+
+/**
+ * @brief Returns all chunks, the queued bytes are lost.
+ */
+void app::OutboundQueue::release() {
+  for (auto* chunk : m_chunks) {
+    chunk_pool().deallocate(chunk);
+  }
+  m_chunks.clear();
+  m_readOffset = 0;
+  m_writeOffset = ChunkSize;
+  m_bytes = 0;
+  m_blocked = false;
+}
@@ -0,0 +1,373 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "pcapReader.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+// clang-format on
+
+namespace {
+constexpr uint32_t PcapMagicMicroseconds = 0xA1B2C3D4;  ///< pcap with microsecond timestamps
+constexpr uint32_t PcapMagicNanoseconds = 0xA1B23C4D;   ///< pcap with nanosecond timestamps
+constexpr size_t PcapHeaderSize = 24;                   ///< size of the pcap file header
+constexpr size_t PcapRecordHeaderSize = 16;             ///< size of a pcap record header
+
+constexpr uint32_t SectionHeaderBlock = 0x0A0D0D0A;         ///< starts every pcapng section
+constexpr uint32_t InterfaceDescriptionBlock = 0x00000001;  ///< link type and options of an interface
+constexpr uint32_t SimplePacketBlock = 0x00000003;          ///< frame without interface and timestamp
+constexpr uint32_t EnhancedPacketBlock = 0x00000006;        ///< frame with interface and timestamp
+constexpr uint32_t ByteOrderMagic = 0x1A2B3C4D;             ///< byte order of a pcapng section
+constexpr uint16_t OptionTimestampResolution = 9;           ///< if_tsresol option of an interface
+
+constexpr uint64_t NanosecondsPerSecond = 1'000'000'000;
+
+/**
+ * @brief Reads a 32-bit value in host byte order.
+ * @param data The bytes.
+ * @return The value.
+ */
+uint32_t load32(const std::byte* data) {
+  uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+}  // namespace
+
+/**
+ * @brief Gets the name of a capture format.
+ * @param format The format.
+ * @return The name.
+ */
+std::string_view app::to_string(PcapFormat format) {
+  switch (format) {
+    case PcapFormat::pcap:
+      return "pcap";
+    case PcapFormat::pcapng:
+      return "pcapng";
+    case PcapFormat::none:
+      break;
+  }
+  return "none";
+}
+
+/**
+ * @brief Destructor unmaps the file.
+ */
+app::PcapReader::~PcapReader() {
+  close();
+}
+
+/**
+ * @brief Maps the capture file read-only and detects the format from the magic number.
+ * @param path The path of the capture file.
+ * @return true if the file is a pcap or pcapng capture, otherwise false.
+ */
+bool app::PcapReader::open(const std::filesystem::path& path) {
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st {};
+  if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < PcapHeaderSize) {
+    ::close(fd);
+    return false;
+  }
+
+  auto size = static_cast<size_t>(st.st_size);
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  madvise(mapping, size, MADV_SEQUENTIAL);
+  m_data = static_cast<const std::byte*>(mapping);
+  m_size = size;
+
+  auto magic = load32(m_data);
+  if (magic == SectionHeaderBlock) {
+    m_format = PcapFormat::pcapng;
+    rewind();
+    // the first section header decides the byte order, later sections may change it
+    if (!read_section_header(0)) {
+      close();
+      return false;
+    }
+    rewind();
+    return true;
+  }
+
+  for (auto candidate : {PcapMagicMicroseconds, PcapMagicNanoseconds}) {
+    if (magic == candidate || magic == __builtin_bswap32(candidate)) {
+      m_format = PcapFormat::pcap;
+      m_swapped = magic != candidate;
+      Interface link;
+      link.snapLength = get32(16);
+      // the upper bits of the link type field carry the FCS length of some captures
+      link.linkType = static_cast<uint16_t>(get32(20) & 0xFFFF);
+      link.unitsPerSecond = candidate == PcapMagicNanoseconds ? NanosecondsPerSecond : 1'000'000;
+      m_interfaces.assign(1, link);
+      rewind();
+      return true;
+    }
+  }
+  close();
+  return false;
+}
+
+/**
+ * @brief Unmaps the capture file.
+ */
+void app::PcapReader::close() {
+  if (m_data != nullptr) {
+    munmap(const_cast<std::byte*>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_offset = 0;
+  m_format = PcapFormat::none;
+  m_swapped = false;
+  m_truncated = false;
+  m_interfaces.clear();
+}
+
+/**
+ * @brief Restarts the iteration at the first frame.
+ */
+void app::PcapReader::rewind() {
+  m_offset = m_format == PcapFormat::pcap ? PcapHeaderSize : 0;
+  m_truncated = false;
+  if (m_format == PcapFormat::pcapng) {
+    m_interfaces.clear();
+  }
+}
+
+/**
+ * @brief Gets the next frame. The data refers to the mapped file and stays valid until close().
+ * @return The frame or std::nullopt at the end of the file or on a truncated block.
+ */
+std::optional<app::PcapFrame> app::PcapReader::next() {
+  if (m_data == nullptr || m_offset >= m_size) {
+    return std::nullopt;
+  }
+  return m_format == PcapFormat::pcap ? next_pcap() : next_pcapng();
+}
+
+/**
+ * @brief Reads the next record of a pcap file.
+ * @return The frame or std::nullopt on a truncated record.
+ */
+std::optional<app::PcapFrame> app::PcapReader::next_pcap() {
+  if (m_size - m_offset < PcapRecordHeaderSize) {
+    return stop();
+  }
+  auto seconds = get32(m_offset);
+  auto fraction = get32(m_offset + 4);
+  auto captured = get32(m_offset + 8);
+  if (captured > m_size - m_offset - PcapRecordHeaderSize) {
+    // a capture cut by a crash or a full disk ends with a partial record
+    return stop();
+  }
+  const auto& link = m_interfaces.front();
+  PcapFrame frame;
+  frame.timestamp = std::chrono::seconds(seconds) + to_nanoseconds(fraction, link);
+  frame.linkType = link.linkType;
+  frame.originalLength = get32(m_offset + 12);
+  frame.data = std::span<const std::byte>(m_data + m_offset + PcapRecordHeaderSize, captured);
+  m_offset += PcapRecordHeaderSize + captured;
+  return frame;
+}
+
+/**
+ * @brief Reads the blocks of a pcapng file up to the next packet block.
+ * @return The frame or std::nullopt at the end of the file or on a malformed block.
+ */
+std::optional<app::PcapFrame> app::PcapReader::next_pcapng() {
+  while (m_offset < m_size) {
+    if (m_size - m_offset < 12) {
+      return stop();
+    }
+    auto offset = m_offset;
+    // the section header type reads the same in both byte orders
+    if (load32(m_data + offset) == SectionHeaderBlock) {
+      if (!read_section_header(offset)) {
+        return stop();
+      }
+      continue;
+    }
+    auto type = get32(offset);
+    auto length = get32(offset + 4);
+    if (length < 12 || length % 4 != 0 || length > m_size - offset) {
+      return stop();
+    }
+    m_offset += length;
+    auto body = offset + 8;
+    auto bodyLength = length - 12;
+
+    if (type == InterfaceDescriptionBlock) {
+      if (bodyLength < 8) {
+        return stop();
+      }
+      read_interface(body, bodyLength);
+    } else if (type == EnhancedPacketBlock) {
+      if (bodyLength < 20) {
+        return stop();
+      }
+      auto interface = get32(body);
+      auto captured = get32(body + 12);
+      if (interface >= m_interfaces.size() || captured > bodyLength - 20) {
+        return stop();
+      }
+      const auto& description = m_interfaces[interface];
+      auto timestamp = (static_cast<uint64_t>(get32(body + 4)) << 32) | get32(body + 8);
+      PcapFrame frame;
+      frame.timestamp = to_nanoseconds(timestamp, description);
+      frame.interface = interface;
+      frame.linkType = description.linkType;
+      frame.originalLength = get32(body + 16);
+      frame.data = std::span<const std::byte>(m_data + body + 20, captured);
+      return frame;
+    } else if (type == SimplePacketBlock) {
+      if (bodyLength < 4 || m_interfaces.empty()) {
+        return stop();
+      }
+      const auto& description = m_interfaces.front();
+      PcapFrame frame;
+      frame.linkType = description.linkType;
+      frame.originalLength = get32(body);
+      size_t captured = std::min<size_t>(frame.originalLength, bodyLength - 4);
+      if (description.snapLength > 0) {
+        captured = std::min<size_t>(captured, description.snapLength);
+      }
+      frame.data = std::span<const std::byte>(m_data + body + 4, captured);
+      return frame;
+    }
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief Reads a section header: byte order and length; the section starts without interfaces.
+ * @param offset The offset of the block.
+ * @return true if valid, otherwise false.
+ */
+bool app::PcapReader::read_section_header(size_t offset) {
+  if (m_size - offset < 28) {
+    return false;
+  }
+  auto byteOrder = load32(m_data + offset + 8);
+  if (byteOrder != ByteOrderMagic && byteOrder != __builtin_bswap32(ByteOrderMagic)) {
+    return false;
+  }
+  m_swapped = byteOrder != ByteOrderMagic;
+  auto length = get32(offset + 4);
+  if (length < 28 || length % 4 != 0 || length > m_size - offset) {
+    return false;
+  }
+  m_interfaces.clear();
+  m_offset = offset + length;
+  return true;
+}
+
+/**
+ * @brief Adds an interface of the section: link type, snap length and timestamp resolution.
+ * @param offset The offset of the block body.
+ * @param length The length of the block body.
+ */
+void app::PcapReader::read_interface(size_t offset, size_t length) {
+  Interface interface;
+  interface.linkType = get16(offset);
+  interface.snapLength = get32(offset + 4);
+  for (size_t option = offset + 8; option + 4 <= offset + length;) {
+    auto code = get16(option);
+    auto size = get16(option + 2);
+    if (code == 0 || option + 4 + size > offset + length) {
+      break;
+    }
+    if (code == OptionTimestampResolution && size >= 1) {
+      // the high bit selects a power of two, otherwise a power of ten
+      auto resolution = std::to_integer<uint8_t>(m_data[option + 4]);
+      auto exponent = resolution & 0x7F;
+      if ((resolution & 0x80) != 0 && exponent < 64) {
+        interface.unitsPerSecond = uint64_t{1} << exponent;
+      } else if ((resolution & 0x80) == 0 && exponent <= 19) {
+        interface.unitsPerSecond = 1;
+        for (int i = 0; i < exponent; ++i) {
+          interface.unitsPerSecond *= 10;
+        }
+      }
+    }
+    option += 4 + ((size + 3u) & ~3u);
+  }
+  m_interfaces.push_back(interface);
+}
+
+/**
+ * @brief Reads a 16-bit value in the byte order of the file.
+ * @param offset The offset.
+ * @return The value.
+ */
+uint16_t app::PcapReader::get16(size_t offset) const {
+  uint16_t value;
+  std::memcpy(&value, m_data + offset, sizeof(value));
+  return m_swapped ? __builtin_bswap16(value) : value;
+}
+
+/**
+ * @brief Reads a 32-bit value in the byte order of the file.
+ * @param offset The offset.
+ * @return The value.
+ */
+uint32_t app::PcapReader::get32(size_t offset) const {
+  auto value = load32(m_data + offset);
+  return m_swapped ? __builtin_bswap32(value) : value;
+}
+
+/**
+ * @brief Converts a timestamp in units of the interface into nanoseconds.
+ * @param timestamp The timestamp.
+ * @param interface The interface.
+ * @return The timestamp in nanoseconds.
+ */
+std::chrono::nanoseconds app::PcapReader::to_nanoseconds(uint64_t timestamp, const Interface& interface) const {
+  if (interface.unitsPerSecond <= NanosecondsPerSecond && NanosecondsPerSecond % interface.unitsPerSecond == 0) {
+    return std::chrono::nanoseconds(timestamp * (NanosecondsPerSecond / interface.unitsPerSecond));
+  }
+  // whole seconds and the remainder, so the product stays in 64 bits on targets without 128-bit integers
+  auto units = interface.unitsPerSecond;
+  auto remainder = timestamp % units;
+  uint64_t fraction{0};
+  if (remainder <= UINT64_MAX / NanosecondsPerSecond) {
+    fraction = remainder * NanosecondsPerSecond / units;
+  } else if (units % NanosecondsPerSecond == 0) {
+    fraction = remainder / (units / NanosecondsPerSecond);
+  } else {
+    fraction = static_cast<uint64_t>(static_cast<long double>(remainder) * NanosecondsPerSecond / units);
+  }
+  return std::chrono::nanoseconds(static_cast<int64_t>(timestamp / units * NanosecondsPerSecond + fraction));
+}
+
+/**
+ * @brief Stops the iteration at a truncated or malformed block.
+ * @return std::nullopt.
+ */
+std::optional<app::PcapFrame> app::PcapReader::stop() {
+  m_truncated = true;
+  m_offset = m_size;
+  return std::nullopt;
+}
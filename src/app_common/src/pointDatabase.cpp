@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "pointDatabase.hpp"
+
+#include <algorithm>
+// clang-format on
+
+namespace {
+
+/**
+ * @brief Gets the bytes of an array, rounded up to the array alignment.
+ * @param count The number of elements.
+ * @param size The size of an element.
+ * @return The bytes.
+ */
+size_t array_bytes(size_t count, size_t size) {
+  return (count * size + app::PointDatabase::ArrayAlignment - 1) & ~(app::PointDatabase::ArrayAlignment - 1);
+}
+
+}  // namespace
+
+/**
+ * @brief Reserves the arrays for a number of points, all values zero and unchanged.
+ * @param points The number of points.
+ * @param policy The backings to try.
+ * @return true if the arrays are reserved, otherwise false.
+ */
+bool app::PointDatabase::reserve(size_t points, HugePagePolicy policy) {
+  m_size = 0;
+  m_changedWords = (points + 63) / 64;
+  const auto valueBytes = array_bytes(points, sizeof(double));
+  const auto timestampBytes = array_bytes(points, sizeof(int64_t));
+  const auto qualityBytes = array_bytes(points, sizeof(uint32_t));
+  const auto changedBytes = array_bytes(m_changedWords, sizeof(uint64_t));
+  if (!m_region.reserve(valueBytes + timestampBytes + qualityBytes + changedBytes, policy)) {
+    m_changedWords = 0;
+    return false;
+  }
+
+  // a fresh anonymous mapping is zero, so all values are 0.0 and no point is changed
+  auto* next = m_region.data();
+  m_values = reinterpret_cast<double*>(next);
+  next += valueBytes;
+  m_timestamps = reinterpret_cast<int64_t*>(next);
+  next += timestampBytes;
+  m_qualities = reinterpret_cast<uint32_t*>(next);
+  next += qualityBytes;
+  m_changed = reinterpret_cast<uint64_t*>(next);
+  m_size = points;
+  return true;
+}
+
+/**
+ * @brief Counts the changed points.
+ * @return The number of changed points.
+ */
+size_t app::PointDatabase::count_changed() const {
+  size_t count{0};
+  for (size_t word = 0; word < m_changedWords; ++word) {
+    count += static_cast<size_t>(std::popcount(m_changed[word]));
+  }
+  return count;
+}
+
+/**
+ * @brief Clears all changed bits.
+ */
+void app::PointDatabase::clear_changed() {
+  std::fill_n(m_changed, m_changedWords, uint64_t{0});
+}
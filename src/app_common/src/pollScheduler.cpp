@@ -0,0 +1,408 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "pollScheduler.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <tuple>
+// clang-format on
+
+namespace {
+/// The policies, for the parser
+constexpr app::PollPolicy Policies[] = {app::PollPolicy::aligned, app::PollPolicy::hashed,
+                                        app::PollPolicy::staggered};
+
+/**
+ * @brief Mixes the bits of a key, the finalizer of splitmix64.
+ * @param key The key.
+ * @return The hash.
+ */
+uint64_t mix(uint64_t key) {
+  key ^= key >> 30;
+  key *= 0xBF58476D1CE4E5B9ULL;
+  key ^= key >> 27;
+  key *= 0x94D049BB133111EBULL;
+  key ^= key >> 31;
+  return key;
+}
+
+/**
+ * @brief Maps a hash to a phase of a period.
+ * @param hash The hash.
+ * @param period The period in nanoseconds.
+ * @return The phase in [0, period).
+ */
+int64_t phase_of_hash(uint64_t hash, int64_t period) {
+  return static_cast<int64_t>(hash % static_cast<uint64_t>(period));
+}
+
+/**
+ * @brief Gets the first time at a phase of a period.
+ * @param now The time in nanoseconds.
+ * @param phase The phase.
+ * @param period The period.
+ * @return The time, not before now.
+ */
+int64_t next_at_phase(int64_t now, int64_t phase, int64_t period) {
+  const int64_t offset = ((now % period) + period) % period;
+  return now + ((phase - offset) % period + period) % period;
+}
+
+/**
+ * @brief Orders the heap entries, the earliest due time on top.
+ */
+struct Later {
+  template <typename Entry>
+  bool operator()(const Entry& a, const Entry& b) const {
+    return std::tie(a.due, a.task) > std::tie(b.due, b.task);
+  }
+};
+}  // namespace
+
+/**
+ * @brief Gets the name of a policy.
+ * @param policy The policy.
+ * @return The name.
+ */
+std::string_view app::to_string(PollPolicy policy) {
+  switch (policy) {
+    case PollPolicy::aligned:
+      return "aligned";
+    case PollPolicy::hashed:
+      return "hashed";
+    case PollPolicy::staggered:
+      return "staggered";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Parses the name of a policy.
+ * @param text The name.
+ * @return The policy, none if unknown.
+ */
+std::optional<app::PollPolicy> app::parse_poll_policy(std::string_view text) {
+  for (auto policy : Policies) {
+    if (text == to_string(policy)) {
+      return policy;
+    }
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief constructor.
+ * @param config The configuration.
+ */
+app::PollScheduler::PollScheduler(const PollSchedulerConfig& config) : m_config(config), m_burst(config.burstWindow) {}
+
+/**
+ * @brief Adds a task to the group of its period, placed by the next run.
+ * @param key The key of the task.
+ * @param period The period.
+ * @return false if the key is known or the period isn't positive.
+ */
+bool app::PollScheduler::add(uint64_t key, std::chrono::nanoseconds period) {
+  if (period.count() <= 0 || m_index.contains(key)) {
+    return false;
+  }
+  auto group =
+      std::find_if(m_groups.begin(), m_groups.end(), [&](const Group& g) { return g.period == period.count(); });
+  if (group == m_groups.end()) {
+    m_groups.push_back({period.count(), {}, 0, 0, false});
+    group = m_groups.end() - 1;
+  }
+
+  uint32_t index = 0;
+  if (m_free.empty()) {
+    index = static_cast<uint32_t>(m_tasks.size());
+    m_tasks.emplace_back();
+  } else {
+    index = m_free.back();
+    m_free.pop_back();
+  }
+  auto& task = m_tasks[index];
+  task.key = key;
+  task.hash = mix(key);
+  task.period = period.count();
+  task.group = static_cast<uint32_t>(group - m_groups.begin());
+  task.slot = static_cast<uint32_t>(group->members.size());
+  task.placed = false;
+  task.polled = false;
+  group->members.push_back({task.hash, key, index});
+  group->dirty = true;
+  m_dirty = true;
+  m_index.emplace(key, index);
+  ++m_statistics.added;
+  return true;
+}
+
+/**
+ * @brief Removes a task. Its heap entry turns stale and its member is dropped by the next
+ * placement: at once in a staggered group, which is rebalanced, otherwise when half of the
+ * members are removed.
+ * @param key The key of the task.
+ * @return false if the key is unknown.
+ */
+bool app::PollScheduler::remove(uint64_t key) {
+  auto it = m_index.find(key);
+  if (it == m_index.end()) {
+    return false;
+  }
+  const uint32_t index = it->second;
+  m_index.erase(it);
+  auto& task = m_tasks[index];
+  auto& group = m_groups[task.group];
+  group.members[task.slot].task = NoTask;
+  ++group.removed;
+  if (m_config.policy == PollPolicy::staggered || group.removed * 2 > group.members.size()) {
+    group.dirty = true;
+    m_dirty = true;
+  }
+  task.group = NoGroup;
+  ++task.generation;
+  m_free.push_back(index);
+  ++m_statistics.removed;
+  return true;
+}
+
+/**
+ * @brief Removes all tasks, the counters stay.
+ */
+void app::PollScheduler::clear() {
+  m_tasks.clear();
+  m_free.clear();
+  m_groups.clear();
+  m_index.clear();
+  m_heap.clear();
+  m_dirty = false;
+}
+
+/**
+ * @brief Takes the next due task: records its lateness, the deviation of its interval and the
+ * burst, and schedules its next poll a period later, skipping the periods it missed.
+ * @param now The time in nanoseconds.
+ * @return The key of the task, none if no task is due.
+ */
+std::optional<uint64_t> app::PollScheduler::next_due(int64_t now) {
+  if (m_dirty) {
+    place(now);
+  }
+  while (!m_heap.empty()) {
+    const Entry entry = m_heap.front();
+    if (is_current(entry) && entry.due > now) {
+      return std::nullopt;
+    }
+    std::pop_heap(m_heap.begin(), m_heap.end(), Later());
+    m_heap.pop_back();
+    if (!is_current(entry)) {
+      continue;
+    }
+
+    auto& task = m_tasks[entry.task];
+    m_lateness.record(std::chrono::nanoseconds(now - task.due));
+    if (task.polled) {
+      m_jitter.record(std::chrono::nanoseconds(std::abs(now - task.last - task.period)));
+    }
+    m_burst.record(now);
+    task.last = now;
+    task.polled = true;
+    ++m_statistics.polls;
+
+    task.due += task.period;
+    if (task.due <= now) {
+      const int64_t missed = (now - task.due) / task.period + 1;
+      task.due += missed * task.period;
+      m_statistics.missed += static_cast<uint64_t>(missed);
+    }
+    push(entry.task);
+    return task.key;
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief Gets the time until the next due task.
+ * @param now The time in nanoseconds.
+ * @param limit The longest delay to return.
+ * @return The earlier of the limit and the time until the next due task, rounded up.
+ */
+std::chrono::milliseconds app::PollScheduler::next_delay(int64_t now, std::chrono::milliseconds limit) {
+  if (m_dirty) {
+    place(now);
+  }
+  while (!m_heap.empty() && !is_current(m_heap.front())) {
+    std::pop_heap(m_heap.begin(), m_heap.end(), Later());
+    m_heap.pop_back();
+  }
+  if (m_heap.empty()) {
+    return limit;
+  }
+  const int64_t wait = m_heap.front().due - now;
+  if (wait <= 0) {
+    return std::chrono::milliseconds(0);
+  }
+  return std::min(limit, std::chrono::milliseconds((wait + 999'999) / 1'000'000));
+}
+
+/**
+ * @brief Gets the phase of a task.
+ * @param key The key of the task.
+ * @return The offset of the polls in the period in nanoseconds, none if unknown or not yet placed.
+ */
+std::optional<int64_t> app::PollScheduler::phase(uint64_t key) const {
+  auto it = m_index.find(key);
+  if (it == m_index.end() || !m_tasks[it->second].placed) {
+    return std::nullopt;
+  }
+  return m_tasks[it->second].phase;
+}
+
+/**
+ * @brief Clears the burst meter and the histograms.
+ */
+void app::PollScheduler::reset_metrics() {
+  m_burst.reset();
+  m_lateness.reset();
+  m_jitter.reset();
+}
+
+/**
+ * @brief Places the tasks of the changed groups and rebuilds the heap.
+ * @param now The time in nanoseconds.
+ */
+void app::PollScheduler::place(int64_t now) {
+  for (auto& group : m_groups) {
+    if (group.dirty) {
+      place(group, now);
+      group.dirty = false;
+      ++m_statistics.rebalances;
+    }
+  }
+  rebuild_heap();
+  m_dirty = false;
+}
+
+/**
+ * @brief Places the tasks of a group.
+ *
+ * An aligned task polls first at the run that places it, a hashed one at the phase of its hash.
+ * The staggered tasks take the slots of the period in the order of their hashes, from an offset
+ * hashed from the period, so the groups of different periods don't start together. A placed task
+ * keeps its due time shifted by the change of its phase, wrapped into half a period, so a
+ * rebalance neither polls a task twice nor skips a period.
+ * @param group The group.
+ * @param now The time in nanoseconds.
+ */
+void app::PollScheduler::place(Group& group, int64_t now) {
+  const int64_t period = group.period;
+  compact(group);
+  if (m_config.policy != PollPolicy::staggered) {
+    for (uint32_t slot = 0; slot < group.members.size(); ++slot) {
+      auto& task = m_tasks[group.members[slot].task];
+      task.slot = slot;
+      if (!task.placed) {
+        task.phase = m_config.policy == PollPolicy::hashed ? phase_of_hash(task.hash, period)
+                                                           : ((now % period) + period) % period;
+        task.due = m_config.policy == PollPolicy::hashed ? next_at_phase(now, task.phase, period) : now;
+        task.placed = true;
+      }
+    }
+    return;
+  }
+
+  // the placed members stay in order, only the added ones are sorted
+  const auto added = group.members.begin() + static_cast<std::ptrdiff_t>(group.sorted);
+  std::sort(added, group.members.end());
+  std::inplace_merge(group.members.begin(), added, group.members.end());
+  group.sorted = group.members.size();
+
+  const auto count = static_cast<uint64_t>(group.members.size());
+  const int64_t base = phase_of_hash(mix(static_cast<uint64_t>(period)), period);
+  for (uint32_t slot = 0; slot < group.members.size(); ++slot) {
+    auto& task = m_tasks[group.members[slot].task];
+    // slot * period / count, split so the product stays in 64 bits on targets without 128-bit integers
+    const auto spacing = static_cast<int64_t>(slot * (static_cast<uint64_t>(period) / count) +
+                                              slot * (static_cast<uint64_t>(period) % count) / count);
+    const int64_t phase = (base + spacing) % period;
+    if (task.placed) {
+      int64_t shift = ((phase - task.phase) % period + period) % period;
+      if (shift > period / 2) {
+        shift -= period;
+      }
+      if (shift != 0) {
+        // a task moved into the past polls now, not late
+        task.due = std::max(task.due + shift, now);
+        ++m_statistics.moved;
+      }
+    } else {
+      task.due = next_at_phase(now, phase, period);
+      task.placed = true;
+    }
+    task.phase = phase;
+    task.slot = slot;
+  }
+}
+
+/**
+ * @brief Drops the removed members of a group, the order of the others stays.
+ * @param group The group.
+ */
+void app::PollScheduler::compact(Group& group) {
+  if (group.removed == 0) {
+    return;
+  }
+  size_t kept = 0;
+  size_t sorted = 0;
+  for (size_t i = 0; i < group.members.size(); ++i) {
+    if (group.members[i].task != NoTask) {
+      sorted += i < group.sorted ? 1 : 0;
+      group.members[kept++] = group.members[i];
+    }
+  }
+  group.members.resize(kept);
+  group.sorted = sorted;
+  group.removed = 0;
+}
+
+/**
+ * @brief Pushes the due time of a task onto the heap.
+ * @param task The task.
+ */
+void app::PollScheduler::push(uint32_t task) {
+  m_heap.push_back({m_tasks[task].due, task, m_tasks[task].generation});
+  std::push_heap(m_heap.begin(), m_heap.end(), Later());
+}
+
+/**
+ * @brief Rebuilds the heap from the placed tasks, which drops the stale entries.
+ */
+void app::PollScheduler::rebuild_heap() {
+  m_heap.clear();
+  for (const auto& group : m_groups) {
+    for (const auto& member : group.members) {
+      if (member.task != NoTask) {
+        m_heap.push_back({m_tasks[member.task].due, member.task, m_tasks[member.task].generation});
+      }
+    }
+  }
+  std::make_heap(m_heap.begin(), m_heap.end(), Later());
+}
+
+/**
+ * @brief Checks whether a heap entry is the due time of a scheduled task.
+ * @param entry The entry.
+ * @return false if the task was removed since the push.
+ */
+bool app::PollScheduler::is_current(const Entry& entry) const {
+  const auto& task = m_tasks[entry.task];
+  return task.group != NoGroup && task.generation == entry.generation;
+}
@@ -0,0 +1,375 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "reconnectManager.hpp"
+
+#include <algorithm>
+#include <random>
+#include <tuple>
+// clang-format on
+
+namespace {
+/// The policies, for the parser
+constexpr app::BackoffPolicy Policies[] = {app::BackoffPolicy::fixed, app::BackoffPolicy::exponential,
+                                           app::BackoffPolicy::decorrelated};
+
+/**
+ * @brief Orders the heap entries, the earliest attempt on top.
+ */
+struct Later {
+  template <typename Entry>
+  bool operator()(const Entry& a, const Entry& b) const {
+    return std::tie(a.due, a.peer) > std::tie(b.due, b.peer);
+  }
+};
+}  // namespace
+
+/**
+ * @brief Gets the name of a policy.
+ * @param policy The policy.
+ * @return The name.
+ */
+std::string_view app::to_string(BackoffPolicy policy) {
+  switch (policy) {
+    case BackoffPolicy::fixed:
+      return "fixed";
+    case BackoffPolicy::exponential:
+      return "exponential";
+    case BackoffPolicy::decorrelated:
+      return "decorrelated";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Parses the name of a policy.
+ * @param text The name.
+ * @return The policy, none if unknown.
+ */
+std::optional<app::BackoffPolicy> app::parse_backoff_policy(std::string_view text) {
+  for (auto policy : Policies) {
+    if (text == to_string(policy)) {
+      return policy;
+    }
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief constructor, seeds the jitter. Without a seed every process draws other delays, otherwise
+ * the nodes of a fleet would retry in step again.
+ * @param config The configuration.
+ */
+app::ReconnectManager::ReconnectManager(const ReconnectConfig& config)
+    : m_config(config), m_random(config.seed != 0 ? config.seed : (uint64_t{std::random_device{}()} << 32) ^
+                                                                      std::random_device{}()) {
+  m_config.base = std::max(m_config.base, std::chrono::nanoseconds(1));
+  m_config.cap = std::max(m_config.cap, m_config.base);
+  m_random = m_random * 0x9E3779B97F4A7C15ULL | 1;
+}
+
+/**
+ * @brief Adds a connection, its first attempt is due at once.
+ * @param key The key of the connection.
+ * @param now The time in nanoseconds.
+ * @return false if the key is known.
+ */
+bool app::ReconnectManager::add(uint64_t key, int64_t now) {
+  if (m_index.contains(key)) {
+    return false;
+  }
+  uint32_t index = 0;
+  if (!m_free.empty()) {
+    index = m_free.back();
+    m_free.pop_back();
+  } else {
+    index = static_cast<uint32_t>(m_peers.size());
+    m_peers.emplace_back();
+  }
+  auto& peer = m_peers[index];
+  peer.key = key;
+  peer.since = now;
+  peer.delay = 0;
+  peer.failures = 0;
+  peer.due = now;
+  peer.state = State::waiting;
+  ++peer.generation;
+  m_attempts.push_back({now, index, peer.generation});
+  std::push_heap(m_attempts.begin(), m_attempts.end(), Later());
+  m_index.emplace(key, index);
+  ++m_statistics.added;
+  return true;
+}
+
+/**
+ * @brief Removes a connection, its heap entries become stale.
+ * @param key The key of the connection.
+ * @return false if the key is unknown.
+ */
+bool app::ReconnectManager::remove(uint64_t key) {
+  auto it = m_index.find(key);
+  if (it == m_index.end()) {
+    return false;
+  }
+  auto& peer = m_peers[it->second];
+  if (peer.state == State::connecting) {
+    --m_connecting;
+  } else if (peer.state == State::connected) {
+    --m_established;
+  }
+  peer.state = State::free;
+  ++peer.generation;
+  m_free.push_back(it->second);
+  m_index.erase(it);
+  ++m_statistics.removed;
+  return true;
+}
+
+/**
+ * @brief Starts the next due attempt if the limit has a free slot.
+ * @param now The time in nanoseconds.
+ * @return The key of the connection, none if no attempt is due or the limit is reached.
+ */
+std::optional<uint64_t> app::ReconnectManager::next_attempt(int64_t now) {
+  if (m_config.maxConnecting > 0 && m_connecting >= m_config.maxConnecting) {
+    return std::nullopt;
+  }
+  while (!m_attempts.empty()) {
+    const Entry entry = m_attempts.front();
+    const bool current = is_current(entry, State::waiting);
+    if (current && entry.due > now) {
+      return std::nullopt;
+    }
+    std::pop_heap(m_attempts.begin(), m_attempts.end(), Later());
+    m_attempts.pop_back();
+    if (!current) {
+      continue;
+    }
+
+    auto& peer = m_peers[entry.peer];
+    peer.state = State::connecting;
+    peer.started = now;
+    ++peer.generation;
+    m_timeouts.push_back({now + m_config.connectTimeout.count(), entry.peer, peer.generation});
+    ++m_connecting;
+    ++m_statistics.attempts;
+    m_statistics.peak = std::max<uint64_t>(m_statistics.peak, m_connecting);
+    return peer.key;
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief Fails the next attempt beyond the connect timeout. The attempts start in time order with
+ * one timeout, so the queue is ordered by the deadline.
+ * @param now The time in nanoseconds.
+ * @return The key of the connection, none if no attempt expired.
+ */
+std::optional<uint64_t> app::ReconnectManager::next_expired(int64_t now) {
+  while (!m_timeouts.empty()) {
+    const Entry entry = m_timeouts.front();
+    const bool current = is_current(entry, State::connecting);
+    if (current && entry.due > now) {
+      return std::nullopt;
+    }
+    m_timeouts.pop_front();
+    if (!current) {
+      continue;
+    }
+    ++m_statistics.timeouts;
+    const auto key = m_peers[entry.peer].key;
+    failed(key, now);
+    return key;
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief Gets the time until the next attempt or timeout.
+ * @param now The time in nanoseconds.
+ * @param limit The longest delay to return.
+ * @return The earlier of the limit and the time, rounded up.
+ */
+std::chrono::milliseconds app::ReconnectManager::next_delay(int64_t now, std::chrono::milliseconds limit) {
+  while (!m_attempts.empty() && !is_current(m_attempts.front(), State::waiting)) {
+    std::pop_heap(m_attempts.begin(), m_attempts.end(), Later());
+    m_attempts.pop_back();
+  }
+  while (!m_timeouts.empty() && !is_current(m_timeouts.front(), State::connecting)) {
+    m_timeouts.pop_front();
+  }
+  int64_t next = INT64_MAX;
+  const bool full = m_config.maxConnecting > 0 && m_connecting >= m_config.maxConnecting;
+  if (!m_attempts.empty() && !full) {
+    next = m_attempts.front().due;
+  }
+  if (!m_timeouts.empty()) {
+    next = std::min(next, m_timeouts.front().due);
+  }
+  if (next == INT64_MAX) {
+    return limit;
+  }
+  const int64_t wait = next - now;
+  if (wait <= 0) {
+    return std::chrono::milliseconds(0);
+  }
+  return std::min(limit, std::chrono::milliseconds((wait + 999'999) / 1'000'000));
+}
+
+/**
+ * @brief Reports an established connection and records its latency and recovery time.
+ * @param key The key of the connection.
+ * @param now The time in nanoseconds.
+ * @return false if no attempt of the key runs.
+ */
+bool app::ReconnectManager::connected(uint64_t key, int64_t now) {
+  auto it = m_index.find(key);
+  if (it == m_index.end() || m_peers[it->second].state != State::connecting) {
+    return false;
+  }
+  auto& peer = m_peers[it->second];
+  finish_attempt(peer);
+  m_connectLatency.record(std::chrono::nanoseconds(now - peer.started));
+  m_recovery.record(std::chrono::nanoseconds(now - peer.since));
+  peer.state = State::connected;
+  peer.delay = 0;
+  peer.failures = 0;
+  ++m_established;
+  ++m_statistics.connected;
+  return true;
+}
+
+/**
+ * @brief Reports a failed attempt and schedules the retry after the backoff delay.
+ * @param key The key of the connection.
+ * @param now The time in nanoseconds.
+ * @return false if no attempt of the key runs.
+ */
+bool app::ReconnectManager::failed(uint64_t key, int64_t now) {
+  auto it = m_index.find(key);
+  if (it == m_index.end() || m_peers[it->second].state != State::connecting) {
+    return false;
+  }
+  finish_attempt(m_peers[it->second]);
+  ++m_statistics.failed;
+  schedule(it->second, now);
+  return true;
+}
+
+/**
+ * @brief Reports a broken connection. The first attempt waits a backoff delay as well: the peer
+ * likely broke the connections of all its clients at once.
+ * @param key The key of the connection.
+ * @param now The time in nanoseconds.
+ * @return false if the key isn't connected.
+ */
+bool app::ReconnectManager::lost(uint64_t key, int64_t now) {
+  auto it = m_index.find(key);
+  if (it == m_index.end() || m_peers[it->second].state != State::connected) {
+    return false;
+  }
+  auto& peer = m_peers[it->second];
+  --m_established;
+  peer.since = now;
+  ++m_statistics.lost;
+  schedule(it->second, now);
+  return true;
+}
+
+/**
+ * @brief Checks whether a connection is established.
+ * @param key The key of the connection.
+ * @return true if connected, otherwise false.
+ */
+bool app::ReconnectManager::is_connected(uint64_t key) const {
+  auto it = m_index.find(key);
+  return it != m_index.end() && m_peers[it->second].state == State::connected;
+}
+
+/**
+ * @brief Clears the histograms.
+ */
+void app::ReconnectManager::reset_metrics() {
+  m_connectLatency.reset();
+  m_recovery.reset();
+}
+
+/**
+ * @brief Schedules the next attempt of a connection after its backoff delay.
+ * @param index The slot of the connection.
+ * @param now The time in nanoseconds.
+ */
+void app::ReconnectManager::schedule(uint32_t index, int64_t now) {
+  auto& peer = m_peers[index];
+  peer.due = now + backoff(peer);
+  peer.state = State::waiting;
+  ++peer.generation;
+  m_attempts.push_back({peer.due, index, peer.generation});
+  std::push_heap(m_attempts.begin(), m_attempts.end(), Later());
+}
+
+/**
+ * @brief Ends the running attempt of a connection, its timeout becomes stale.
+ * @param peer The connection.
+ */
+void app::ReconnectManager::finish_attempt(Peer& peer) {
+  --m_connecting;
+  ++peer.generation;
+}
+
+/**
+ * @brief Draws the next backoff delay of a connection.
+ * @param peer The connection, its delay and failures advance.
+ * @return The delay in nanoseconds.
+ */
+int64_t app::ReconnectManager::backoff(Peer& peer) {
+  const int64_t base = m_config.base.count();
+  const int64_t cap = m_config.cap.count();
+  int64_t delay = base;
+  switch (m_config.policy) {
+    case BackoffPolicy::fixed:
+      break;
+    case BackoffPolicy::exponential:
+      delay = peer.failures >= 62 || (cap >> peer.failures) < base ? cap : base << peer.failures;
+      break;
+    case BackoffPolicy::decorrelated: {
+      // uniform in [base, 3 * previous], the first delay of a loss or addition in [base, 3 * base]
+      const int64_t upper = std::min(cap, 3 * std::max(peer.delay, base));
+      delay = base + static_cast<int64_t>(next_random() % static_cast<uint64_t>(upper - base + 1));
+      break;
+    }
+  }
+  delay = std::min(delay, cap);
+  peer.delay = delay;
+  ++peer.failures;
+  return delay;
+}
+
+/**
+ * @brief Draws a random number, xorshift64.
+ * @return The number.
+ */
+uint64_t app::ReconnectManager::next_random() {
+  m_random ^= m_random << 13;
+  m_random ^= m_random >> 7;
+  m_random ^= m_random << 17;
+  return m_random;
+}
+
+/**
+ * @brief Checks whether an entry belongs to the current state of its connection.
+ * @param entry The entry.
+ * @param state The state the entry was pushed for.
+ * @return true if current, otherwise false.
+ */
+bool app::ReconnectManager::is_current(const Entry& entry, State state) const {
+  const auto& peer = m_peers[entry.peer];
+  return peer.state == state && peer.generation == entry.generation;
+}
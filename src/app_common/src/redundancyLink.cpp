@@ -0,0 +1,926 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "redundancyLink.hpp"
+
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+#include "netAddress.hpp"
+// clang-format on
+
+namespace {
+
+/**
+ * @brief Appends a little-endian integer.
+ * @param buffer The output buffer.
+ * @param value The value.
+ */
+template <typename T>
+void put_le(std::vector<uint8_t>& buffer, T value) {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    buffer.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i)));
+  }
+}
+
+/**
+ * @brief Appends an unsigned LEB128 varint.
+ * @param buffer The output buffer.
+ * @param value The value.
+ */
+void put_varint(std::vector<uint8_t>& buffer, uint64_t value) {
+  while (value >= 0x80) {
+    buffer.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  buffer.push_back(static_cast<uint8_t>(value));
+}
+
+/**
+ * @brief Reader of a frame payload, every read fails once the payload is exhausted.
+ */
+class PayloadReader {
+ public:
+  explicit PayloadReader(std::span<const uint8_t> payload) : m_payload(payload) {}
+
+  template <typename T>
+  bool le(T& value) {
+    if (m_payload.size() - m_offset < sizeof(T)) {
+      return false;
+    }
+    uint64_t result{0};
+    for (size_t i = 0; i < sizeof(T); ++i) {
+      result |= static_cast<uint64_t>(m_payload[m_offset + i]) << (8 * i);
+    }
+    m_offset += sizeof(T);
+    value = static_cast<T>(result);
+    return true;
+  }
+
+  bool varint(uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64 && m_offset < m_payload.size(); shift += 7) {
+      auto byte = m_payload[m_offset++];
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool bytes(size_t size, std::span<const uint8_t>& value) {
+    if (m_payload.size() - m_offset < size) {
+      return false;
+    }
+    value = m_payload.subspan(m_offset, size);
+    m_offset += size;
+    return true;
+  }
+
+ private:
+  std::span<const uint8_t> m_payload;  ///< payload
+  size_t m_offset{0};                  ///< read position
+};
+
+/**
+ * @brief Parses a node "id@[host:]port".
+ * @param text The text.
+ * @param id Receives the id.
+ * @param address Receives the address.
+ * @return true if valid.
+ */
+bool parse_node(std::string_view text, uint32_t& id, std::string& address) {
+  auto at = text.find('@');
+  if (at == std::string_view::npos || at == 0) {
+    return false;
+  }
+  try {
+    size_t used{0};
+    auto number = std::string(text.substr(0, at));
+    auto value = std::stoul(number, &used);
+    if (used != number.size() || value == 0 || value > UINT32_MAX) {
+      return false;
+    }
+    id = static_cast<uint32_t>(value);
+  } catch (const std::exception&) {
+    return false;
+  }
+  address = std::string(text.substr(at + 1));
+  // a port without host listens on all interfaces, the colon is optional
+  if (!address.empty() && address.front() == ':') {
+    address.erase(0, 1);
+  }
+  return !address.empty();
+}
+
+/**
+ * @brief Parses a positive number of milliseconds.
+ * @param text The text.
+ * @return The duration, none if invalid.
+ */
+std::optional<std::chrono::milliseconds> parse_milliseconds(std::string_view text) {
+  try {
+    size_t used{0};
+    auto number = std::string(text);
+    auto value = std::stol(number, &used);
+    if (used != number.size() || value <= 0) {
+      return std::nullopt;
+    }
+    return std::chrono::milliseconds(value);
+  } catch (const std::exception&) {
+    return std::nullopt;
+  }
+}
+
+}  // namespace
+
+/**
+ * @brief Gets the name of a role.
+ * @param role The role.
+ * @return The name.
+ */
+std::string_view app::to_string(RedundancyRole role) {
+  switch (role) {
+    case RedundancyRole::starting:
+      return "starting";
+    case RedundancyRole::active:
+      return "active";
+    case RedundancyRole::standby:
+      return "standby";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Parses "id@[host:]port,peer id@[host:]port[,heartbeat ms[,lease ms]]".
+ * @param text The text.
+ * @return The configuration, none if the text is invalid.
+ */
+std::optional<app::RedundancyConfig> app::RedundancyConfig::parse(std::string_view text) {
+  std::vector<std::string_view> fields;
+  while (!text.empty()) {
+    auto comma = text.find(',');
+    fields.push_back(text.substr(0, comma));
+    text = comma == std::string_view::npos ? std::string_view{} : text.substr(comma + 1);
+  }
+  RedundancyConfig config;
+  if (fields.size() < 2 || fields.size() > 4 || !parse_node(fields[0], config.nodeId, config.listenAddress) ||
+      !parse_node(fields[1], config.peerId, config.peerAddress) || config.nodeId == config.peerId) {
+    return std::nullopt;
+  }
+  if (fields.size() > 2) {
+    auto heartbeat = parse_milliseconds(fields[2]);
+    if (!heartbeat) {
+      return std::nullopt;
+    }
+    config.heartbeat = *heartbeat;
+    config.lease = std::max(config.lease, 3 * config.heartbeat);
+  }
+  if (fields.size() > 3) {
+    auto lease = parse_milliseconds(fields[3]);
+    // a lease shorter than two heartbeats expires on a single late heartbeat
+    if (!lease || *lease < 2 * config.heartbeat) {
+      return std::nullopt;
+    }
+    config.lease = *lease;
+  }
+  return config;
+}
+
+/**
+ * @brief Destructor closes the link.
+ */
+app::RedundancyLink::~RedundancyLink() {
+  close();
+}
+
+/**
+ * @brief Opens the listener and starts in the starting role.
+ * @param config The configuration.
+ * @return true if the listener is open, otherwise false.
+ */
+bool app::RedundancyLink::open(const RedundancyConfig& config) {
+  close();
+  auto listenAddress = parse_ipv4_address(config.listenAddress);
+  auto peerAddress = parse_ipv4_address(config.peerAddress, "127.0.0.1");
+  if (!listenAddress || !peerAddress) {
+    report("invalid redundancy addresses '" + config.listenAddress + "', '" + config.peerAddress + "'");
+    return false;
+  }
+  m_config = config;
+  m_peerAddress = *peerAddress;
+
+  m_listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  int enable = 1;
+  if (m_listenFd < 0 || setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) < 0 ||
+      bind(m_listenFd, reinterpret_cast<const sockaddr*>(&*listenAddress), sizeof(*listenAddress)) < 0 ||
+      listen(m_listenFd, 4) < 0) {
+    report("can't listen on " + config.listenAddress + ": " + std::system_category().message(errno));
+    close();
+    return false;
+  }
+
+  m_role = RedundancyRole::starting;
+  m_started = Clock::now();
+  m_lastLease = m_started;
+  report("node " + std::to_string(m_config.nodeId) + " listens on " + format_ipv4_address(*listenAddress) +
+         " for node " + std::to_string(m_config.peerId) + " at " + format_ipv4_address(m_peerAddress));
+  return true;
+}
+
+/**
+ * @brief Closes the connection and the listener.
+ */
+void app::RedundancyLink::close() {
+  if (m_peerFd >= 0) {
+    ::close(m_peerFd);
+    m_peerFd = -1;
+  }
+  if (m_listenFd >= 0) {
+    ::close(m_listenFd);
+    m_listenFd = -1;
+  }
+  close_pending();
+  m_connecting = false;
+  m_helloReceived = false;
+  m_peerRole.reset();
+  m_input.clear();
+  m_output.clear();
+}
+
+/**
+ * @brief Processes the connection: accepts and connects, reads and applies frames, sends heartbeats
+ * and the changed points, and arbitrates the role.
+ * @param timeout The maximal time to wait for input.
+ * @return The number of processed frames and connection events.
+ */
+size_t app::RedundancyLink::poll(std::chrono::milliseconds timeout) {
+  m_streamedPoints = false;
+  if (m_listenFd < 0) {
+    return 0;
+  }
+  size_t events{0};
+
+  auto now = Clock::now();
+  if (m_peerFd < 0 && m_config.nodeId < m_config.peerId && now - m_lastConnect >= m_config.heartbeat) {
+    connect_peer();
+  }
+
+  std::array<pollfd, 3> fds{};
+  fds[0] = {m_listenFd, POLLIN, 0};
+  fds[1] = {-1, 0, 0};
+  fds[2] = {m_pendingFd, POLLIN, 0};
+  if (m_peerFd >= 0) {
+    short wanted = m_connecting ? POLLOUT : static_cast<short>(POLLIN | (m_output.empty() ? 0 : POLLOUT));
+    fds[1] = {m_peerFd, wanted, 0};
+  }
+  auto wait = std::min(timeout, next_timeout());
+  if (::poll(fds.data(), fds.size(), static_cast<int>(std::max<int64_t>(wait.count(), 0))) > 0) {
+    if (fds[0].revents & POLLIN) {
+      accept_peer();
+      events++;
+    }
+    if (fds[2].fd >= 0 && fds[2].fd == m_pendingFd && fds[2].revents != 0) {
+      read_pending(events);
+    }
+    if (fds[1].fd >= 0 && fds[1].fd == m_peerFd && fds[1].revents != 0) {
+      if (m_connecting) {
+        int error{0};
+        socklen_t length = sizeof(error);
+        getsockopt(m_peerFd, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error != 0) {
+          drop_peer(std::system_category().message(error));
+        } else {
+          m_connecting = false;
+          m_lastReceived = Clock::now();
+          m_statistics.connections++;
+          report("connected to node " + std::to_string(m_config.peerId));
+          send_hello();
+        }
+        events++;
+      } else {
+        if (fds[1].revents & (POLLIN | POLLERR | POLLHUP)) {
+          read_peer(events);
+        }
+        if (m_peerFd >= 0 && (fds[1].revents & POLLOUT)) {
+          write_peer();
+        }
+      }
+    }
+  }
+
+  check_timers();
+
+  if (m_role == RedundancyRole::active && is_connected() && m_helloReceived) {
+    if (m_needSnapshot) {
+      if (m_peerRole && *m_peerRole != RedundancyRole::active) {
+        send_snapshot();
+        m_streamedPoints = true;
+      }
+    } else {
+      send_points(false);
+      m_streamedPoints = true;
+      for (const auto& key : m_dirtyState) {
+        send_state(key);
+      }
+      m_dirtyState.clear();
+    }
+  }
+  if (m_peerFd >= 0 && !m_connecting && !m_output.empty()) {
+    write_peer();
+  }
+  return events;
+}
+
+/**
+ * @brief Gets the time until the link must be polled again.
+ * @return The time until the next heartbeat or lease expiry.
+ */
+std::chrono::milliseconds app::RedundancyLink::next_timeout() const {
+  auto now = Clock::now();
+  auto until = [&](Clock::time_point deadline) {
+    return std::chrono::ceil<std::chrono::milliseconds>(std::max(deadline - now, Clock::duration::zero()));
+  };
+  auto timeout = m_config.heartbeat;
+  if (is_connected()) {
+    timeout = std::min(timeout, until(m_lastHeartbeat + m_config.heartbeat));
+  }
+  if (m_role == RedundancyRole::standby) {
+    timeout = std::min(timeout, until(m_lastLease + m_config.lease));
+  } else if (m_role == RedundancyRole::starting) {
+    timeout = std::min(timeout, until(m_started + m_config.startupWindow));
+  }
+  return timeout;
+}
+
+/**
+ * @brief Sets a context state entry, replicated with the next poll while active.
+ * @param key The key.
+ * @param value The value.
+ */
+void app::RedundancyLink::set_state(const std::string& key, std::span<const std::byte> value) {
+  auto& entry = m_state[key];
+  if (entry.size() == value.size() && std::equal(entry.begin(), entry.end(), value.begin())) {
+    return;
+  }
+  entry.assign(value.begin(), value.end());
+  m_dirtyState.insert(key);
+}
+
+/**
+ * @brief Accepts the connection of the peer. While a connection exists, the new one waits for the
+ * hello of the peer before it replaces the current one: the peer only connects again after it lost
+ * the previous connection, but a port scan or a health check must not cut the replication.
+ */
+void app::RedundancyLink::accept_peer() {
+  int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  int enable = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  if (m_peerFd >= 0) {
+    close_pending();
+    m_pendingFd = fd;
+    m_pendingSince = Clock::now();
+    return;
+  }
+  install_peer(fd);
+}
+
+/**
+ * @brief Makes an accepted connection the connection to the peer, without the bytes of the
+ * previous connection.
+ * @param fd The connection.
+ */
+void app::RedundancyLink::install_peer(int fd) {
+  m_peerFd = fd;
+  m_input.clear();
+  m_output.clear();
+  m_lastReceived = Clock::now();
+  m_statistics.connections++;
+  report("accepted node " + std::to_string(m_config.peerId));
+  send_hello();
+}
+
+/**
+ * @brief Starts a non-blocking connection to the peer.
+ */
+void app::RedundancyLink::connect_peer() {
+  m_lastConnect = Clock::now();
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return;
+  }
+  int enable = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  if (connect(fd, reinterpret_cast<const sockaddr*>(&m_peerAddress), sizeof(m_peerAddress)) < 0 &&
+      errno != EINPROGRESS) {
+    ::close(fd);
+    return;
+  }
+  m_peerFd = fd;
+  m_connecting = true;
+  m_input.clear();
+  m_output.clear();
+}
+
+/**
+ * @brief Closes the connection to the peer.
+ * @param reason The reason for the log.
+ */
+void app::RedundancyLink::drop_peer(std::string_view reason) {
+  if (m_peerFd < 0) {
+    return;
+  }
+  if (!m_connecting) {
+    report("connection to node " + std::to_string(m_config.peerId) + " closed: " + std::string(reason));
+  }
+  ::close(m_peerFd);
+  m_peerFd = -1;
+  m_connecting = false;
+  m_helloReceived = false;
+  m_peerRole.reset();
+  m_input.clear();
+  m_output.clear();
+  // whatever the peer missed is sent as snapshot on the next connection
+  m_needSnapshot = true;
+}
+
+/**
+ * @brief Reads the new connection until it shows the hello of the peer, then replaces the current
+ * connection with it. Any other first frame closes the new connection.
+ * @param events Counts the handled frames.
+ */
+void app::RedundancyLink::read_pending(size_t& events) {
+  constexpr size_t HelloPrefix = FrameHeaderSize + sizeof(uint32_t);
+  std::array<uint8_t, HelloPrefix> buffer{};
+  while (m_pendingInput.size() < HelloPrefix) {
+    auto received = recv(m_pendingFd, buffer.data(), HelloPrefix - m_pendingInput.size(), MSG_DONTWAIT);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+    if (received <= 0) {
+      close_pending();
+      return;
+    }
+    m_pendingInput.insert(m_pendingInput.end(), buffer.begin(), buffer.begin() + received);
+  }
+
+  uint32_t peerId{0};
+  std::memcpy(&peerId, &m_pendingInput[FrameHeaderSize], sizeof(peerId));
+  if (static_cast<FrameType>(m_pendingInput[0]) != FrameType::hello || peerId != m_config.peerId) {
+    close_pending();
+    return;
+  }
+  drop_peer("replaced by a new connection");
+  install_peer(std::exchange(m_pendingFd, -1));
+  m_statistics.bytesReceived += m_pendingInput.size();
+  m_input = std::move(m_pendingInput);
+  m_pendingInput.clear();
+  read_peer(events);
+}
+
+/**
+ * @brief Closes the new connection that didn't introduce itself yet.
+ */
+void app::RedundancyLink::close_pending() {
+  if (m_pendingFd >= 0) {
+    ::close(m_pendingFd);
+    m_pendingFd = -1;
+  }
+  m_pendingInput.clear();
+}
+
+/**
+ * @brief Reads the available bytes of the peer and handles the complete frames.
+ * @param events Counts the handled frames.
+ */
+void app::RedundancyLink::read_peer(size_t& events) {
+  std::array<uint8_t, 64 * 1024> buffer{};
+  for (;;) {
+    auto received = recv(m_peerFd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+    if (received < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        drop_peer(std::system_category().message(errno));
+        return;
+      }
+      break;
+    }
+    if (received == 0) {
+      drop_peer("closed by peer");
+      return;
+    }
+    m_statistics.bytesReceived += static_cast<uint64_t>(received);
+    m_input.insert(m_input.end(), buffer.begin(), buffer.begin() + received);
+  }
+  m_lastReceived = Clock::now();
+  handle_input(events);
+}
+
+/**
+ * @brief Handles the complete frames of the received bytes.
+ * @param events Counts the handled frames.
+ */
+void app::RedundancyLink::handle_input(size_t& events) {
+  size_t offset{0};
+  while (m_input.size() - offset >= FrameHeaderSize) {
+    auto type = static_cast<FrameType>(m_input[offset]);
+    uint32_t length{0};
+    std::memcpy(&length, &m_input[offset + 1], sizeof(length));
+    if (length > MaxFrameSize) {
+      drop_peer("frame too large");
+      return;
+    }
+    if (m_input.size() - offset - FrameHeaderSize < length) {
+      break;
+    }
+    if (!handle_frame(type, std::span<const uint8_t>(m_input).subspan(offset + FrameHeaderSize, length))) {
+      drop_peer("invalid frame");
+      return;
+    }
+    offset += FrameHeaderSize + length;
+    events++;
+  }
+  m_input.erase(m_input.begin(), m_input.begin() + static_cast<std::ptrdiff_t>(offset));
+}
+
+/**
+ * @brief Writes the queued bytes as far as the socket accepts them.
+ */
+void app::RedundancyLink::write_peer() {
+  size_t offset{0};
+  while (offset < m_output.size()) {
+    auto sent = ::send(m_peerFd, m_output.data() + offset, m_output.size() - offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        drop_peer(std::system_category().message(errno));
+        return;
+      }
+      break;
+    }
+    offset += static_cast<size_t>(sent);
+    m_statistics.bytesSent += static_cast<uint64_t>(sent);
+  }
+  m_output.erase(m_output.begin(), m_output.begin() + static_cast<std::ptrdiff_t>(offset));
+}
+
+/**
+ * @brief Handles a frame of the peer.
+ * @param type The frame type.
+ * @param payload The payload.
+ * @return false if the frame is invalid.
+ */
+bool app::RedundancyLink::handle_frame(FrameType type, std::span<const uint8_t> payload) {
+  PayloadReader reader(payload);
+  switch (type) {
+    case FrameType::hello: {
+      uint32_t peerId{0};
+      uint64_t epoch{0};
+      uint8_t role{0};
+      if (!reader.le(peerId) || !reader.le(epoch) || !reader.le(role) || role > 2) {
+        return false;
+      }
+      if (peerId != m_config.peerId) {
+        report("unexpected node " + std::to_string(peerId));
+        return false;
+      }
+      m_helloReceived = true;
+      handle_peer_role(static_cast<RedundancyRole>(role), epoch, peerId);
+      return true;
+    }
+    case FrameType::heartbeat: {
+      uint64_t epoch{0};
+      uint8_t role{0};
+      if (!m_helloReceived || !reader.le(epoch) || !reader.le(role) || role > 2) {
+        return false;
+      }
+      handle_peer_role(static_cast<RedundancyRole>(role), epoch, m_config.peerId);
+      return true;
+    }
+    case FrameType::points:
+      return m_role != RedundancyRole::standby || apply_points(payload);
+    case FrameType::state: {
+      uint64_t sequence{0};
+      uint64_t keySize{0};
+      uint64_t valueSize{0};
+      std::span<const uint8_t> key;
+      std::span<const uint8_t> value;
+      if (!reader.le(sequence) || !reader.varint(keySize) || !reader.bytes(keySize, key) ||
+          !reader.varint(valueSize) || !reader.bytes(valueSize, value)) {
+        return false;
+      }
+      if (m_role == RedundancyRole::standby) {
+        auto bytes = std::as_bytes(value);
+        m_state[std::string(key.begin(), key.end())].assign(bytes.begin(), bytes.end());
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Arbitrates the role with the role the peer reported.
+ * @param peerRole The role of the peer.
+ * @param peerEpoch The epoch of the peer.
+ * @param peerId The id of the peer.
+ */
+void app::RedundancyLink::handle_peer_role(RedundancyRole peerRole, uint64_t peerEpoch, uint32_t peerId) {
+  m_peerRole = peerRole;
+  if (peerRole == RedundancyRole::active) {
+    bool wins = m_epoch > peerEpoch || (m_epoch == peerEpoch && m_config.nodeId < peerId);
+    if (m_role == RedundancyRole::active && wins) {
+      // the peer gives up when it sees this node active, then receives a snapshot
+      m_needSnapshot = true;
+      send_heartbeat();
+      return;
+    }
+    m_epoch = std::max(m_epoch, peerEpoch);
+    m_lastLease = Clock::now();
+    change_role(RedundancyRole::standby);
+    return;
+  }
+  m_epoch = std::max(m_epoch, peerEpoch);
+  if (m_role == RedundancyRole::starting && peerRole == RedundancyRole::starting && m_config.nodeId < peerId) {
+    promote("peer starting, lower node id");
+  }
+}
+
+/**
+ * @brief Changes the role and calls the role handler.
+ * @param role The new role.
+ */
+void app::RedundancyLink::change_role(RedundancyRole role) {
+  if (role == m_role) {
+    return;
+  }
+  auto previous = m_role;
+  m_role = role;
+  if (role == RedundancyRole::standby) {
+    // the active node overwrites the points with its snapshot
+    m_dirtyState.clear();
+  }
+  if (is_connected()) {
+    send_heartbeat();
+  }
+  if (m_roleHandler) {
+    m_roleHandler(previous, role);
+  }
+}
+
+/**
+ * @brief Takes over the active role with a new epoch.
+ * @param reason The reason for the log.
+ */
+void app::RedundancyLink::promote(std::string_view reason) {
+  auto now = Clock::now();
+  if (m_role == RedundancyRole::standby) {
+    m_statistics.failover = now - m_lastLease;
+  }
+  m_epoch++;
+  m_statistics.promotions++;
+  // the applied points are the state of the new active node, not changes to replicate
+  m_points.clear_changed();
+  m_needSnapshot = true;
+  report("node " + std::to_string(m_config.nodeId) + " becomes active in epoch " + std::to_string(m_epoch) + ": " +
+         std::string(reason));
+  change_role(RedundancyRole::active);
+}
+
+/**
+ * @brief Promotes on lease expiry or at the end of the startup window, sends heartbeats and drops a
+ * silent peer.
+ */
+void app::RedundancyLink::check_timers() {
+  auto now = Clock::now();
+  if (m_peerFd >= 0 && !m_connecting && now - m_lastReceived >= m_config.lease) {
+    drop_peer("peer silent");
+  }
+  if (m_pendingFd >= 0 && now - m_pendingSince >= m_config.lease) {
+    close_pending();
+  }
+  if (m_role == RedundancyRole::standby && now - m_lastLease >= m_config.lease) {
+    promote("lease expired");
+  } else if (m_role == RedundancyRole::starting && now - m_started >= m_config.startupWindow) {
+    promote("no active peer");
+  }
+  if (is_connected() && now - m_lastHeartbeat >= m_config.heartbeat) {
+    send_heartbeat();
+  }
+}
+
+/**
+ * @brief Starts a frame in the frame buffer.
+ * @param type The frame type.
+ */
+void app::RedundancyLink::begin_frame(FrameType type) {
+  m_frame.clear();
+  m_frame.push_back(static_cast<uint8_t>(type));
+  put_le<uint32_t>(m_frame, 0);
+}
+
+/**
+ * @brief Completes the frame in the frame buffer and queues it. A peer that doesn't read is dropped,
+ * the rest of the frames is discarded until the next connection.
+ */
+void app::RedundancyLink::end_frame() {
+  if (m_peerFd < 0) {
+    return;
+  }
+  auto length = static_cast<uint32_t>(m_frame.size() - FrameHeaderSize);
+  std::memcpy(&m_frame[1], &length, sizeof(length));
+  if (m_output.size() + m_frame.size() > MaxPendingOutput) {
+    drop_peer("peer doesn't read, resync");
+    return;
+  }
+  m_output.insert(m_output.end(), m_frame.begin(), m_frame.end());
+}
+
+/**
+ * @brief Sends node id, epoch and role.
+ */
+void app::RedundancyLink::send_hello() {
+  begin_frame(FrameType::hello);
+  put_le<uint32_t>(m_frame, m_config.nodeId);
+  put_le<uint64_t>(m_frame, m_epoch);
+  put_le<uint8_t>(m_frame, static_cast<uint8_t>(m_role));
+  end_frame();
+}
+
+/**
+ * @brief Sends epoch and role, the heartbeat of an active node renews its lease.
+ */
+void app::RedundancyLink::send_heartbeat() {
+  begin_frame(FrameType::heartbeat);
+  put_le<uint64_t>(m_frame, m_epoch);
+  put_le<uint8_t>(m_frame, static_cast<uint8_t>(m_role));
+  end_frame();
+  // delta frames don't renew the lease, the heartbeat is due even while points stream
+  m_lastHeartbeat = Clock::now();
+}
+
+/**
+ * @brief Sends the changed points or, for a snapshot, all points, and clears the changed flags.
+ * @param snapshot true to send all points.
+ */
+void app::RedundancyLink::send_points(bool snapshot) {
+  size_t entries{0};
+  size_t countOffset{0};
+  int64_t previousIndex{-1};
+  int64_t previousTimestamp{0};
+  auto values = m_points.values();
+  auto qualities = m_points.qualities();
+  auto timestamps = m_points.timestamps();
+
+  auto flush = [&]() {
+    if (entries > 0) {
+      auto count = static_cast<uint32_t>(entries);
+      std::memcpy(&m_frame[countOffset], &count, sizeof(count));
+      end_frame();
+      m_statistics.deltas++;
+      m_statistics.pointsSent += entries;
+      entries = 0;
+    }
+  };
+  auto add = [&](size_t index) {
+    if (entries == 0) {
+      begin_frame(FrameType::points);
+      put_le<uint64_t>(m_frame, ++m_sequence);
+      put_le<uint8_t>(m_frame, snapshot ? 1 : 0);
+      countOffset = m_frame.size();
+      put_le<uint32_t>(m_frame, 0);
+      previousIndex = -1;
+      previousTimestamp = 0;
+    }
+    put_varint(m_frame, static_cast<uint64_t>(static_cast<int64_t>(index) - previousIndex - 1));
+    uint64_t value{0};
+    std::memcpy(&value, &values[index], sizeof(value));
+    put_le<uint64_t>(m_frame, value);
+    put_varint(m_frame, qualities[index]);
+    auto distance = timestamps[index] - previousTimestamp;
+    put_varint(m_frame, (static_cast<uint64_t>(distance) << 1) ^ static_cast<uint64_t>(distance >> 63));
+    previousIndex = static_cast<int64_t>(index);
+    previousTimestamp = timestamps[index];
+    if (++entries == MaxPointsPerFrame) {
+      flush();
+    }
+  };
+
+  if (snapshot) {
+    for (size_t index = 0; index < m_points.size(); ++index) {
+      add(index);
+    }
+  } else {
+    m_points.for_each_changed(add);
+  }
+  flush();
+  m_points.clear_changed();
+}
+
+/**
+ * @brief Sends a context state entry.
+ * @param key The key.
+ */
+void app::RedundancyLink::send_state(const std::string& key) {
+  auto entry = m_state.find(key);
+  if (entry == m_state.end()) {
+    return;
+  }
+  begin_frame(FrameType::state);
+  put_le<uint64_t>(m_frame, ++m_sequence);
+  put_varint(m_frame, key.size());
+  m_frame.insert(m_frame.end(), key.begin(), key.end());
+  put_varint(m_frame, entry->second.size());
+  auto bytes = reinterpret_cast<const uint8_t*>(entry->second.data());
+  m_frame.insert(m_frame.end(), bytes, bytes + entry->second.size());
+  end_frame();
+}
+
+/**
+ * @brief Sends all points and the whole context state.
+ */
+void app::RedundancyLink::send_snapshot() {
+  m_needSnapshot = false;
+  m_statistics.snapshots++;
+  send_points(true);
+  for (const auto& [key, value] : m_state) {
+    send_state(key);
+  }
+  m_dirtyState.clear();
+  report("snapshot of " + std::to_string(m_points.size()) + " points and " + std::to_string(m_state.size()) +
+         " state entries sent to node " + std::to_string(m_config.peerId));
+}
+
+/**
+ * @brief Applies the point entries of a points frame.
+ * @param payload The payload.
+ * @return false if the frame is invalid.
+ */
+bool app::RedundancyLink::apply_points(std::span<const uint8_t> payload) {
+  PayloadReader reader(payload);
+  uint64_t sequence{0};
+  uint8_t snapshot{0};
+  uint32_t count{0};
+  if (!reader.le(sequence) || !reader.le(snapshot) || !reader.le(count)) {
+    return false;
+  }
+  int64_t index{-1};
+  int64_t timestamp{0};
+  for (uint32_t i = 0; i < count; ++i) {
+    uint64_t distance{0};
+    uint64_t value{0};
+    uint64_t quality{0};
+    uint64_t encodedTimestamp{0};
+    if (!reader.varint(distance) || !reader.le(value) || !reader.varint(quality) || !reader.varint(encodedTimestamp)) {
+      return false;
+    }
+    index += static_cast<int64_t>(distance) + 1;
+    timestamp += static_cast<int64_t>(encodedTimestamp >> 1) ^ -static_cast<int64_t>(encodedTimestamp & 1);
+    if (index < 0 || static_cast<size_t>(index) >= m_points.size()) {
+      // the peer has a larger database, its extra points have no place here
+      continue;
+    }
+    double converted{0};
+    std::memcpy(&converted, &value, sizeof(converted));
+    m_points.update(static_cast<size_t>(index), converted, static_cast<uint32_t>(quality), timestamp);
+    m_statistics.pointsApplied++;
+  }
+  return true;
+}
+
+/**
+ * @brief Passes a connection event to the event handler.
+ * @param message The description.
+ */
+void app::RedundancyLink::report(const std::string& message) const {
+  if (m_eventHandler) {
+    m_eventHandler(message);
+  }
+}
@@ -0,0 +1,291 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "sampledValues.hpp"
+
+#include <algorithm>
+
+#include "berCodec.hpp"
+// clang-format on
+
+namespace {
+constexpr uint16_t EtherTypeVlan = 0x8100;  ///< IEEE 802.1Q tag
+constexpr uint16_t EtherTypeQinQ = 0x88A8;  ///< IEEE 802.1ad service tag
+constexpr size_t EthernetHeaderSize = 14;   ///< addresses and EtherType
+constexpr size_t SvHeaderSize = 8;          ///< APPID, length, reserved 1 and 2
+
+constexpr uint32_t TagSavPdu = 0x60;                 ///< [APPLICATION 0] savPdu
+constexpr uint32_t TagSequenceOfAsdu = 0xA2;         ///< [2] seqASDU
+constexpr uint32_t TagAsdu = 0x30;                   ///< SEQUENCE of one ASDU
+constexpr uint32_t TagSvId = 0x80;                   ///< [0] svID
+constexpr uint32_t TagSampleCount = 0x82;            ///< [2] smpCnt
+constexpr uint32_t TagConfigurationRevision = 0x83;  ///< [3] confRev
+constexpr uint32_t TagSampleSynchronized = 0x85;     ///< [5] smpSynch
+constexpr uint32_t TagSequenceOfData = 0x87;         ///< [7] seqData
+
+/**
+ * @brief Reads a big-endian unsigned integer.
+ * @param data The bytes, at most eight.
+ * @return The value.
+ */
+uint64_t get_unsigned(std::span<const std::byte> data) {
+  uint64_t value{0};
+  for (auto byte : data) {
+    value = (value << 8) | std::to_integer<uint8_t>(byte);
+  }
+  return value;
+}
+
+/**
+ * @brief Reads a big-endian 32-bit value.
+ * @param data The bytes.
+ * @return The value.
+ */
+uint32_t get_be32(const std::byte* data) {
+  return (std::to_integer<uint32_t>(data[0]) << 24) | (std::to_integer<uint32_t>(data[1]) << 16) |
+         (std::to_integer<uint32_t>(data[2]) << 8) | std::to_integer<uint32_t>(data[3]);
+}
+
+/**
+ * @brief Reads a big-endian 16-bit value.
+ * @param data The bytes.
+ * @return The value.
+ */
+uint16_t get_be16(const std::byte* data) {
+  return static_cast<uint16_t>((std::to_integer<uint16_t>(data[0]) << 8) | std::to_integer<uint16_t>(data[1]));
+}
+}  // namespace
+
+/**
+ * @brief Removes all ASDUs, the capacity stays.
+ */
+void app::SampledValuesBatch::clear() {
+  stream.clear();
+  sampleCount.clear();
+  configurationRevision.clear();
+  synchronized.clear();
+  timestamp.clear();
+  firstChannel.clear();
+  channels.clear();
+  values.clear();
+  qualities.clear();
+}
+
+/**
+ * @brief Decodes an Ethernet frame and appends its ASDUs to the batch. Other frames are counted
+ * and ignored.
+ * @param frame The frame, starting with the destination MAC address.
+ * @param timestamp The capture time in nanoseconds since epoch.
+ * @return The number of appended ASDUs.
+ */
+size_t app::SampledValuesDecoder::decode_frame(std::span<const std::byte> frame, int64_t timestamp) {
+  m_statistics.frames++;
+  if (frame.size() < EthernetHeaderSize) {
+    return 0;
+  }
+  size_t offset = 12;
+  auto etherType = get_be16(frame.data() + offset);
+  while (etherType == EtherTypeVlan || etherType == EtherTypeQinQ) {
+    offset += 4;
+    if (frame.size() < offset + 2) {
+      return 0;
+    }
+    etherType = get_be16(frame.data() + offset);
+  }
+  offset += 2;
+  if (etherType != EtherType) {
+    return 0;
+  }
+
+  m_statistics.svFrames++;
+  if (frame.size() - offset < SvHeaderSize) {
+    m_statistics.malformed++;
+    return 0;
+  }
+  auto appId = get_be16(frame.data() + offset);
+  // the length counts from the APPID, Ethernet padding follows it
+  size_t length = get_be16(frame.data() + offset + 2);
+  if (length < SvHeaderSize || length > frame.size() - offset) {
+    m_statistics.malformed++;
+    return 0;
+  }
+  size_t asdus{0};
+  if (!decode_pdu(frame.subspan(offset + SvHeaderSize, length - SvHeaderSize), appId, timestamp, asdus)) {
+    m_statistics.malformed++;
+  }
+  return asdus;
+}
+
+/**
+ * @brief Decodes the savPdu; the ASDUs before a malformed one stay in the batch.
+ * @param pdu The savPdu.
+ * @param appId The APPID of the frame.
+ * @param timestamp The capture time.
+ * @param asdus Counts the appended ASDUs.
+ * @return false if the savPdu is malformed.
+ */
+bool app::SampledValuesDecoder::decode_pdu(std::span<const std::byte> pdu, uint16_t appId, int64_t timestamp,
+                                           size_t& asdus) {
+  BerReader frame(pdu);
+  BerElement savPdu;
+  if (!frame.expect(TagSavPdu, savPdu)) {
+    return false;
+  }
+  BerReader fields(savPdu);
+  BerElement field;
+  while (fields.next(field)) {
+    // noASDU and the optional security field are implied by the sequence
+    if (field.tag != TagSequenceOfAsdu) {
+      continue;
+    }
+    BerReader sequence(field);
+    BerElement asdu;
+    while (sequence.next(asdu)) {
+      if (asdu.tag != TagAsdu || !decode_asdu(asdu.value, appId, timestamp)) {
+        return false;
+      }
+      asdus++;
+    }
+    if (sequence.error() != BerError::none) {
+      return false;
+    }
+  }
+  return fields.error() == BerError::none;
+}
+
+/**
+ * @brief Decodes an ASDU and appends it to the batch.
+ * @param asdu The contents of the ASDU sequence.
+ * @param appId The APPID of the frame.
+ * @param timestamp The capture time.
+ * @return false if the ASDU is malformed.
+ */
+bool app::SampledValuesDecoder::decode_asdu(std::span<const std::byte> asdu, uint16_t appId, int64_t timestamp) {
+  std::string_view svId;
+  std::span<const std::byte> data;
+  uint16_t sampleCount{0};
+  uint32_t revision{0};
+  uint8_t synchronized{0};
+  bool hasSampleCount{false};
+  BerReader fields(asdu);
+  BerElement field;
+  while (fields.next(field)) {
+    switch (field.tag) {
+      case TagSvId:
+        svId = field.to_string();
+        break;
+      case TagSampleCount:
+        // smpCnt and confRev are fixed size unsigned fields, not minimal INTEGERs
+        if (field.value.size() > 2) {
+          return false;
+        }
+        sampleCount = static_cast<uint16_t>(get_unsigned(field.value));
+        hasSampleCount = true;
+        break;
+      case TagConfigurationRevision:
+        if (field.value.size() > 4) {
+          return false;
+        }
+        revision = static_cast<uint32_t>(get_unsigned(field.value));
+        break;
+      case TagSampleSynchronized:
+        synchronized = static_cast<uint8_t>(get_unsigned(field.value.first(std::min<size_t>(field.value.size(), 1))));
+        break;
+      case TagSequenceOfData:
+        data = field.value;
+        break;
+      default:
+        // datSet, refrTm, smpRate and smpMod don't reach the points
+        break;
+    }
+  }
+  if (fields.error() != BerError::none) {
+    return false;
+  }
+  auto channels = data.size() / 8;
+  if (svId.empty() || !hasSampleCount || channels == 0 || channels > MaxChannels || data.size() % 8 != 0) {
+    return false;
+  }
+
+  auto index = find_stream(svId, appId, static_cast<uint16_t>(channels));
+  auto& stream = m_streams[index];
+  if (stream.channels != channels) {
+    m_statistics.mismatched++;
+    return true;
+  }
+  if (stream.asdus > 0 && sampleCount != static_cast<uint16_t>(stream.lastSampleCount + 1) && sampleCount != 0) {
+    stream.sampleGaps++;
+  }
+  stream.lastSampleCount = sampleCount;
+  stream.asdus++;
+  m_statistics.asdus++;
+
+  m_batch.stream.push_back(index);
+  m_batch.sampleCount.push_back(sampleCount);
+  m_batch.configurationRevision.push_back(revision);
+  m_batch.synchronized.push_back(synchronized);
+  m_batch.timestamp.push_back(timestamp);
+  m_batch.firstChannel.push_back(static_cast<uint32_t>(m_batch.values.size()));
+  m_batch.channels.push_back(static_cast<uint16_t>(channels));
+  for (size_t channel = 0; channel < channels; ++channel) {
+    m_batch.values.push_back(static_cast<int32_t>(get_be32(data.data() + channel * 8)));
+    m_batch.qualities.push_back(get_be32(data.data() + channel * 8 + 4));
+  }
+  return true;
+}
+
+/**
+ * @brief Finds the stream of an svID, a new stream reserves the points after the known streams.
+ * @param svId The svID.
+ * @param appId The APPID of the frame.
+ * @param channels The channels of the dataset.
+ * @return The index of the stream.
+ */
+uint32_t app::SampledValuesDecoder::find_stream(std::string_view svId, uint16_t appId, uint16_t channels) {
+  // a merging unit publishes few streams, the scan beats hashing the svID
+  for (uint32_t index = 0; index < m_streams.size(); ++index) {
+    if (m_streams[index].svId == svId) {
+      return index;
+    }
+  }
+  Stream stream;
+  stream.svId = std::string(svId);
+  stream.appId = appId;
+  stream.channels = channels;
+  stream.firstPoint = m_nextPoint;
+  m_nextPoint += channels;
+  m_streams.push_back(std::move(stream));
+  return static_cast<uint32_t>(m_streams.size() - 1);
+}
+
+/**
+ * @brief Writes the batch into the point database and clears it. ASDUs of streams whose points
+ * lie beyond the size of the database are counted as unmapped.
+ * @param points The point database.
+ * @return The number of updated points.
+ */
+size_t app::SampledValuesDecoder::apply(PointDatabase& points) {
+  size_t updated{0};
+  for (size_t i = 0; i < m_batch.size(); ++i) {
+    const auto& stream = m_streams[m_batch.stream[i]];
+    if (stream.firstPoint + stream.channels > points.size()) {
+      m_statistics.unmapped++;
+      continue;
+    }
+    auto first = m_batch.firstChannel[i];
+    for (size_t channel = 0; channel < m_batch.channels[i]; ++channel) {
+      points.update(stream.firstPoint + channel, static_cast<double>(m_batch.values[first + channel]),
+                    m_batch.qualities[first + channel], m_batch.timestamp[i]);
+    }
+    updated += m_batch.channels[i];
+  }
+  m_batch.clear();
+  return updated;
+}
@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "socketActivation.hpp"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <optional>
+#include <utility>
+// clang-format on
+
+namespace {
+/// The name of a socket passed without names
+constexpr std::string_view UnknownName = "unknown";
+
+/// The most sockets an activation may pass
+constexpr long MaxSockets = 1024;
+
+/**
+ * @brief Reads and clears a variable of the environment.
+ * @param name The name of the variable.
+ * @return The value, none if not set.
+ */
+std::optional<std::string> take_variable(const char* name) {
+  const char* value = std::getenv(name);
+  std::optional<std::string> result;
+  if (value != nullptr) {
+    result = value;
+  }
+  unsetenv(name);
+  return result;
+}
+
+/**
+ * @brief Parses a decimal number.
+ * @param text The text.
+ * @return The number, none if the text isn't a number.
+ */
+std::optional<long> parse_number(std::string_view text) {
+  long value = 0;
+  auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (error != std::errc() || end != text.data() + text.size() || text.empty()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+/**
+ * @brief Closes the sockets.
+ * @param sockets The sockets.
+ */
+void close_sockets(const std::vector<app::ActivatedSocket>& sockets) {
+  for (const auto& socket : sockets) {
+    ::close(socket.fd);
+  }
+}
+}  // namespace
+
+/**
+ * @brief destructor closes the sockets not taken.
+ */
+app::SocketActivation::~SocketActivation() {
+  close_sockets(m_sockets);
+}
+
+/**
+ * @brief move constructor, takes the sockets.
+ * @param other The activation, empty afterwards.
+ */
+app::SocketActivation::SocketActivation(SocketActivation&& other) noexcept
+    : m_sockets(std::move(other.m_sockets)), m_error(std::move(other.m_error)) {
+  other.m_sockets.clear();
+}
+
+/**
+ * @brief move assignment, closes the own sockets and takes the sockets of the other activation.
+ * @param other The activation, empty afterwards.
+ * @return This activation.
+ */
+app::SocketActivation& app::SocketActivation::operator=(SocketActivation&& other) noexcept {
+  if (this != &other) {
+    close_sockets(m_sockets);
+    m_sockets = std::move(other.m_sockets);
+    other.m_sockets.clear();
+    m_error = std::move(other.m_error);
+  }
+  return *this;
+}
+
+/**
+ * @brief Reads the sockets passed to this process and clears the environment.
+ *
+ * The sockets are marked close-on-exec, their type is read from the socket. A descriptor that
+ * isn't open is skipped and, as a number of names that doesn't match the sockets, reported as error.
+ * @return The sockets, none without an activation or if LISTEN_PID names another process.
+ */
+app::SocketActivation app::SocketActivation::from_environment() {
+  SocketActivation activation;
+  auto pid = take_variable("LISTEN_PID");
+  auto fds = take_variable("LISTEN_FDS");
+  auto names = take_variable("LISTEN_FDNAMES");
+  if (!pid || !fds) {
+    return activation;
+  }
+  auto owner = parse_number(*pid);
+  if (!owner || *owner != getpid()) {
+    // the sockets of a parent that didn't clear the environment
+    return activation;
+  }
+  auto count = parse_number(*fds);
+  if (!count || *count <= 0 || *count > MaxSockets) {
+    activation.m_error = "LISTEN_FDS \"" + *fds + "\" is invalid";
+    return activation;
+  }
+
+  std::vector<std::string> socketNames;
+  if (names) {
+    std::string_view text(*names);
+    for (size_t start = 0; start <= text.size();) {
+      auto end = std::min(text.find(':', start), text.size());
+      socketNames.emplace_back(text.substr(start, end - start));
+      start = end + 1;
+    }
+    if (socketNames.size() != static_cast<size_t>(*count)) {
+      activation.m_error = "LISTEN_FDNAMES names " + std::to_string(socketNames.size()) + " sockets, LISTEN_FDS " +
+                           std::to_string(*count);
+      socketNames.clear();
+    }
+  }
+
+  for (int index = 0; index < *count; ++index) {
+    ActivatedSocket socket;
+    socket.fd = FirstFd + index;
+    socket.name = socketNames.empty() ? std::string(UnknownName) : socketNames[index];
+    if (fcntl(socket.fd, F_SETFD, FD_CLOEXEC) < 0) {
+      activation.m_error = "descriptor " + std::to_string(socket.fd) + " isn't open";
+      continue;
+    }
+    int value = 0;
+    socklen_t length = sizeof(value);
+    if (getsockopt(socket.fd, SOL_SOCKET, SO_TYPE, &value, &length) == 0) {
+      socket.type = value;
+      length = sizeof(value);
+      socket.listening = getsockopt(socket.fd, SOL_SOCKET, SO_ACCEPTCONN, &value, &length) == 0 && value != 0;
+    }
+    activation.m_sockets.push_back(std::move(socket));
+  }
+  return activation;
+}
+
+/**
+ * @brief Passes sockets to the next exec.
+ *
+ * The sockets are parked above the target descriptors first, so a socket that already sits on the
+ * target of another one isn't overwritten. The moved descriptors stay open across the exec.
+ * @param sockets The sockets, their descriptors are updated.
+ * @return false if a descriptor can't be moved, errno tells why.
+ */
+bool app::SocketActivation::pass(std::vector<ActivatedSocket>& sockets) {
+  const int count = static_cast<int>(sockets.size());
+  for (auto& socket : sockets) {
+    int parked = fcntl(socket.fd, F_DUPFD_CLOEXEC, FirstFd + count);
+    if (parked < 0) {
+      return false;
+    }
+    ::close(socket.fd);
+    socket.fd = parked;
+  }
+
+  std::string names;
+  for (int index = 0; index < count; ++index) {
+    auto& socket = sockets[index];
+    // the duplicate of dup2 is inherited by the exec
+    if (dup2(socket.fd, FirstFd + index) < 0) {
+      return false;
+    }
+    ::close(socket.fd);
+    socket.fd = FirstFd + index;
+    names += index > 0 ? ":" : "";
+    names += socket.name.empty() ? UnknownName : std::string_view(socket.name);
+  }
+
+  setenv("LISTEN_FDS", std::to_string(count).c_str(), 1);
+  setenv("LISTEN_FDNAMES", names.c_str(), 1);
+  setenv("LISTEN_PID", std::to_string(getpid()).c_str(), 1);
+  return true;
+}
+
+/**
+ * @brief Duplicates sockets, the duplicates share the open socket and are close-on-exec.
+ * @param sockets The sockets.
+ * @return The duplicates, the caller owns them; empty if a descriptor can't be duplicated, errno tells why.
+ */
+std::vector<app::ActivatedSocket> app::SocketActivation::duplicate(const std::vector<ActivatedSocket>& sockets) {
+  std::vector<ActivatedSocket> duplicates;
+  for (const auto& socket : sockets) {
+    auto copy = socket;
+    copy.fd = fcntl(socket.fd, F_DUPFD_CLOEXEC, 0);
+    if (copy.fd < 0) {
+      int error = errno;
+      close_sockets(duplicates);
+      errno = error;
+      return {};
+    }
+    duplicates.push_back(std::move(copy));
+  }
+  return duplicates;
+}
+
+/**
+ * @brief Takes the sockets of a name, the caller owns them.
+ * @param name The name.
+ * @return The sockets in the passed order, empty if none has the name.
+ */
+std::vector<app::ActivatedSocket> app::SocketActivation::take(std::string_view name) {
+  std::vector<ActivatedSocket> taken;
+  std::erase_if(m_sockets, [&](const ActivatedSocket& socket) {
+    if (socket.name != name) {
+      return false;
+    }
+    taken.push_back(socket);
+    return true;
+  });
+  return taken;
+}
+
+/**
+ * @brief Closes the sockets no one has taken.
+ * @return The names of the closed sockets.
+ */
+std::vector<std::string> app::SocketActivation::close_unclaimed() {
+  std::vector<std::string> names;
+  for (auto& socket : m_sockets) {
+    names.push_back(std::move(socket.name));
+  }
+  close_sockets(m_sockets);
+  m_sockets.clear();
+  return names;
+}
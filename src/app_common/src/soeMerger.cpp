@@ -0,0 +1,209 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "soeMerger.hpp"
+
+#include <algorithm>
+#include <utility>
+// clang-format on
+
+namespace {
+constexpr size_t InitialCapacity = 16;  ///< events of a source queue before it grows
+}  // namespace
+
+/**
+ * @brief Adds a source, open and without progress.
+ * @return The identifier of the source, MaxSources if there are too many.
+ */
+size_t app::SoeMerger::add_source() {
+  if (m_sources.size() >= MaxSources) {
+    return MaxSources;
+  }
+  m_sources.emplace_back();
+  return m_sources.size() - 1;
+}
+
+/**
+ * @brief Queues an event of a source and opens a closed source.
+ *
+ * An event older than the last released event is late and goes to the late events or is
+ * dropped. Any other event joins the queue of its source.
+ * @param source The source.
+ * @param event The event, the arrival and the source are set.
+ * @param now The time in nanoseconds on the time line of the event timestamps.
+ * @return true if queued, false if the event is late and dropped.
+ */
+bool app::SoeMerger::push(size_t source, const SoeEvent& event, int64_t now) {
+  auto& queue = m_sources[source];
+  queue.open = true;
+  ++m_statistics.received;
+
+  SoeEvent queued = event;
+  queued.arrival = now;
+  queued.source = static_cast<uint16_t>(source);
+  queued.late = false;
+  if (event.timestamp < m_lastReleased) {
+    ++m_statistics.late;
+    if (m_config.latePolicy == SoeLatePolicy::drop) {
+      ++m_statistics.dropped;
+      return false;
+    }
+    queued.late = true;
+    m_late.push_back(queued);
+    return true;
+  }
+  queue.progress = std::max(queue.progress, event.timestamp);
+  enqueue(queue, queued);
+  return true;
+}
+
+/**
+ * @brief Advances the progress of a source without an event.
+ * @param source The source.
+ * @param timestamp The timestamp in nanoseconds.
+ */
+void app::SoeMerger::advance(size_t source, int64_t timestamp) {
+  auto& queue = m_sources[source];
+  queue.open = true;
+  queue.progress = std::max(queue.progress, timestamp);
+}
+
+/**
+ * @brief Closes a source, it no longer holds the watermark back.
+ * @param source The source.
+ */
+void app::SoeMerger::close(size_t source) {
+  m_sources[source].open = false;
+}
+
+/**
+ * @brief Gets the timestamp up to which all events can be released.
+ *
+ * The minimum over the open sources costs one pass over the sources per release, not per event.
+ * @param now The time in nanoseconds.
+ * @return The progress of the slowest open source, at least the window before now.
+ */
+int64_t app::SoeMerger::watermark(int64_t now) const {
+  auto slowest = std::numeric_limits<int64_t>::max();
+  for (const auto& source : m_sources) {
+    if (source.open) {
+      slowest = std::min(slowest, source.progress);
+    }
+  }
+  return std::max(slowest, now - static_cast<int64_t>(m_config.window.count()));
+}
+
+/**
+ * @brief Appends an event to the queue of its source.
+ *
+ * A source delivers in order, so an event goes to the back; an older one is sorted in from the
+ * back. The queue enters the heap with its first event and moves up when its front got older.
+ * @param source The source.
+ * @param event The event.
+ */
+void app::SoeMerger::enqueue(Source& source, const SoeEvent& event) {
+  if (source.count == source.ring.size()) {
+    std::vector<SoeEvent> ring(std::max(InitialCapacity, source.ring.size() * 2));
+    for (size_t i = 0; i < source.count; ++i) {
+      ring[i] = source.ring[(source.head + i) & (source.ring.size() - 1)];
+    }
+    source.ring = std::move(ring);
+    source.head = 0;
+  }
+  const auto mask = source.ring.size() - 1;
+  auto position = source.count;
+  while (position > 0 && source.ring[(source.head + position - 1) & mask].timestamp > event.timestamp) {
+    source.ring[(source.head + position) & mask] = source.ring[(source.head + position - 1) & mask];
+    --position;
+  }
+  if (position != source.count) {
+    ++m_statistics.reordered;
+  }
+  source.ring[(source.head + position) & mask] = event;
+  ++source.count;
+  ++m_queued;
+
+  if (source.heapIndex == NotQueued) {
+    source.heapIndex = static_cast<uint32_t>(m_heap.size());
+    m_heap.push_back(event.source);
+    sift_up(source.heapIndex);
+  } else if (position == 0) {
+    sift_up(source.heapIndex);
+  }
+}
+
+/**
+ * @brief Compares the front events of two sources.
+ * @param a The first source.
+ * @param b The second source.
+ * @return true if the front of a is released before the front of b.
+ */
+bool app::SoeMerger::before(uint16_t a, uint16_t b) const {
+  auto left = m_sources[a].front().timestamp;
+  auto right = m_sources[b].front().timestamp;
+  return left < right || (left == right && a < b);
+}
+
+/**
+ * @brief Moves a heap entry up to its place.
+ * @param index The position of the entry.
+ */
+void app::SoeMerger::sift_up(size_t index) {
+  auto entry = m_heap[index];
+  while (index > 0) {
+    auto parent = (index - 1) / 2;
+    if (!before(entry, m_heap[parent])) {
+      break;
+    }
+    m_heap[index] = m_heap[parent];
+    m_sources[m_heap[index]].heapIndex = static_cast<uint32_t>(index);
+    index = parent;
+  }
+  m_heap[index] = entry;
+  m_sources[entry].heapIndex = static_cast<uint32_t>(index);
+}
+
+/**
+ * @brief Moves a heap entry down to its place.
+ * @param index The position of the entry.
+ */
+void app::SoeMerger::sift_down(size_t index) {
+  auto entry = m_heap[index];
+  const auto size = m_heap.size();
+  for (;;) {
+    auto child = 2 * index + 1;
+    if (child >= size) {
+      break;
+    }
+    if (child + 1 < size && before(m_heap[child + 1], m_heap[child])) {
+      ++child;
+    }
+    if (!before(m_heap[child], entry)) {
+      break;
+    }
+    m_heap[index] = m_heap[child];
+    m_sources[m_heap[index]].heapIndex = static_cast<uint32_t>(index);
+    index = child;
+  }
+  m_heap[index] = entry;
+  m_sources[entry].heapIndex = static_cast<uint32_t>(index);
+}
+
+/**
+ * @brief Removes the source at the top of the heap, its queue is empty.
+ */
+void app::SoeMerger::remove_top() {
+  m_sources[m_heap.front()].heapIndex = NotQueued;
+  m_heap.front() = m_heap.back();
+  m_heap.pop_back();
+  if (!m_heap.empty()) {
+    sift_down(0);
+  }
+}
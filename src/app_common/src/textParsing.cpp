@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "textParsing.hpp"
+// clang-format on
+
+/**
+ * @brief Splits a line into tokens separated by blanks.
+ * @param line The line without comment.
+ * @return The tokens, views into the line.
+ */
+std::vector<std::string_view> app::split_tokens(std::string_view line) {
+  std::vector<std::string_view> tokens;
+  size_t position = 0;
+  while ((position = line.find_first_not_of(" \t\r", position)) != std::string_view::npos) {
+    auto end = line.find_first_of(" \t\r", position);
+    tokens.push_back(line.substr(position, end - position));
+    position = end;
+  }
+  return tokens;
+}
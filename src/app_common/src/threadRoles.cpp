@@ -0,0 +1,280 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "threadRoles.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <system_error>
+#include <utility>
+
+#include "cpuResources.hpp"
+// clang-format on
+
+namespace {
+
+/**
+ * @brief The scheduling policies by name.
+ */
+constexpr std::pair<std::string_view, int> Policies[] = {
+    {"other", SCHED_OTHER},
+    {"batch", SCHED_BATCH},
+    {"fifo", SCHED_FIFO},
+    {"rr", SCHED_RR},
+};
+
+/**
+ * @brief Reads a CPU list file of sysfs.
+ * @param path The file.
+ * @return The CPUs, empty if the file is missing or empty.
+ */
+std::vector<size_t> read_cpu_list(const std::filesystem::path& path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return app::CpuResources::parse_cpu_list(line);
+}
+
+/**
+ * @brief Reads the CPU list of a kernel parameter like "isolcpus=domain,2-5".
+ * @param cmdline The kernel command line file.
+ * @param parameter The parameter with the equal sign.
+ * @return The CPUs, empty if the parameter is missing. Flags in the list are skipped.
+ */
+std::vector<size_t> read_kernel_cpu_list(const std::filesystem::path& cmdline, std::string_view parameter) {
+  std::ifstream file(cmdline);
+  std::string word;
+  while (file >> word) {
+    if (word.rfind(parameter, 0) == 0) {
+      return app::CpuResources::parse_cpu_list(std::string_view(word).substr(parameter.size()));
+    }
+  }
+  return {};
+}
+
+/**
+ * @brief Formats CPUs as a list like "0-3,6".
+ * @param cpus The CPUs in ascending order.
+ * @return The list.
+ */
+std::string format_cpu_list(const std::vector<size_t>& cpus) {
+  std::string list;
+  for (size_t i = 0; i < cpus.size();) {
+    size_t last = i;
+    while (last + 1 < cpus.size() && cpus[last + 1] == cpus[last] + 1) {
+      last++;
+    }
+    list += (list.empty() ? "" : ",") + std::to_string(cpus[i]);
+    if (last > i) {
+      list += "-" + std::to_string(cpus[last]);
+    }
+    i = last + 1;
+  }
+  return list;
+}
+
+}  // namespace
+
+/**
+ * @brief Gets the name of a thread role.
+ * @param role The role.
+ * @return The name.
+ */
+std::string_view app::to_string(ThreadRole role) {
+  return role == ThreadRole::critical ? "critical" : "housekeeping";
+}
+
+/**
+ * @brief Parses the scheduling "other[:nice]", "batch[:nice]", "fifo:priority" or "rr:priority".
+ * @param text The text.
+ * @return true if the text is valid, the settings are unchanged otherwise.
+ */
+bool app::RoleSettings::parse_scheduling(std::string_view text) {
+  auto colon = text.find(':');
+  auto name = text.substr(0, colon);
+  auto entry = std::find_if(std::begin(Policies), std::end(Policies), [&](const auto& p) { return p.first == name; });
+  if (entry == std::end(Policies)) {
+    return false;
+  }
+  bool realtime = entry->second == SCHED_FIFO || entry->second == SCHED_RR;
+  int value{0};
+  if (colon != std::string_view::npos) {
+    try {
+      size_t used{0};
+      auto number = std::string(text.substr(colon + 1));
+      value = std::stoi(number, &used);
+      if (used != number.size()) {
+        return false;
+      }
+    } catch (const std::exception&) {
+      return false;
+    }
+  } else if (realtime) {
+    return false;
+  }
+  if (realtime && (value < sched_get_priority_min(entry->second) || value > sched_get_priority_max(entry->second))) {
+    return false;
+  }
+  if (!realtime && (value < -20 || value > 19)) {
+    return false;
+  }
+  policy = entry->second;
+  priority = realtime ? value : 0;
+  nice = realtime ? 0 : value;
+  return true;
+}
+
+/**
+ * @brief Formats the settings for the log.
+ * @return The text, e.g. "cpus 2-3, fifo:50".
+ */
+std::string app::RoleSettings::describe() const {
+  auto name = std::find_if(std::begin(Policies), std::end(Policies), [&](const auto& p) { return p.second == policy; });
+  std::string text = cpus.empty() ? "all cpus" : "cpus " + format_cpu_list(cpus);
+  text += ", ";
+  text += name != std::end(Policies) ? name->first : "policy " + std::to_string(policy);
+  bool realtime = policy == SCHED_FIFO || policy == SCHED_RR;
+  return text + ":" + std::to_string(realtime ? priority : nice);
+}
+
+/**
+ * @brief Applies the settings to the calling thread: affinity, policy and nice value.
+ * @return The error of the first setting that failed, none on success.
+ */
+std::optional<std::string> app::RoleSettings::apply() const {
+  if (!cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus) {
+      CPU_SET(cpu, &set);
+    }
+    if (auto error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); error != 0) {
+      return "affinity " + format_cpu_list(cpus) + ": " + std::system_category().message(error);
+    }
+  }
+  sched_param param{};
+  param.sched_priority = priority;
+  if (auto error = pthread_setschedparam(pthread_self(), policy, &param); error != 0) {
+    return "scheduling " + describe() + ": " + std::system_category().message(error);
+  }
+  if (policy == SCHED_OTHER || policy == SCHED_BATCH) {
+    // the nice value is a property of the thread on Linux
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), nice) != 0) {
+      return "nice " + std::to_string(nice) + ": " + std::system_category().message(errno);
+    }
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief Detects the partition from the isolated and the nohz_full CPUs of the kernel. The critical
+ * CPUs are the isolated ones, the housekeeping CPUs the other online CPUs.
+ * @param cpuSysfs The CPU directory in sysfs.
+ * @param cmdline The kernel command line, read if sysfs doesn't list isolated CPUs.
+ * @return The partition, without CPU sets if no CPU is isolated.
+ */
+app::ThreadPartition app::ThreadPartition::detect(const std::filesystem::path& cpuSysfs,
+                                                  const std::filesystem::path& cmdline) {
+  ThreadPartition partition;
+  auto isolated = read_cpu_list(cpuSysfs / "isolated");
+  auto nohzFull = read_cpu_list(cpuSysfs / "nohz_full");
+  if (isolated.empty() && nohzFull.empty()) {
+    isolated = read_kernel_cpu_list(cmdline, "isolcpus=");
+    nohzFull = read_kernel_cpu_list(cmdline, "nohz_full=");
+  }
+  partition.origin = !isolated.empty() ? "isolcpus" : !nohzFull.empty() ? "nohz_full" : "none";
+
+  std::vector<size_t> critical;
+  std::set_union(isolated.begin(), isolated.end(), nohzFull.begin(), nohzFull.end(), std::back_inserter(critical));
+  auto online = read_cpu_list(cpuSysfs / "online");
+  std::vector<size_t> housekeeping;
+  std::set_difference(online.begin(), online.end(), critical.begin(), critical.end(),
+                      std::back_inserter(housekeeping));
+  std::vector<size_t> usable;
+  std::set_intersection(critical.begin(), critical.end(), online.begin(), online.end(), std::back_inserter(usable));
+
+  // a partition needs CPUs on both sides, otherwise all threads share all CPUs
+  if (!usable.empty() && !housekeeping.empty()) {
+    partition.critical.cpus = std::move(usable);
+    partition.housekeeping.cpus = std::move(housekeeping);
+  } else {
+    partition.origin = "none";
+  }
+  return partition;
+}
+
+/**
+ * @brief Gets the roles of the process.
+ * @return The roles.
+ */
+app::ThreadRoles& app::ThreadRoles::instance() {
+  static ThreadRoles roles;
+  return roles;
+}
+
+/**
+ * @brief Sets the partition used for later assignments.
+ * @param partition The partition.
+ */
+void app::ThreadRoles::configure(ThreadPartition partition) {
+  std::lock_guard lock(m_mutex);
+  m_partition = std::move(partition);
+}
+
+/**
+ * @brief Gets the partition.
+ * @return The partition.
+ */
+app::ThreadPartition app::ThreadRoles::partition() const {
+  std::lock_guard lock(m_mutex);
+  return m_partition;
+}
+
+/**
+ * @brief Tags the calling thread, names it and applies the settings of its role.
+ * A thread that is tagged again, e.g. after a reconfiguration, replaces its entry.
+ * @param role The role.
+ * @param name The thread name, truncated to 15 characters by the kernel.
+ * @return The error of the settings, none if applied.
+ */
+std::optional<std::string> app::ThreadRoles::assign(ThreadRole role, std::string_view name) {
+  std::lock_guard lock(m_mutex);
+  auto error = m_partition.settings(role).apply();
+
+  std::string threadName(name.substr(0, 15));
+  pthread_setname_np(pthread_self(), threadName.c_str());
+
+  auto tid = gettid();
+  auto entry = std::find_if(m_threads.begin(), m_threads.end(), [&](const auto& info) { return info.tid == tid; });
+  ThreadInfo info{std::string(name), role, tid, error.value_or("")};
+  if (entry != m_threads.end()) {
+    *entry = std::move(info);
+  } else {
+    m_threads.push_back(std::move(info));
+  }
+  return error;
+}
+
+/**
+ * @brief Gets the tagged threads.
+ * @return The threads in the order of their assignment.
+ */
+std::vector<app::ThreadRoles::ThreadInfo> app::ThreadRoles::threads() const {
+  std::lock_guard lock(m_mutex);
+  return m_threads;
+}
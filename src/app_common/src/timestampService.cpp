@@ -0,0 +1,217 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "timestampService.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include <algorithm>
+#include <thread>
+// clang-format on
+
+namespace {
+
+/// The first calibration spans this time, later calibrations refine it with the growing distance
+constexpr std::chrono::milliseconds CalibrationTime{10};
+
+/// update() recalibrates at most once per interval
+constexpr std::chrono::seconds RecalibrationInterval{1};
+
+/**
+ * @brief A counter value and the monotonic timestamp read at the same moment.
+ */
+struct CalibrationPoint {
+  uint64_t ticks;  ///< counter value
+  int64_t ns;      ///< monotonic timestamp
+};
+
+/**
+ * @brief Reads the counter around the monotonic clock and keeps the tightest of a few attempts,
+ * so a preemption between the reads doesn't spoil the calibration.
+ * @return The calibration point.
+ */
+CalibrationPoint read_calibration_point() {
+  CalibrationPoint best{0, 0};
+  uint64_t bestSpread{UINT64_MAX};
+  for (int attempt = 0; attempt < 5; ++attempt) {
+    auto before = app::TimestampService::read_ticks();
+    auto ns = app::TimestampService::monotonic_now().count();
+    auto after = app::TimestampService::read_ticks();
+    if (after - before < bestSpread) {
+      bestSpread = after - before;
+      best = {before + (after - before) / 2, ns};
+    }
+  }
+  return best;
+}
+
+/**
+ * @brief Divides nanoseconds by ticks in the fixed point of the multiplier, (ns << 32) / ticks by
+ * long division, the shifted nanoseconds of a long uptime don't fit into 64 bits.
+ * @param ns The nanoseconds.
+ * @param ticks The ticks, less than 2^63.
+ * @return The nanoseconds per tick, shifted by 32.
+ */
+uint64_t fixed_ratio(uint64_t ns, uint64_t ticks) {
+  uint64_t ratio = ns / ticks;
+  uint64_t remainder = ns % ticks;
+  for (int bit = 0; bit < 32; ++bit) {
+    remainder <<= 1;
+    ratio <<= 1;
+    if (remainder >= ticks) {
+      remainder -= ticks;
+      ratio |= 1;
+    }
+  }
+  return ratio;
+}
+
+/**
+ * @brief Gets the wall-clock time minus the monotonic time.
+ * @return The offset in nanoseconds.
+ */
+int64_t read_wall_offset() {
+  timespec wall{};
+  clock_gettime(CLOCK_REALTIME, &wall);
+  auto monotonic = app::TimestampService::monotonic_now();
+  auto wallNs = std::chrono::seconds(wall.tv_sec) + std::chrono::nanoseconds(wall.tv_nsec);
+  return (wallNs - monotonic).count();
+}
+
+}  // namespace
+
+/**
+ * @brief Gets the name of a timestamp source.
+ * @param source The source.
+ * @return The name.
+ */
+std::string_view app::to_string(TimestampSource source) {
+  switch (source) {
+    case TimestampSource::tsc:
+      return "tsc";
+    case TimestampSource::vdso:
+      return "vdso";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Gets the service shared by the process, it uses the counter if it is invariant.
+ * @return The service.
+ */
+app::TimestampService& app::TimestampService::instance() {
+  static TimestampService service;
+  return service;
+}
+
+/**
+ * @brief constructor, calibrates the counter.
+ * @param preferred The preferred source, the vDSO is used if the counter is not invariant.
+ */
+app::TimestampService::TimestampService(TimestampSource preferred)
+    : m_source(preferred == TimestampSource::tsc && counter_invariant() ? TimestampSource::tsc
+                                                                        : TimestampSource::vdso) {
+  if (m_source == TimestampSource::tsc) {
+    calibrate();
+  }
+  update();
+}
+
+/**
+ * @brief Checks if the CPU has a counter with constant rate in all power states.
+ * @return true if the counter is invariant.
+ */
+bool app::TimestampService::counter_invariant() {
+#if defined(__x86_64__) || defined(__i386__)
+  // CPUID 8000_0007h EDX bit 8: invariant TSC
+  unsigned int eax{0};
+  unsigned int ebx{0};
+  unsigned int ecx{0};
+  unsigned int edx{0};
+  if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007 || !__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  return (edx & (1U << 8)) != 0;
+#elif defined(__aarch64__)
+  // the generic timer runs at a constant rate by architecture
+  return true;
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief Calibrates the counter against the monotonic clock over CalibrationTime.
+ */
+void app::TimestampService::calibrate() {
+  auto first = read_calibration_point();
+  std::this_thread::sleep_for(CalibrationTime);
+  auto second = read_calibration_point();
+  if (second.ticks <= first.ticks || second.ns <= first.ns) {
+    m_source = TimestampSource::vdso;
+    return;
+  }
+  auto mult = fixed_ratio(static_cast<uint64_t>(second.ns - first.ns), second.ticks - first.ticks);
+  m_firstTicks = first.ticks;
+  m_firstNs = first.ns;
+  m_calibratedNs.store(second.ns, std::memory_order_relaxed);
+  m_baseTicks.store(second.ticks, std::memory_order_relaxed);
+  m_baseNs.store(second.ns, std::memory_order_relaxed);
+  m_mult.store(mult, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Refreshes the cached timestamp, the wall-clock offset and the calibration.
+ * Concurrent callers skip the recalibration while another caller performs it.
+ * @return The new cached timestamp.
+ */
+std::chrono::nanoseconds app::TimestampService::update() {
+  auto timestamp = now();
+  m_cachedNs.store(timestamp.count(), std::memory_order_relaxed);
+  m_wallOffsetNs.store(read_wall_offset(), std::memory_order_relaxed);
+
+  auto sequence = m_sequence.load(std::memory_order_relaxed);
+  auto sinceCalibration = std::chrono::nanoseconds(timestamp.count() - m_calibratedNs.load(std::memory_order_relaxed));
+  if (m_source != TimestampSource::tsc || sinceCalibration < RecalibrationInterval || (sequence & 1) != 0 ||
+      !m_sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire)) {
+    return timestamp;
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+
+  // the slope over the whole distance to the first point, the base continues the current conversion
+  // or jumps forward to the clock, so the timestamps never go back
+  auto point = read_calibration_point();
+  if (point.ticks > m_firstTicks && point.ns > m_firstNs) {
+    auto mult = fixed_ratio(static_cast<uint64_t>(point.ns - m_firstNs), point.ticks - m_firstTicks);
+    auto baseTicks = m_baseTicks.load(std::memory_order_relaxed);
+    auto continued = m_baseNs.load(std::memory_order_relaxed) +
+                     scale(static_cast<int64_t>(point.ticks - baseTicks), m_mult.load(std::memory_order_relaxed));
+    m_baseTicks.store(point.ticks, std::memory_order_relaxed);
+    m_baseNs.store(std::max(continued, point.ns), std::memory_order_relaxed);
+    m_mult.store(mult, std::memory_order_relaxed);
+    m_calibratedNs.store(point.ns, std::memory_order_relaxed);
+  }
+  m_sequence.store(sequence + 2, std::memory_order_release);
+  return timestamp;
+}
+
+/**
+ * @brief Gets the calibrated counter frequency.
+ * @return The frequency in Hz, 0 without counter.
+ */
+double app::TimestampService::counter_hz() const {
+  auto mult = m_mult.load(std::memory_order_relaxed);
+  if (m_source != TimestampSource::tsc || mult == 0) {
+    return 0.0;
+  }
+  return 1e9 * static_cast<double>(uint64_t{1} << Shift) / static_cast<double>(mult);
+}
@@ -0,0 +1,345 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "trafficCapture.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "timestampService.hpp"
+// clang-format on
+
+namespace {
+
+/**
+ * @brief Appends an unsigned LEB128 varint to the buffer.
+ * @param buffer The output buffer.
+ * @param value The value to append.
+ */
+void put_varint(std::vector<uint8_t>& buffer, uint64_t value) {
+  while (value >= 0x80) {
+    buffer.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  buffer.push_back(static_cast<uint8_t>(value));
+}
+
+/**
+ * @brief Reads an unsigned LEB128 varint.
+ * @param data The input bytes.
+ * @param size The size of the input.
+ * @param offset The read offset, advanced past the varint.
+ * @return The value or std::nullopt if the varint is truncated or too long.
+ */
+std::optional<uint64_t> get_varint(const std::byte* data, size_t size, size_t& offset) {
+  uint64_t value{0};
+  for (unsigned shift = 0; shift < 64 && offset < size; shift += 7) {
+    auto byte = std::to_integer<uint8_t>(data[offset++]);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief Appends a little-endian integer to the buffer.
+ */
+template <typename T>
+void put_le(std::vector<uint8_t>& buffer, T value) {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    buffer.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i)));
+  }
+}
+
+/**
+ * @brief Reads a little-endian integer.
+ */
+template <typename T>
+T get_le(const std::byte* data) {
+  uint64_t value{0};
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    value |= static_cast<uint64_t>(std::to_integer<uint8_t>(data[i])) << (8 * i);
+  }
+  return static_cast<T>(value);
+}
+
+/**
+ * @brief Writes the whole buffer to the file descriptor.
+ * @return true if all bytes are written, otherwise false.
+ */
+bool write_all(int fd, const uint8_t* data, size_t size) {
+  while (size > 0) {
+    auto written = ::write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+}  // namespace
+
+/**
+ * @brief Destructor flushes the buffered records and closes the capture file.
+ */
+app::TrafficCaptureWriter::~TrafficCaptureWriter() {
+  close();
+}
+
+/**
+ * @brief Creates the capture file and writes the header.
+ *
+ * The header holds the wall-clock start time, the records hold the monotonic time relative to it,
+ * so a capture replays with its original pacing even if the system clock is adjusted while recording.
+ *
+ * @param path The path of the capture file.
+ * @return true if the file is created, otherwise false.
+ */
+bool app::TrafficCaptureWriter::open(const std::filesystem::path& path) {
+  std::lock_guard lock(m_mutex);
+  if (m_fd >= 0) {
+    return false;
+  }
+
+  m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (m_fd < 0) {
+    return false;
+  }
+
+  m_start = TimestampService::to_steady(TimestampService::instance().now());
+  m_last = std::chrono::nanoseconds(0);
+  m_records = 0;
+  m_bytes = 0;
+  m_buffer.clear();
+  m_buffer.reserve(FlushThreshold * 2);
+
+  auto wallStart = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch());
+  put_le<uint32_t>(m_buffer, Magic);
+  put_le<uint16_t>(m_buffer, Version);
+  put_le<uint16_t>(m_buffer, 0);
+  put_le<uint64_t>(m_buffer, static_cast<uint64_t>(wallStart.count()));
+  flush_locked();
+  return m_fd >= 0;
+}
+
+/**
+ * @brief Flushes the buffered records and closes the capture file.
+ */
+void app::TrafficCaptureWriter::close() {
+  std::lock_guard lock(m_mutex);
+  if (m_fd >= 0) {
+    flush_locked();
+    if (m_fd >= 0) {
+      ::close(m_fd);
+      m_fd = -1;
+    }
+  }
+}
+
+/**
+ * @brief Checks if the capture file is open.
+ * @return true if open, otherwise false.
+ */
+bool app::TrafficCaptureWriter::is_open() const {
+  std::lock_guard lock(m_mutex);
+  return m_fd >= 0;
+}
+
+/**
+ * @brief Records received bytes with the current monotonic timestamp.
+ * @param endpoint The endpoint id.
+ * @param session The session id within the endpoint.
+ * @param data The received bytes.
+ */
+void app::TrafficCaptureWriter::record(uint32_t endpoint, uint32_t session, std::span<const std::byte> data) {
+  auto now = TimestampService::to_steady(TimestampService::instance().now());
+
+  std::lock_guard lock(m_mutex);
+  if (m_fd < 0) {
+    return;
+  }
+
+  auto timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_start);
+  // the clock is read outside the lock, so concurrent records can arrive slightly out of order
+  auto delta = timestamp > m_last ? timestamp - m_last : std::chrono::nanoseconds(0);
+  m_last += delta;
+
+  put_varint(m_buffer, static_cast<uint64_t>(delta.count()));
+  put_varint(m_buffer, endpoint);
+  put_varint(m_buffer, session);
+  put_varint(m_buffer, data.size());
+  auto bytes = reinterpret_cast<const uint8_t*>(data.data());
+  m_buffer.insert(m_buffer.end(), bytes, bytes + data.size());
+
+  m_records++;
+  m_bytes += data.size();
+
+  if (m_buffer.size() >= FlushThreshold) {
+    flush_locked();
+  }
+}
+
+/**
+ * @brief Writes buffered records to the file.
+ */
+void app::TrafficCaptureWriter::flush() {
+  std::lock_guard lock(m_mutex);
+  flush_locked();
+}
+
+/**
+ * @brief Writes buffered records to the file. The mutex must be held.
+ * On a write error the file is closed and further records are dropped.
+ */
+void app::TrafficCaptureWriter::flush_locked() {
+  if (m_fd < 0 || m_buffer.empty()) {
+    return;
+  }
+  if (!write_all(m_fd, m_buffer.data(), m_buffer.size())) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+  m_buffer.clear();
+}
+
+/**
+ * @brief Gets the number of recorded records.
+ * @return The number of records.
+ */
+uint64_t app::TrafficCaptureWriter::records() const {
+  std::lock_guard lock(m_mutex);
+  return m_records;
+}
+
+/**
+ * @brief Gets the number of recorded payload bytes.
+ * @return The number of payload bytes.
+ */
+uint64_t app::TrafficCaptureWriter::bytes() const {
+  std::lock_guard lock(m_mutex);
+  return m_bytes;
+}
+
+/**
+ * @brief Destructor unmaps the capture file.
+ */
+app::TrafficCaptureReader::~TrafficCaptureReader() {
+  close();
+}
+
+/**
+ * @brief Maps the capture file read-only and validates the header.
+ * @param path The path of the capture file.
+ * @return true if the file is a valid capture, otherwise false.
+ */
+bool app::TrafficCaptureReader::open(const std::filesystem::path& path) {
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st {};
+  if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < TrafficCaptureWriter::HeaderSize) {
+    ::close(fd);
+    return false;
+  }
+
+  auto size = static_cast<size_t>(st.st_size);
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  madvise(mapping, size, MADV_SEQUENTIAL);
+
+  m_data = static_cast<const std::byte*>(mapping);
+  m_size = size;
+
+  if (get_le<uint32_t>(m_data) != TrafficCaptureWriter::Magic ||
+      get_le<uint16_t>(m_data + 4) != TrafficCaptureWriter::Version) {
+    close();
+    return false;
+  }
+
+  m_startTime = std::chrono::system_clock::time_point(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+          std::chrono::nanoseconds(get_le<uint64_t>(m_data + 8))));
+  rewind();
+  return true;
+}
+
+/**
+ * @brief Unmaps the capture file.
+ */
+void app::TrafficCaptureReader::close() {
+  if (m_data != nullptr) {
+    munmap(const_cast<std::byte*>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_offset = 0;
+}
+
+/**
+ * @brief Restarts the iteration at the first record.
+ */
+void app::TrafficCaptureReader::rewind() {
+  m_offset = TrafficCaptureWriter::HeaderSize;
+  m_last = std::chrono::nanoseconds(0);
+  m_truncated = false;
+}
+
+/**
+ * @brief Gets the next record. The payload refers to the mapped file and stays valid until close().
+ * @return The record or std::nullopt at the end of the file or on a truncated record.
+ */
+std::optional<app::CaptureRecord> app::TrafficCaptureReader::next() {
+  if (m_data == nullptr || m_offset >= m_size) {
+    return std::nullopt;
+  }
+
+  auto offset = m_offset;
+  auto delta = get_varint(m_data, m_size, offset);
+  auto endpoint = get_varint(m_data, m_size, offset);
+  auto session = get_varint(m_data, m_size, offset);
+  auto length = get_varint(m_data, m_size, offset);
+  if (!delta || !endpoint || !session || !length || *length > m_size - offset) {
+    // a capture cut by a crash or a full disk ends with a partial record
+    m_truncated = true;
+    m_offset = m_size;
+    return std::nullopt;
+  }
+
+  m_last += std::chrono::nanoseconds(*delta);
+
+  CaptureRecord record;
+  record.timestamp = m_last;
+  record.endpoint = static_cast<uint32_t>(*endpoint);
+  record.session = static_cast<uint32_t>(*session);
+  record.payload = std::span<const std::byte>(m_data + offset, static_cast<size_t>(*length));
+
+  m_offset = offset + static_cast<size_t>(*length);
+  return record;
+}
@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the common declarations of the benchmark suite
+ * \ingroup Benchmark
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include <fmt/format.h>
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace bench {
+
+/**
+ * @brief The options shared by all benchmarks.
+ */
+struct Options {
+  bool quick{false};      ///< reduced problem sizes for a smoke run
+  size_t threads{4};      ///< largest number of threads of multi-threaded measurements
+  uint64_t seed{1};       ///< seed of the random generators
+  std::string capture;    ///< capture file of the sv benchmark, synthetic captures only if empty
+  std::string directory;  ///< directory of the queue files, the temporary directory if empty
+};
+
+/**
+ * @brief A benchmark of the suite.
+ */
+struct Benchmark {
+  std::string_view name;                     ///< name on the command line
+  std::string_view description;              ///< one line description
+  bool (*function)(const Options& options);  ///< runs the benchmark, false if a check failed
+};
+
+/**
+ * @brief Fast xorshift generator of the workloads, its cost must not hide the measured code.
+ */
+struct Random {
+  uint64_t state;  ///< xorshift state, never zero
+
+  explicit Random(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ULL | 1) {}
+
+  uint64_t next() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+
+  /// @return uniform value in [0, 1)
+  double uniform() {
+    return static_cast<double>(next() >> 11) * 0x1.0p-53;
+  }
+
+  /// @return uniform value in [low, high)
+  double uniform(double low, double high) {
+    return low + (high - low) * uniform();
+  }
+
+  /// @return exponentially distributed value of the mean
+  double exponential(double mean) {
+    return -mean * std::log1p(-uniform());
+  }
+};
+
+/**
+ * @brief Prints the title of a measurement.
+ * @param title The title.
+ */
+inline void print_header(std::string_view title) {
+  std::cout << "\n" << title << "\n";
+}
+
+/**
+ * @brief Prints a result line in the report layout of the tools.
+ * @param label The label.
+ * @param value The formatted value.
+ */
+inline void print_row(std::string_view label, std::string_view value) {
+  std::cout << fmt::format("  {:<18}: {}\n", label, value);
+}
+
+/**
+ * @brief Measures the wall time of a function.
+ * @param function The function.
+ * @return The time in seconds.
+ */
+template <typename Function>
+double measure_seconds(Function&& function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Keeps the compiler from removing the computation of a value.
+ * @param value The value.
+ */
+template <typename T>
+inline void do_not_optimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// The benchmarks, one translation unit each.
+bool run_pool_benchmark(const Options& options);
+bool run_huge_page_benchmark(const Options& options);
+bool run_clock_benchmark(const Options& options);
+bool run_jitter_benchmark(const Options& options);
+bool run_sv_benchmark(const Options& options);
+bool run_ber_benchmark(const Options& options);
+bool run_map_benchmark(const Options& options);
+bool run_expression_benchmark(const Options& options);
+bool run_alarm_benchmark(const Options& options);
+bool run_soe_benchmark(const Options& options);
+bool run_crc_benchmark(const Options& options);
+bool run_queue_benchmark(const Options& options);
+bool run_poll_benchmark(const Options& options);
+bool run_reconnect_benchmark(const Options& options);
+bool run_send_benchmark(const Options& options);
+bool run_table_benchmark(const Options& options);
+
+}  // namespace bench
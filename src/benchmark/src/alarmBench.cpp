@@ -0,0 +1,206 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <cmath>
+#include <vector>
+
+#include "alarmEngine.hpp"
+#include "benchmark.hpp"
+#include "pointDatabase.hpp"
+// clang-format on
+
+namespace {
+
+/// The time between two ticks
+constexpr int64_t TickNanoseconds = 10'000'000;
+
+/// The share of the changes in per mille that leave the limits, a fault or a switching operation
+constexpr uint64_t ExcursionPermille = 20;
+
+/**
+ * @brief The alarm of a point as the scalar loop keeps it, limits and state in one record.
+ */
+struct ScalarAlarm {
+  app::AlarmLimits limits;  ///< limits
+  int64_t since{0};         ///< start of the pending level
+  int8_t level{0};          ///< level
+  int8_t pendingLevel{0};   ///< pending level
+  bool pending{false};      ///< a delayed level is pending
+  bool latched{false};      ///< the alarm is latched
+};
+
+/**
+ * @brief Evaluates every alarm with the branches of a hand-written state machine, the loop a
+ * context runs without change tracking.
+ * @param alarms The alarms.
+ * @param points The point database.
+ * @param now The time in nanoseconds.
+ * @param events Receives the transitions.
+ * @return The number of transitions.
+ */
+size_t evaluate_scalar(std::vector<ScalarAlarm>& alarms, const app::PointDatabase& points, int64_t now,
+                       std::vector<app::AlarmEvent>& events) {
+  events.clear();
+  auto values = points.values();
+  auto timestamps = points.timestamps();
+  for (size_t point = 0; point < alarms.size(); ++point) {
+    auto& alarm = alarms[point];
+    const auto& limits = alarm.limits;
+    double v = values[point];
+    int8_t target{0};
+    if (v >= limits.highHigh || (alarm.level == 2 && v > limits.highHigh - limits.deadband)) {
+      target = 2;
+    } else if (v >= limits.high || (alarm.level > 0 && v > limits.high - limits.deadband)) {
+      target = 1;
+    } else if (v <= limits.lowLow || (alarm.level == -2 && v < limits.lowLow + limits.deadband)) {
+      target = -2;
+    } else if (v <= limits.low || (alarm.level < 0 && v < limits.low + limits.deadband)) {
+      target = -1;
+    }
+    if (target == alarm.level) {
+      alarm.pending = false;
+      continue;
+    }
+    if (limits.delay.count() > 0) {
+      if (!alarm.pending || alarm.pendingLevel != target) {
+        alarm.pending = true;
+        alarm.pendingLevel = target;
+        alarm.since = now;
+        continue;
+      }
+      if (now - alarm.since < std::chrono::duration_cast<std::chrono::nanoseconds>(limits.delay).count()) {
+        continue;
+      }
+      alarm.pending = false;
+    }
+    alarm.latched = alarm.latched || (target != 0 && limits.latching);
+    events.push_back({static_cast<uint32_t>(point), static_cast<app::AlarmLevel>(alarm.level),
+                      static_cast<app::AlarmLevel>(target), alarm.latched, v,
+                      limits.delay.count() > 0 ? now : timestamps[point]});
+    alarm.level = target;
+  }
+  return events.size();
+}
+
+/**
+ * @brief The result of a run of ticks.
+ */
+struct RunResult {
+  double engineSeconds{0};  ///< time of the engine
+  double scalarSeconds{0};  ///< time of the scalar loop
+  size_t engineEvents{0};   ///< transitions of the engine
+  size_t scalarEvents{0};   ///< transitions of the scalar loop
+};
+
+/**
+ * @brief Runs ticks in which a share of the points changes, the engine and the scalar loop
+ * evaluate the same changes.
+ * @param points The point database.
+ * @param engine The engine.
+ * @param alarms The alarms of the scalar loop.
+ * @param changes The changed points per tick.
+ * @param ticks The number of ticks.
+ * @param now The time, advanced by the ticks.
+ * @param random The generator of the changes.
+ * @return The result.
+ */
+RunResult run_ticks(app::PointDatabase& points, app::AlarmEngine& engine, std::vector<ScalarAlarm>& alarms,
+                    size_t changes, size_t ticks, int64_t& now, bench::Random& random) {
+  RunResult result;
+  std::vector<app::AlarmEvent> events;
+  for (size_t tick = 0; tick < ticks; ++tick) {
+    now += TickNanoseconds;
+    for (size_t i = 0; i < changes; ++i) {
+      auto point = changes == points.size() ? i : random.next() % points.size();
+      // a mean-reverting walk around 100 within the limits, a share of the changes jumps beyond
+      // them, and half of the changes of a point beyond them bring it back
+      auto value = points.values()[point];
+      if (random.next() % 1000 < ExcursionPermille) {
+        value = random.next() & 1 ? 100 + random.uniform(20, 45) : 100 - random.uniform(20, 45);
+      } else if (std::abs(value - 100) > 15 && random.next() & 1) {
+        value = 100 + random.uniform(-6, 6);
+      } else {
+        value += 0.1 * (100 - value) + random.uniform(-6, 6);
+      }
+      points.update(point, value, 0, now);
+    }
+    result.engineSeconds += bench::measure_seconds([&]() { result.engineEvents += engine.evaluate(points, now); });
+    result.scalarSeconds +=
+        bench::measure_seconds([&]() { result.scalarEvents += evaluate_scalar(alarms, points, now, events); });
+    points.clear_changed();
+  }
+  return result;
+}
+
+}  // namespace
+
+/**
+ * @brief Measures the limit alarms of 500k points with the alarm engine, which evaluates the
+ * changed points in batches, against a scalar loop over all points: ticks with 1% of the points
+ * changed and ticks with all points changed.
+ * @param options The options.
+ * @return false if the engine and the scalar loop disagree on a transition, level or latch.
+ */
+bool bench::run_alarm_benchmark(const Options& options) {
+  const size_t count = options.quick ? 50'000 : 500'000;
+  const size_t ticks = options.quick ? 50 : 200;
+  Random random(options.seed);
+
+  // values around 100, limits 15 to 40 away, every fifth alarm delayed, every tenth latching
+  app::PointDatabase points;
+  if (!points.reserve(count)) {
+    print_row("reserve", "no memory");
+    return false;
+  }
+  app::AlarmEngine engine;
+  engine.reserve(count);
+  std::vector<ScalarAlarm> alarms(count);
+  for (size_t point = 0; point < count; ++point) {
+    auto& limits = alarms[point].limits;
+    limits.highHigh = 100 + random.uniform(30, 40);
+    limits.high = 100 + random.uniform(15, 25);
+    limits.low = 100 - random.uniform(15, 25);
+    limits.lowLow = 100 - random.uniform(30, 40);
+    limits.deadband = random.uniform(0, 3);
+    limits.delay = random.next() % 5 == 0 ? std::chrono::milliseconds(20 + random.next() % 80)
+                                          : std::chrono::milliseconds(0);
+    limits.latching = random.next() % 10 == 0;
+    points.update(point, 100, 0, 0);
+    if (!engine.configure(point, limits)) {
+      print_row("configure", fmt::format("point {} rejected", point));
+      return false;
+    }
+  }
+  points.clear_changed();
+  size_t delivered{0};
+  engine.subscribe([&delivered](std::span<const app::AlarmEvent> events) { delivered += events.size(); });
+
+  bool passed = true;
+  int64_t now{0};
+  for (auto share : {1, 100}) {
+    const size_t changes = count * static_cast<size_t>(share) / 100;
+    const size_t runTicks = share == 100 ? ticks / 10 : ticks;
+    auto result = run_ticks(points, engine, alarms, changes, runTicks, now, random);
+    passed = passed && result.engineEvents == result.scalarEvents;
+    print_header(fmt::format("{} points, {} changed per tick, {} ticks", count, changes, runTicks));
+    print_row("scalar loop", fmt::format("{:8.1f} us/tick  {:8.1f} transitions/tick",
+                                         result.scalarSeconds * 1e6 / static_cast<double>(runTicks),
+                                         static_cast<double>(result.scalarEvents) / static_cast<double>(runTicks)));
+    print_row("alarm engine", fmt::format("{:8.1f} us/tick  {:8.1f} transitions/tick",
+                                          result.engineSeconds * 1e6 / static_cast<double>(runTicks),
+                                          static_cast<double>(result.engineEvents) / static_cast<double>(runTicks)));
+  }
+
+  for (size_t point = 0; point < count && passed; ++point) {
+    passed = static_cast<int8_t>(engine.level(point)) == alarms[point].level &&
+             engine.is_latched(point) == alarms[point].latched;
+  }
+  return passed && delivered > 0;
+}
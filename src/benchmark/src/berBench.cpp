@@ -0,0 +1,375 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "berCodec.hpp"
+// clang-format on
+
+namespace {
+
+// The MMS tags of an InformationReport, ISO 9506-2 and IEC 61850-8-1.
+constexpr uint32_t TagUnconfirmedPdu = 0xA3;     ///< unconfirmed-PDU [3]
+constexpr uint32_t TagInformationReport = 0xA0;  ///< informationReport [0]
+constexpr uint32_t TagVariableListName = 0xA1;   ///< variableListName [1]
+constexpr uint32_t TagVmdSpecific = 0x80;        ///< vmd-specific [0] name
+constexpr uint32_t TagAccessResults = 0xA0;      ///< listOfAccessResult [0]
+constexpr uint32_t TagStructure = 0xA2;          ///< Data structure [2]
+constexpr uint32_t TagBoolean = 0x83;            ///< Data boolean [3]
+constexpr uint32_t TagBitString = 0x84;          ///< Data bit-string [4]
+constexpr uint32_t TagUnsigned = 0x86;           ///< Data unsigned [6]
+constexpr uint32_t TagFloatingPoint = 0x87;      ///< Data floating-point [7]
+constexpr uint32_t TagOctetString = 0x89;        ///< Data octet-string [9]
+constexpr uint32_t TagVisibleString = 0x8A;      ///< Data visible-string [10]
+constexpr uint32_t TagBinaryTime = 0x8C;         ///< Data binary-time [12]
+constexpr uint32_t TagUtcTime = 0x91;            ///< Data utc-time [17]
+
+// The options of a report, bit n is bit n of OptFlds.
+constexpr uint64_t OptionSequenceNumber = 1 << 1;  ///< sequence-number
+constexpr uint64_t OptionTimeOfEntry = 1 << 2;     ///< report-time-stamp
+constexpr uint64_t OptionReason = 1 << 3;          ///< reason-for-inclusion
+constexpr uint64_t OptionDataSet = 1 << 4;         ///< data-set-name
+constexpr uint64_t OptionBufferOverflow = 1 << 6;  ///< buffer-overflow
+constexpr uint64_t OptionEntryId = 1 << 7;         ///< entryID
+constexpr uint64_t OptionConfRevision = 1 << 8;    ///< conf-revision
+constexpr size_t OptionBits = 10;                  ///< bits of OptFlds
+
+/// The options of the reports of the benchmark, those of a typical buffered report control block
+constexpr uint64_t ReportOptions = OptionSequenceNumber | OptionTimeOfEntry | OptionReason | OptionDataSet |
+                                   OptionBufferOverflow | OptionEntryId | OptionConfRevision;
+
+/// The size of the report buffer, the largest MMS PDU size servers negotiate
+constexpr size_t BufferSize = 64 * 1024;
+
+/**
+ * @brief The contents of a report: measured values with quality and time, in arrays.
+ */
+struct Report {
+  uint64_t sequenceNumber{0};     ///< SqNum
+  int64_t timeOfEntry{0};         ///< time of the entry in nanoseconds since epoch
+  std::vector<float> values;      ///< mag.f of each value
+  std::vector<uint64_t> quality;  ///< q of each value
+  std::vector<int64_t> time;      ///< t of each value in nanoseconds since epoch
+  std::vector<uint64_t> reason;   ///< reason for inclusion of each value
+};
+
+/**
+ * @brief Fills a report with the values of an iteration.
+ * @param report The report, values sized.
+ * @param iteration The iteration.
+ */
+void fill_report(Report& report, uint64_t iteration) {
+  report.sequenceNumber = iteration;
+  report.timeOfEntry = 1'700'000'000'000'000'000 + static_cast<int64_t>(iteration) * 1'000'000;
+  for (size_t i = 0; i < report.values.size(); ++i) {
+    report.values[i] = static_cast<float>(230.0 + std::sin(static_cast<double>(iteration + i)) * 10.0);
+    report.quality[i] = (iteration + i) % 97 == 0 ? 0x0003 : 0x0000;
+    report.time[i] = report.timeOfEntry - static_cast<int64_t>(i) * 1000;
+    report.reason[i] = 0x02;
+  }
+}
+
+/**
+ * @brief Encodes a report as MMS InformationReport of a buffered report control block. The writer
+ * encodes backwards, so the fields are written in reverse order.
+ * @param writer The writer.
+ * @param report The report.
+ */
+void encode_report(app::BerWriter& writer, const Report& report) {
+  writer.reset();
+  auto pdu = writer.size();
+  auto informationReport = writer.size();
+  auto results = writer.size();
+  const auto count = report.values.size();
+  for (size_t i = count; i-- > 0;) {
+    writer.put_bit_string(TagBitString, report.reason[i], 6);
+  }
+  for (size_t i = count; i-- > 0;) {
+    auto value = writer.size();
+    writer.put_utc_time(TagUtcTime, report.time[i], 0x0A);
+    writer.put_bit_string(TagBitString, report.quality[i], 13);
+    auto magnitude = writer.size();
+    writer.put_float(TagFloatingPoint, report.values[i]);
+    writer.close(TagStructure, magnitude);
+    writer.close(TagStructure, value);
+  }
+  writer.put_bit_string(TagBitString, count >= 64 ? UINT64_MAX : (uint64_t{1} << count) - 1, count);
+  writer.put_unsigned(TagUnsigned, 1);
+  static constexpr std::byte EntryId[8]{std::byte{0}, std::byte{0}, std::byte{0}, std::byte{0},
+                                        std::byte{0}, std::byte{0}, std::byte{0x10}, std::byte{0x01}};
+  writer.put_octets(TagOctetString, EntryId);
+  writer.put_boolean(TagBoolean, false);
+  writer.put_string(TagVisibleString, "MEAS/LLN0$Measurements");
+  // BinaryTime of 6 octets: milliseconds of the day and days since 1984, the value doesn't matter here
+  static constexpr std::byte EntryTime[6]{std::byte{0x01}, std::byte{0x23}, std::byte{0x45},
+                                          std::byte{0x67}, std::byte{0x2F}, std::byte{0x1A}};
+  writer.put_octets(TagBinaryTime, EntryTime);
+  writer.put_unsigned(TagUnsigned, report.sequenceNumber);
+  writer.put_bit_string(TagBitString, ReportOptions, OptionBits);
+  writer.put_string(TagVisibleString, "MEAS/LLN0$BR$brcbMX01");
+  writer.close(TagAccessResults, results);
+  auto name = writer.size();
+  writer.put_string(TagVmdSpecific, "RPT");
+  writer.close(TagVariableListName, name);
+  writer.close(TagInformationReport, informationReport);
+  writer.close(TagUnconfirmedPdu, pdu);
+}
+
+/**
+ * @brief Decodes an MMS InformationReport in place into the arrays of a report.
+ * @param data The encoded PDU.
+ * @param report The report, receives the values.
+ * @return false if the report is malformed.
+ */
+bool decode_report(std::span<const std::byte> data, Report& report) {
+  app::BerElement element;
+  app::BerReader pdu(data);
+  if (!pdu.expect(TagUnconfirmedPdu, element)) {
+    return false;
+  }
+  app::BerReader unconfirmed(element);
+  if (!unconfirmed.expect(TagInformationReport, element)) {
+    return false;
+  }
+  app::BerReader informationReport(element);
+  if (!informationReport.expect(TagVariableListName, element) ||
+      !informationReport.expect(TagAccessResults, element)) {
+    return false;
+  }
+
+  app::BerReader results(element);
+  uint64_t options{0};
+  uint64_t inclusion{0};
+  size_t bits{0};
+  if (!results.expect(TagVisibleString, element) || !results.expect(TagBitString, element) ||
+      !element.to_bit_string(options, bits)) {
+    return false;
+  }
+  if ((options & OptionSequenceNumber) != 0 &&
+      (!results.expect(TagUnsigned, element) || !element.to_unsigned(report.sequenceNumber))) {
+    return false;
+  }
+  if ((options & OptionTimeOfEntry) != 0 && !results.expect(TagBinaryTime, element)) {
+    return false;
+  }
+  if ((options & OptionDataSet) != 0 && !results.expect(TagVisibleString, element)) {
+    return false;
+  }
+  if ((options & OptionBufferOverflow) != 0 && !results.expect(TagBoolean, element)) {
+    return false;
+  }
+  if ((options & OptionEntryId) != 0 && !results.expect(TagOctetString, element)) {
+    return false;
+  }
+  if ((options & OptionConfRevision) != 0 && !results.expect(TagUnsigned, element)) {
+    return false;
+  }
+  if (!results.expect(TagBitString, element) || !element.to_bit_string(inclusion, bits) ||
+      bits != report.values.size()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < bits; ++i) {
+    app::BerElement field;
+    uint8_t timeQuality{0};
+    double magnitude{0};
+    size_t qualityBits{0};
+    if (!results.expect(TagStructure, element)) {
+      return false;
+    }
+    app::BerReader value(element);
+    if (!value.expect(TagStructure, field)) {
+      return false;
+    }
+    app::BerReader mag(field);
+    if (!mag.expect(TagFloatingPoint, field) || !field.to_float(magnitude) ||
+        !value.expect(TagBitString, field) || !field.to_bit_string(report.quality[i], qualityBits) ||
+        !value.expect(TagUtcTime, field) || !field.to_utc_time(report.time[i], timeQuality)) {
+      return false;
+    }
+    report.values[i] = static_cast<float>(magnitude);
+  }
+  if ((options & OptionReason) != 0) {
+    for (size_t i = 0; i < bits; ++i) {
+      size_t reasonBits{0};
+      if (!results.expect(TagBitString, element) || !element.to_bit_string(report.reason[i], reasonBits)) {
+        return false;
+      }
+    }
+  }
+  return results.empty() && results.error() == app::BerError::none;
+}
+
+/**
+ * @brief A node of a decoded tree, the way generic ASN.1 libraries represent a message.
+ */
+struct TreeNode {
+  uint32_t tag{0};                 ///< identifier octets
+  std::vector<std::byte> value;    ///< copy of primitive contents
+  std::vector<TreeNode> children;  ///< decoded constructed contents
+};
+
+/**
+ * @brief Decodes elements into a tree of nodes with copied contents.
+ * @param data The encoded elements.
+ * @param nodes Receives the nodes.
+ * @return false if the encoding is malformed.
+ */
+bool decode_tree(std::span<const std::byte> data, std::vector<TreeNode>& nodes) {
+  app::BerReader reader(data);
+  app::BerElement element;
+  while (reader.next(element)) {
+    auto& node = nodes.emplace_back();
+    node.tag = element.tag;
+    if (element.is_constructed()) {
+      if (!decode_tree(element.value, node.children)) {
+        return false;
+      }
+    } else {
+      node.value.assign(element.value.begin(), element.value.end());
+    }
+  }
+  return reader.error() == app::BerError::none;
+}
+
+/**
+ * @brief Decodes a report through a tree: the message is decoded first, the values are taken from
+ * the nodes afterwards.
+ * @param data The encoded PDU.
+ * @param report The report, receives the values.
+ * @return false if the report is malformed.
+ */
+bool decode_report_tree(std::span<const std::byte> data, Report& report) {
+  std::vector<TreeNode> root;
+  if (!decode_tree(data, root) || root.size() != 1 || root[0].children.size() != 1 ||
+      root[0].children[0].children.size() != 2) {
+    return false;
+  }
+  // the fields of the report options of the benchmark precede the values and the reasons
+  const auto& results = root[0].children[0].children[1].children;
+  if (results.size() < 3 + 2 * report.values.size() ||
+      !app::BerElement{results[2].tag, results[2].value}.to_unsigned(report.sequenceNumber)) {
+    return false;
+  }
+  size_t first = results.size() - 2 * report.values.size();
+  for (size_t i = 0; i < report.values.size(); ++i) {
+    const auto& value = results[first + i].children;
+    if (value.size() != 3 || value[0].children.size() != 1) {
+      return false;
+    }
+    double magnitude{0};
+    size_t bits{0};
+    uint8_t timeQuality{0};
+    if (!app::BerElement{value[0].children[0].tag, value[0].children[0].value}.to_float(magnitude) ||
+        !app::BerElement{value[1].tag, value[1].value}.to_bit_string(report.quality[i], bits) ||
+        !app::BerElement{value[2].tag, value[2].value}.to_utc_time(report.time[i], timeQuality)) {
+      return false;
+    }
+    report.values[i] = static_cast<float>(magnitude);
+  }
+  return true;
+}
+
+/**
+ * @brief Checks that a decoded report matches the encoded one; times within the 60 ns of the
+ * UtcTime fraction.
+ * @param decoded The decoded report.
+ * @param encoded The encoded report.
+ * @return true if the reports match.
+ */
+bool same_report(const Report& decoded, const Report& encoded) {
+  for (size_t i = 0; i < encoded.values.size(); ++i) {
+    if (decoded.values[i] != encoded.values[i] || decoded.quality[i] != encoded.quality[i] ||
+        std::abs(decoded.time[i] - encoded.time[i]) > 60) {
+      return false;
+    }
+  }
+  return decoded.sequenceNumber == encoded.sequenceNumber;
+}
+
+}  // namespace
+
+/**
+ * @brief Measures the BER codec on MMS InformationReports of a buffered report control block:
+ * encoding backwards into a preallocated buffer, decoding in place and, as the baseline, decoding
+ * into a tree of nodes.
+ * @param options The options.
+ * @return false if a decoded report differs from the encoded one.
+ */
+bool bench::run_ber_benchmark(const Options& options) {
+  bool passed = true;
+  std::vector<std::byte> buffer(BufferSize);
+  app::BerWriter writer(buffer);
+
+  for (size_t count : {16, 64}) {
+    const size_t reports = (options.quick ? 200'000 : 2'000'000) / count;
+    Report encoded;
+    Report decoded;
+    for (auto* report : {&encoded, &decoded}) {
+      report->values.resize(count);
+      report->quality.resize(count);
+      report->time.resize(count);
+      report->reason.resize(count);
+    }
+    fill_report(encoded, 1);
+    encode_report(writer, encoded);
+    auto size = writer.data().size();
+    print_header(fmt::format("MMS InformationReport with {} values, {} bytes", count, size));
+
+    size_t bytes{0};
+    auto encodeSeconds = measure_seconds([&]() {
+      for (size_t i = 0; i < reports; ++i) {
+        encoded.sequenceNumber = i;
+        encode_report(writer, encoded);
+        bytes += writer.data().size();
+        do_not_optimize(writer.data()[0]);
+      }
+    });
+    passed = passed && !writer.is_overflow();
+
+    // distinct reports for the checks, one encoding for the rates
+    for (uint64_t iteration = 0; iteration < 8; ++iteration) {
+      fill_report(encoded, iteration);
+      encode_report(writer, encoded);
+      Report tree = decoded;
+      passed = passed && decode_report(writer.data(), decoded) && same_report(decoded, encoded) &&
+               decode_report_tree(writer.data(), tree) && same_report(tree, encoded);
+    }
+
+    size_t failed{0};
+    auto decodeSeconds = measure_seconds([&]() {
+      for (size_t i = 0; i < reports; ++i) {
+        failed += decode_report(writer.data(), decoded) ? 0 : 1;
+        do_not_optimize(decoded.values[0]);
+      }
+    });
+    auto treeSeconds = measure_seconds([&]() {
+      for (size_t i = 0; i < reports; ++i) {
+        failed += decode_report_tree(writer.data(), decoded) ? 0 : 1;
+        do_not_optimize(decoded.values[0]);
+      }
+    });
+    passed = passed && failed == 0;
+
+    auto rate = [&](double seconds) {
+      return fmt::format("{:9.0f} reports/s  {:7.1f} ns/value  {:6.0f} MB/s", static_cast<double>(reports) / seconds,
+                         seconds * 1e9 / static_cast<double>(reports * count),
+                         static_cast<double>(reports * size) / seconds / 1e6);
+    };
+    print_row("encode backwards", rate(encodeSeconds));
+    print_row("decode in place", rate(decodeSeconds));
+    print_row("decode tree", rate(treeSeconds));
+    do_not_optimize(bytes);
+  }
+  return passed;
+}
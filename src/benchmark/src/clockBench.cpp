@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+
+#include "benchmark.hpp"
+#include "timestampService.hpp"
+// clang-format on
+
+namespace {
+
+/**
+ * @brief Measures the cost of one timestamp.
+ * @param count The number of timestamps.
+ * @param read Reads one timestamp.
+ * @return The cost in nanoseconds per timestamp.
+ */
+template <typename Read>
+double cost_per_timestamp(uint64_t count, Read&& read) {
+  auto seconds = bench::measure_seconds([&]() {
+    for (uint64_t i = 0; i < count; ++i) {
+      bench::do_not_optimize(read());
+    }
+  });
+  return seconds * 1e9 / static_cast<double>(count);
+}
+
+/**
+ * @brief Reads the coarse monotonic clock, the clock of the kernel tick.
+ * @return The time since the monotonic epoch.
+ */
+std::chrono::nanoseconds coarse_now() {
+  timespec time{};
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &time);
+  return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+}
+
+}  // namespace
+
+/**
+ * @brief Compares the cost of a timestamp of the timestamp service in each mode with the standard
+ * clocks, and checks the calibrated counter against CLOCK_MONOTONIC.
+ * @param options The options.
+ * @return false if the counter deviates from the monotonic clock or goes back.
+ */
+bool bench::run_clock_benchmark(const Options& options) {
+  const uint64_t count = options.quick ? 2'000'000 : 20'000'000;
+  bool passed{true};
+
+  app::TimestampService tsc(app::TimestampSource::tsc);
+  app::TimestampService vdso(app::TimestampSource::vdso);
+
+  print_header(fmt::format("source: {}, counter {:.3f} MHz, invariant {}", app::to_string(tsc.source()),
+                           tsc.counter_hz() / 1e6, app::TimestampService::counter_invariant()));
+
+  print_header(fmt::format("cost of {} timestamps, ns/timestamp", count));
+  auto row = [](std::string_view label, double ns) { print_row(label, fmt::format("{:7.2f}", ns)); };
+  row("system_clock", cost_per_timestamp(count, []() { return std::chrono::system_clock::now(); }));
+  row("steady_clock", cost_per_timestamp(count, []() { return std::chrono::steady_clock::now(); }));
+  row("coarse clock", cost_per_timestamp(count, coarse_now));
+  row("service vdso", cost_per_timestamp(count, [&]() { return vdso.now(); }));
+  row("service tsc", cost_per_timestamp(count, [&]() { return tsc.now(); }));
+  row("service cached", cost_per_timestamp(count, [&]() { return tsc.cached(); }));
+  row("to_system", cost_per_timestamp(count, [&]() { return tsc.to_system(tsc.now()); }));
+
+  // an event loop refreshing the cached clock once per pass while its handlers read it
+  constexpr uint64_t PerPass = 64;
+  auto pass = cost_per_timestamp(count / PerPass, [&]() {
+    tsc.update();
+    std::chrono::nanoseconds last{0};
+    for (uint64_t i = 0; i < PerPass; ++i) {
+      last = std::max(last, tsc.cached());
+    }
+    return last;
+  });
+  row("update + 64 cached", pass / static_cast<double>(PerPass));
+
+  // the counter against the monotonic clock, the first interval runs on the initial calibration
+  print_header("counter deviation from CLOCK_MONOTONIC, us");
+  const int intervals = options.quick ? 3 : 10;
+  std::chrono::nanoseconds previous{0};
+  for (int interval = 1; interval <= intervals; ++interval) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.quick ? 350 : 1100));
+    tsc.update();
+    std::chrono::nanoseconds worst{0};
+    for (int i = 0; i < 1000; ++i) {
+      auto counter = tsc.now();
+      auto monotonic = app::TimestampService::monotonic_now();
+      passed = passed && counter >= previous;
+      previous = counter;
+      auto deviation = counter - monotonic;
+      worst = std::abs(deviation.count()) > std::abs(worst.count()) ? deviation : worst;
+    }
+    auto label = fmt::format("after {} updates", interval);
+    print_row(label, fmt::format("{:+8.3f}", static_cast<double>(worst.count()) / 1e3));
+    // a deviation of 100 us would make the counter useless for sequence-of-events timestamps
+    passed = passed && std::abs(worst.count()) < 100'000;
+  }
+  return passed;
+}
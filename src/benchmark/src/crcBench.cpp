@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <vector>
+
+#include "benchmark.hpp"
+#include "checksum.hpp"
+// clang-format on
+
+namespace {
+
+/// The buffer sizes: a serial frame, a journal record, a snapshot part
+constexpr size_t BufferSizes[] = {64, 4096, 1 << 20};
+
+/// The algorithms
+constexpr app::ChecksumAlgorithm Algorithms[] = {app::ChecksumAlgorithm::crc16Modbus,
+                                                 app::ChecksumAlgorithm::iec101Sum, app::ChecksumAlgorithm::crc32,
+                                                 app::ChecksumAlgorithm::crc32c};
+
+/// The paths, slowest first
+constexpr app::ChecksumPath Paths[] = {app::ChecksumPath::bytewise, app::ChecksumPath::slicing8,
+                                       app::ChecksumPath::hardware};
+
+}  // namespace
+
+/**
+ * @brief Measures the throughput of every checksum algorithm on every path the CPU supports, for
+ * buffers of a serial frame, a journal record and a snapshot part. Every path must compute the
+ * checksum of the bytewise reference, also when the data arrives in odd parts.
+ * @param options The options.
+ * @return false if a path computes a different checksum.
+ */
+bool bench::run_crc_benchmark(const Options& options) {
+  const size_t volume = options.quick ? (size_t{32} << 20) : (size_t{256} << 20);
+  Random random(options.seed);
+  std::vector<uint8_t> data(BufferSizes[std::size(BufferSizes) - 1] + 1);
+  for (auto& byte : data) {
+    byte = static_cast<uint8_t>(random.next());
+  }
+  bool passed = true;
+
+  for (auto algorithm : Algorithms) {
+    print_header(fmt::format("{}, best path {}", app::to_string(algorithm),
+                             app::to_string(app::Checksum::best_path(algorithm))));
+    for (auto path : Paths) {
+      if (!app::Checksum::is_supported(algorithm, path)) {
+        print_row(app::to_string(path), "not available");
+        continue;
+      }
+      std::string rates;
+      for (auto size : BufferSizes) {
+        // an odd start, the buffers of a receiver aren't aligned
+        std::span<const uint8_t> buffer(data.data() + 1, size);
+        app::Checksum reference(algorithm, app::ChecksumPath::bytewise);
+        reference.update(buffer);
+        app::Checksum parts(algorithm, path);
+        for (size_t offset = 0; offset < size; offset += 13) {
+          parts.update(buffer.subspan(offset, std::min<size_t>(13, size - offset)));
+        }
+        passed = passed && parts.value() == reference.value();
+
+        const size_t rounds = volume / size;
+        app::Checksum checksum(algorithm, path);
+        auto seconds = measure_seconds([&]() {
+          for (size_t round = 0; round < rounds; ++round) {
+            checksum.reset();
+            checksum.update(buffer);
+            do_not_optimize(checksum.value());
+          }
+        });
+        passed = passed && checksum.value() == reference.value();
+        rates += fmt::format("  {:>7}: {:6.2f} GB/s", size < 1024 ? fmt::format("{} B", size)
+                                                                  : fmt::format("{} KiB", size / 1024),
+                             static_cast<double>(rounds * size) / seconds / 1e9);
+      }
+      print_row(app::to_string(path), rates);
+    }
+  }
+  return passed;
+}
@@ -0,0 +1,295 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <algorithm>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "expressionEngine.hpp"
+#include "pointDatabase.hpp"
+// clang-format on
+
+namespace {
+
+/// The received points of a bay: three voltages, three currents, P, Q and the two breaker positions
+constexpr uint32_t BayPoints = 10;
+
+/// The computed points of a bay
+constexpr uint32_t BayFormulas = 6;
+
+/**
+ * @brief A node of the syntax tree a classic interpreter walks for every formula.
+ */
+struct Node {
+  enum class Kind { point, constant, add, subtract, multiply, divide, greater, less, logicalAnd, logicalOr, logicalNot,
+                    minimum, maximum, sum, average, limit, select };
+
+  Kind kind;                   ///< operation
+  uint32_t point{0};           ///< point of a point node
+  double value{0};             ///< value of a constant node
+  std::vector<Node> children;  ///< operands
+};
+
+Node point(uint32_t index) {
+  return {Node::Kind::point, index, 0, {}};
+}
+
+Node constant(double value) {
+  return {Node::Kind::constant, 0, value, {}};
+}
+
+Node node(Node::Kind kind, std::vector<Node> children) {
+  return {kind, 0, 0, std::move(children)};
+}
+
+/**
+ * @brief Prints a tree as formula of the engine.
+ * @param tree The tree.
+ * @return The formula.
+ */
+std::string to_formula(const Node& tree) {
+  auto list = [&tree](std::string_view name) {
+    std::string text = std::string(name) + "(";
+    for (size_t i = 0; i < tree.children.size(); ++i) {
+      text += (i > 0 ? ", " : "") + to_formula(tree.children[i]);
+    }
+    return text + ")";
+  };
+  auto infix = [&tree](std::string_view op) {
+    return fmt::format("({} {} {})", to_formula(tree.children[0]), op, to_formula(tree.children[1]));
+  };
+  switch (tree.kind) {
+    case Node::Kind::point:
+      return fmt::format("p{}", tree.point);
+    case Node::Kind::constant:
+      return fmt::format("{}", tree.value);
+    case Node::Kind::add:
+      return infix("+");
+    case Node::Kind::subtract:
+      return infix("-");
+    case Node::Kind::multiply:
+      return infix("*");
+    case Node::Kind::divide:
+      return infix("/");
+    case Node::Kind::greater:
+      return infix(">");
+    case Node::Kind::less:
+      return infix("<");
+    case Node::Kind::logicalAnd:
+      return infix("&&");
+    case Node::Kind::logicalOr:
+      return infix("||");
+    case Node::Kind::logicalNot:
+      return "!" + to_formula(tree.children[0]);
+    case Node::Kind::minimum:
+      return list("min");
+    case Node::Kind::maximum:
+      return list("max");
+    case Node::Kind::sum:
+      return list("sum");
+    case Node::Kind::average:
+      return list("avg");
+    case Node::Kind::limit:
+      return list("limit");
+    case Node::Kind::select:
+      return list("if");
+  }
+  return {};
+}
+
+/**
+ * @brief Evaluates a tree, one node after the other.
+ * @param tree The tree.
+ * @param values The values of the points.
+ * @return The value.
+ */
+double interpret(const Node& tree, const double* values) {
+  auto operand = [&](size_t i) { return interpret(tree.children[i], values); };
+  switch (tree.kind) {
+    case Node::Kind::point:
+      return values[tree.point];
+    case Node::Kind::constant:
+      return tree.value;
+    case Node::Kind::add:
+      return operand(0) + operand(1);
+    case Node::Kind::subtract:
+      return operand(0) - operand(1);
+    case Node::Kind::multiply:
+      return operand(0) * operand(1);
+    case Node::Kind::divide:
+      return operand(0) / operand(1);
+    case Node::Kind::greater:
+      return operand(0) > operand(1) ? 1.0 : 0.0;
+    case Node::Kind::less:
+      return operand(0) < operand(1) ? 1.0 : 0.0;
+    case Node::Kind::logicalAnd:
+      return operand(0) != 0.0 && operand(1) != 0.0 ? 1.0 : 0.0;
+    case Node::Kind::logicalOr:
+      return operand(0) != 0.0 || operand(1) != 0.0 ? 1.0 : 0.0;
+    case Node::Kind::logicalNot:
+      return operand(0) == 0.0 ? 1.0 : 0.0;
+    case Node::Kind::limit:
+      return std::min(std::max(operand(0), operand(1)), operand(2));
+    case Node::Kind::select:
+      return operand(0) != 0.0 ? operand(1) : operand(2);
+    case Node::Kind::minimum:
+    case Node::Kind::maximum:
+    case Node::Kind::sum:
+    case Node::Kind::average: {
+      double result = operand(0);
+      for (size_t i = 1; i < tree.children.size(); ++i) {
+        auto value = operand(i);
+        result = tree.kind == Node::Kind::minimum   ? std::min(result, value)
+                 : tree.kind == Node::Kind::maximum ? std::max(result, value)
+                                                    : result + value;
+      }
+      return tree.kind == Node::Kind::average ? result / static_cast<double>(tree.children.size()) : result;
+    }
+  }
+  return 0.0;
+}
+
+/**
+ * @brief Builds the computed points of the bays: current sum, voltage average, voltage limit check,
+ * scaled and limited power, an interlock and, one level higher, a formula over three of them.
+ * @param bays The number of bays.
+ * @param random The generator of the limits.
+ * @return The trees in the order of their levels, the destination of tree i is bays * BayPoints + i.
+ */
+std::vector<Node> make_formulas(uint32_t bays, bench::Random& random) {
+  using Kind = Node::Kind;
+  std::vector<Node> formulas(size_t{bays} * BayFormulas);
+  const uint32_t computed = bays * BayPoints;
+  for (uint32_t bay = 0; bay < bays; ++bay) {
+    auto p = [bay](uint32_t offset) { return point(bay * BayPoints + offset); };
+    auto result = [&](uint32_t formula) { return point(computed + bay * (BayFormulas - 1) + formula); };
+    auto* formula = &formulas[size_t{bay} * (BayFormulas - 1)];
+    formula[0] = node(Kind::sum, {p(3), p(4), p(5)});
+    formula[1] = node(Kind::average, {p(0), p(1), p(2)});
+    formula[2] = node(Kind::logicalOr, {node(Kind::greater, {p(0), constant(random.uniform(240, 245))}),
+                                        node(Kind::less, {p(0), constant(random.uniform(195, 200))})});
+    formula[3] = node(Kind::limit, {node(Kind::add, {node(Kind::multiply, {p(6), constant(0.001)}),
+                                                     node(Kind::multiply, {p(7), constant(0.0005)})}),
+                                    constant(-50), constant(50)});
+    formula[4] = node(Kind::select, {node(Kind::logicalAnd, {p(8), node(Kind::logicalNot, {p(9)})}), constant(0),
+                                     node(Kind::divide, {p(6), node(Kind::maximum, {p(0), constant(1)})})});
+    // the level 1 formulas follow all level 0 formulas
+    formulas[size_t{bays} * (BayFormulas - 1) + bay] =
+        node(Kind::subtract, {node(Kind::multiply, {result(0), result(1)}), result(4)});
+  }
+  return formulas;
+}
+
+/**
+ * @brief Sets a received point to a random value of its kind.
+ * @param points The point database.
+ * @param index The point.
+ * @param random The generator.
+ */
+void set_received(app::PointDatabase& points, uint32_t index, bench::Random& random) {
+  auto offset = index % BayPoints;
+  double value = offset < 3 ? random.uniform(190, 250) : offset < 6 ? random.uniform(0, 1000)
+                 : offset < 8 ? random.uniform(-100000, 100000)
+                              : static_cast<double>(random.next() & 1);
+  points.update(index, value, 0, 0);
+}
+
+}  // namespace
+
+/**
+ * @brief Measures the computed points of 20k bays, six formulas each, with the expression engine
+ * against a tree-walking interpreter: a full evaluation and ticks in which 1% of the received
+ * points changed.
+ * @param options The options.
+ * @return false if the formulas don't compile or the engine computes other values than the
+ * interpreter.
+ */
+bool bench::run_expression_benchmark(const Options& options) {
+  const uint32_t bays = options.quick ? 2'000 : 20'000;
+  const size_t rounds = options.quick ? 10 : 50;
+  Random random(options.seed);
+
+  auto formulas = make_formulas(bays, random);
+  const uint32_t computed = bays * BayPoints;
+  std::vector<app::ExpressionDefinition> definitions;
+  for (size_t i = 0; i < formulas.size(); ++i) {
+    definitions.push_back({static_cast<uint32_t>(computed + i), to_formula(formulas[i])});
+  }
+  app::PointDatabase points;
+  if (!points.reserve(computed + formulas.size())) {
+    print_row("reserve", "no memory");
+    return false;
+  }
+  for (uint32_t i = 0; i < computed; ++i) {
+    set_received(points, i, random);
+  }
+  points.clear_changed();
+
+  app::ExpressionEngine engine;
+  bool compiled{false};
+  auto compileSeconds = measure_seconds([&]() { compiled = engine.compile(definitions); });
+  print_header(fmt::format("{} computed points of {} bays, {} received points", formulas.size(), bays, computed));
+  if (!compiled) {
+    print_row("compile", engine.last_error());
+    return false;
+  }
+  print_row("compile", fmt::format("{:6.1f} ms, {} groups", compileSeconds * 1e3, engine.groups()));
+
+  // the interpreter walks the trees in the order of their levels, like the engine its groups
+  std::vector<double> expected(points.values().begin(), points.values().end());
+  auto interpret_all = [&]() {
+    for (size_t i = 0; i < formulas.size(); ++i) {
+      expected[computed + i] = interpret(formulas[i], expected.data());
+    }
+  };
+  auto check = [&]() {
+    std::copy(points.values().begin(), points.values().begin() + computed, expected.begin());
+    interpret_all();
+    return std::equal(expected.begin(), expected.end(), points.values().begin());
+  };
+
+  auto engineSeconds = measure_seconds([&]() {
+    for (size_t round = 0; round < rounds; ++round) {
+      engine.invalidate();
+      engine.evaluate(points);
+    }
+  });
+  auto treeSeconds = measure_seconds([&]() {
+    for (size_t round = 0; round < rounds; ++round) {
+      interpret_all();
+    }
+  });
+  bool passed = check();
+  auto evaluations = static_cast<double>(rounds * formulas.size());
+  print_row("interpreter", fmt::format("{:6.1f} ns/formula", treeSeconds * 1e9 / evaluations));
+  print_row("engine", fmt::format("{:6.1f} ns/formula", engineSeconds * 1e9 / evaluations));
+
+  // a tick changes 1% of the received points, the engine evaluates only the formulas reading them
+  const size_t ticks = rounds * 10;
+  const auto changes = computed / 100;
+  points.clear_changed();
+  auto before = engine.evaluated();
+  auto tickSeconds = measure_seconds([&]() {
+    for (size_t tick = 0; tick < ticks; ++tick) {
+      for (uint32_t i = 0; i < changes; ++i) {
+        set_received(points, static_cast<uint32_t>(random.next() % computed), random);
+      }
+      engine.evaluate(points);
+      points.clear_changed();
+    }
+  });
+  passed = passed && check();
+  print_header(fmt::format("ticks with {} of {} received points changed", changes, computed));
+  print_row("interpreter", fmt::format("{:8.1f} us/tick, all {} formulas", treeSeconds * 1e6 / rounds,
+                                       formulas.size()));
+  print_row("engine", fmt::format("{:8.1f} us/tick, {:.0f} formulas evaluated", tickSeconds * 1e6 / ticks,
+                                  static_cast<double>(engine.evaluated() - before) / ticks));
+  return passed;
+}
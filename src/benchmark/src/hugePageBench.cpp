@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <array>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "hugePageMemory.hpp"
+#include "pointDatabase.hpp"
+// clang-format on
+
+namespace {
+
+/**
+ * @brief The policies compared, each with the label of its row.
+ */
+constexpr std::array<std::pair<app::HugePagePolicy, std::string_view>, 3> Policies = {{
+    {app::HugePagePolicy::normal, "normal"},
+    {app::HugePagePolicy::transparent, "transparent"},
+    {app::HugePagePolicy::automatic, "automatic"},
+}};
+
+/**
+ * @brief Formats the backing of a region and how much of it the kernel backs with huge pages.
+ * @param region The region.
+ * @return The text.
+ */
+std::string describe(const app::HugePageRegion& region) {
+  return fmt::format("{}, {} of {} MiB huge", app::to_string(region.backing()), region.huge_page_bytes() >> 20,
+                     region.size() >> 20);
+}
+
+}  // namespace
+
+/**
+ * @brief Compares random-access point updates and buffer accesses on normal, transparent huge and
+ * explicit huge pages. The backing each policy obtained is reported with the result.
+ * @param options The options.
+ * @return false if a region could not be reserved or an update was lost.
+ */
+bool bench::run_huge_page_benchmark(const Options& options) {
+  const size_t points = options.quick ? 2'000'000 : 16'000'000;
+  const uint64_t updates = options.quick ? 5'000'000 : 40'000'000;
+  const size_t buffers = options.quick ? 8192 : 65536;
+  constexpr size_t BufferSize = 2048;
+  bool passed{true};
+
+  print_header(fmt::format("random updates of {} points ({} MiB), ns/update", points,
+                           points * (sizeof(double) + sizeof(int64_t) + sizeof(uint32_t)) >> 20));
+  for (const auto& [policy, label] : Policies) {
+    app::PointDatabase database;
+    if (!database.reserve(points, policy)) {
+      print_row(label, "reserve failed");
+      passed = false;
+      continue;
+    }
+    Random random(options.seed);
+    auto seconds = measure_seconds([&]() {
+      for (uint64_t i = 0; i < updates; ++i) {
+        auto index = random.next() % points;
+        database.update(index, static_cast<double>(i), 0, static_cast<int64_t>(i));
+      }
+    });
+    size_t changed{0};
+    auto scan = measure_seconds([&]() { changed = database.count_changed(); });
+    passed = passed && changed > 0 && changed <= points;
+    print_row(label, fmt::format("{:6.2f}  scan {:6.2f} ms  {}", seconds * 1e9 / static_cast<double>(updates),
+                                 scan * 1e3, describe(database.region())));
+  }
+
+  print_header(fmt::format("random 64-byte writes into {} buffers of {} bytes ({} MiB), ns/write", buffers, BufferSize,
+                           buffers * BufferSize >> 20));
+  for (const auto& [policy, label] : Policies) {
+    app::BufferPool pool;
+    if (!pool.reserve(BufferSize, buffers, policy)) {
+      print_row(label, "reserve failed");
+      passed = false;
+      continue;
+    }
+    std::vector<std::span<std::byte>> acquired;
+    while (pool.available() > 0) {
+      acquired.push_back(pool.acquire());
+    }
+    std::array<std::byte, 64> message{};
+    Random random(options.seed);
+    auto seconds = measure_seconds([&]() {
+      for (uint64_t i = 0; i < updates; ++i) {
+        auto value = random.next();
+        auto& buffer = acquired[value % acquired.size()];
+        auto offset = (value >> 32) % (BufferSize / message.size()) * message.size();
+        std::memcpy(buffer.data() + offset, message.data(), message.size());
+      }
+    });
+    for (auto buffer : acquired) {
+      pool.release(buffer);
+    }
+    passed = passed && pool.available() == buffers;
+    print_row(label, fmt::format("{:6.2f}  {}", seconds * 1e9 / static_cast<double>(updates), describe(pool.region())));
+  }
+  return passed;
+}
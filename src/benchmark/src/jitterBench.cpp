@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "latencyHistogram.hpp"
+#include "threadRoles.hpp"
+// clang-format on
+
+namespace {
+
+/// The period of the critical task
+constexpr std::chrono::microseconds Period{250};
+
+/// The memory each housekeeping thread copies per round, larger than the caches of most cores
+constexpr size_t LoadBytes = 8 * 1024 * 1024;
+
+/**
+ * @brief Gets the partition of the benchmark: the detected one, or the CPUs of the process split
+ * into the last CPU for the critical task and the others for the housekeeping load.
+ * @return The partition.
+ */
+app::ThreadPartition make_partition() {
+  auto partition = app::ThreadPartition::detect();
+  if (partition.origin == "none") {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    sched_getaffinity(0, sizeof(set), &set);
+    std::vector<size_t> cpus;
+    for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+    partition.origin = "split";
+    partition.critical.cpus = {cpus.back()};
+    partition.housekeeping.cpus = cpus.size() > 1 ? std::vector<size_t>(cpus.begin(), cpus.end() - 1) : cpus;
+  }
+  partition.critical.parse_scheduling("fifo:10");
+  partition.housekeeping.parse_scheduling("batch:10");
+  return partition;
+}
+
+/**
+ * @brief Applies the critical settings, without privileges the strongest scheduling allowed.
+ * @param settings The critical settings.
+ * @return The settings applied, none if the affinity can't be set.
+ */
+std::optional<app::RoleSettings> apply_critical(app::RoleSettings settings) {
+  for (auto scheduling : {"fifo:10", "other:-10", "other:0"}) {
+    settings.parse_scheduling(scheduling);
+    if (!settings.apply()) {
+      return settings;
+    }
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief Copies memory and writes to /dev/null like log flushing and metrics aggregation.
+ * @param stop Ends the load.
+ */
+void housekeeping_load(const std::atomic<bool>& stop) {
+  std::vector<char> source(LoadBytes, 1);
+  std::vector<char> target(LoadBytes);
+  int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  while (!stop.load(std::memory_order_relaxed)) {
+    std::memcpy(target.data(), source.data(), LoadBytes);
+    bench::do_not_optimize(target[LoadBytes / 2]);
+    for (size_t offset = 0; offset < LoadBytes && null >= 0; offset += 64 * 1024) {
+      [[maybe_unused]] auto written = write(null, target.data() + offset, 64 * 1024);
+    }
+  }
+  if (null >= 0) {
+    close(null);
+  }
+}
+
+/**
+ * @brief Runs a periodic critical task next to the housekeeping load.
+ * @param options The options.
+ * @param partition The partition, none to share all CPUs.
+ * @param applied Receives the description of the critical settings applied.
+ * @return The wakeup lateness of the critical task in nanoseconds.
+ */
+app::LatencyHistogram run_scenario(const bench::Options& options, const std::optional<app::ThreadPartition>& partition,
+                                   std::string& applied) {
+  const auto duration = options.quick ? std::chrono::seconds(1) : std::chrono::seconds(5);
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> load;
+  for (size_t i = 0; i < options.threads; ++i) {
+    load.emplace_back([&]() {
+      if (partition) {
+        [[maybe_unused]] auto error = partition->housekeeping.apply();
+      }
+      housekeeping_load(stop);
+    });
+  }
+
+  app::LatencyHistogram lateness;
+  std::thread critical([&]() {
+    applied = "shared cpus, other:0";
+    if (partition) {
+      auto settings = apply_critical(partition->critical);
+      applied = settings ? settings->describe() : "settings failed";
+    }
+    timespec next{};
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end) {
+      next.tv_nsec += std::chrono::nanoseconds(Period).count();
+      if (next.tv_nsec >= 1'000'000'000) {
+        next.tv_nsec -= 1'000'000'000;
+        next.tv_sec++;
+      }
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+      timespec now{};
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      auto late = (now.tv_sec - next.tv_sec) * 1'000'000'000LL + (now.tv_nsec - next.tv_nsec);
+      lateness.record(std::chrono::nanoseconds(late));
+    }
+  });
+  critical.join();
+  stop = true;
+  for (auto& thread : load) {
+    thread.join();
+  }
+  return lateness;
+}
+
+/**
+ * @brief Formats the percentiles of a histogram in microseconds.
+ * @param histogram The histogram.
+ * @return The text.
+ */
+std::string format_lateness(const app::LatencyHistogram& histogram) {
+  auto us = [&](double percentile) { return static_cast<double>(histogram.percentile(percentile)) / 1e3; };
+  return fmt::format("p50 {:7.1f}  p99 {:7.1f}  p99.9 {:8.1f}  max {:8.1f}", us(50), us(99), us(99.9),
+                     static_cast<double>(histogram.max()) / 1e3);
+}
+
+}  // namespace
+
+/**
+ * @brief Measures the wakeup lateness of a periodic critical task while housekeeping threads copy
+ * memory and write, once with all threads sharing all CPUs and once with the threads partitioned
+ * by role.
+ * @param options The options.
+ * @return false if the critical task didn't run.
+ */
+bool bench::run_jitter_benchmark(const Options& options) {
+  auto partition = make_partition();
+  print_header(fmt::format("partition ({}): critical {}, housekeeping {}", partition.origin,
+                           partition.critical.describe(), partition.housekeeping.describe()));
+
+  print_header(fmt::format("lateness of a {} us periodic task next to {} housekeeping threads, us", Period.count(),
+                           options.threads));
+  std::string applied;
+  auto shared = run_scenario(options, std::nullopt, applied);
+  print_row("shared", format_lateness(shared));
+  auto partitioned = run_scenario(options, partition, applied);
+  print_row("partitioned", format_lateness(partitioned));
+  print_row("critical settings", applied);
+  return shared.count() > 0 && partitioned.count() > 0;
+}
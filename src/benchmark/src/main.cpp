@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+//----------------------------------------------------------------------------
+// Includes
+//----------------------------------------------------------------------------
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "benchmark.hpp"
+#include "cpuDispatch.hpp"
+#include "version.hpp"
+
+//----------------------------------------------------------------------------
+// Typedefs, enums, unions, variables
+//----------------------------------------------------------------------------
+
+/**
+ * @brief The benchmarks of the suite in the order of a complete run.
+ */
+static const std::array<bench::Benchmark, 16> BENCHMARKS = {{
+    {"pool", "slab pool against malloc: throughput and fragmentation over a 30-day churn", bench::run_pool_benchmark},
+    {"hugepage", "point updates and buffer writes on normal and huge pages", bench::run_huge_page_benchmark},
+    {"clock", "cost per timestamp of the timestamp service modes and the standard clocks", bench::run_clock_benchmark},
+    {"jitter", "periodic task lateness with and without thread role partitioning", bench::run_jitter_benchmark},
+    {"sv", "pcap and pcapng ingestion of Sampled Values into the point database", bench::run_sv_benchmark},
+    {"ber", "BER encoding and decoding of MMS reports, in place against a decoded tree", bench::run_ber_benchmark},
+    {"map", "address mapping of 200k sources, compiled map against unordered_map", bench::run_map_benchmark},
+    {"expr", "computed points of 20k bays, batched bytecode against a tree interpreter",
+     bench::run_expression_benchmark},
+    {"alarm", "limit alarms of 500k points at 1% churn, change bitmap against a scalar loop",
+     bench::run_alarm_benchmark},
+    {"soe", "k-way merge of 8 to 512 event streams with watermarks against a sorted vector under a lock",
+     bench::run_soe_benchmark},
+    {"crc", "CRC-16/MODBUS, IEC 101 sum, CRC-32 and CRC-32C in GB/s per path", bench::run_crc_benchmark},
+    {"queue", "store-and-forward queue of an outage: RAM, segment files, disk budget, restart",
+     bench::run_queue_benchmark},
+    {"poll", "periodic polls of 10k devices, aligned against hashed and staggered phases", bench::run_poll_benchmark},
+    {"send", "1 to 256 messages per tick, one send each against a coalescing outbound queue",
+     bench::run_send_benchmark},
+    {"reconnect", "reconnect storm of 100 to 10k connections after a master restart, backoff policies",
+     bench::run_reconnect_benchmark},
+    {"table", "session lookups on 1 to n threads, concurrent table against a map behind a shared_mutex",
+     bench::run_table_benchmark},
+}};
+
+/**
+ * @brief The options for the program.
+ */
+static const std::array<std::string_view, 10> OPTIONS = {
+    "  -l, --list               list the benchmarks\n",
+    "  -q, --quick              reduced problem sizes, a smoke run of the suite\n",
+    "  -T, --threads            largest number of threads of multi-threaded measurements\n",
+    "  -s, --seed               seed of the random generators\n",
+    "  -c, --capture            pcap or pcapng file measured by the sv benchmark\n",
+    "  -d, --directory          directory of the queue benchmark files, e.g. on flash\n",
+    "  -X, --cpu-level          highest SIMD level of the kernels: scalar, sse4.2, avx2, avx512, neon\n",
+    "  -v, --version            version\n",
+    "  -h, --help               this message\n",
+    "  [benchmark...]           benchmarks to run, all if none is given\n"};
+
+/**
+ *  @brief The help options for the program.
+ */
+static const char* help_options = "h?vlqT:s:c:d:X:";
+static const struct option long_options[] = {
+    {"help", no_argument, nullptr, 'h'},
+    {"version", no_argument, nullptr, 'v'},
+    {"list", no_argument, nullptr, 'l'},
+    {"quick", no_argument, nullptr, 'q'},
+    {"threads", required_argument, nullptr, 'T'},
+    {"seed", required_argument, nullptr, 's'},
+    {"capture", required_argument, nullptr, 'c'},
+    {"directory", required_argument, nullptr, 'd'},
+    {"cpu-level", required_argument, nullptr, 'X'},
+    {nullptr, 0, nullptr, 0},
+};
+
+/**
+ * @brief The sample command lines for the program.
+ */
+static const std::array<std::string_view, 6> SAMPLE_COMMANDS = {
+    " -l\n", " -q\n", " -T 8 pool\n", " -c merging-unit.pcapng sv\n", " -X scalar alarm\n", " -d /mnt/flash queue\n"};
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+
+/*************************************************************************/ /**
+ * Displays the help message for the program.
+ * @param programName The name of the program.
+ * @param errorOption The option with an error.
+ *****************************************************************************/
+static void display_help(const char* programName, std::string_view errorOption = "") {
+  if (!errorOption.empty()) {
+    std::cerr << "Error in option: " << errorOption << "\n";
+  }
+  std::cout << "\nUsage: " << programName << " [OPTIONS] [benchmark...]\n" << std::endl;
+  for (const auto& option : OPTIONS) {
+    std::cout << option;
+  }
+  std::cout << "\nSample command lines:" << std::endl;
+  for (const auto& cmd : SAMPLE_COMMANDS) {
+    std::cout << programName << cmd;
+  }
+
+  if (!errorOption.empty()) {
+    exit(EXIT_FAILURE);
+  }
+}
+
+/*************************************************************************/ /**
+ * Lists the benchmarks of the suite.
+ *****************************************************************************/
+static void list_benchmarks() {
+  for (const auto& benchmark : BENCHMARKS) {
+    std::cout << fmt::format("  {:<12} {}\n", benchmark.name, benchmark.description);
+  }
+}
+
+/*************************************************************************/ /**
+ * @brief Processes the command line options passed to the program.
+ * @param argc The number of command line arguments.
+ * @param argv The array of command line argument strings.
+ * @param options The benchmark options.
+ * @return The selected benchmarks.
+ *****************************************************************************/
+static std::vector<const bench::Benchmark*> process_command_line(int argc, char* argv[], bench::Options& options) {
+  int option_index = 0;
+  for (;;) {
+    int current_option = getopt_long(argc, argv, help_options, long_options, &option_index);
+    if (current_option == -1) {
+      break;
+    }
+
+    try {
+      switch (current_option) {
+        case 'h':
+        case '?':
+          display_help(argv[0]);
+          exit(EXIT_SUCCESS);
+
+        case 'v':
+          std::cout << argv[0] << " v." << version::daemonBench::getVersion(true) << std::endl;
+          exit(EXIT_SUCCESS);
+
+        case 'l':
+          list_benchmarks();
+          exit(EXIT_SUCCESS);
+
+        case 'q':
+          options.quick = true;
+          break;
+
+        case 'T':
+          options.threads = std::stoul(optarg);
+          break;
+
+        case 's':
+          options.seed = std::stoull(optarg);
+          break;
+
+        case 'c':
+          options.capture = optarg;
+          break;
+
+        case 'd':
+          options.directory = optarg;
+          break;
+
+        case 'X':
+          if (auto level = app::parse_cpu_level(optarg);
+              !level.has_value() || !app::CpuDispatch::instance().force_level(*level)) {
+            display_help(argv[0], optarg);
+          }
+          break;
+
+        default:
+          display_help(argv[0], std::to_string(current_option));
+      }
+    } catch (const std::exception&) {
+      display_help(argv[0], std::string(argv[optind - 1]));
+    }
+  }
+
+  if (options.threads == 0) {
+    display_help(argv[0], "threads");
+  }
+
+  std::vector<const bench::Benchmark*> selected;
+  for (int i = optind; i < argc; ++i) {
+    std::string_view name(argv[i]);
+    auto it = std::find_if(BENCHMARKS.begin(), BENCHMARKS.end(), [name](const auto& b) { return b.name == name; });
+    if (it == BENCHMARKS.end()) {
+      display_help(argv[0], argv[i]);
+    }
+    selected.push_back(&*it);
+  }
+  if (selected.empty()) {
+    for (const auto& benchmark : BENCHMARKS) {
+      selected.push_back(&benchmark);
+    }
+  }
+  return selected;
+}
+
+/*************************************************************************/ /**
+ * @file main.c
+ * @brief Runs the selected benchmarks and reports the time of the suite.
+ *****************************************************************************/
+int main(int argc, char** argv) {
+  bench::Options options;
+  options.threads = std::clamp<size_t>(std::thread::hardware_concurrency(), 2, 8);
+  auto selected = process_command_line(argc, argv, options);
+
+  std::cout << version::daemonBench::getHeader(true) << "\n";
+  const auto& dispatch = app::CpuDispatch::instance();
+  std::cout << fmt::format("cpu level {} (detected {}): {}\n", app::to_string(dispatch.level()),
+                           app::to_string(dispatch.detected_level()), dispatch.features().to_string());
+  for (const auto& binding : dispatch.bindings()) {
+    std::cout << fmt::format("  kernel {:<14} {}\n", binding.name, app::to_string(binding.level));
+  }
+  bool passed{true};
+  auto seconds = bench::measure_seconds([&]() {
+    for (const auto* benchmark : selected) {
+      std::cout << "\n=== " << benchmark->name << ": " << benchmark->description << "\n";
+      if (!benchmark->function(options)) {
+        std::cerr << "benchmark " << benchmark->name << " failed its checks\n";
+        passed = false;
+      }
+    }
+  });
+
+  std::cout << fmt::format("\nsuite time: {:.2f} s\n", seconds);
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
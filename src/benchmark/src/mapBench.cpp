@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "addressMap.hpp"
+#include "benchmark.hpp"
+// clang-format on
+
+namespace {
+
+/// The mappings of a large converter deployment
+constexpr size_t Mappings = 200'000;
+
+/**
+ * @brief Generates the mappings of an address plan.
+ * @param plan "iec104" spread IOAs of 64 stations, "raw" numbers with gaps, "reference" object
+ * references.
+ * @param seed The seed.
+ * @return The mappings.
+ */
+std::vector<app::AddressMapping> make_mappings(std::string_view plan, uint64_t seed) {
+  bench::Random random(seed);
+  std::vector<app::AddressMapping> mappings;
+  std::unordered_set<uint64_t> sources;
+  while (mappings.size() < Mappings) {
+    app::AddressMapping mapping;
+    auto index = static_cast<uint32_t>(mappings.size());
+    if (plan == "iec104") {
+      mapping.source = app::make_address(app::AddressSpace::iec104, ((random.next() % 64 + 1) << 24) |
+                                                                        (random.next() & 0xFFFFFF));
+    } else if (plan == "raw") {
+      mapping.source = app::make_address(app::AddressSpace::raw, index * 3 / 2);
+    } else {
+      mapping.source = app::make_reference_address(fmt::format("BAY{:03}/MMXU{}.PhV.phs{}.cVal.mag.f", index / 64,
+                                                               index % 64 / 4 + 1, "ABCN"[index % 4]));
+    }
+    if (!sources.insert(mapping.source).second) {
+      continue;
+    }
+    mapping.destination = index;
+    mapping.scale = 0.001 * static_cast<double>(index % 7 + 1);
+    mapping.offset = static_cast<double>(index % 3);
+    mappings.push_back(mapping);
+  }
+  return mappings;
+}
+
+}  // namespace
+
+/**
+ * @brief Measures the lookup and scaling of source addresses in the compiled address map against
+ * std::unordered_map, for 200k mappings of three address plans and a random stream of values.
+ * @param options The options.
+ * @return false if a map doesn't compile or returns another mapping than the unordered_map.
+ */
+bool bench::run_map_benchmark(const Options& options) {
+  const size_t lookups = options.quick ? 2'000'000 : 20'000'000;
+  bool passed = true;
+
+  for (std::string_view plan : {"iec104", "raw", "reference"}) {
+    auto mappings = make_mappings(plan, options.seed);
+
+    app::AddressMap map;
+    std::unordered_map<uint64_t, app::AddressMapping> hashMap;
+    bool compiled{false};
+    auto compileSeconds = measure_seconds([&]() { compiled = map.compile(mappings); });
+    auto buildSeconds = measure_seconds([&]() {
+      hashMap.reserve(mappings.size());
+      for (const auto& mapping : mappings) {
+        hashMap.emplace(mapping.source, mapping);
+      }
+    });
+    print_header(fmt::format("{} mappings, {} plan, {} layout", mappings.size(), plan, to_string(map.layout())));
+    if (!compiled) {
+      print_row("compile", map.last_error());
+      passed = false;
+      continue;
+    }
+
+    // every source maps as in the unordered_map, other addresses don't map
+    Random random(options.seed + 1);
+    for (const auto& mapping : mappings) {
+      const auto* found = map.find(mapping.source);
+      passed = passed && found != nullptr && found->destination == hashMap.at(mapping.source).destination;
+    }
+    for (size_t i = 0; i < 100'000; ++i) {
+      auto source = random.next() >> 8;
+      passed = passed && (map.find(source) != nullptr) == hashMap.contains(source);
+    }
+
+    // the received values arrive in random order of the sources
+    std::vector<uint64_t> stream(1 << 20);
+    for (auto& source : stream) {
+      source = mappings[random.next() % mappings.size()].source;
+    }
+    double sum{0};
+    auto mapSeconds = measure_seconds([&]() {
+      for (size_t i = 0; i < lookups; ++i) {
+        const auto* mapping = map.find(stream[i & (stream.size() - 1)]);
+        sum += mapping != nullptr ? mapping->apply(static_cast<double>(i)) : 0.0;
+      }
+    });
+    double hashSum{0};
+    auto hashSeconds = measure_seconds([&]() {
+      for (size_t i = 0; i < lookups; ++i) {
+        auto it = hashMap.find(stream[i & (stream.size() - 1)]);
+        hashSum += it != hashMap.end() ? it->second.apply(static_cast<double>(i)) : 0.0;
+      }
+    });
+    passed = passed && sum == hashSum;
+    do_not_optimize(sum);
+
+    // the nodes of the unordered_map hold the key, the mapping and the next pointer
+    auto hashBytes = hashMap.bucket_count() * sizeof(void*) +
+                     hashMap.size() * (sizeof(void*) + sizeof(std::pair<const uint64_t, app::AddressMapping>));
+    print_row("address map", fmt::format("{:6.1f} ns/value  build {:6.1f} ms  {:5.1f} MiB",
+                                         mapSeconds * 1e9 / static_cast<double>(lookups), compileSeconds * 1e3,
+                                         static_cast<double>(map.memory_bytes()) / (1 << 20)));
+    print_row("unordered_map", fmt::format("{:6.1f} ns/value  build {:6.1f} ms  {:5.1f} MiB",
+                                           hashSeconds * 1e9 / static_cast<double>(lookups), buildSeconds * 1e3,
+                                           static_cast<double>(hashBytes) / (1 << 20)));
+  }
+  return passed;
+}
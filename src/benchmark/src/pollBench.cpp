@@ -0,0 +1,236 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "pollScheduler.hpp"
+// clang-format on
+
+namespace {
+
+/// The CPU time of a poll: request, response and the update of its points
+constexpr int64_t ServiceNanoseconds = 50'000;
+
+/// The longest wait of the simulated context task, its process_executing limit
+constexpr std::chrono::milliseconds WaitLimit{1000};
+
+/// The start of the simulated time line, not at a period boundary
+constexpr int64_t StartNanoseconds = 3'600'000'000'000 + 123'456'789;
+
+/// The policies in the order of the rows
+constexpr app::PollPolicy Policies[] = {app::PollPolicy::aligned, app::PollPolicy::hashed,
+                                        app::PollPolicy::staggered};
+
+/**
+ * @brief A polled device.
+ */
+struct Device {
+  int64_t period;  ///< poll period in nanoseconds
+};
+
+/**
+ * @brief The result of a simulated run.
+ */
+struct Run {
+  uint64_t polls{0};                                      ///< polls of the devices
+  uint64_t wakeups{0};                                    ///< waits of the context task
+  int64_t shortest{std::numeric_limits<int64_t>::max()};  ///< shortest interval against the period
+  std::vector<uint32_t> counts;                           ///< polls of each device
+};
+
+/**
+ * @brief Creates devices, the key of a task is the index of its device.
+ * @param count The number of devices.
+ * @param periods The periods in nanoseconds, assigned in turn.
+ * @return The devices.
+ */
+std::vector<Device> make_devices(size_t count, const std::vector<int64_t>& periods) {
+  std::vector<Device> devices(count);
+  for (size_t i = 0; i < count; ++i) {
+    devices[i] = {periods[i % periods.size()]};
+  }
+  return devices;
+}
+
+/**
+ * @brief Simulates the context task: the due polls run one after the other, each costs the
+ * service time, then the task waits for the delay process_executing returns.
+ * @param scheduler The scheduler.
+ * @param devices The devices, indexed by the key of their task.
+ * @param start The start of the run.
+ * @param end The end of the run.
+ * @param run Receives the polls, the wakeups and the intervals.
+ * @param last The time of the last poll of each device, kept across runs.
+ * @return The end of the run.
+ */
+int64_t simulate(app::PollScheduler& scheduler, const std::vector<Device>& devices, int64_t start, int64_t end,
+                 Run& run, std::vector<int64_t>& last) {
+  int64_t now = start;
+  while (now < end) {
+    while (auto key = scheduler.next_due(now)) {
+      const auto device = static_cast<size_t>(*key);
+      if (last[device] != 0) {
+        run.shortest = std::min(run.shortest, (now - last[device]) * 1000 / devices[device].period);
+      }
+      last[device] = now;
+      ++run.counts[device];
+      ++run.polls;
+      now += ServiceNanoseconds;
+    }
+    auto wait = scheduler.next_delay(now, WaitLimit);
+    now += std::chrono::nanoseconds(wait).count();
+    ++run.wakeups;
+  }
+  return now;
+}
+
+/**
+ * @brief Formats the burst and jitter metrics of a scheduler.
+ * @param scheduler The scheduler.
+ * @return The text.
+ */
+std::string format_metrics(const app::PollScheduler& scheduler) {
+  const auto& burst = scheduler.burst();
+  return fmt::format("peak {:5} polls/{} ms, burst {:6.1f}x, late p99 {:7.1f} ms max {:7.1f} ms, jitter p99 {:6.1f} ms",
+                     burst.peak(), std::chrono::duration_cast<std::chrono::milliseconds>(burst.window()).count(),
+                     burst.burst(), static_cast<double>(scheduler.lateness().percentile(99)) / 1e6,
+                     static_cast<double>(scheduler.lateness().max()) / 1e6,
+                     static_cast<double>(scheduler.jitter().percentile(99)) / 1e6);
+}
+
+/**
+ * @brief Runs the devices under every policy from a common start, as after a startup or reload.
+ * @param devices The devices.
+ * @param duration The simulated time in nanoseconds.
+ * @return false if the staggered polls burst as the aligned ones or miss a period.
+ */
+bool compare_policies(const std::vector<Device>& devices, int64_t duration) {
+  bool passed = true;
+  double alignedBurst = 0.0;
+  for (auto policy : Policies) {
+    app::PollScheduler scheduler({policy});
+    for (size_t i = 0; i < devices.size(); ++i) {
+      scheduler.add(i, std::chrono::nanoseconds(devices[i].period));
+    }
+    Run run;
+    run.counts.assign(devices.size(), 0);
+    std::vector<int64_t> last(devices.size(), 0);
+    simulate(scheduler, devices, StartNanoseconds, StartNanoseconds + duration, run, last);
+    bench::print_row(app::to_string(policy), format_metrics(scheduler));
+
+    const double burst = scheduler.burst().burst();
+    if (policy == app::PollPolicy::aligned) {
+      alignedBurst = burst;
+    }
+    if (policy == app::PollPolicy::staggered) {
+      passed = passed && burst < alignedBurst && scheduler.statistics().missed == 0;
+      for (size_t i = 0; i < devices.size(); ++i) {
+        const int64_t expected = duration / devices[i].period;
+        passed = passed && run.counts[i] + 1 >= expected && run.counts[i] <= expected + 1;
+      }
+    }
+  }
+  return passed;
+}
+
+}  // namespace
+
+/**
+ * @brief Measures the flattening of periodic device polls: thousands of devices added at once, as
+ * after a startup or a reload, polled in a simulated context task whose polls cost CPU time and
+ * which waits for the delay of the scheduler. It reports the peak polls of a 10 ms window and the
+ * burst against the mean, the lateness of the polls and the deviation of their intervals from the
+ * period, for one period and for a mix of periods under the aligned, hashed and staggered policies.
+ * A reload that replaces a tenth of the devices shows the rebalancing, and the real cost of a poll
+ * and of a rebalance shows the overhead of the scheduler.
+ * @param options The options.
+ * @return false if the staggered polls burst as the aligned ones, or a device misses a period or
+ * is polled twice within half a period.
+ */
+bool bench::run_poll_benchmark(const Options& options) {
+  const size_t count = options.quick ? 2'000 : 10'000;
+  const int64_t duration = (options.quick ? 10 : 60) * int64_t{1'000'000'000};
+  Random random(options.seed);
+  bool passed = true;
+
+  print_header(fmt::format("{} devices every 1 s, {} us per poll, {} s", count, ServiceNanoseconds / 1000,
+                           duration / 1'000'000'000));
+  passed = compare_policies(make_devices(count, {1'000'000'000}), duration) && passed;
+
+  print_header(fmt::format("{} devices every 1, 2, 5 and 10 s", count));
+  passed =
+      compare_policies(make_devices(count, {1'000'000'000, 2'000'000'000, 5'000'000'000, 10'000'000'000}), duration) &&
+      passed;
+
+  print_header(fmt::format("staggered, a reload every 5 s replaces {} of {} devices every 1 s", count / 10, count));
+  {
+    const auto reloads = static_cast<size_t>(duration / 5'000'000'000);
+    auto devices = make_devices(count + reloads * (count / 10), {1'000'000'000});
+    app::PollScheduler scheduler({app::PollPolicy::staggered});
+    for (size_t i = 0; i < count; ++i) {
+      scheduler.add(i, std::chrono::nanoseconds(devices[i].period));
+    }
+    Run run;
+    run.counts.assign(devices.size(), 0);
+    std::vector<int64_t> last(devices.size(), 0);
+    size_t oldest = 0;
+    size_t next = count;
+    int64_t now = simulate(scheduler, devices, StartNanoseconds, StartNanoseconds + 5'000'000'000, run, last);
+    const int64_t end = StartNanoseconds + duration;
+    while (now < end) {
+      for (size_t i = 0; i < count / 10 && next < devices.size(); ++i) {
+        scheduler.remove(oldest++);
+        scheduler.add(next, std::chrono::nanoseconds(devices[next].period));
+        ++next;
+      }
+      now = simulate(scheduler, devices, now, std::min(end, now + 5'000'000'000), run, last);
+    }
+    const auto& statistics = scheduler.statistics();
+    passed = passed && statistics.missed == 0 && run.shortest >= 500;
+    print_row("reload", format_metrics(scheduler));
+    print_row("rebalance",
+              fmt::format("{} reloads, {:.0f} phases moved per reload, shortest interval {:.2f} periods",
+                          statistics.rebalances - 1,
+                          static_cast<double>(statistics.moved) /
+                              static_cast<double>(std::max<uint64_t>(statistics.rebalances - 1, 1)),
+                          static_cast<double>(run.shortest) / 1000.0));
+  }
+
+  const size_t tasks = options.quick ? 100'000 : 1'000'000;
+  print_header(fmt::format("cost of the scheduler, {} tasks every 1 s", tasks));
+  {
+    app::PollScheduler scheduler({app::PollPolicy::staggered});
+    for (size_t i = 0; i < tasks; ++i) {
+      scheduler.add(random.next(), std::chrono::seconds(1));
+    }
+    auto seconds = measure_seconds([&]() { do_not_optimize(scheduler.next_delay(StartNanoseconds, WaitLimit)); });
+    print_row("placement", fmt::format("{:8.1f} ms", seconds * 1e3));
+    scheduler.add(random.next(), std::chrono::seconds(1));
+    seconds = measure_seconds([&]() { do_not_optimize(scheduler.next_delay(StartNanoseconds, WaitLimit)); });
+    print_row("rebalance", fmt::format("{:8.1f} ms after one added task", seconds * 1e3));
+
+    uint64_t polls = 0;
+    seconds = measure_seconds([&]() {
+      for (int64_t now = StartNanoseconds; now < StartNanoseconds + 2'000'000'000; now += 1'000'000) {
+        while (auto key = scheduler.next_due(now)) {
+          do_not_optimize(*key);
+          ++polls;
+        }
+      }
+    });
+    print_row("poll", fmt::format("{:8.1f} ns per poll, {} polls", seconds * 1e9 / static_cast<double>(polls), polls));
+  }
+  return passed;
+}
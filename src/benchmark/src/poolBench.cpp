@@ -0,0 +1,386 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <malloc.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numbers>
+#include <thread>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "objectPool.hpp"
+// clang-format on
+
+namespace {
+
+//----------------------------------------------------------------------------
+// 30-day churn
+//----------------------------------------------------------------------------
+
+/**
+ * @brief Object sizes of the churn: timer entries, protocol messages, connection structs and buffers.
+ */
+constexpr std::array<size_t, 4> ChurnSizes = {48, 160, 512, 2048};
+constexpr std::array<unsigned, 4> ChurnWeights = {40, 30, 20, 10};  ///< percent of the arrivals per size
+
+constexpr uint32_t MinutesPerDay = 24 * 60;
+constexpr double ArrivalsPerMinute = 600.0;     ///< mean arrivals, following a daily curve
+constexpr double ShortLifetime = 20.0;          ///< mean lifetime of most objects in minutes
+constexpr double LongLifetime = MinutesPerDay;  ///< mean lifetime of long-lived objects in minutes
+constexpr double LongLivedShare = 0.02;         ///< share of long-lived objects, they pin memory
+
+/**
+ * @brief The header every churn object writes into its block, checked when it is released.
+ */
+struct ChurnObject {
+  ChurnObject* next;   ///< next object expiring in the same minute
+  uint64_t tag;        ///< tag of the allocation, repeated at the end of the block
+  uint32_t sizeClass;  ///< index into ChurnSizes
+};
+
+/**
+ * @brief The glibc heap.
+ */
+struct MallocChurn {
+  static constexpr std::string_view Name = "malloc";
+
+  void* allocate(uint32_t sizeClass) {
+    return std::malloc(ChurnSizes[sizeClass]);
+  }
+
+  void deallocate(void* block, uint32_t /*sizeClass*/) {
+    std::free(block);
+  }
+
+  /// @return bytes the heap took from the system
+  size_t footprint() const {
+#if defined(__GLIBC__)
+    auto info = mallinfo2();
+    return info.arena + info.hblkhd;
+#else
+    return 0;
+#endif
+  }
+};
+
+/**
+ * @brief The slab pools of the churn sizes.
+ */
+struct PoolChurn {
+  static constexpr std::string_view Name = "slab pool";
+
+  std::array<app::SlabPool*, ChurnSizes.size()> pools{};
+
+  PoolChurn() {
+    for (size_t i = 0; i < ChurnSizes.size(); ++i) {
+      pools[i] = &app::SlabPool::for_size(ChurnSizes[i]);
+    }
+  }
+
+  void* allocate(uint32_t sizeClass) {
+    return pools[sizeClass]->allocate();
+  }
+
+  void deallocate(void* block, uint32_t sizeClass) {
+    pools[sizeClass]->deallocate(block);
+  }
+
+  /// @return bytes the pools took from the system
+  size_t footprint() const {
+    size_t bytes{0};
+    for (const auto* pool : pools) {
+      bytes += pool->statistics().reservedBytes;
+    }
+    return bytes;
+  }
+};
+
+/**
+ * @brief The result of a churn simulation.
+ */
+struct ChurnResult {
+  double seconds{0};          ///< wall time of the simulation
+  uint64_t operations{0};     ///< allocations and releases
+  size_t peakLive{0};         ///< most live bytes
+  size_t peakFootprint{0};    ///< most bytes taken from the system
+  size_t troughLive{0};       ///< live bytes at the last midnight
+  size_t troughFootprint{0};  ///< bytes taken from the system at the last midnight
+  uint64_t corrupted{0};      ///< objects whose tags were overwritten
+};
+
+/**
+ * @brief Simulates the allocations of a daemon over days: arrivals follow a daily curve with the
+ * peak at noon, most objects live minutes, a few live for days and pin the memory around them.
+ * @param allocator The allocator.
+ * @param days The simulated days.
+ * @param seed The seed, equal seeds give equal allocation sequences.
+ * @return The result.
+ */
+template <typename Allocator>
+ChurnResult simulate_churn(Allocator& allocator, uint32_t days, uint64_t seed) {
+  ChurnResult result;
+  const uint32_t minutes = days * MinutesPerDay;
+  // the expiry wheel is allocated before the measurement, the objects link themselves into it
+  std::vector<ChurnObject*> wheel(minutes + 1, nullptr);
+  const size_t baseline = allocator.footprint();
+  bench::Random random(seed);
+  size_t live{0};
+  uint64_t tag{0};
+
+  auto release = [&](ChurnObject* object) {
+    auto size = ChurnSizes[object->sizeClass];
+    uint64_t tail;
+    std::memcpy(&tail, reinterpret_cast<std::byte*>(object) + size - sizeof(tail), sizeof(tail));
+    if (tail != object->tag) {
+      result.corrupted++;
+    }
+    live -= size;
+    allocator.deallocate(object, object->sizeClass);
+    result.operations++;
+  };
+
+  result.seconds = bench::measure_seconds([&]() {
+    for (uint32_t minute = 0; minute < minutes; ++minute) {
+      for (auto* object = wheel[minute]; object != nullptr;) {
+        auto* next = object->next;
+        release(object);
+        object = next;
+      }
+
+      auto phase = 2.0 * std::numbers::pi * (minute % MinutesPerDay) / MinutesPerDay;
+      auto rate = ArrivalsPerMinute * (1.0 - 0.7 * std::cos(phase));
+      auto arrivals = static_cast<uint32_t>(rate * (0.8 + 0.4 * random.uniform()));
+      for (uint32_t i = 0; i < arrivals; ++i) {
+        auto pick = static_cast<unsigned>(random.next() % 100);
+        uint32_t sizeClass{0};
+        while (pick >= ChurnWeights[sizeClass]) {
+          pick -= ChurnWeights[sizeClass++];
+        }
+        auto lifetime = random.exponential(random.uniform() < LongLivedShare ? LongLifetime : ShortLifetime);
+        auto expiry = std::min<uint64_t>(minute + 1 + static_cast<uint64_t>(lifetime), minutes);
+
+        auto size = ChurnSizes[sizeClass];
+        auto* object = static_cast<ChurnObject*>(allocator.allocate(sizeClass));
+        object->tag = ++tag;
+        object->sizeClass = sizeClass;
+        std::memcpy(reinterpret_cast<std::byte*>(object) + size - sizeof(tag), &tag, sizeof(tag));
+        object->next = wheel[expiry];
+        wheel[expiry] = object;
+        live += size;
+        result.operations++;
+      }
+
+      result.peakLive = std::max(result.peakLive, live);
+      if (minute % 60 == 0) {
+        auto footprint = std::max(allocator.footprint(), baseline) - baseline;
+        result.peakFootprint = std::max(result.peakFootprint, footprint);
+        if (minute % MinutesPerDay == 0) {
+          result.troughLive = live;
+          result.troughFootprint = footprint;
+        }
+      }
+    }
+
+    for (auto* object = wheel[minutes]; object != nullptr;) {
+      auto* next = object->next;
+      release(object);
+      object = next;
+    }
+  });
+  return result;
+}
+
+/**
+ * @brief Prints the result of a churn simulation.
+ * @param name The allocator.
+ * @param result The result.
+ */
+void print_churn(std::string_view name, const ChurnResult& result) {
+  auto mib = [](size_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+  auto overhead = [](size_t footprint, size_t live) {
+    return live > 0 ? (static_cast<double>(footprint) / static_cast<double>(live) - 1.0) * 100.0 : 0.0;
+  };
+  bench::print_header(fmt::format("{}:", name));
+  auto rate = static_cast<double>(result.operations) / result.seconds;
+  bench::print_row("throughput", fmt::format("{:.1f} Mops/s", rate / 1e6));
+  bench::print_row("peak live", fmt::format("{:.1f} MiB", mib(result.peakLive)));
+  bench::print_row("peak footprint", fmt::format("{:.1f} MiB, {:+.1f} % over live", mib(result.peakFootprint),
+                                                 overhead(result.peakFootprint, result.peakLive)));
+  bench::print_row("trough live", fmt::format("{:.1f} MiB", mib(result.troughLive)));
+  bench::print_row("trough footprint", fmt::format("{:.1f} MiB, {:+.1f} % over live", mib(result.troughFootprint),
+                                                   overhead(result.troughFootprint, result.troughLive)));
+}
+
+//----------------------------------------------------------------------------
+// typed objects
+//----------------------------------------------------------------------------
+
+/**
+ * @brief A protocol message of fixed size.
+ */
+struct Message {
+  uint64_t sequence{0};             ///< sequence number
+  std::array<std::byte, 120> data;  ///< payload
+};
+
+/**
+ * @brief Replaces random objects of a working set, the pattern of message and timer churn.
+ * @param operations The number of replacements.
+ * @param workingSet The number of live objects.
+ * @param seed The seed.
+ * @param make The factory of the owning handle.
+ * @return The number of replacements.
+ */
+template <typename Make>
+uint64_t replace_objects(uint64_t operations, size_t workingSet, uint64_t seed, Make make) {
+  std::vector<decltype(make(0))> objects(workingSet);
+  bench::Random random(seed);
+  for (uint64_t i = 0; i < operations; ++i) {
+    auto& slot = objects[random.next() % workingSet];
+    slot = make(i);
+    bench::do_not_optimize(slot->sequence);
+  }
+  return operations;
+}
+
+/**
+ * @brief Measures the replacement rate of threads, each with its own working set.
+ * @param threads The number of threads.
+ * @param operations The replacements per thread.
+ * @param make The factory of the owning handle.
+ * @return Replacements per second of all threads.
+ */
+template <typename Make>
+double measure_threads(size_t threads, uint64_t operations, Make make) {
+  auto seconds = bench::measure_seconds([&]() {
+    std::vector<std::jthread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+      workers.emplace_back([=]() { replace_objects(operations, 4096, t + 1, make); });
+    }
+  });
+  return static_cast<double>(threads * operations) / seconds;
+}
+
+/**
+ * @brief Measures objects created on a producer thread and destroyed on a consumer thread,
+ * the way received messages are handed to a worker.
+ * @param operations The number of objects.
+ * @param make The factory of the owning handle.
+ * @return Objects per second.
+ */
+template <typename Make>
+double measure_handover(uint64_t operations, Make make) {
+  using Handle = decltype(make(0));
+  constexpr size_t HandoverBatch = 256;
+  std::mutex mutex;
+  std::vector<Handle> queue;
+  bool done{false};
+
+  auto seconds = bench::measure_seconds([&]() {
+    std::jthread consumer([&]() {
+      std::vector<Handle> batch;
+      for (;;) {
+        {
+          std::lock_guard lock(mutex);
+          batch.swap(queue);
+          if (batch.empty() && done) {
+            return;
+          }
+        }
+        if (batch.empty()) {
+          std::this_thread::yield();
+        }
+        batch.clear();
+      }
+    });
+
+    std::vector<Handle> batch;
+    for (uint64_t i = 0; i < operations; ++i) {
+      batch.push_back(make(i));
+      if (batch.size() == HandoverBatch) {
+        std::lock_guard lock(mutex);
+        std::move(batch.begin(), batch.end(), std::back_inserter(queue));
+        batch.clear();
+      }
+    }
+    std::lock_guard lock(mutex);
+    std::move(batch.begin(), batch.end(), std::back_inserter(queue));
+    done = true;
+  });
+  return static_cast<double>(operations) / seconds;
+}
+
+}  // namespace
+
+/**
+ * @brief Compares the slab pool with malloc: fragmentation and throughput of a simulated 30-day
+ * churn, typed object replacement on 1..n threads and the handover between threads.
+ * @param options The options.
+ * @return false if an object was corrupted.
+ */
+bool bench::run_pool_benchmark(const Options& options) {
+  const uint32_t days = options.quick ? 3 : 30;
+  const uint64_t operations = options.quick ? 2'000'000 : 20'000'000;
+  bool passed{true};
+
+  print_header(fmt::format("churn of {} simulated days, {} arrivals per minute at noon, sizes 48..2048 bytes", days,
+                           static_cast<int>(ArrivalsPerMinute * 1.7)));
+  {
+    MallocChurn heap;
+    auto result = simulate_churn(heap, days, options.seed);
+    print_churn(MallocChurn::Name, result);
+    passed = passed && result.corrupted == 0;
+  }
+  {
+    PoolChurn pool;
+    auto result = simulate_churn(pool, days, options.seed);
+    print_churn(PoolChurn::Name, result);
+    passed = passed && result.corrupted == 0;
+  }
+
+  auto makeHeap = [](uint64_t i) {
+    auto message = std::make_unique<Message>();
+    message->sequence = i;
+    return message;
+  };
+  auto makePooled = [](uint64_t i) {
+    auto message = app::make_pooled<Message>();
+    message->sequence = i;
+    return message;
+  };
+
+  print_header(fmt::format("replacement of {}-byte messages in working sets of 4096, Mops/s", sizeof(Message)));
+  for (size_t threads = 1; threads <= options.threads; threads *= 2) {
+    auto heap = measure_threads(threads, operations / threads, makeHeap);
+    auto pooled = measure_threads(threads, operations / threads, makePooled);
+    print_row(fmt::format("{} thread{}", threads, threads > 1 ? "s" : ""),
+              fmt::format("new/delete {:7.1f}   pool_ptr {:7.1f}   {:.2f}x", heap / 1e6, pooled / 1e6, pooled / heap));
+  }
+
+  print_header("handover from a producer to a consumer thread, Mops/s");
+  {
+    auto heap = measure_handover(operations / 2, makeHeap);
+    auto pooled = measure_handover(operations / 2, makePooled);
+    print_row("2 threads",
+              fmt::format("new/delete {:7.1f}   pool_ptr {:7.1f}   {:.2f}x", heap / 1e6, pooled / 1e6, pooled / heap));
+  }
+
+  auto stats = app::PoolDeleter<Message>::pool().statistics();
+  print_row("message pool", fmt::format("{} slabs, {} blocks free, {} held by threads", stats.slabs, stats.globalFree,
+                                        stats.threadHeld));
+  return passed;
+}
@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "diskQueue.hpp"
+// clang-format on
+
+namespace {
+
+/// The size of an outgoing event record, a report with a few points
+constexpr size_t RecordSize = 256;
+
+/// The segment size of the queues
+constexpr size_t SegmentSize = size_t{4} << 20;
+
+/// The RAM threshold of the queues
+constexpr size_t MemoryLimit = size_t{8} << 20;
+
+/**
+ * @brief Writes the sequence number into a record, the rest stays random.
+ * @param record The record.
+ * @param sequence The sequence number.
+ */
+void stamp(std::vector<uint8_t>& record, uint64_t sequence) {
+  std::memcpy(record.data(), &sequence, sizeof(sequence));
+}
+
+/**
+ * @brief Reads the sequence number of a record.
+ * @param record The record.
+ * @return The sequence number.
+ */
+uint64_t sequence_of(std::span<const uint8_t> record) {
+  uint64_t sequence = 0;
+  std::memcpy(&sequence, record.data(), sizeof(sequence));
+  return sequence;
+}
+
+/**
+ * @brief Formats a throughput.
+ * @param records The number of records.
+ * @param seconds The time.
+ * @return The text.
+ */
+std::string format_rate(uint64_t records, double seconds) {
+  return fmt::format("{:6.2f} M records/s {:8.1f} MB/s", static_cast<double>(records) / seconds / 1e6,
+                     static_cast<double>(records * RecordSize) / seconds / 1e6);
+}
+
+/**
+ * @brief Drains a queue and checks that the records come in sequence.
+ * @param queue The queue.
+ * @param first The sequence number of the first record.
+ * @param count Receives the number of records.
+ * @return true if in sequence, otherwise false.
+ */
+bool drain_in_sequence(app::DiskQueue& queue, uint64_t first, uint64_t& count) {
+  bool ordered = true;
+  count = 0;
+  queue.drain(SIZE_MAX, [&](std::span<const uint8_t> record) {
+    ordered = ordered && record.size() == RecordSize && sequence_of(record) == first + count;
+    ++count;
+    return true;
+  });
+  return ordered;
+}
+
+}  // namespace
+
+/**
+ * @brief Measures the store-and-forward queue of an outage: enqueue and dequeue with the link up,
+ * where the records stay in one RAM segment, against a deque of records; an outage that spills to
+ * segment files beyond the RAM threshold and the drain at the end of it; an outage beyond the disk
+ * budget, which drops the oldest records; and a restart, which takes over the files. The files go to
+ * the directory of -d, which should be on the flash of the target.
+ * @param options The options.
+ * @return false if a queue loses, repeats or reorders records.
+ */
+bool bench::run_queue_benchmark(const Options& options) {
+  const uint64_t volume = options.quick ? (uint64_t{64} << 20) : (uint64_t{512} << 20);
+  const uint64_t records = volume / RecordSize;
+  auto directory = (options.directory.empty() ? std::filesystem::temp_directory_path()
+                                              : std::filesystem::path(options.directory)) /
+                   fmt::format("daemonBench-queue-{}", ::getpid());
+  std::error_code error;
+  std::filesystem::remove_all(directory, error);
+
+  Random random(options.seed);
+  std::vector<uint8_t> record(RecordSize);
+  for (auto& byte : record) {
+    byte = static_cast<uint8_t>(random.next());
+  }
+  bool passed = true;
+
+  print_header(fmt::format("link up, {} records of {} B, enqueue and dequeue in turn", records, RecordSize));
+  {
+    std::deque<std::vector<uint8_t>> deque;
+    uint64_t sum = 0;
+    auto seconds = measure_seconds([&]() {
+      for (uint64_t i = 0; i < records; ++i) {
+        stamp(record, i);
+        deque.push_back(record);
+        sum += sequence_of(deque.front());
+        deque.pop_front();
+      }
+    });
+    passed = passed && sum == records * (records - 1) / 2;
+    print_row("deque", format_rate(records, seconds));
+
+    app::DiskQueue queue({directory, SegmentSize, MemoryLimit});
+    passed = passed && queue.open();
+    sum = 0;
+    seconds = measure_seconds([&]() {
+      for (uint64_t i = 0; i < records; ++i) {
+        stamp(record, i);
+        queue.push(record);
+        sum += sequence_of(*queue.front());
+        queue.pop();
+      }
+    });
+    passed = passed && sum == records * (records - 1) / 2 && queue.statistics().spilled == 0;
+    print_row("disk queue",
+              format_rate(records, seconds) + fmt::format("  RAM {} MiB", queue.memory_bytes() >> 20));
+  }
+
+  print_header(
+      fmt::format("outage of {} MiB, RAM threshold {} MiB, then the drain", volume >> 20, MemoryLimit >> 20));
+  {
+    std::deque<std::vector<uint8_t>> deque;
+    auto seconds = measure_seconds([&]() {
+      for (uint64_t i = 0; i < records; ++i) {
+        stamp(record, i);
+        deque.push_back(record);
+      }
+    });
+    print_row("deque enqueue", format_rate(records, seconds) + fmt::format("  RAM {} MiB", volume >> 20));
+    uint64_t expected = 0;
+    bool ordered = true;
+    seconds = measure_seconds([&]() {
+      for (; !deque.empty(); deque.pop_front()) {
+        ordered = ordered && sequence_of(deque.front()) == expected++;
+      }
+    });
+    passed = passed && ordered && expected == records;
+    print_row("deque drain", format_rate(records, seconds));
+
+    app::DiskQueue queue({directory, SegmentSize, MemoryLimit, volume * 2});
+    passed = passed && queue.open();
+    seconds = measure_seconds([&]() {
+      for (uint64_t i = 0; i < records; ++i) {
+        stamp(record, i);
+        queue.push(record);
+      }
+    });
+    print_row("queue enqueue", format_rate(records, seconds) + fmt::format("  RAM {} MiB, files {} MiB",
+                                                                           queue.memory_bytes() >> 20,
+                                                                           queue.disk_bytes() >> 20));
+    uint64_t count = 0;
+    seconds = measure_seconds([&]() { ordered = drain_in_sequence(queue, 0, count); });
+    passed = passed && ordered && count == records && queue.disk_bytes() == 0 && queue.statistics().dropped == 0;
+    print_row("queue drain", format_rate(records, seconds));
+  }
+
+  const uint64_t budget = volume / 4;
+  print_header(fmt::format("outage of {} MiB, disk budget {} MiB", volume >> 20, budget >> 20));
+  {
+    app::DiskQueue queue({directory, SegmentSize, MemoryLimit, budget});
+    passed = passed && queue.open();
+    auto seconds = measure_seconds([&]() {
+      for (uint64_t i = 0; i < records; ++i) {
+        stamp(record, i);
+        queue.push(record);
+      }
+    });
+    const auto& statistics = queue.statistics();
+    passed = passed && queue.disk_bytes() <= budget && statistics.dropped + queue.size() == records;
+    print_row("enqueue", format_rate(records, seconds) +
+                             fmt::format("  files {} MiB, {} oldest records dropped", queue.disk_bytes() >> 20,
+                                         statistics.dropped));
+    uint64_t count = 0;
+    passed = passed && drain_in_sequence(queue, statistics.dropped, count) && count + statistics.dropped == records;
+  }
+
+  print_header("restart with the outage queued");
+  {
+    auto queue =
+        std::make_unique<app::DiskQueue>(app::DiskQueueConfig{directory, SegmentSize, MemoryLimit, volume * 2});
+    passed = passed && queue->open();
+    for (uint64_t i = 0; i < records; ++i) {
+      stamp(record, i);
+      queue->push(record);
+    }
+    auto seconds = measure_seconds([&]() { queue.reset(); });
+    print_row("close", fmt::format("{:8.1f} ms, the segments in RAM written", seconds * 1e3));
+
+    app::DiskQueue reopened({directory, SegmentSize, MemoryLimit, volume * 2});
+    bool opened = false;
+    seconds = measure_seconds([&]() { opened = reopened.open(); });
+    passed = passed && opened && reopened.statistics().recovered == records && reopened.statistics().corrupt == 0;
+    print_row("open", fmt::format("{:8.1f} ms, {} records recovered and checked", seconds * 1e3,
+                                  reopened.statistics().recovered));
+    uint64_t count = 0;
+    seconds = measure_seconds([&]() { passed = drain_in_sequence(reopened, 0, count) && passed; });
+    passed = passed && count == records;
+    print_row("drain", format_rate(count, seconds));
+  }
+
+  std::filesystem::remove_all(directory, error);
+  return passed;
+}
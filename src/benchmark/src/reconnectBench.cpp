@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <algorithm>
+#include <chrono>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "pollScheduler.hpp"
+#include "reconnectManager.hpp"
+// clang-format on
+
+namespace {
+
+/// The time the master is down after it broke all connections
+constexpr int64_t OutageNanoseconds = 1'000'000'000;
+
+/// The round trip of a SYN, also the time to a refused attempt while the master is down
+constexpr int64_t RoundTripNanoseconds = 200'000;
+
+/// The time the master spends on an accepted connection: handshake, session start, interrogation
+constexpr int64_t ServiceNanoseconds = 1'000'000;
+
+/// The accepted connections the master queues, more SYNs are dropped
+constexpr int64_t Backlog = 128;
+
+/// The longest simulated recovery
+constexpr int64_t HorizonNanoseconds = int64_t{600} * 1'000'000'000;
+
+/// The start of the simulated time line
+constexpr int64_t StartNanoseconds = 3'600'000'000'000;
+
+/**
+ * @brief A reconnect policy of a row.
+ */
+struct Policy {
+  const char* label;            ///< label of the row
+  app::ReconnectConfig config;  ///< configuration of the manager
+};
+
+/**
+ * @brief The outcome of an attempt, as seen by the client.
+ */
+struct Outcome {
+  int64_t time;  ///< time the client learns the outcome
+  uint64_t key;  ///< the connection
+  bool success;  ///< established or refused
+
+  bool operator>(const Outcome& other) const {
+    return time > other.time;
+  }
+};
+
+/**
+ * @brief The result of a simulated recovery.
+ */
+struct Run {
+  int64_t allConnected{0};  ///< time from the loss until the last connection, -1 if beyond the horizon
+  uint64_t attempts{0};     ///< attempts of the clients
+  uint64_t refused{0};      ///< attempts refused while the master was down
+  uint64_t dropped{0};      ///< attempts dropped at the full backlog, failed by the connect timeout
+  uint64_t peak{0};         ///< most SYNs at the master in 10 ms
+};
+
+/**
+ * @brief The master station: down during the outage, then one connection after the other, with
+ * a backlog of accepted connections and SYNs dropped beyond it.
+ */
+class Master {
+ public:
+  explicit Master(int64_t up) : m_up(up) {}
+
+  /**
+   * @brief Receives a SYN.
+   * @param key The connection.
+   * @param now The time of the SYN.
+   * @param outcomes Receives the outcome, none for a dropped SYN.
+   * @param run Receives the counters.
+   */
+  void arrive(uint64_t key, int64_t now, std::priority_queue<Outcome, std::vector<Outcome>, std::greater<>>& outcomes,
+              Run& run) {
+    m_meter.record(now);
+    if (now < m_up) {
+      ++run.refused;
+      outcomes.push({now + RoundTripNanoseconds, key, false});
+      return;
+    }
+    if (m_free > now && (m_free - now + ServiceNanoseconds - 1) / ServiceNanoseconds >= Backlog) {
+      ++run.dropped;
+      return;
+    }
+    m_free = std::max(m_free, now) + ServiceNanoseconds;
+    outcomes.push({m_free + RoundTripNanoseconds, key, true});
+  }
+
+  [[nodiscard]] uint64_t peak() const {
+    return m_meter.peak();
+  }
+
+ private:
+  int64_t m_up;             ///< time the master is up again
+  int64_t m_free{0};        ///< time the master finished the queued connections
+  app::BurstMeter m_meter;  ///< SYNs per 10 ms
+};
+
+/**
+ * @brief Simulates the recovery of the connections after the master broke them all at once.
+ * @param peers The number of connections.
+ * @param config The configuration of the manager.
+ * @param manager Receives the latency and recovery metrics.
+ * @return The result.
+ */
+Run simulate(size_t peers, const app::ReconnectConfig& config, app::ReconnectManager& manager) {
+  manager = app::ReconnectManager(config);
+  for (uint64_t key = 0; key < peers; ++key) {
+    manager.add(key, StartNanoseconds);
+    while (manager.next_attempt(StartNanoseconds)) {
+    }
+    manager.connected(key, StartNanoseconds);
+  }
+  manager.reset_metrics();
+  for (uint64_t key = 0; key < peers; ++key) {
+    manager.lost(key, StartNanoseconds);
+  }
+
+  Run run;
+  Master master(StartNanoseconds + OutageNanoseconds);
+  std::priority_queue<Outcome, std::vector<Outcome>, std::greater<>> outcomes;
+  int64_t now = StartNanoseconds;
+  const int64_t end = StartNanoseconds + HorizonNanoseconds;
+  while (manager.established() < peers && now < end) {
+    while (!outcomes.empty() && outcomes.top().time <= now) {
+      const auto outcome = outcomes.top();
+      outcomes.pop();
+      if (outcome.success) {
+        manager.connected(outcome.key, now);
+      } else {
+        manager.failed(outcome.key, now);
+      }
+    }
+    while (manager.next_expired(now)) {
+    }
+    while (auto key = manager.next_attempt(now)) {
+      ++run.attempts;
+      master.arrive(*key, now, outcomes, run);
+    }
+    int64_t next = now + std::chrono::nanoseconds(manager.next_delay(now, std::chrono::seconds(1))).count();
+    if (!outcomes.empty()) {
+      next = std::min(next, outcomes.top().time);
+    }
+    now = std::max(next, now + 1);
+  }
+  run.allConnected = manager.established() == peers ? now - StartNanoseconds : -1;
+  run.peak = master.peak();
+  return run;
+}
+
+/**
+ * @brief Formats the result of a run.
+ * @param run The run.
+ * @param peers The number of connections.
+ * @param manager The manager of the run.
+ * @return The text.
+ */
+std::string format_run(const Run& run, size_t peers, const app::ReconnectManager& manager) {
+  const auto all = run.allConnected < 0 ? std::string("  > 600") : fmt::format("{:7.2f}", run.allConnected / 1e9);
+  return fmt::format("all in {} s, {:5.1f} attempts/peer, {:6} dropped, peak {:5} SYN/10 ms, connect p99 {:6.1f} ms",
+                     all, static_cast<double>(run.attempts) / static_cast<double>(peers), run.dropped, run.peak,
+                     static_cast<double>(manager.connect_latency().percentile(99)) / 1e6);
+}
+
+}  // namespace
+
+/**
+ * @brief Simulates the reconnect storm after the restart of a master station: all connections of the
+ * outstations break at once, the master is down for a second, then it sets up one connection per
+ * millisecond and drops SYNs beyond a backlog of 128, which fail by the connect timeout of a second.
+ * For 100 to 10k connections it compares a fixed retry of a second, exponential and decorrelated
+ * backoff from 100 ms without a limit, and decorrelated backoff with 64 attempts in flight. It
+ * reports the time until all connections are established, the attempts per connection, the dropped
+ * SYNs, the peak SYNs at the master in 10 ms and the 99th percentile of the connect latency.
+ * @param options The options.
+ * @return false if the decorrelated backoff with the limit doesn't connect all peers, drops SYNs,
+ * exceeds the limit or bursts as the fixed retry.
+ */
+bool bench::run_reconnect_benchmark(const Options& options) {
+  const std::vector<size_t> counts = options.quick ? std::vector<size_t>{100, 500, 2'000}
+                                                   : std::vector<size_t>{100, 500, 2'000, 10'000};
+  using std::chrono::milliseconds;
+  using std::chrono::seconds;
+  const Policy policies[] = {
+      {"fixed 1 s", {app::BackoffPolicy::fixed, seconds(1), seconds(1), seconds(1), 0, options.seed}},
+      {"exponential", {app::BackoffPolicy::exponential, milliseconds(100), seconds(30), seconds(1), 0, options.seed}},
+      {"decorrelated", {app::BackoffPolicy::decorrelated, milliseconds(100), seconds(30), seconds(1), 0, options.seed}},
+      {"decorr. limit 64",
+       {app::BackoffPolicy::decorrelated, milliseconds(100), seconds(30), seconds(1), 64, options.seed}},
+  };
+  bool passed = true;
+
+  for (auto peers : counts) {
+    print_header(fmt::format("{} connections lost at once, master down for {} s, {} ms per connection, backlog {}",
+                             peers, OutageNanoseconds / 1'000'000'000, ServiceNanoseconds / 1'000'000, Backlog));
+    uint64_t fixedPeak = 0;
+    for (const auto& policy : policies) {
+      app::ReconnectManager manager;
+      const auto run = simulate(peers, policy.config, manager);
+      bench::print_row(policy.label, format_run(run, peers, manager));
+      if (policy.config.policy == app::BackoffPolicy::fixed) {
+        fixedPeak = run.peak;
+      }
+      if (policy.config.maxConnecting > 0) {
+        passed = passed && run.allConnected >= 0 && run.dropped == 0 && run.peak < fixedPeak &&
+                 manager.statistics().peak <= policy.config.maxConnecting;
+      }
+    }
+  }
+  return passed;
+}
@@ -0,0 +1,306 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "outboundQueue.hpp"
+// clang-format on
+
+namespace {
+
+/// The shortest message, a spontaneous report of one point
+constexpr size_t MinMessageSize = 16;
+
+/// The longest message, a report with a few points
+constexpr size_t MaxMessageSize = 256;
+
+/// The messages of a tick in the order of the rows
+constexpr size_t TickMessages[] = {1, 16, 256};
+
+/**
+ * @brief A connected TCP pair on the loopback interface, the sender without Nagle as the sessions
+ * of the endpoint.
+ */
+struct Connection {
+  int sender{-1};    ///< non-blocking socket of the sender
+  int receiver{-1};  ///< non-blocking socket of the receiver
+
+  Connection() {
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (listener < 0 || bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(listener, 1) < 0 || getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) < 0) {
+      if (listener >= 0) {
+        ::close(listener);
+      }
+      return;
+    }
+    sender = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sender >= 0 && connect(sender, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0) {
+      receiver = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      int enable = 1;
+      setsockopt(sender, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    }
+    ::close(listener);
+  }
+
+  ~Connection() {
+    for (int fd : {sender, receiver}) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+    }
+  }
+
+  Connection(const Connection&) = delete;
+  Connection& operator=(const Connection&) = delete;
+
+  [[nodiscard]] bool is_open() const {
+    return sender >= 0 && receiver >= 0;
+  }
+};
+
+/**
+ * @brief The messages of a run, sliced from one random buffer.
+ */
+struct Messages {
+  std::vector<std::byte> buffer;  ///< contents of all messages
+  std::vector<size_t> sizes;      ///< sizes of the messages in the order of sending
+  uint64_t hash{0};               ///< hash of the byte stream of all messages
+};
+
+/**
+ * @brief The result of a run.
+ */
+struct Run {
+  uint64_t calls{0};     ///< send system calls
+  uint64_t received{0};  ///< bytes received
+  uint64_t hash{0};      ///< hash of the received byte stream
+  double seconds{0.0};   ///< wall time
+};
+
+/**
+ * @brief Continues the FNV-1a hash of a byte stream.
+ * @param hash The hash of the previous bytes.
+ * @param data The bytes.
+ * @return The hash.
+ */
+uint64_t hash_bytes(uint64_t hash, std::span<const std::byte> data) {
+  for (auto byte : data) {
+    hash = (hash ^ static_cast<uint8_t>(byte)) * 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+/// The FNV-1a hash of no bytes
+constexpr uint64_t EmptyHash = 0xCBF29CE484222325ULL;
+
+/**
+ * @brief Creates messages of random sizes and contents.
+ * @param bytes The volume of the messages.
+ * @param random The generator.
+ * @return The messages.
+ */
+Messages make_messages(size_t bytes, bench::Random& random) {
+  Messages messages;
+  messages.buffer.resize(bytes + MaxMessageSize);
+  for (auto& byte : messages.buffer) {
+    byte = static_cast<std::byte>(random.next());
+  }
+  for (size_t total = 0; total < bytes;) {
+    const size_t size = MinMessageSize + random.next() % (MaxMessageSize - MinMessageSize + 1);
+    messages.sizes.push_back(size);
+    total += size;
+  }
+  size_t offset = 0;
+  messages.hash = EmptyHash;
+  for (auto size : messages.sizes) {
+    messages.hash = hash_bytes(messages.hash, std::span(messages.buffer).subspan(offset, size));
+    offset += size;
+  }
+  return messages;
+}
+
+/**
+ * @brief Reads all available bytes of the receiver, the peer of the benchmark.
+ * @param connection The connection.
+ * @param buffer The receive buffer.
+ * @param run Receives the bytes and their hash.
+ */
+void drain(const Connection& connection, std::vector<std::byte>& buffer, Run& run) {
+  for (;;) {
+    auto received = recv(connection.receiver, buffer.data(), buffer.size(), MSG_DONTWAIT);
+    if (received <= 0) {
+      if (received < 0 && errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    run.received += static_cast<uint64_t>(received);
+    run.hash = hash_bytes(run.hash, std::span(buffer).first(static_cast<size_t>(received)));
+  }
+}
+
+/**
+ * @brief Sends every message with its own send, as the endpoint without coalescing.
+ * @param messages The messages.
+ * @param perTick The messages of a tick, the receiver drains after every tick.
+ * @return The result.
+ */
+Run send_each(const Messages& messages, size_t perTick) {
+  Connection connection;
+  Run run{0, 0, EmptyHash, 0.0};
+  if (!connection.is_open()) {
+    return run;
+  }
+  std::vector<std::byte> buffer(size_t{256} << 10);
+  run.seconds = bench::measure_seconds([&]() {
+    size_t offset = 0;
+    for (size_t i = 0; i < messages.sizes.size(); ++i) {
+      auto data = std::span(messages.buffer).subspan(offset, messages.sizes[i]);
+      offset += data.size();
+      while (!data.empty()) {
+        auto sent = ::send(connection.sender, data.data(), data.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        ++run.calls;
+        if (sent < 0) {
+          if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            return;
+          }
+          drain(connection, buffer, run);
+          continue;
+        }
+        data = data.subspan(static_cast<size_t>(sent));
+      }
+      if ((i + 1) % perTick == 0) {
+        drain(connection, buffer, run);
+      }
+    }
+    while (run.received < offset) {
+      drain(connection, buffer, run);
+    }
+  });
+  return run;
+}
+
+/**
+ * @brief Sends the messages through an outbound queue, flushed at the end of every tick.
+ * @param messages The messages.
+ * @param perTick The messages of a tick, the receiver drains after every tick.
+ * @param config The configuration of the queue.
+ * @param statistics Receives the counters of the queue.
+ * @return The result.
+ */
+Run send_coalesced(const Messages& messages, size_t perTick, const app::OutboundQueueConfig& config,
+                   app::OutboundStatistics& statistics) {
+  Connection connection;
+  Run run{0, 0, EmptyHash, 0.0};
+  if (!connection.is_open()) {
+    return run;
+  }
+  std::vector<std::byte> buffer(size_t{256} << 10);
+  app::OutboundQueue queue(config);
+  run.seconds = bench::measure_seconds([&]() {
+    size_t offset = 0;
+    for (size_t i = 0; i < messages.sizes.size(); ++i) {
+      auto data = std::span(messages.buffer).subspan(offset, messages.sizes[i]);
+      offset += data.size();
+      if (!queue.send(connection.sender, data, 0)) {
+        return;
+      }
+      if ((i + 1) % perTick == 0 || i + 1 == messages.sizes.size()) {
+        // the end of the tick, a blocked queue is written when the peer has read
+        auto reason = app::FlushReason::tick;
+        while (queue.flush(connection.sender, reason) == app::FlushResult::blocked) {
+          drain(connection, buffer, run);
+          reason = app::FlushReason::writable;
+        }
+        drain(connection, buffer, run);
+      }
+    }
+    while (run.received < offset) {
+      drain(connection, buffer, run);
+    }
+  });
+  run.calls = queue.statistics().writes;
+  statistics = queue.statistics();
+  return run;
+}
+
+/**
+ * @brief Formats the calls and the throughput of a run.
+ * @param run The run.
+ * @param count The number of messages.
+ * @return The text.
+ */
+std::string format_run(const Run& run, size_t count) {
+  return fmt::format("{:7.3f} calls/msg {:6.2f} M msgs/s {:8.1f} MB/s",
+                     static_cast<double>(run.calls) / static_cast<double>(count),
+                     static_cast<double>(count) / run.seconds / 1e6,
+                     static_cast<double>(run.received) / run.seconds / 1e6);
+}
+
+}  // namespace
+
+/**
+ * @brief Measures the coalescing of outbound messages: the messages of a tick, 16 to 256 bytes of
+ * random size, sent over a loopback TCP connection with one send each against an outbound queue
+ * that writes them with one gathering sendmsg at the end of the tick, for 1, 16 and 256 messages
+ * per tick. The peer reads after every tick on the same thread. A small flush size shows the
+ * flushes at the size inside a tick. It reports the send calls per message and the throughput.
+ * @param options The options.
+ * @return false if a received byte stream differs from the sent one.
+ */
+bool bench::run_send_benchmark(const Options& options) {
+  const size_t volume = options.quick ? (size_t{8} << 20) : (size_t{64} << 20);
+  Random random(options.seed);
+  const auto messages = make_messages(volume, random);
+  const size_t count = messages.sizes.size();
+  bool passed = true;
+
+  for (auto perTick : TickMessages) {
+    print_header(fmt::format("{} messages of {} to {} B, {} per tick", count, MinMessageSize, MaxMessageSize, perTick));
+    const auto each = send_each(messages, perTick);
+    passed = passed && each.hash == messages.hash;
+    print_row("send per message", format_run(each, count));
+
+    app::OutboundStatistics statistics;
+    const auto coalesced = send_coalesced(messages, perTick, {}, statistics);
+    passed = passed && coalesced.hash == messages.hash && statistics.messages == count;
+    print_row("coalesced", format_run(coalesced, count));
+    print_row("speedup", fmt::format("{:7.2f}x fewer calls {:6.2f}x throughput",
+                                     static_cast<double>(each.calls) / static_cast<double>(coalesced.calls),
+                                     each.seconds / coalesced.seconds));
+  }
+
+  print_header("256 messages per tick, flush size 4 KiB");
+  {
+    app::OutboundStatistics statistics;
+    const auto run = send_coalesced(messages, 256, {size_t{4} << 10}, statistics);
+    passed = passed && run.hash == messages.hash;
+    print_row("coalesced", format_run(run, count));
+    print_row("flushes", fmt::format("{} at the size, {} at the tick end, {} blocked", statistics.sizeFlushes,
+                                     statistics.tickFlushes, statistics.blocked));
+  }
+  return passed;
+}
@@ -0,0 +1,264 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "latencyHistogram.hpp"
+#include "soeMerger.hpp"
+// clang-format on
+
+namespace {
+
+/// The reorder window of both merges
+constexpr int64_t WindowNanoseconds = 10'000'000;
+
+/// The forwarding period of the northbound side
+constexpr int64_t TickNanoseconds = 1'000'000;
+
+/// The heartbeat period of a link
+constexpr int64_t HeartbeatNanoseconds = 1'000'000;
+
+/// The events of all links per second
+constexpr int64_t EventRate = 1'000'000;
+
+/**
+ * @brief An event or heartbeat as it arrives from a link.
+ */
+struct Arrival {
+  int64_t arrival;    ///< time of the arrival
+  int64_t timestamp;  ///< time of the event or heartbeat at the source
+  uint32_t source;    ///< link
+  uint32_t point;     ///< point of an event
+  bool heartbeat;     ///< a heartbeat, no event
+};
+
+/**
+ * @brief Generates the arrivals of all links in arrival order. Each link sends in timestamp
+ * order with its own delay plus jitter, so the union arrives out of order.
+ * @param sources The number of links.
+ * @param events The number of events of all links.
+ * @param maxDelay The largest link delay in nanoseconds.
+ * @param random The generator.
+ * @return The arrivals.
+ */
+std::vector<Arrival> generate_arrivals(size_t sources, size_t events, int64_t maxDelay, bench::Random& random) {
+  const int64_t duration = static_cast<int64_t>(events) * 1'000'000'000 / EventRate;
+  const int64_t meanGap = static_cast<int64_t>(sources) * 1'000'000'000 / EventRate;
+  std::vector<Arrival> arrivals;
+  arrivals.reserve(events + sources * static_cast<size_t>(duration / HeartbeatNanoseconds + 1));
+  uint32_t point = 0;
+  for (uint32_t source = 0; source < sources; ++source) {
+    auto delay = static_cast<int64_t>(random.next() % static_cast<uint64_t>(maxDelay));
+    int64_t lastArrival = 0;
+    int64_t heartbeat = HeartbeatNanoseconds;
+    auto send = [&](int64_t timestamp, bool isHeartbeat) {
+      auto jitter = static_cast<int64_t>(random.next() % 50'000);
+      lastArrival = std::max(lastArrival, timestamp + delay + jitter);  // a link doesn't overtake itself
+      arrivals.push_back({lastArrival, timestamp, source, point++, isHeartbeat});
+    };
+    for (int64_t timestamp = 0; timestamp < duration;) {
+      timestamp += 1 + static_cast<int64_t>(random.next() % static_cast<uint64_t>(2 * meanGap));
+      for (; heartbeat < timestamp; heartbeat += HeartbeatNanoseconds) {
+        send(heartbeat, true);
+      }
+      send(timestamp, false);
+    }
+  }
+  // stable, a link keeps the order of its events and heartbeats of equal arrival
+  std::stable_sort(arrivals.begin(), arrivals.end(), [](const Arrival& a, const Arrival& b) {
+    return a.arrival < b.arrival || (a.arrival == b.arrival && a.source < b.source);
+  });
+  return arrivals;
+}
+
+/**
+ * @brief The merge without per-link queues: all events in one vector under a lock, sorted on
+ * every forwarding tick. Without the progress of the links it must wait the full window.
+ */
+struct SortedVector {
+  std::mutex mutex;                   ///< guards the events against the link threads
+  std::vector<app::SoeEvent> events;  ///< pending events
+
+  void push(const app::SoeEvent& event) {
+    std::lock_guard lock(mutex);
+    events.push_back(event);
+  }
+
+  template <typename Sink>
+  void release(int64_t limit, int64_t now, app::LatencyHistogram& hold, Sink&& sink) {
+    std::lock_guard lock(mutex);
+    std::sort(events.begin(), events.end(), [](const app::SoeEvent& a, const app::SoeEvent& b) {
+      return a.timestamp < b.timestamp || (a.timestamp == b.timestamp && a.source < b.source);
+    });
+    auto end = std::find_if(events.begin(), events.end(), [limit](const auto& e) { return e.timestamp > limit; });
+    for (auto it = events.begin(); it != end; ++it) {
+      hold.record(std::chrono::nanoseconds(now - it->arrival));
+      sink(*it);
+    }
+    events.erase(events.begin(), end);
+  }
+};
+
+/**
+ * @brief The order check of a released stream.
+ */
+struct Checksum {
+  uint64_t hash{0};                                   ///< hash over the order of the events
+  uint64_t count{0};                                  ///< released events
+  int64_t last{std::numeric_limits<int64_t>::min()};  ///< timestamp of the last in-order event
+  bool ordered{true};                                 ///< the in-order events never went back
+
+  void add(const app::SoeEvent& event) {
+    ++count;
+    hash = (hash ^ (static_cast<uint64_t>(event.timestamp) * 31 + event.source)) * 0x100000001B3ULL;
+    if (!event.late) {
+      ordered = ordered && event.timestamp >= last;
+      last = event.timestamp;
+    }
+  }
+};
+
+/**
+ * @brief Formats the percentiles of a histogram in microseconds.
+ * @param histogram The histogram.
+ * @return The text.
+ */
+std::string format_hold(const app::LatencyHistogram& histogram) {
+  auto us = [&](double percentile) { return static_cast<double>(histogram.percentile(percentile)) / 1e3; };
+  return fmt::format("hold p50 {:7.1f} us  p99 {:7.1f} us", us(50), us(99));
+}
+
+/**
+ * @brief Feeds the arrivals tick by tick into the k-way merger.
+ * @param arrivals The arrivals.
+ * @param sources The number of links.
+ * @param policy The handling of late events.
+ * @param checksum Receives the released events.
+ * @param seconds Receives the time of the merge.
+ * @return The merger after the final flush, for its statistics.
+ */
+app::SoeMerger run_merger(const std::vector<Arrival>& arrivals, size_t sources, app::SoeLatePolicy policy,
+                          Checksum& checksum, double& seconds) {
+  app::SoeMerger merger({std::chrono::nanoseconds(WindowNanoseconds), policy});
+  for (size_t source = 0; source < sources; ++source) {
+    merger.add_source();
+  }
+  auto sink = [&checksum](const app::SoeEvent& event) { checksum.add(event); };
+  seconds = bench::measure_seconds([&]() {
+    int64_t now = 0;
+    for (size_t next = 0; next < arrivals.size();) {
+      now += TickNanoseconds;
+      for (; next < arrivals.size() && arrivals[next].arrival <= now; ++next) {
+        const auto& input = arrivals[next];
+        if (input.heartbeat) {
+          merger.advance(input.source, input.timestamp);
+        } else {
+          app::SoeEvent event;
+          event.timestamp = input.timestamp;
+          event.point = input.point;
+          merger.push(input.source, event, input.arrival);
+        }
+      }
+      merger.release(now, sink);
+    }
+    merger.flush(now, sink);
+  });
+  return merger;
+}
+
+}  // namespace
+
+/**
+ * @brief Measures the merge of the event streams of 8 to 512 links into one stream in timestamp
+ * order: the k-way merger with per-link queues and watermarks against one vector sorted under a
+ * lock on every tick. Both must forward the same sequence; the hold time is the latency the merge
+ * adds. A run with a link slower than the window shows the late events.
+ * @param options The options.
+ * @return false if the merges forward different sequences or the merger goes back in time.
+ */
+bool bench::run_soe_benchmark(const Options& options) {
+  const size_t events = options.quick ? 200'000 : 2'000'000;
+  Random random(options.seed);
+  bool passed = true;
+
+  for (size_t sources : {8, 64, 512}) {
+    auto arrivals = generate_arrivals(sources, events, 4'000'000, random);
+
+    Checksum sorted;
+    SortedVector vector;
+    app::LatencyHistogram vectorHold;
+    auto sortedSeconds = measure_seconds([&]() {
+      int64_t now = 0;
+      auto sink = [&sorted](const app::SoeEvent& event) { sorted.add(event); };
+      for (size_t next = 0; next < arrivals.size();) {
+        now += TickNanoseconds;
+        for (; next < arrivals.size() && arrivals[next].arrival <= now; ++next) {
+          const auto& input = arrivals[next];
+          if (!input.heartbeat) {
+            app::SoeEvent event;
+            event.timestamp = input.timestamp;
+            event.arrival = input.arrival;
+            event.point = input.point;
+            event.source = static_cast<uint16_t>(input.source);
+            vector.push(event);
+          }
+        }
+        vector.release(now - WindowNanoseconds, now, vectorHold, sink);
+      }
+      vector.release(std::numeric_limits<int64_t>::max(), now, vectorHold, sink);
+    });
+
+    Checksum merged;
+    double mergedSeconds{0};
+    auto merger = run_merger(arrivals, sources, app::SoeLatePolicy::forward, merged, mergedSeconds);
+
+    passed = passed && merged.ordered && sorted.ordered && merged.count == sorted.count &&
+             merged.hash == sorted.hash && merger.statistics().late == 0;
+    print_header(
+        fmt::format("{} links, {} events, window {} ms", sources, merged.count, WindowNanoseconds / 1'000'000));
+    auto rate = [](const Checksum& checksum, double seconds) {
+      return static_cast<double>(checksum.count) / seconds / 1e6;
+    };
+    print_row("sorted vector",
+              fmt::format("{:6.1f} M events/s  {}", rate(sorted, sortedSeconds), format_hold(vectorHold)));
+    print_row("k-way merge",
+              fmt::format("{:6.1f} M events/s  {}", rate(merged, mergedSeconds), format_hold(merger.hold_time())));
+  }
+
+  // one link 15 ms behind the others, beyond the window: its events come after newer ones left
+  auto arrivals = generate_arrivals(64, events, 4'000'000, random);
+  for (auto& input : arrivals) {
+    if (input.source == 0) {
+      input.arrival += 15'000'000;
+    }
+  }
+  std::stable_sort(arrivals.begin(), arrivals.end(), [](const Arrival& a, const Arrival& b) {
+    return a.arrival < b.arrival;
+  });
+  print_header("64 links, one 15 ms behind");
+  for (auto policy : {app::SoeLatePolicy::forward, app::SoeLatePolicy::drop}) {
+    Checksum checksum;
+    double seconds{0};
+    auto merger = run_merger(arrivals, 64, policy, checksum, seconds);
+    const auto& statistics = merger.statistics();
+    passed = passed && checksum.ordered && statistics.late > 0 &&
+             checksum.count == statistics.received - statistics.dropped;
+    print_row(policy == app::SoeLatePolicy::forward ? "late forwarded" : "late dropped",
+              fmt::format("{:6.1f} M events/s  {} of {} events late  {}",
+                          static_cast<double>(checksum.count) / seconds / 1e6, statistics.late, statistics.received,
+                          format_hold(merger.hold_time())));
+  }
+  return passed;
+}
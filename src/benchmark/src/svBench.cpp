@@ -0,0 +1,359 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <unistd.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "pcapReader.hpp"
+#include "pointDatabase.hpp"
+#include "sampledValues.hpp"
+// clang-format on
+
+namespace {
+
+/// The merging units of the synthetic capture, one stream each
+constexpr size_t Streams = 8;
+
+/// The sample rate of a stream, 80 samples per cycle at 50 Hz as in 9-2LE
+constexpr size_t SampleRate = 4000;
+
+/// The channels of a 9-2LE dataset: 4 currents and 4 voltages
+constexpr size_t Channels = 8;
+
+/// The decoded ASDUs applied to the point database at once
+constexpr size_t BatchAsdus = 256;
+
+/**
+ * @brief Gets the value of a channel in the synthetic capture.
+ * @param stream The stream.
+ * @param sample The sample.
+ * @param channel The channel.
+ * @return The value.
+ */
+int32_t sample_value(size_t stream, size_t sample, size_t channel) {
+  return static_cast<int32_t>((sample * 7 + channel * 1000 + stream * 13) % 100000) - 50000;
+}
+
+/**
+ * @brief Appends a BER tag and length.
+ * @param out The output.
+ * @param tag The tag.
+ * @param length The length of the contents.
+ */
+void put_tag(std::vector<uint8_t>& out, uint8_t tag, size_t length) {
+  out.push_back(tag);
+  if (length < 0x80) {
+    out.push_back(static_cast<uint8_t>(length));
+  } else if (length < 0x100) {
+    out.push_back(0x81);
+    out.push_back(static_cast<uint8_t>(length));
+  } else {
+    out.push_back(0x82);
+    out.push_back(static_cast<uint8_t>(length >> 8));
+    out.push_back(static_cast<uint8_t>(length));
+  }
+}
+
+/**
+ * @brief Appends a big-endian integer.
+ * @param out The output.
+ * @param value The value.
+ * @param bytes The number of bytes.
+ */
+void put_be(std::vector<uint8_t>& out, uint64_t value, size_t bytes) {
+  for (size_t i = bytes; i-- > 0;) {
+    out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+/**
+ * @brief Builds a VLAN tagged Sampled Values frame.
+ * @param stream The stream.
+ * @param firstSample The sample of the first ASDU.
+ * @param asdus The ASDUs of the frame.
+ * @return The frame.
+ */
+std::vector<uint8_t> build_frame(size_t stream, size_t firstSample, size_t asdus) {
+  std::vector<uint8_t> sequence;
+  for (size_t asdu = 0; asdu < asdus; ++asdu) {
+    auto sample = firstSample + asdu;
+    std::vector<uint8_t> fields;
+    auto svId = fmt::format("MU{:02}01/LLN0$MS$SV", stream + 1);
+    put_tag(fields, 0x80, svId.size());
+    fields.insert(fields.end(), svId.begin(), svId.end());
+    put_tag(fields, 0x82, 2);
+    put_be(fields, sample % SampleRate, 2);
+    put_tag(fields, 0x83, 4);
+    put_be(fields, 1, 4);
+    put_tag(fields, 0x85, 1);
+    fields.push_back(2);
+    put_tag(fields, 0x87, Channels * 8);
+    for (size_t channel = 0; channel < Channels; ++channel) {
+      put_be(fields, static_cast<uint32_t>(sample_value(stream, sample, channel)), 4);
+      put_be(fields, 0, 4);
+    }
+    put_tag(sequence, 0x30, fields.size());
+    sequence.insert(sequence.end(), fields.begin(), fields.end());
+  }
+  std::vector<uint8_t> pdu;
+  put_tag(pdu, 0x80, 1);
+  pdu.push_back(static_cast<uint8_t>(asdus));
+  put_tag(pdu, 0xA2, sequence.size());
+  pdu.insert(pdu.end(), sequence.begin(), sequence.end());
+
+  auto unit = static_cast<uint8_t>(stream + 1);
+  std::vector<uint8_t> frame{0x01, 0x0C, 0xCD, 0x04, 0x00, unit, 0x00, 0x50, 0xC2, 0x4F, 0x90, unit};
+  put_be(frame, 0x8100, 2);
+  put_be(frame, 0x8000, 2);
+  put_be(frame, 0x88BA, 2);
+  put_be(frame, 0x4000 + stream, 2);
+  std::vector<uint8_t> savPdu;
+  put_tag(savPdu, 0x60, pdu.size());
+  savPdu.insert(savPdu.end(), pdu.begin(), pdu.end());
+  put_be(frame, savPdu.size() + 8, 2);
+  put_be(frame, 0, 4);
+  frame.insert(frame.end(), savPdu.begin(), savPdu.end());
+  return frame;
+}
+
+/**
+ * @brief Appends a little-endian integer.
+ * @param out The output.
+ * @param value The value.
+ * @param bytes The number of bytes.
+ */
+void put_le(std::vector<uint8_t>& out, uint64_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) {
+    out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+/**
+ * @brief Writes a synthetic capture: the streams interleaved at the sample rate.
+ * @param path The file.
+ * @param format pcap with nanosecond timestamps or pcapng with one Ethernet interface.
+ * @param seconds The duration of the capture.
+ * @param asdusPerFrame The ASDUs of each frame.
+ * @return The number of frames.
+ */
+size_t write_capture(const std::filesystem::path& path, app::PcapFormat format, size_t seconds, size_t asdusPerFrame) {
+  std::vector<uint8_t> out;
+  if (format == app::PcapFormat::pcap) {
+    put_le(out, 0xA1B23C4D, 4);
+    put_le(out, 2, 2);
+    put_le(out, 4, 2);
+    put_le(out, 0, 8);
+    put_le(out, 65535, 4);
+    put_le(out, app::PcapReader::LinkTypeEthernet, 4);
+  } else {
+    put_le(out, 0x0A0D0D0A, 4);
+    put_le(out, 28, 4);
+    put_le(out, 0x1A2B3C4D, 4);
+    put_le(out, 1, 2);
+    put_le(out, 0, 2);
+    put_le(out, UINT64_MAX, 8);
+    put_le(out, 28, 4);
+    // interface with if_tsresol 9: nanoseconds
+    put_le(out, 1, 4);
+    put_le(out, 32, 4);
+    put_le(out, app::PcapReader::LinkTypeEthernet, 2);
+    put_le(out, 0, 2);
+    put_le(out, 65535, 4);
+    put_le(out, 9, 2);
+    put_le(out, 1, 2);
+    put_le(out, 9, 4);
+    put_le(out, 0, 4);
+    put_le(out, 32, 4);
+  }
+
+  const uint64_t start = 1'700'000'000'000'000'000;
+  size_t frames{0};
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  for (size_t sample = 0; sample < seconds * SampleRate; sample += asdusPerFrame) {
+    for (size_t stream = 0; stream < Streams; ++stream) {
+      auto frame = build_frame(stream, sample, asdusPerFrame);
+      auto timestamp = start + sample * 1'000'000'000 / SampleRate + stream * 1000;
+      if (format == app::PcapFormat::pcap) {
+        put_le(out, timestamp / 1'000'000'000, 4);
+        put_le(out, timestamp % 1'000'000'000, 4);
+        put_le(out, frame.size(), 4);
+        put_le(out, frame.size(), 4);
+        out.insert(out.end(), frame.begin(), frame.end());
+      } else {
+        auto padded = (frame.size() + 3) & ~size_t{3};
+        put_le(out, 6, 4);
+        put_le(out, 32 + padded, 4);
+        put_le(out, 0, 4);
+        put_le(out, timestamp >> 32, 4);
+        put_le(out, timestamp & 0xFFFFFFFF, 4);
+        put_le(out, frame.size(), 4);
+        put_le(out, frame.size(), 4);
+        out.insert(out.end(), frame.begin(), frame.end());
+        out.resize(out.size() + padded - frame.size(), 0);
+        put_le(out, 32 + padded, 4);
+      }
+      frames++;
+    }
+    if (out.size() > 1024 * 1024) {
+      file.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+      out.clear();
+    }
+  }
+  file.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+  return file.good() ? frames : 0;
+}
+
+/**
+ * @brief The result of an ingestion run.
+ */
+struct IngestResult {
+  size_t frames{0};                          ///< frames read
+  size_t bytes{0};                           ///< captured bytes read
+  app::SampledValuesDecoder::Statistics sv;  ///< decoder statistics
+  double scanSeconds{0};                     ///< time to iterate the frames
+  double decodeSeconds{0};                   ///< time to iterate, decode and apply the frames
+};
+
+/**
+ * @brief Reads a capture once without decoding and once into the point database.
+ * @param path The capture.
+ * @param points The point database.
+ * @param decoder Receives the streams.
+ * @return The result, no frames if the file can't be read.
+ */
+IngestResult ingest(const std::filesystem::path& path, app::PointDatabase& points, app::SampledValuesDecoder& decoder) {
+  IngestResult result;
+  app::PcapReader reader;
+  if (!reader.open(path)) {
+    return result;
+  }
+  result.scanSeconds = bench::measure_seconds([&]() {
+    while (auto frame = reader.next()) {
+      result.frames++;
+      result.bytes += frame->data.size();
+      bench::do_not_optimize(frame->data[0]);
+    }
+  });
+  reader.rewind();
+  result.decodeSeconds = bench::measure_seconds([&]() {
+    while (auto frame = reader.next()) {
+      if (frame->linkType == app::PcapReader::LinkTypeEthernet) {
+        decoder.decode_frame(frame->data, frame->timestamp.count());
+        if (decoder.batch().size() >= BatchAsdus) {
+          decoder.apply(points);
+        }
+      }
+    }
+    decoder.apply(points);
+  });
+  result.sv = decoder.statistics();
+  return result;
+}
+
+/**
+ * @brief Prints the rates of an ingestion run.
+ * @param label The label.
+ * @param result The result.
+ */
+void print_result(std::string_view label, const IngestResult& result) {
+  auto asdus = static_cast<double>(std::max<uint64_t>(result.sv.asdus, 1));
+  bench::print_row(label, fmt::format("{:8.2f} Mframes/s scan  {:7.2f} Mframes/s decode  {:6.1f} ns/ASDU  {:.2f} GB/s",
+                                      static_cast<double>(result.frames) / result.scanSeconds / 1e6,
+                                      static_cast<double>(result.frames) / result.decodeSeconds / 1e6,
+                                      result.decodeSeconds * 1e9 / asdus,
+                                      static_cast<double>(result.bytes) / result.decodeSeconds / 1e9));
+}
+
+/**
+ * @brief Checks the last sample of every synthetic stream in the point database.
+ * @param points The point database.
+ * @param decoder The decoder.
+ * @param lastSample The last sample of the capture.
+ * @return true if all values match.
+ */
+bool check_points(const app::PointDatabase& points, const app::SampledValuesDecoder& decoder, size_t lastSample) {
+  for (const auto& stream : decoder.streams()) {
+    // the svID "MUss01/..." names the stream of the generator
+    auto index = static_cast<size_t>(std::stoul(stream.svId.substr(2, 2))) - 1;
+    for (size_t channel = 0; channel < Channels; ++channel) {
+      if (points.values()[stream.firstPoint + channel] != sample_value(index, lastSample, channel)) {
+        return false;
+      }
+    }
+  }
+  return decoder.streams().size() == Streams;
+}
+
+}  // namespace
+
+/**
+ * @brief Measures the offline ingestion of Sampled Values captures: iterating the mapped frames,
+ * and decoding them into the point database. Synthetic pcap and pcapng captures of 8 merging units
+ * are generated; a capture given with --capture is measured as well.
+ * @param options The options.
+ * @return false if a synthetic capture didn't decode into the expected points.
+ */
+bool bench::run_sv_benchmark(const Options& options) {
+  const size_t seconds = options.quick ? 1 : 10;
+  auto directory = std::filesystem::temp_directory_path();
+  bool passed = true;
+
+  print_header(fmt::format("{} merging units, {} samples/s, {} s of samples", Streams, SampleRate, seconds));
+  struct Scenario {
+    std::string_view label;
+    app::PcapFormat format;
+    size_t asdusPerFrame;
+  };
+  for (const auto& scenario : {Scenario{"pcap 1 ASDU", app::PcapFormat::pcap, 1},
+                               Scenario{"pcapng 1 ASDU", app::PcapFormat::pcapng, 1},
+                               Scenario{"pcap 8 ASDU", app::PcapFormat::pcap, 8}}) {
+    auto path = directory / fmt::format("daemonBench-sv-{}.{}", getpid(), app::to_string(scenario.format));
+    auto frames = write_capture(path, scenario.format, seconds, scenario.asdusPerFrame);
+    app::PointDatabase points;
+    app::SampledValuesDecoder decoder;
+    if (frames == 0 || !points.reserve(Streams * Channels)) {
+      print_row(scenario.label, "capture can't be written");
+      std::filesystem::remove(path);
+      passed = false;
+      continue;
+    }
+    auto result = ingest(path, points, decoder);
+    std::filesystem::remove(path);
+    print_result(scenario.label, result);
+    passed = passed && result.frames == frames && result.sv.malformed == 0 &&
+             result.sv.asdus == frames * scenario.asdusPerFrame &&
+             check_points(points, decoder, seconds * SampleRate - 1);
+  }
+
+  if (!options.capture.empty()) {
+    print_header(fmt::format("capture {}", options.capture));
+    app::PointDatabase points;
+    app::SampledValuesDecoder decoder;
+    if (!points.reserve(64 * 1024)) {
+      return false;
+    }
+    auto result = ingest(options.capture, points, decoder);
+    if (result.frames == 0) {
+      print_row("capture", "can't be read");
+      return false;
+    }
+    print_result("capture", result);
+    print_row("frames", fmt::format("{} ({} Sampled Values, {} malformed), {} ASDUs, {} streams", result.frames,
+                                    result.sv.svFrames, result.sv.malformed, result.sv.asdus,
+                                    decoder.streams().size()));
+  }
+  return passed;
+}
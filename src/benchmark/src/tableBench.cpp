@@ -0,0 +1,269 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "concurrentTable.hpp"
+// clang-format on
+
+namespace {
+
+/// The sessions of a large gateway: peers, links and common addresses
+constexpr size_t Sessions = 10'000;
+
+/// The read shares of the mixes in per mille, frames are looked up far more often than sessions change
+constexpr std::array<unsigned, 3> ReadPermille = {1000, 990, 900};
+
+/**
+ * @brief The state of a session a received frame needs, written as a whole by a writer.
+ */
+struct Session {
+  uint64_t peer{0};                 ///< IPv4 address and port of the peer
+  uint64_t sequence{0};             ///< number of the last update
+  uint32_t link{0};                 ///< link id
+  uint16_t commonAddress{0};        ///< common address of the station
+  std::array<uint64_t, 4> state{};  ///< counters and timers of the session
+  uint64_t check{0};                ///< checksum of the fields, a torn read breaks it
+
+  /**
+   * @brief Makes the session of a peer after an update.
+   * @param key The peer.
+   * @param update The number of the update.
+   * @return The session.
+   */
+  static Session make(uint64_t key, uint64_t update) {
+    Session session;
+    session.peer = key;
+    session.sequence = update;
+    session.link = static_cast<uint32_t>(key % 4096);
+    session.commonAddress = static_cast<uint16_t>(key % 65535 + 1);
+    session.state.fill(update * 3);
+    session.check = session.checksum();
+    return session;
+  }
+
+  /// @return checksum of the fields
+  [[nodiscard]] uint64_t checksum() const {
+    return peer * 0x9E3779B97F4A7C15ULL ^ sequence ^ link ^ commonAddress ^ state[0] ^ state[3];
+  }
+};
+
+/**
+ * @brief std::unordered_map behind a std::shared_mutex, readers share the lock.
+ */
+struct LockedRegistry {
+  static constexpr std::string_view Name = "shared_mutex";
+
+  mutable std::shared_mutex mutex;
+  std::unordered_map<uint64_t, Session> sessions;
+
+  template <typename Visit>
+  bool visit(uint64_t key, Visit&& function) const {
+    std::shared_lock lock(mutex);
+    auto it = sessions.find(key);
+    if (it == sessions.end()) {
+      return false;
+    }
+    function(it->second);
+    return true;
+  }
+
+  void assign(uint64_t key, const Session& session) {
+    std::unique_lock lock(mutex);
+    sessions.insert_or_assign(key, session);
+  }
+
+  void erase(uint64_t key) {
+    std::unique_lock lock(mutex);
+    sessions.erase(key);
+  }
+
+  [[nodiscard]] size_t size() const {
+    std::shared_lock lock(mutex);
+    return sessions.size();
+  }
+};
+
+/**
+ * @brief The concurrent table, readers don't lock.
+ */
+struct TableRegistry {
+  static constexpr std::string_view Name = "table";
+
+  app::ConcurrentTable<Session> sessions;
+
+  template <typename Visit>
+  bool visit(uint64_t key, Visit&& function) const {
+    return sessions.visit(key, std::forward<Visit>(function));
+  }
+
+  void assign(uint64_t key, const Session& session) {
+    sessions.insert_or_assign(key, session);
+  }
+
+  void erase(uint64_t key) {
+    sessions.erase(key);
+  }
+
+  [[nodiscard]] size_t size() const {
+    return sessions.size();
+  }
+};
+
+/**
+ * @brief The result of a mix.
+ */
+struct MixResult {
+  double rate{0};      ///< operations per second of all threads
+  uint64_t torn{0};    ///< lookups that saw a mix of two updates
+  uint64_t missed{0};  ///< lookups of a session that was closed at the moment
+};
+
+/**
+ * @brief Generates the peers, IPv4 addresses of a few subnets with their source ports.
+ * @param seed The seed.
+ * @return The peers.
+ */
+std::vector<uint64_t> make_peers(uint64_t seed) {
+  bench::Random random(seed);
+  std::vector<uint64_t> peers;
+  std::unordered_set<uint64_t> seen;
+  while (peers.size() < Sessions) {
+    uint64_t address = 0x0A000000 | (random.next() % 16) << 8 | random.next() % 256;
+    uint64_t peer = address << 16 | (1024 + random.next() % 64512);
+    if (seen.insert(peer).second) {
+      peers.push_back(peer);
+    }
+  }
+  return peers;
+}
+
+/**
+ * @brief Runs a mix of lookups and updates on threads: a write replaces a session, or closes and
+ * reopens it.
+ * @param registry The registry, filled with the peers.
+ * @param peers The peers.
+ * @param threads The number of threads.
+ * @param operations The operations per thread.
+ * @param readPermille The share of lookups in per mille.
+ * @param seed The seed.
+ * @return The result.
+ */
+template <typename Registry>
+MixResult run_mix(Registry& registry, const std::vector<uint64_t>& peers, size_t threads, uint64_t operations,
+                  unsigned readPermille, uint64_t seed) {
+  MixResult result;
+  std::atomic<uint64_t> torn{0};
+  std::atomic<uint64_t> missed{0};
+  std::atomic<uint64_t> update{Sessions};
+
+  auto seconds = bench::measure_seconds([&]() {
+    std::vector<std::jthread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+      workers.emplace_back([&, t]() {
+        bench::Random random(seed + t);
+        uint64_t localTorn{0};
+        uint64_t localMissed{0};
+        uint64_t sum{0};
+        for (uint64_t i = 0; i < operations; ++i) {
+          auto pick = random.next();
+          auto peer = peers[(pick >> 16) % peers.size()];
+          if (pick % 1000 < readPermille) {
+            bool found = registry.visit(peer, [&](const Session& session) {
+              localTorn += session.peer != peer || session.check != session.checksum();
+              sum += session.link + session.commonAddress;
+            });
+            localMissed += !found;
+          } else if (pick & 0x8000) {
+            registry.assign(peer, Session::make(peer, update.fetch_add(1, std::memory_order_relaxed)));
+          } else {
+            registry.erase(peer);
+            registry.assign(peer, Session::make(peer, update.fetch_add(1, std::memory_order_relaxed)));
+          }
+        }
+        bench::do_not_optimize(sum);
+        torn.fetch_add(localTorn, std::memory_order_relaxed);
+        missed.fetch_add(localMissed, std::memory_order_relaxed);
+      });
+    }
+  });
+  result.rate = static_cast<double>(threads * operations) / seconds;
+  result.torn = torn.load();
+  result.missed = missed.load();
+  return result;
+}
+
+/**
+ * @brief Fills a registry with the sessions of the peers.
+ * @param registry The registry.
+ * @param peers The peers.
+ */
+template <typename Registry>
+void fill(Registry& registry, const std::vector<uint64_t>& peers) {
+  for (size_t index = 0; index < peers.size(); ++index) {
+    registry.assign(peers[index], Session::make(peers[index], index));
+  }
+}
+
+}  // namespace
+
+/**
+ * @brief Compares the concurrent table with std::unordered_map behind a std::shared_mutex: session
+ * lookups by peer on 1..n threads with 100, 99 and 90 % reads.
+ * @param options The options.
+ * @return false if a lookup saw a torn session, a session got lost or no node was freed.
+ */
+bool bench::run_table_benchmark(const Options& options) {
+  const uint64_t operations = options.quick ? 1'000'000 : 10'000'000;
+  const auto peers = make_peers(options.seed);
+  bool passed{true};
+
+  LockedRegistry locked;
+  TableRegistry table;
+  fill(locked, peers);
+  fill(table, peers);
+
+  for (auto readPermille : ReadPermille) {
+    print_header(fmt::format("{} sessions, {:.0f} % lookups, {} % updates, Mops/s", Sessions, readPermille / 10.0,
+                             (1000 - readPermille) / 10.0));
+    for (size_t threads = 1; threads <= options.threads; threads *= 2) {
+      auto lockedResult = run_mix(locked, peers, threads, operations / threads, readPermille, options.seed);
+      auto tableResult = run_mix(table, peers, threads, operations / threads, readPermille, options.seed);
+      print_row(fmt::format("{} thread{}", threads, threads > 1 ? "s" : ""),
+                fmt::format("{} {:7.2f}   {} {:7.2f}   {:.2f}x   missed {:.3f} %", LockedRegistry::Name,
+                            lockedResult.rate / 1e6, TableRegistry::Name, tableResult.rate / 1e6,
+                            tableResult.rate / lockedResult.rate,
+                            100.0 * static_cast<double>(tableResult.missed) / static_cast<double>(operations)));
+      passed = passed && lockedResult.torn == 0 && tableResult.torn == 0;
+      passed = passed && locked.size() == Sessions && table.size() == Sessions;
+    }
+  }
+
+  table.sessions.reclaim();
+  auto stats = table.sessions.statistics();
+  print_header("table");
+  print_row("layout", fmt::format("{} sessions in {} buckets, {} stripes", table.size(), table.sessions.buckets(),
+                                  table.sessions.stripes()));
+  print_row("writes", fmt::format("{} inserts, {} updates, {} erases, {} grows", stats.inserts, stats.updates,
+                                  stats.erases, stats.grows));
+  print_row("reclamation", fmt::format("{} retired, {} freed, {} waiting", stats.retired, stats.reclaimed,
+                                       stats.retired - stats.reclaimed));
+  passed = passed && stats.reclaimed > 0;
+  return passed;
+}
@@ -15,11 +15,22 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <filesystem>
+#include <memory>
 #include <mutex>
 
+#include "addressMap.hpp"
+#include "alarmEngine.hpp"
 #include "appContextBase.hpp"
+#include "expressionEngine.hpp"
+#include "forkSnapshot.hpp"
+#include "ioEndpoint.hpp"
+#include "pointDatabase.hpp"
+#include "pollScheduler.hpp"
+#include "redundancyLink.hpp"
+#include "trafficCapture.hpp"
 
 namespace app {
 
@@ -28,9 +39,98 @@ namespace app {
  */
 class AppContext : public IAppContext {
   // Private Variables
-  std::filesystem::path m_pathConfigFile;    ///< The path of the configuration file
-  std::filesystem::path m_pathConfigFolder;  ///< The path of the configuration folder
-  std::filesystem::path m_pathLogFile;       ///< The path of the log file
+  std::filesystem::path m_pathConfigFile;              ///< The path of the configuration file
+  std::filesystem::path m_pathConfigFolder;            ///< The path of the configuration folder
+  std::filesystem::path m_pathLogFile;                 ///< The path of the log file
+  std::string m_listenAddress;                         ///< The listen address of the I/O endpoint
+  std::filesystem::path m_pathCaptureFile;             ///< The path of the traffic capture file
+  IoEndpoint m_endpoint;                               ///< The I/O endpoint of the context
+  TrafficCaptureWriter m_capture;                      ///< The capture of received traffic
+  bool m_busyPolling{false};                           ///< The task busy-polls the endpoint
+  std::optional<RedundancyConfig> m_redundancyConfig;  ///< The hot-standby configuration, none for a single node
+  PointDatabase m_points;                              ///< The points of the context, replicated to the standby
+  RedundancyLink m_redundancy{m_points};               ///< The link to the redundant peer
+  std::filesystem::path m_pathSnapshotFile;            ///< The path of the snapshot file
+  ForkSnapshot m_snapshot;                             ///< The snapshot child of the context task
+  std::atomic<bool> m_snapshotRequested{false};        ///< A signal requested a snapshot
+  std::filesystem::path m_pathMappingFile;             ///< The path of the address mapping file
+  bool m_mappingLoaded{false};                         ///< The mapping file was loaded at start
+  AddressMap m_addressMap;                             ///< The address map of the context task
+  std::mutex m_mappingMutex;                           ///< Guards the handover of a reloaded map
+  std::unique_ptr<AddressMap> m_pendingMapping;        ///< A reloaded map, not yet taken by the task
+  std::atomic<bool> m_mappingPending{false};           ///< A reloaded map waits for the task
+  uint64_t m_unmappedValues{0};                        ///< Received values without a mapping
+  std::filesystem::path m_pathExpressionFile;          ///< The path of the formulas of the computed points
+  ExpressionEngine m_expressions;                      ///< The computed points of the context task
+  std::filesystem::path m_pathAlarmFile;               ///< The path of the limit alarms
+  AlarmEngine m_alarms;                                ///< The limit alarms of the context task
+  uint64_t m_alarmEvents{0};                           ///< Alarm transitions delivered to the log
+  std::chrono::milliseconds m_pollPeriod{0};           ///< The interrogation period of the sessions, 0 for none
+  PollScheduler m_polls;                               ///< The interrogations of the sessions
+  OutboundQueueConfig m_coalescing{0};                 ///< The coalescing of the sends, none by default
+  std::vector<ActivatedSocket> m_activatedSockets;     ///< The activated sockets, kept open for every open
+
+  /// The maximal time the application task waits for I/O events
+  static constexpr std::chrono::milliseconds IoPollInterval{50};
+
+  /// The time a receive of a busy-polling task polls the device queue (SO_BUSY_POLL)
+  static constexpr std::chrono::microseconds SocketBusyPoll{50};
+
+  /// The points of the example converter, one per session slot
+  static constexpr size_t ContextPoints{4096};
+
+  /**
+   * @brief Opens the I/O endpoint, on a redundant node only while active.
+   * @return true if the endpoint is open, otherwise false.
+   */
+  [[nodiscard]] bool open_endpoint();
+
+  /**
+   * @brief Opens the endpoint when the node becomes active and closes it when it becomes standby.
+   * @param previous The previous role.
+   * @param role The new role.
+   */
+  void change_redundancy_role(RedundancyRole previous, RedundancyRole role);
+
+  /**
+   * @brief Starts a requested snapshot and reports a finished one, called by the context task.
+   */
+  void process_snapshot();
+
+  /**
+   * @brief Compiles the mapping file and hands the map to the context task.
+   * @return true if compiled, otherwise false; the task keeps its map then.
+   */
+  bool load_mapping();
+
+  /**
+   * @brief Takes a reloaded map, called by the context task.
+   */
+  void process_mapping();
+
+  /**
+   * @brief Evaluates the computed points and the alarms of the changed points, called by the context task.
+   */
+  void process_points();
+
+  /**
+   * @brief Clears the changed bits of the points unless the redundancy link consumed them, called by the context task.
+   */
+  void release_changes();
+
+  /**
+   * @brief Sends the due interrogations of the sessions, called by the context task.
+   * @param limit The longest delay to return.
+   * @return The earlier of the limit and the time until the next interrogation.
+   */
+  std::chrono::milliseconds poll_sessions(std::chrono::milliseconds limit);
+
+  /**
+   * @brief Writes the points and the context state, runs in the snapshot child.
+   * @param sink The output.
+   * @return true if written, otherwise false.
+   */
+  bool write_snapshot(SnapshotSink& sink) const;
 
  public:
   /// constructor
@@ -46,6 +146,14 @@ class AppContext : public IAppContext {
    */
   [[nodiscard]] std::optional<bool> validate_configuration(const app::DaemonConfig& config) override;
 
+  /**
+   * @brief Hands the sockets of a socket activation to the context, before the configuration is validated.
+   * The endpoint opens on duplicates of them instead of the listen address; a closed endpoint, e.g.
+   * of a node that became standby, reopens on them again.
+   * @param sockets The sockets of the context name, the context owns them.
+   */
+  void adopt_sockets(std::vector<ActivatedSocket> sockets);
+
   /**
    * @brief Process everything before reconfiguring the application.
    * @return std::optional<bool> true if the process completes successfully, otherwise false.
@@ -94,6 +202,12 @@ class AppContext : public IAppContext {
    */
   [[nodiscard]] std::chrono::milliseconds process_executing(const std::chrono::milliseconds& min_duration) override;
 
+  /**
+   * @brief polls the endpoint once without blocking.
+   * @return true if the poll processed I/O events.
+   */
+  [[nodiscard]] bool process_polling() override;
+
   /**
    * @brief Set the path of the configuration file.
    * @param path The path of the configuration file.
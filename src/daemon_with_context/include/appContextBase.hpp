@@ -126,6 +126,18 @@ class IAppContext {
                                                                    const std::chrono::milliseconds& min_duration) {
     return self.process_executing(min_duration);
   }
+
+  /**
+   * @brief polls the inputs of the context once without blocking, used by busy-polling tasks between
+   * two process_executing calls.
+   * @return true if the poll found work, the default without non-blocking inputs never does.
+   */
+  [[nodiscard]] virtual bool process_polling() {
+    return false;
+  }
+  [[nodiscard]] static bool process_polling(IAppContext& self) {
+    return self.process_polling();
+  }
 };
 
 }  // namespace app
@@ -13,6 +13,10 @@
 #include <functional>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#include "socketActivation.hpp"
 
 //----------------------------------------------------------------------------
 // Declarations
@@ -153,6 +157,20 @@ class Daemon {
    */
   std::optional<bool> make_daemon(const std::string& pid_file_name);
 
+  /**
+   * @brief Takes the listening sockets a socket activation passed for a context.
+   * @param name The name of the sockets, e.g. the socket name of the context.
+   * @return The sockets, the caller owns them; empty without an activation of the name.
+   */
+  [[nodiscard]] std::vector<ActivatedSocket> take_sockets(std::string_view name) {
+    return m_activation.take(name);
+  }
+
+  /**
+   * @brief Closes the activated sockets no context has taken.
+   */
+  void close_unclaimed_sockets();
+
  private:
   Daemon();
   Daemon(Daemon const&) = delete;
@@ -226,6 +244,7 @@ class Daemon {
   std::function<std::optional<bool>()> m_handlerUser1;          ///< Function to be called by USER1 signal
   std::function<std::optional<bool>()> m_handlerUser2;          ///< Function to be called by USER2 signal
   std::function<std::optional<bool>()> m_handlerBeforeToExit;   ///< Function to be called before the daemon exits
+  SocketActivation m_activation;                                ///< Sockets passed by the activation, not yet taken
 };
 
 }  // namespace app
\ No newline at end of file
@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 namespace app {
@@ -22,11 +23,28 @@ namespace app {
  * running in the foreground.
  */
 struct DaemonConfig {
-  std::string pidFile;           ///< The path of the PID file
-  bool isDaemon{false};          ///< Whether the process should run as a daemon
-  bool hasTestConsole{false};    ///< Whether there is a test console running in the foreground
-  std::string pathConfigFile;    ///< The path of the configuration file
-  std::string pathConfigFolder;  ///< The path of the configuration folder
-  std::string logFile;           ///< The path of the log file
+  std::string pidFile;                     ///< The path of the PID file
+  bool isDaemon{false};                    ///< Whether the process should run as a daemon
+  bool hasTestConsole{false};              ///< Whether there is a test console running in the foreground
+  std::string pathConfigFile;              ///< The path of the configuration file
+  std::string pathConfigFolder;            ///< The path of the configuration folder
+  std::string logFile;                     ///< The path of the log file
+  std::string listenAddress;               ///< The listen address of the context I/O endpoint
+  std::string captureFile;                 ///< The path of the capture file for received traffic
+  uint32_t busyPollSpins{0};               ///< Idle polls of the busy-polling task before it parks, 0 to sleep
+  int taskCpu{-1};                         ///< The CPU the context task is pinned to, -1 for no pinning
+  std::string criticalCpus;                ///< The CPUs of latency-critical threads, empty to detect isolated CPUs
+  std::string housekeepingCpus;            ///< The CPUs of housekeeping threads, empty to detect the other CPUs
+  std::string criticalSched{"other"};      ///< The scheduling of latency-critical threads
+  std::string housekeepingSched{"other"};  ///< The scheduling of housekeeping threads
+  std::string redundancy;                  ///< The hot-standby link to the redundant peer, empty for a single node
+  std::string snapshotFile;                ///< The file SIGUSR1 writes the context state to, empty to disable
+  std::string mappingFile;                 ///< The address mapping of the context, empty to count per session
+  std::string expressionFile;              ///< The formulas of the computed points, empty for none
+  std::string alarmFile;                   ///< The limit alarms of the points, empty for none
+  std::string cpuLevel;                    ///< The highest SIMD level of the kernels, empty for the detected one
+  std::string poll;                        ///< The interrogation of the sessions, "period ms[:policy]", empty for none
+  std::string coalesce;                    ///< The coalescing of the sends, "flush bytes[:budget us]", empty for none
+  std::string socketName{"endpoint"};      ///< The name of the activated sockets of the context endpoint
 };
 }  // namespace app
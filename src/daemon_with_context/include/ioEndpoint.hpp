@@ -0,0 +1,271 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/**
+ * \file
+ * \brief   contains the I/O endpoint of the application context
+ * \ingroup Daemon with Application Context
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <netinet/in.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "objectPool.hpp"
+#include "outboundQueue.hpp"
+#include "socketActivation.hpp"
+#include "trafficCapture.hpp"
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+namespace app {
+
+/**
+ * @brief The IoEndpoint class provides a non-blocking TCP listener and UDP socket with their client sessions.
+ *
+ * The endpoint is polled from the application task. Every TCP connection and every UDP peer address
+ * is a session. Received bytes are passed to the receive handler and, if a capture is attached,
+ * recorded with timestamps. The outgoing bytes of a TCP session go through its outbound queue: by
+ * default every send is written at once, with coalescing the sends of a poll are gathered and
+ * written with one call at its end, before the next wait, or when their latency budget expired.
+ * A UDP peer that sent nothing for the idle timeout is closed, datagrams of new peers beyond the
+ * maximum are dropped, so spoofed or churning source ports can't grow the sessions without limit.
+ */
+class IoEndpoint {
+ public:
+  /**
+   * @brief Handler for received bytes.
+   * @param endpoint The endpoint the bytes were received on.
+   * @param session The session id.
+   * @param data The received bytes.
+   */
+  using ReceiveHandler = std::function<void(IoEndpoint& endpoint, uint32_t session, std::span<const std::byte> data)>;
+
+  /**
+   * @brief Handler for opened and closed sessions.
+   * @param endpoint The endpoint of the session.
+   * @param session The session id.
+   * @param open true for an accepted connection or a new UDP peer, false for a closed session.
+   */
+  using SessionHandler = std::function<void(IoEndpoint& endpoint, uint32_t session, bool open)>;
+
+  /**
+   * @brief Statistics of the endpoint.
+   */
+  struct Statistics {
+    uint64_t accepted{0};       ///< accepted sessions
+    uint64_t closed{0};         ///< closed sessions
+    uint64_t receivedBytes{0};  ///< received bytes
+    uint64_t sentBytes{0};      ///< sent bytes
+    uint64_t sendCalls{0};      ///< send system calls
+    uint64_t expiredPeers{0};   ///< UDP peers closed after the idle timeout
+    uint64_t rejectedPeers{0};  ///< datagrams of new UDP peers dropped at the maximum
+  };
+
+  static constexpr std::chrono::milliseconds DefaultPeerIdleTimeout{60'000};  ///< idle timeout of UDP peers
+  static constexpr size_t DefaultMaxPeers = 1024;                             ///< UDP peers of an endpoint
+
+  /**
+   * @brief constructor
+   * @param id The endpoint id used in captures.
+   */
+  explicit IoEndpoint(uint32_t id = 0) : m_id(id), m_peerIdle(DefaultPeerIdleTimeout) {}
+
+  /// destructor closes all sessions and the listener
+  ~IoEndpoint();
+
+  IoEndpoint(const IoEndpoint&) = delete;
+  IoEndpoint& operator=(const IoEndpoint&) = delete;
+
+  /**
+   * @brief Opens the TCP listener and the UDP socket on the same address.
+   * @param address The listen address in the form "[host:]port".
+   * @return true if the listener is open, otherwise false.
+   */
+  [[nodiscard]] bool open(const std::string& address);
+
+  /**
+   * @brief Opens the endpoint on the sockets of a socket activation instead of binding them.
+   * @param sockets The listening TCP socket and an optional IPv4 UDP socket, the endpoint owns them.
+   * @return true if a listening TCP socket was passed, otherwise false.
+   */
+  [[nodiscard]] bool adopt(const std::vector<ActivatedSocket>& sockets);
+
+  /**
+   * @brief Closes all sessions and the listener, without calling the session handler.
+   */
+  void close();
+
+  /**
+   * @brief Checks if the listener is open.
+   * @return true if open, otherwise false.
+   */
+  [[nodiscard]] bool is_open() const {
+    return m_listenFd >= 0;
+  }
+
+  /**
+   * @brief Waits for and processes I/O events.
+   * @param timeout The maximal time to wait for events.
+   * @return The number of processed events.
+   */
+  size_t poll(std::chrono::milliseconds timeout);
+
+  /**
+   * @brief Sends bytes to a session. Bytes which cannot be sent immediately are queued.
+   * @param session The session id.
+   * @param data The bytes to send.
+   * @return true if the bytes are sent or queued, otherwise false.
+   */
+  bool send(uint32_t session, std::span<const std::byte> data);
+
+  /**
+   * @brief Writes the coalesced bytes of all sessions, e.g. for a message that must not wait.
+   */
+  void flush();
+
+  /**
+   * @brief Sets the coalescing of the TCP sessions opened later.
+   * @param config The configuration of their outbound queues, a flush size of 0 writes every send at once.
+   */
+  void set_coalescing(const OutboundQueueConfig& config) {
+    m_coalescing = config;
+  }
+
+  /**
+   * @brief Sets the limits of the UDP peers.
+   * @param idleTimeout The time without a datagram after which a peer is closed.
+   * @param maxPeers The maximal number of UDP peers, datagrams of further peers are dropped.
+   */
+  void set_peer_limits(std::chrono::milliseconds idleTimeout, size_t maxPeers) {
+    m_peerIdle = idleTimeout;
+    m_maxPeers = maxPeers;
+  }
+
+  /**
+   * @brief Sets the busy-poll budget (SO_BUSY_POLL) of the listener, the UDP socket and all sessions.
+   * With a budget, a receive on a socket polls the device queue of the NIC for up to the budget
+   * before it falls back to the interrupt path, which removes the interrupt and softirq latency
+   * for busy-polling tasks. Raising the budget above net.core.busy_read requires CAP_NET_ADMIN.
+   * @param budget The budget, 0 to disable.
+   * @return true if the budget is set on all sockets, otherwise false.
+   */
+  bool set_busy_poll(std::chrono::microseconds budget);
+
+  /**
+   * @brief Sets the handler for received bytes.
+   * @param handler The handler.
+   */
+  void set_receive_handler(ReceiveHandler handler) {
+    m_receiveHandler = std::move(handler);
+  }
+
+  /**
+   * @brief Sets the handler for opened and closed sessions.
+   * @param handler The handler, may send to an opened session.
+   */
+  void set_session_handler(SessionHandler handler) {
+    m_sessionHandler = std::move(handler);
+  }
+
+  /**
+   * @brief Attaches a capture that records all received bytes.
+   * @param capture The capture or nullptr to detach.
+   */
+  void set_capture(TrafficCaptureWriter* capture) {
+    m_capture = capture;
+  }
+
+  /**
+   * @brief Gets the endpoint id.
+   * @return The endpoint id.
+   */
+  [[nodiscard]] uint32_t id() const {
+    return m_id;
+  }
+
+  /**
+   * @brief Gets the number of open sessions.
+   * @return The number of sessions.
+   */
+  [[nodiscard]] size_t sessions() const {
+    return m_sessions.size();
+  }
+
+  /**
+   * @brief Gets the statistics of the endpoint.
+   * @return The statistics.
+   */
+  [[nodiscard]] const Statistics& statistics() const {
+    return m_statistics;
+  }
+
+ private:
+  /**
+   * @brief The client session.
+   */
+  struct Session {
+    int fd{-1};              ///< socket of the session, -1 for a UDP peer
+    OutboundQueue output;    ///< bytes not yet accepted by the socket
+    sockaddr_in peer{};      ///< address of a UDP peer
+    int64_t lastReceive{0};  ///< time of the last datagram of a UDP peer in ns
+    bool pending{false};     ///< listed for the next flush
+    bool watching{false};    ///< waits for a writable socket
+  };
+
+  static constexpr uint64_t ListenerKey = UINT64_MAX;      ///< epoll key of the listener
+  static constexpr uint64_t DatagramKey = UINT64_MAX - 1;  ///< epoll key of the UDP socket
+
+  bool attach(const std::string& description);
+  void accept_sessions();
+  void read_session(uint32_t session);
+  void read_datagrams();
+  void write_session(uint32_t session);
+  void flush_pending(bool all);
+  bool flush_session(uint32_t session, Session& state, FlushReason reason);
+  void update_output(uint32_t session, Session& state, const OutboundStatistics& before);
+  void close_session(uint32_t session);
+  void expire_peers(int64_t now);
+  void watch_output(uint32_t session, Session& state, bool enable);
+  bool apply_busy_poll(int fd) const;
+
+  uint32_t m_id;                                               ///< endpoint id
+  int m_listenFd{-1};                                          ///< listening socket
+  int m_udpFd{-1};                                             ///< UDP socket
+  int m_epollFd{-1};                                           ///< epoll instance
+  uint32_t m_nextSession{1};                                   ///< next session id
+  int m_busyPollUs{0};                                         ///< SO_BUSY_POLL budget of the sockets
+  std::unordered_map<uint32_t, pool_ptr<Session>> m_sessions;  ///< open sessions, allocated from the slab pool
+  std::unordered_map<uint64_t, uint32_t> m_peers;              ///< session ids of UDP peer addresses
+  std::chrono::milliseconds m_peerIdle;                        ///< idle timeout of UDP peers
+  size_t m_maxPeers{DefaultMaxPeers};                          ///< maximal number of UDP peers
+  int64_t m_nextExpiry{0};                                     ///< time of the next idle check in ns
+  std::vector<std::byte> m_receiveBuffer;                      ///< receive buffer shared by all sessions
+  OutboundQueueConfig m_coalescing{0};                         ///< outbound queues of new sessions, no coalescing
+  std::vector<uint32_t> m_pending;                             ///< sessions with coalesced bytes to flush
+  ReceiveHandler m_receiveHandler;                             ///< handler of received bytes
+  SessionHandler m_sessionHandler;                             ///< handler of opened and closed sessions
+  TrafficCaptureWriter* m_capture{nullptr};                    ///< optional capture of received bytes
+  Statistics m_statistics;                                     ///< statistics
+};
+
+}  // namespace app
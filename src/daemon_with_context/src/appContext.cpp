@@ -9,13 +9,23 @@
 
 #include "appContext.hpp"
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
 #include <chrono>
 #include <fstream>
 #include <iostream>
 #include <regex>
 #include <thread>
+#include <utility>
 
 #include <fmt/chrono.h>
+#include <spdlog/spdlog.h>
+
+#include "threadRoles.hpp"
+#include "timestampService.hpp"
 
 //-----------------------------------------------------------------------------
 // includes
@@ -28,6 +38,11 @@
 //----------------------------------------------------------------------------
 // Typedefs, enums, unions, variables
 //----------------------------------------------------------------------------
+namespace {
+/// The interrogation of a session, the U-format TESTFR act frame of IEC 60870-5-104
+constexpr std::array<std::byte, 6> InterrogationFrame = {std::byte{0x68}, std::byte{0x04}, std::byte{0x43},
+                                                         std::byte{0x00}, std::byte{0x00}, std::byte{0x00}};
+}  // namespace
 
 //----------------------------------------------------------------------------
 // Declarations
@@ -61,6 +76,17 @@ bool app::AppContext::validate_path(const std::string& path, const std::string&
   return true;
 }
 
+/*************************************************************************/ /**
+ * @brief Hands the sockets of a socket activation to the context.
+ * @param sockets The sockets of the context name, the context owns them.
+ ******************************************************************************/
+void app::AppContext::adopt_sockets(std::vector<ActivatedSocket> sockets) {
+  for (const auto& socket : m_activatedSockets) {
+    ::close(socket.fd);
+  }
+  m_activatedSockets = std::move(sockets);
+}
+
 /*************************************************************************/ /**
  * @brief Validates the configuration of the daemon.
  * @param config The configuration of the daemon to validate.
@@ -78,6 +104,16 @@ std::optional<bool> app::AppContext::validate_configuration(const app::DaemonCon
   m_pathConfigFile = config.pathConfigFile;
   m_pathConfigFolder = config.pathConfigFolder;
   m_pathLogFile = config.logFile;
+  m_listenAddress = config.listenAddress;
+  m_pathCaptureFile = config.captureFile;
+  m_busyPolling = config.busyPollSpins > 0;
+  m_redundancyConfig.reset();
+  m_pathSnapshotFile = config.snapshotFile;
+  m_pathMappingFile = config.mappingFile;
+  m_pathExpressionFile = config.expressionFile;
+  m_pathAlarmFile = config.alarmFile;
+  m_pollPeriod = std::chrono::milliseconds(0);
+  m_coalescing = OutboundQueueConfig{0};
 
   /*
    * Use the validatePath function to validate all paths.
@@ -94,6 +130,78 @@ std::optional<bool> app::AppContext::validate_configuration(const app::DaemonCon
     errorCount++;
   }
 
+  if (!m_pathCaptureFile.empty() && !validate_path(m_pathCaptureFile.parent_path(), "Capture folder")) {
+    errorCount++;
+  }
+
+  if (!m_pathSnapshotFile.empty() && !validate_path(m_pathSnapshotFile.parent_path(), "Snapshot folder")) {
+    errorCount++;
+  }
+
+  if (!validate_path(m_pathMappingFile, "Mapping file")) {
+    errorCount++;
+  }
+
+  if (!validate_path(m_pathExpressionFile, "Expression file")) {
+    errorCount++;
+  }
+
+  if (!validate_path(m_pathAlarmFile, "Alarm file")) {
+    errorCount++;
+  }
+
+  if (!config.redundancy.empty()) {
+    m_redundancyConfig = RedundancyConfig::parse(config.redundancy);
+    if (!m_redundancyConfig) {
+      std::cerr << "Redundancy \"" << config.redundancy << "\" is invalid" << std::endl;
+      errorCount++;
+    } else if (m_listenAddress.empty() && m_activatedSockets.empty()) {
+      std::cerr << "Redundancy needs a listen address or activated sockets" << std::endl;
+      errorCount++;
+    }
+  }
+
+  if (!config.poll.empty()) {
+    // "period ms[:policy]", the staggered policy by default
+    std::string_view text(config.poll);
+    auto separator = text.find(':');
+    uint32_t period = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + std::min(separator, text.size()), period);
+    auto policy = separator == std::string_view::npos ? std::optional(PollPolicy::staggered)
+                                                      : parse_poll_policy(text.substr(separator + 1));
+    if (error != std::errc() || end != text.data() + std::min(separator, text.size()) || period == 0 || !policy) {
+      std::cerr << "Poll \"" << config.poll << "\" is invalid" << std::endl;
+      errorCount++;
+    } else if (m_listenAddress.empty() && m_activatedSockets.empty()) {
+      std::cerr << "Poll needs a listen address or activated sockets" << std::endl;
+      errorCount++;
+    } else {
+      m_pollPeriod = std::chrono::milliseconds(period);
+      m_polls = PollScheduler({*policy});
+    }
+  }
+
+  if (!config.coalesce.empty()) {
+    // "flush bytes[:latency budget us]", without a budget the sends of a poll are written at its end
+    std::string_view text(config.coalesce);
+    auto separator = std::min(text.find(':'), text.size());
+    size_t flushBytes = 0;
+    uint32_t budget = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + separator, flushBytes);
+    bool valid = error == std::errc() && end == text.data() + separator && flushBytes > 0;
+    if (valid && separator < text.size()) {
+      auto [budgetEnd, budgetError] = std::from_chars(text.data() + separator + 1, text.data() + text.size(), budget);
+      valid = budgetError == std::errc() && budgetEnd == text.data() + text.size();
+    }
+    if (!valid || flushBytes > m_coalescing.maxPending) {
+      std::cerr << "Coalescing \"" << config.coalesce << "\" is invalid" << std::endl;
+      errorCount++;
+    } else {
+      m_coalescing.flushBytes = flushBytes;
+      m_coalescing.latencyBudget = std::chrono::microseconds(budget);
+    }
+  }
+
   if (errorCount > 0)
     return false;
 
@@ -116,6 +224,13 @@ std::optional<bool> app::AppContext::validate_configuration(const app::DaemonCon
  ******************************************************************************/
 std::optional<bool> app::AppContext::process_reconfigure() {
   std::cout << "Application context: Reconfiguring the application" << std::endl;
+  if (!m_pathMappingFile.empty()) {
+    // the task keeps mapping with its map until it takes the new one, a failed reload doesn't stop the daemon
+    if (!load_mapping()) {
+      spdlog::warn("Address map: reload failed, the previous map stays");
+    }
+    return true;
+  }
   std::this_thread::sleep_for(std::chrono::seconds(1));
   return true;
 }
@@ -138,6 +253,11 @@ std::optional<bool> app::AppContext::process_restart() {
  ******************************************************************************/
 std::optional<bool> app::AppContext::process_user1() {
   std::cout << "Application context: get and process the USER1 signal" << std::endl;
+  if (!m_pathSnapshotFile.empty()) {
+    // the context task forks at its next poll, between two processing steps
+    m_snapshotRequested = true;
+    return true;
+  }
   std::this_thread::sleep_for(std::chrono::seconds(1));
   return true;
 }
@@ -160,6 +280,71 @@ std::optional<bool> app::AppContext::process_user2() {
  ******************************************************************************/
 std::optional<bool> app::AppContext::process_start() {
   std ::cout << "Application context: Start the application" << std::endl;
+
+  if (!m_pathCaptureFile.empty() && !m_capture.is_open()) {
+    if (!m_capture.open(m_pathCaptureFile)) {
+      std::cerr << "Capture file \"" << m_pathCaptureFile.string() << "\" can't be created" << std::endl;
+      return false;
+    }
+    spdlog::info("Recording received traffic into {}", m_pathCaptureFile.string());
+  }
+
+  if (m_points.size() == 0 && !m_points.reserve(ContextPoints)) {
+    std::cerr << "Point database can't be reserved" << std::endl;
+    return false;
+  }
+  if (!m_pathMappingFile.empty() && !m_mappingLoaded) {
+    if (!load_mapping()) {
+      return false;
+    }
+    m_mappingLoaded = true;
+  }
+  if (!m_pathExpressionFile.empty() && m_expressions.size() == 0) {
+    if (!m_expressions.load(m_pathExpressionFile)) {
+      std::cerr << "Expressions: " << m_expressions.last_error() << std::endl;
+      return false;
+    }
+    if (m_expressions.required_points() > m_points.size()) {
+      std::cerr << "Expressions: the formulas use " << m_expressions.required_points() << " points, the context has "
+                << m_points.size() << std::endl;
+      return false;
+    }
+    spdlog::info("Expressions {}: {} computed points in {} groups", m_pathExpressionFile.string(),
+                 m_expressions.size(), m_expressions.groups());
+  }
+  if (!m_pathAlarmFile.empty() && m_alarms.configured() == 0) {
+    m_alarms.reserve(m_points.size());
+    if (!m_alarms.load(m_pathAlarmFile)) {
+      std::cerr << "Alarms: " << m_alarms.last_error() << std::endl;
+      return false;
+    }
+    m_alarms.subscribe([this](std::span<const AlarmEvent> events) {
+      m_alarmEvents += events.size();
+      for (const auto& event : events) {
+        spdlog::info("Alarm p{}: {} -> {}{}, value {}", event.point, to_string(event.previous), to_string(event.level),
+                     event.latched ? " latched" : "", event.value);
+      }
+    });
+    spdlog::info("Alarms {}: {} points with limits", m_pathAlarmFile.string(), m_alarms.configured());
+  }
+  // the snapshot child serializes next to the housekeeping threads, not on the CPU of the task
+  m_snapshot.set_child_settings(ThreadRoles::instance().partition().housekeeping);
+
+  if (m_redundancyConfig) {
+    // the endpoint opens when the link arbitrated the active role
+    if (!m_redundancy.is_open()) {
+      m_redundancy.set_event_handler([](std::string_view message) { spdlog::info("Redundancy: {}", message); });
+      m_redundancy.set_role_handler(
+          [this](RedundancyRole previous, RedundancyRole role) { change_redundancy_role(previous, role); });
+      return m_redundancy.open(*m_redundancyConfig);
+    }
+    return true;
+  }
+
+  if ((!m_listenAddress.empty() || !m_activatedSockets.empty()) && !m_endpoint.is_open()) {
+    return open_endpoint();
+  }
+
   std::this_thread::sleep_for(std::chrono::seconds(1));
   return true;
 }
@@ -171,6 +356,51 @@ std::optional<bool> app::AppContext::process_start() {
  ******************************************************************************/
 std::optional<bool> app::AppContext::process_shutdown() {
   std ::cout << "Application context: Shutting down the application" << std::endl;
+  if (auto result = m_snapshot.wait()) {
+    spdlog::info("Snapshot {} completed at shutdown: {}", result->target, result->success ? "ok" : result->error);
+  }
+  if (m_redundancy.is_open()) {
+    const auto& stats = m_redundancy.statistics();
+    spdlog::info("Redundancy: {} in epoch {}, {} connections, {} snapshots, {} deltas, {} points sent, {} applied",
+                 to_string(m_redundancy.role()), m_redundancy.epoch(), stats.connections, stats.snapshots,
+                 stats.deltas, stats.pointsSent, stats.pointsApplied);
+    m_redundancy.close();
+  }
+  if (m_endpoint.is_open()) {
+    const auto& stats = m_endpoint.statistics();
+    spdlog::info("Endpoint {}: {} sessions, {} bytes received, {} bytes sent in {} calls, {} idle UDP peers "
+                 "closed, {} datagrams of new peers dropped",
+                 m_endpoint.id(), stats.accepted, stats.receivedBytes, stats.sentBytes, stats.sendCalls,
+                 stats.expiredPeers, stats.rejectedPeers);
+    m_endpoint.close();
+  }
+  // the endpoint closed its duplicates, the activated sockets are closed with the context
+  adopt_sockets({});
+  if (m_pollPeriod.count() > 0) {
+    const auto& stats = m_polls.statistics();
+    const auto& burst = m_polls.burst();
+    spdlog::info("Polls: every {} {}, {} sessions, {} interrogations, {} missed periods, {} rebalances", m_pollPeriod,
+                 to_string(m_polls.policy()), stats.added, stats.polls, stats.missed, stats.rebalances);
+    spdlog::info("Polls: peak {} per {}, burst {:.1f}x, late p99 {}, jitter p99 {}", burst.peak(),
+                 std::chrono::duration_cast<std::chrono::milliseconds>(burst.window()), burst.burst(),
+                 std::chrono::microseconds(m_polls.lateness().percentile(99) / 1000),
+                 std::chrono::microseconds(m_polls.jitter().percentile(99) / 1000));
+    m_polls.clear();
+  }
+  if (!m_pathMappingFile.empty()) {
+    spdlog::info("Address map: {} mappings, {} received values unmapped", m_addressMap.size(), m_unmappedValues);
+  }
+  if (!m_pathExpressionFile.empty()) {
+    spdlog::info("Expressions: {} computed points, {} evaluations", m_expressions.size(), m_expressions.evaluated());
+  }
+  if (!m_pathAlarmFile.empty()) {
+    spdlog::info("Alarms: {} points with limits, {} evaluations, {} transitions", m_alarms.configured(),
+                 m_alarms.evaluated(), m_alarmEvents);
+  }
+  if (m_capture.is_open()) {
+    spdlog::info("Capture: {} records, {} bytes", m_capture.records(), m_capture.bytes());
+    m_capture.close();
+  }
   std::this_thread::sleep_for(std::chrono::seconds(1));
   return true;
 }
@@ -181,7 +411,295 @@ std::optional<bool> app::AppContext::process_shutdown() {
  * @return The earlier timeout until next process.
  ******************************************************************************/
 std::chrono::milliseconds app::AppContext::process_executing(const std::chrono::milliseconds& min_duration) {
+  process_snapshot();
+  process_mapping();
+
+  if (m_redundancy.is_open() && !m_endpoint.is_open()) {
+    // a standby or starting node waits in the link for the state of the active node or the lease expiry
+    m_redundancy.poll(m_redundancy.next_timeout());
+    TimestampService::instance().update();
+    return std::chrono::milliseconds(0);
+  }
+
+  if (m_endpoint.is_open()) {
+    // the task waits in the endpoint for I/O instead of sleeping, a redundant node at most until its heartbeat,
+    // after the due interrogations at most until the next one
+    auto timeout = m_redundancy.is_open() ? std::min(IoPollInterval, m_redundancy.next_timeout()) : IoPollInterval;
+    m_endpoint.poll(poll_sessions(timeout));
+    // the endpoint refreshes the cached clock for its events, an idle loop keeps it within the interval
+    TimestampService::instance().update();
+    process_points();
+    if (m_redundancy.is_open()) {
+      // streams the points the received traffic changed, may demote the node and close the endpoint
+      auto received = m_endpoint.statistics().receivedBytes;
+      m_redundancy.set_state("endpoint.received", std::as_bytes(std::span(&received, 1)));
+      m_redundancy.poll(std::chrono::milliseconds(0));
+    }
+    release_changes();
+    return std::chrono::milliseconds(0);
+  }
+
   std::cout << "Processing the context. Minimal duration: " << min_duration.count() << " ms" << std::endl;
   return min_duration > std::chrono::milliseconds(5000) ? std::chrono::milliseconds(1000)
                                                         : min_duration + std::chrono::milliseconds(1000);
 }
+
+/*************************************************************************/ /**
+ * @brief polls the endpoint once without blocking.
+ * @return true if the poll processed I/O events.
+ ******************************************************************************/
+bool app::AppContext::process_polling() {
+  process_snapshot();
+  process_mapping();
+  bool processed = false;
+  if (m_pollPeriod.count() > 0 && m_endpoint.is_open()) {
+    auto polls = m_polls.statistics().polls;
+    poll_sessions(std::chrono::milliseconds(0));
+    processed = m_polls.statistics().polls != polls;
+  }
+  processed = (m_endpoint.is_open() && m_endpoint.poll(std::chrono::milliseconds(0)) > 0) || processed;
+  if (processed) {
+    process_points();
+  }
+  if (m_redundancy.is_open()) {
+    processed = m_redundancy.poll(std::chrono::milliseconds(0)) > 0 || processed;
+  }
+  if (processed) {
+    release_changes();
+  }
+  return processed;
+}
+
+/*************************************************************************/ /**
+ * @brief Opens the I/O endpoint, on a redundant node only while active.
+ *
+ * The example converter maps every received byte unchanged back to its source and
+ * counts the received bytes of each session slot in the point database. With a mapping
+ * file the session slot is the raw source address, its mapping selects and scales the point.
+ * @return true if the endpoint is open, otherwise false.
+ ******************************************************************************/
+bool app::AppContext::open_endpoint() {
+  bool opened{false};
+  if (m_activatedSockets.empty()) {
+    opened = m_endpoint.open(m_listenAddress);
+  } else {
+    // the endpoint closes its duplicates on a demotion, the context keeps the sockets for the next promotion
+    auto sockets = SocketActivation::duplicate(m_activatedSockets);
+    if (sockets.empty()) {
+      spdlog::error("Can't duplicate the activated sockets: {}", std::system_category().message(errno));
+      return false;
+    }
+    opened = m_endpoint.adopt(sockets);
+  }
+  if (!opened) {
+    return false;
+  }
+  m_endpoint.set_receive_handler([this](IoEndpoint& endpoint, uint32_t session, std::span<const std::byte> data) {
+    size_t point = session % m_points.size();
+    auto value = static_cast<double>(data.size());
+    if (!m_pathMappingFile.empty()) {
+      const auto* mapping = m_addressMap.find(make_address(AddressSpace::raw, session));
+      if (mapping == nullptr || mapping->destination >= m_points.size()) {
+        m_unmappedValues++;
+        endpoint.send(session, data);
+        return;
+      }
+      point = mapping->destination;
+      value = mapping->apply(value);
+    }
+    auto& clock = TimestampService::instance();
+    auto timestamp = clock.to_system(clock.cached()).time_since_epoch();
+    m_points.update(point, m_points.values()[point] + value, 0,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp).count());
+    endpoint.send(session, data);
+  });
+  if (m_pollPeriod.count() > 0) {
+    // a session is interrogated from the next run of the task, at the phase the policy gives it
+    m_endpoint.set_session_handler([this](IoEndpoint&, uint32_t session, bool open) {
+      if (open) {
+        m_polls.add(session, m_pollPeriod);
+      } else {
+        m_polls.remove(session);
+      }
+    });
+  }
+  m_endpoint.set_capture(m_capture.is_open() ? &m_capture : nullptr);
+  m_endpoint.set_coalescing(m_coalescing);
+  if (m_busyPolling) {
+    // without CAP_NET_ADMIN the task still spins, only the receives take the interrupt path
+    m_endpoint.set_busy_poll(SocketBusyPoll);
+  }
+  return true;
+}
+
+/*************************************************************************/ /**
+ * @brief Opens the endpoint when the node becomes active and closes it when it becomes standby.
+ * @param previous The previous role.
+ * @param role The new role.
+ ******************************************************************************/
+void app::AppContext::change_redundancy_role(RedundancyRole previous, RedundancyRole role) {
+  if (role == RedundancyRole::active) {
+    if (previous == RedundancyRole::standby) {
+      spdlog::warn("Redundancy: failover in {} after the last heartbeat of the active node",
+                   std::chrono::duration_cast<std::chrono::microseconds>(m_redundancy.statistics().failover));
+    }
+    if (!m_endpoint.is_open() && !open_endpoint()) {
+      spdlog::error("Redundancy: active node can't open the endpoint {}",
+                    m_activatedSockets.empty() ? m_listenAddress : std::string("on the activated sockets"));
+    }
+    return;
+  }
+  spdlog::info("Redundancy: {} -> {} in epoch {}", to_string(previous), to_string(role), m_redundancy.epoch());
+  if (m_endpoint.is_open()) {
+    // the active peer serves the clients, they reconnect to it
+    m_endpoint.close();
+    m_polls.clear();
+  }
+}
+
+/*************************************************************************/ /**
+ * @brief Starts a requested snapshot and reports a finished one, called by the context task.
+ *
+ * The task owns the points, so forking between two of its processing steps quiesces the
+ * context: the child sees a consistent state while the task continues after the fork.
+ ******************************************************************************/
+void app::AppContext::process_snapshot() {
+  if (m_snapshot.is_running()) {
+    if (auto result = m_snapshot.poll()) {
+      if (result->success) {
+        spdlog::info("Snapshot {}: {} bytes in {}, pause {}, {} KiB copied on write of {} KiB resident",
+                     result->target, result->bytes,
+                     std::chrono::duration_cast<std::chrono::milliseconds>(result->duration),
+                     std::chrono::duration_cast<std::chrono::microseconds>(result->pause),
+                     result->copiedBytes / 1024, result->residentBytes / 1024);
+      } else {
+        spdlog::error("Snapshot {} failed: {}", result->target, result->error);
+      }
+    }
+  }
+  if (m_snapshotRequested.load(std::memory_order_relaxed) && m_snapshotRequested.exchange(false)) {
+    if (!m_snapshot.start(m_pathSnapshotFile, [this](SnapshotSink& sink) { return write_snapshot(sink); })) {
+      spdlog::error("Snapshot {} not started: {}", m_pathSnapshotFile.string(), m_snapshot.last_error());
+    }
+  }
+}
+
+/*************************************************************************/ /**
+ * @brief Compiles the mapping file and hands the map to the context task.
+ * @return true if compiled, otherwise false; the task keeps its map then.
+ ******************************************************************************/
+bool app::AppContext::load_mapping() {
+  auto mapping = std::make_unique<AddressMap>();
+  auto start = std::chrono::steady_clock::now();
+  if (!mapping->load(m_pathMappingFile)) {
+    spdlog::error("Address map: {}", mapping->last_error());
+    return false;
+  }
+  spdlog::info("Address map {}: {} mappings, {} layout, {} KiB, compiled in {}", m_pathMappingFile.string(),
+               mapping->size(), to_string(mapping->layout()), mapping->memory_bytes() / 1024,
+               std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+  std::lock_guard lock(m_mappingMutex);
+  m_pendingMapping = std::move(mapping);
+  m_mappingPending = true;
+  return true;
+}
+
+/*************************************************************************/ /**
+ * @brief Takes a reloaded map, called by the context task.
+ ******************************************************************************/
+void app::AppContext::process_mapping() {
+  if (!m_mappingPending.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::unique_ptr<AddressMap> mapping;
+  {
+    std::lock_guard lock(m_mappingMutex);
+    mapping = std::move(m_pendingMapping);
+    m_mappingPending = false;
+  }
+  if (mapping) {
+    // the previous map is released here, on the task that used it
+    std::swap(m_addressMap, *mapping);
+  }
+}
+
+/*************************************************************************/ /**
+ * @brief Evaluates the computed points and the alarms of the changed points, called by the context task.
+ *
+ * Both engines read the changed bits of the point database, the alarms after the computed points
+ * so that computed points alarm in the same poll. The bits are cleared by release_changes() at the
+ * end of the tick.
+ ******************************************************************************/
+void app::AppContext::process_points() {
+  if (m_expressions.size() == 0 && m_alarms.configured() == 0) {
+    return;
+  }
+  m_expressions.evaluate(m_points);
+  if (m_alarms.configured() > 0) {
+    // the time line of the point timestamps: wall clock in ns, as the receive handler stamps them
+    auto& clock = TimestampService::instance();
+    auto now = clock.to_system(clock.cached()).time_since_epoch();
+    m_alarms.evaluate(m_points, std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+  }
+}
+
+/*************************************************************************/ /**
+ * @brief Clears the changed bits of the point database at the end of a tick.
+ *
+ * The redundancy link consumes the bits when it streamed the received and the computed points to
+ * the standby. An active node without a connected standby doesn't stream, without the clear every
+ * point that ever changed would be evaluated again in every tick.
+ ******************************************************************************/
+void app::AppContext::release_changes() {
+  if (!m_redundancy.is_open() || !m_redundancy.streamed_points()) {
+    m_points.clear_changed();
+  }
+}
+
+/*************************************************************************/ /**
+ * @brief Sends the due interrogations of the sessions, called by the context task.
+ *
+ * The scheduler spreads the sessions over the period, so the requests and the responses of
+ * thousands of sessions don't arrive in one burst after a start or a failover. A session whose
+ * send fails is closed by the endpoint and leaves the scheduler.
+ * @param limit The longest delay to return.
+ * @return The earlier of the limit and the time until the next interrogation.
+ ******************************************************************************/
+std::chrono::milliseconds app::AppContext::poll_sessions(std::chrono::milliseconds limit) {
+  if (m_pollPeriod.count() == 0) {
+    return limit;
+  }
+  return m_polls.run(TimestampService::instance().now().count(), limit, [this](uint64_t session) {
+    m_endpoint.send(static_cast<uint32_t>(session), InterrogationFrame);
+  });
+}
+
+/*************************************************************************/ /**
+ * @brief Writes the points and the context state, runs in the snapshot child.
+ *
+ * The layout is a header (magic "DSNP", version, point count, state entries, epoch, role,
+ * timestamp), the value, quality and timestamp arrays, then every state entry as key and
+ * value, each with a 32-bit size, and the CRC-32C of all preceding bytes. Integers are in host
+ * byte order.
+ * @param sink The output.
+ * @return true if written, otherwise false.
+ ******************************************************************************/
+bool app::AppContext::write_snapshot(SnapshotSink& sink) const {
+  constexpr uint32_t Magic = 0x504E5344;  // "DSNP"
+  constexpr uint32_t Version = 2;
+  const auto& state = m_redundancy.state();
+  auto timestamp = TimestampService::instance().cached().count();
+  bool written = sink.write_value(Magic) && sink.write_value(Version) && sink.write_value(uint64_t{m_points.size()}) &&
+                 sink.write_value(uint64_t{state.size()}) && sink.write_value(m_redundancy.epoch()) &&
+                 sink.write_value(static_cast<uint32_t>(m_redundancy.role())) && sink.write_value(timestamp);
+  written = written && sink.write(m_points.values().data(), m_points.values().size_bytes()) &&
+            sink.write(m_points.qualities().data(), m_points.qualities().size_bytes()) &&
+            sink.write(m_points.timestamps().data(), m_points.timestamps().size_bytes());
+  for (auto entry = state.begin(); written && entry != state.end(); ++entry) {
+    written = sink.write_value(static_cast<uint32_t>(entry->first.size())) &&
+              sink.write(entry->first.data(), entry->first.size()) &&
+              sink.write_value(static_cast<uint32_t>(entry->second.size())) &&
+              sink.write(entry->second.data(), entry->second.size());
+  }
+  return written && sink.write_value(sink.checksum());
+}
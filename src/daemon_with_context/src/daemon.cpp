@@ -23,6 +23,8 @@
  *
  * This constructor initializes the state of the daemon to 'start' and sets up signal handlers
  * for the 'ExitSignal', 'TerminateSignal', 'ReloadSignal', 'User1' and 'User2' signals.
+ * It takes the sockets of a socket activation: the instance is created first in main, while
+ * LISTEN_PID still names this process, before make_daemon forks.
  */
 app::Daemon::Daemon() {
   m_state = State::start;
@@ -31,6 +33,15 @@ app::Daemon::Daemon() {
   signal(ReloadSignal, Daemon::signal_handler);
   signal(UserSignal1, Daemon::signal_handler);
   signal(UserSignal2, Daemon::signal_handler);
+
+  m_activation = SocketActivation::from_environment();
+  if (!m_activation.last_error().empty()) {
+    spdlog::warn("Socket activation: {}", m_activation.last_error());
+  }
+  for (const auto& socket : m_activation.sockets()) {
+    spdlog::info("Socket activation: descriptor {} '{}'{}", socket.fd, socket.name,
+                 socket.listening ? " listening" : "");
+  }
 }
 
 /**
@@ -173,3 +184,15 @@ std::optional<bool> app::Daemon::make_daemon(const std::string& pid_file_name) {
 
   return true;
 }
+
+/**
+ * @brief Closes the activated sockets no context has taken.
+ *
+ * A socket without a context would queue the connections of its clients until they time out,
+ * closed they are refused at once.
+ */
+void app::Daemon::close_unclaimed_sockets() {
+  for (const auto& name : m_activation.close_unclaimed()) {
+    spdlog::warn("Socket activation: no context takes the socket '{}', closed", name);
+  }
+}
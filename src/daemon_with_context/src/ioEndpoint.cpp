@@ -0,0 +1,636 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+// clang-format off
+#include "ioEndpoint.hpp"
+
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+
+#include <spdlog/spdlog.h>
+
+#include "netAddress.hpp"
+#include "timestampService.hpp"
+// clang-format on
+
+namespace {
+constexpr size_t ReceiveBufferSize = 64 * 1024;  ///< size of the receive buffer
+constexpr int MaxEventsPerPoll = 64;             ///< epoll events processed per wait
+
+/**
+ * @brief Gets the key of a UDP peer address.
+ */
+uint64_t peer_key(const sockaddr_in& peer) {
+  return (static_cast<uint64_t>(peer.sin_addr.s_addr) << 16) | peer.sin_port;
+}
+
+/**
+ * @brief Gets the address family of a socket.
+ */
+int socket_family(int fd) {
+  int family = AF_UNSPEC;
+  socklen_t length = sizeof(family);
+  if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &family, &length) < 0) {
+    return AF_UNSPEC;
+  }
+  return family;
+}
+
+/**
+ * @brief Gets the local address of a socket.
+ */
+std::string local_address(int fd) {
+  sockaddr_in address{};
+  socklen_t length = sizeof(address);
+  if (getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) < 0 || address.sin_family != AF_INET) {
+    return "descriptor " + std::to_string(fd);
+  }
+  return app::format_ipv4_address(address);
+}
+}  // namespace
+
+/**
+ * @brief Destructor closes all sessions and the listener.
+ */
+app::IoEndpoint::~IoEndpoint() {
+  close();
+}
+
+/**
+ * @brief Opens the non-blocking TCP listener, the UDP socket and the epoll instance.
+ * @param address The listen address in the form "[host:]port".
+ * @return true if the listener is open, otherwise false.
+ */
+bool app::IoEndpoint::open(const std::string& address) {
+  auto socketAddress = parse_ipv4_address(address);
+  if (!socketAddress) {
+    spdlog::error("Invalid listen address '{}'", address);
+    return false;
+  }
+
+  close();
+
+  m_listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (m_listenFd < 0) {
+    spdlog::error("Can't create listen socket: {}", std::system_category().message(errno));
+    return false;
+  }
+
+  int enable = 1;
+  setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  if (m_busyPollUs > 0) {
+    apply_busy_poll(m_listenFd);
+  }
+
+  if (bind(m_listenFd, reinterpret_cast<const sockaddr*>(&*socketAddress), sizeof(*socketAddress)) < 0 ||
+      listen(m_listenFd, SOMAXCONN) < 0) {
+    spdlog::error("Can't listen on {}: {}", address, std::system_category().message(errno));
+    close();
+    return false;
+  }
+
+  m_udpFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (m_udpFd < 0 || bind(m_udpFd, reinterpret_cast<const sockaddr*>(&*socketAddress), sizeof(*socketAddress)) < 0) {
+    spdlog::error("Can't bind UDP socket on {}: {}", address, std::system_category().message(errno));
+    close();
+    return false;
+  }
+  return attach(format_ipv4_address(*socketAddress));
+}
+
+/**
+ * @brief Adopts the listening TCP socket and the UDP socket of a socket activation.
+ *
+ * The sockets were bound by the launcher, clients that connected before are waiting in the
+ * backlog of the listener and are accepted by the first poll. The UDP peers are kept as IPv4
+ * addresses, a UDP socket of another family, e.g. the dual-stack socket of ListenDatagram=2404, is
+ * closed like sockets of other types.
+ * @param sockets The sockets, the endpoint owns them.
+ * @return true if a listening TCP socket was passed, otherwise false.
+ */
+bool app::IoEndpoint::adopt(const std::vector<ActivatedSocket>& sockets) {
+  close();
+
+  for (const auto& socket : sockets) {
+    if (socket.type == SOCK_STREAM && socket.listening && m_listenFd < 0) {
+      m_listenFd = socket.fd;
+    } else if (socket.type == SOCK_DGRAM && m_udpFd < 0 && socket_family(socket.fd) == AF_INET) {
+      m_udpFd = socket.fd;
+    } else if (socket.type == SOCK_DGRAM && m_udpFd < 0) {
+      spdlog::warn("Endpoint {} closes the activated UDP socket {} of '{}', only IPv4 is supported", m_id, socket.fd,
+                   socket.name);
+      ::close(socket.fd);
+    } else {
+      spdlog::warn("Endpoint {} closes the activated descriptor {} of '{}', neither listener nor UDP socket", m_id,
+                   socket.fd, socket.name);
+      ::close(socket.fd);
+    }
+  }
+  if (m_listenFd < 0) {
+    spdlog::error("Endpoint {} got no listening TCP socket by the activation", m_id);
+    close();
+    return false;
+  }
+
+  // the launcher may pass blocking sockets
+  for (int fd : {m_listenFd, m_udpFd}) {
+    if (fd >= 0 && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+      spdlog::error("Can't make the activated descriptor {} non-blocking: {}", fd,
+                    std::system_category().message(errno));
+      close();
+      return false;
+    }
+  }
+  if (m_busyPollUs > 0) {
+    apply_busy_poll(m_listenFd);
+  }
+  return attach(local_address(m_listenFd) + " (activated)");
+}
+
+/**
+ * @brief Registers the listener and the UDP socket in a new epoll instance.
+ * @param description The address of the listener for the log.
+ * @return true if the epoll instance is created, otherwise false.
+ */
+bool app::IoEndpoint::attach(const std::string& description) {
+  m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (m_epollFd < 0) {
+    spdlog::error("Can't create epoll instance: {}", std::system_category().message(errno));
+    close();
+    return false;
+  }
+
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.u64 = ListenerKey;
+  epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listenFd, &event);
+
+  if (m_udpFd >= 0) {
+    event.data.u64 = DatagramKey;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_udpFd, &event);
+    if (m_busyPollUs > 0) {
+      apply_busy_poll(m_udpFd);
+    }
+  }
+
+  m_receiveBuffer.resize(ReceiveBufferSize);
+  spdlog::info("Endpoint {} listens on {}", m_id, description);
+  return true;
+}
+
+/**
+ * @brief Closes all sessions and the listener.
+ */
+void app::IoEndpoint::close() {
+  for (auto& [id, session] : m_sessions) {
+    if (session->fd >= 0) {
+      ::close(session->fd);
+    }
+  }
+  m_statistics.closed += m_sessions.size();
+  m_sessions.clear();
+  m_peers.clear();
+  m_pending.clear();
+
+  if (m_epollFd >= 0) {
+    ::close(m_epollFd);
+    m_epollFd = -1;
+  }
+  if (m_listenFd >= 0) {
+    ::close(m_listenFd);
+    m_listenFd = -1;
+  }
+  if (m_udpFd >= 0) {
+    ::close(m_udpFd);
+    m_udpFd = -1;
+  }
+}
+
+/**
+ * @brief Waits for and processes I/O events.
+ * @param timeout The maximal time to wait for events.
+ * @return The number of processed events.
+ */
+size_t app::IoEndpoint::poll(std::chrono::milliseconds timeout) {
+  if (m_epollFd < 0) {
+    return 0;
+  }
+  // the sends since the last poll: all before a wait, the expired budgets of a busy-polling task
+  flush_pending(timeout.count() > 0);
+  if (!m_peers.empty()) {
+    expire_peers(TimestampService::instance().now().count());
+  }
+
+  std::array<epoll_event, MaxEventsPerPoll> events{};
+  int count = epoll_wait(m_epollFd, events.data(), MaxEventsPerPoll, static_cast<int>(timeout.count()));
+  if (count <= 0) {
+    return 0;
+  }
+  // the handlers of these events see a current cached clock
+  TimestampService::instance().update();
+
+  for (int i = 0; i < count; ++i) {
+    const auto& event = events[static_cast<size_t>(i)];
+    if (event.data.u64 == ListenerKey) {
+      accept_sessions();
+      continue;
+    }
+    if (event.data.u64 == DatagramKey) {
+      read_datagrams();
+      continue;
+    }
+
+    auto session = static_cast<uint32_t>(event.data.u64);
+    if (event.events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+      read_session(session);
+    }
+    if (event.events & EPOLLOUT) {
+      write_session(session);
+    }
+  }
+  // the end of the tick for the responses of the handlers
+  flush_pending(m_coalescing.latencyBudget.count() == 0);
+  return static_cast<size_t>(count);
+}
+
+/**
+ * @brief Sends bytes to a session. TCP bytes go through the outbound queue of the session: they
+ * are written at once without coalescing, otherwise at its flush size or by the next flush of
+ * the pending sessions. Bytes the socket doesn't accept are written as soon as it becomes
+ * writable. UDP datagrams which don't fit into the socket buffer are dropped, any other error
+ * closes the UDP session.
+ * @param session The session id.
+ * @param data The bytes to send.
+ * @return true if the bytes are sent or queued, otherwise false.
+ */
+bool app::IoEndpoint::send(uint32_t session, std::span<const std::byte> data) {
+  auto it = m_sessions.find(session);
+  if (it == m_sessions.end()) {
+    return false;
+  }
+  auto& state = *it->second;
+
+  if (state.fd < 0) {
+    auto sent = sendto(m_udpFd, data.data(), data.size(), MSG_DONTWAIT, reinterpret_cast<const sockaddr*>(&state.peer),
+                       sizeof(state.peer));
+    m_statistics.sendCalls++;
+    if (sent < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS && errno != EINTR) {
+        spdlog::warn("Endpoint {} UDP session {} send failed: {}. Closing", m_id, session,
+                     std::system_category().message(errno));
+        close_session(session);
+      }
+      return false;
+    }
+    m_statistics.sentBytes += static_cast<uint64_t>(sent);
+    return true;
+  }
+
+  if (state.output.bytes() + data.size() > state.output.config().maxPending) {
+    spdlog::warn("Endpoint {} session {} does not read its data. Closing", m_id, session);
+    close_session(session);
+    return false;
+  }
+  const auto before = state.output.statistics();
+  if (!state.output.send(state.fd, data, TimestampService::instance().now().count())) {
+    close_session(session);
+    return false;
+  }
+  update_output(session, state, before);
+  return true;
+}
+
+/**
+ * @brief Writes the coalesced bytes of all sessions.
+ */
+void app::IoEndpoint::flush() {
+  flush_pending(true);
+}
+
+/**
+ * @brief Sets the busy-poll budget (SO_BUSY_POLL) of the listener, the UDP socket and all sessions.
+ * Sockets opened later get the budget as well.
+ * @param budget The budget, 0 to disable.
+ * @return true if the budget is set on all sockets, otherwise false.
+ */
+bool app::IoEndpoint::set_busy_poll(std::chrono::microseconds budget) {
+  m_busyPollUs = static_cast<int>(budget.count());
+  bool applied = true;
+  for (int fd : {m_listenFd, m_udpFd}) {
+    applied = (fd < 0 || apply_busy_poll(fd)) && applied;
+  }
+  for (const auto& [id, session] : m_sessions) {
+    applied = (session->fd < 0 || apply_busy_poll(session->fd)) && applied;
+  }
+  if (!applied) {
+    spdlog::warn("Endpoint {} can't set a busy-poll budget of {} us: {}", m_id, m_busyPollUs,
+                 std::system_category().message(errno));
+  }
+  return applied;
+}
+
+/**
+ * @brief Applies the busy-poll budget to a socket.
+ * @param fd The socket.
+ * @return true if the budget is set, otherwise false.
+ */
+bool app::IoEndpoint::apply_busy_poll(int fd) const {
+  return setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &m_busyPollUs, sizeof(m_busyPollUs)) == 0;
+}
+
+/**
+ * @brief Accepts all pending client connections.
+ */
+void app::IoEndpoint::accept_sessions() {
+  for (;;) {
+    int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        spdlog::warn("Endpoint {} accept failed: {}", m_id, std::system_category().message(errno));
+      }
+      return;
+    }
+
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    if (m_busyPollUs > 0) {
+      apply_busy_poll(fd);
+    }
+
+    auto session = m_nextSession++;
+    if (m_nextSession == 0) {
+      m_nextSession = 1;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = session;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+      ::close(fd);
+      continue;
+    }
+
+    m_sessions.emplace(session, make_pooled<Session>(Session{fd, OutboundQueue(m_coalescing), {}}));
+    m_statistics.accepted++;
+    if (m_sessionHandler) {
+      m_sessionHandler(*this, session, true);
+    }
+  }
+}
+
+/**
+ * @brief Reads all available bytes of a session and passes them to the capture and the receive handler.
+ * @param session The session id.
+ */
+void app::IoEndpoint::read_session(uint32_t session) {
+  for (;;) {
+    auto it = m_sessions.find(session);
+    if (it == m_sessions.end()) {
+      return;
+    }
+
+    auto received = recv(it->second->fd, m_receiveBuffer.data(), m_receiveBuffer.size(), MSG_DONTWAIT);
+    if (received < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        close_session(session);
+      }
+      return;
+    }
+    if (received == 0) {
+      close_session(session);
+      return;
+    }
+
+    auto data = std::span<const std::byte>(m_receiveBuffer.data(), static_cast<size_t>(received));
+    m_statistics.receivedBytes += data.size();
+    if (m_capture != nullptr) {
+      m_capture->record(m_id, session, data);
+    }
+    if (m_receiveHandler) {
+      m_receiveHandler(*this, session, data);
+    }
+
+    if (static_cast<size_t>(received) < m_receiveBuffer.size()) {
+      return;
+    }
+  }
+}
+
+/**
+ * @brief Reads all available datagrams and passes them to the capture and the receive handler.
+ * A new peer address opens a new session unless the endpoint holds the maximal number of peers.
+ */
+void app::IoEndpoint::read_datagrams() {
+  for (;;) {
+    sockaddr_in peer{};
+    socklen_t peerLength = sizeof(peer);
+    auto received = recvfrom(m_udpFd, m_receiveBuffer.data(), m_receiveBuffer.size(), MSG_DONTWAIT,
+                             reinterpret_cast<sockaddr*>(&peer), &peerLength);
+    if (received < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+
+    const auto now = TimestampService::instance().cached().count();
+    auto known = m_peers.find(peer_key(peer));
+    if (known == m_peers.end() && m_peers.size() >= m_maxPeers) {
+      // idle peers make room, the check itself runs at most every quarter of the timeout
+      expire_peers(now);
+      if (m_peers.size() >= m_maxPeers) {
+        m_statistics.rejectedPeers++;
+        continue;
+      }
+    }
+    auto [it, inserted] = m_peers.try_emplace(peer_key(peer), m_nextSession);
+    auto session = it->second;
+    if (inserted) {
+      auto state = make_pooled<Session>(Session{-1, OutboundQueue(m_coalescing), peer});
+      state->lastReceive = now;
+      m_sessions.emplace(m_nextSession, std::move(state));
+      m_statistics.accepted++;
+      if (++m_nextSession == 0) {
+        m_nextSession = 1;
+      }
+      if (m_sessionHandler) {
+        m_sessionHandler(*this, session, true);
+      }
+    } else if (auto state = m_sessions.find(session); state != m_sessions.end()) {
+      state->second->lastReceive = now;
+    }
+
+    auto data = std::span<const std::byte>(m_receiveBuffer.data(), static_cast<size_t>(received));
+    m_statistics.receivedBytes += data.size();
+    if (m_capture != nullptr) {
+      m_capture->record(m_id, session, data);
+    }
+    if (m_receiveHandler) {
+      m_receiveHandler(*this, session, data);
+    }
+  }
+}
+
+/**
+ * @brief Writes the queued bytes of a writable session.
+ * @param session The session id.
+ */
+void app::IoEndpoint::write_session(uint32_t session) {
+  auto it = m_sessions.find(session);
+  if (it == m_sessions.end()) {
+    return;
+  }
+  flush_session(session, *it->second, FlushReason::writable);
+}
+
+/**
+ * @brief Writes the coalesced bytes of the listed sessions. Sessions with bytes left, not yet due
+ * or waiting for a writable socket, stay listed.
+ * @param all true to write all sessions, otherwise only those whose latency budget expired.
+ */
+void app::IoEndpoint::flush_pending(bool all) {
+  if (m_pending.empty()) {
+    return;
+  }
+  const int64_t now = all ? 0 : TimestampService::instance().now().count();
+  const auto reason = all || m_coalescing.latencyBudget.count() == 0 ? FlushReason::tick : FlushReason::budget;
+  size_t kept = 0;
+  // by index, a closed session calls the session handler, which may send to other sessions
+  for (size_t i = 0; i < m_pending.size(); ++i) {
+    const auto session = m_pending[i];
+    auto it = m_sessions.find(session);
+    if (it == m_sessions.end()) {
+      continue;
+    }
+    auto& state = *it->second;
+    if (!state.output.blocked() && (all || state.output.due(now)) && !flush_session(session, state, reason)) {
+      continue;
+    }
+    if (state.output.empty() || state.output.blocked()) {
+      state.pending = false;
+    } else {
+      m_pending[kept++] = session;
+    }
+  }
+  m_pending.resize(kept);
+}
+
+/**
+ * @brief Writes the queued bytes of a session, closes it if the connection failed.
+ * @param session The session id.
+ * @param state The session.
+ * @param reason The trigger of the flush.
+ * @return false if the session is closed, otherwise true.
+ */
+bool app::IoEndpoint::flush_session(uint32_t session, Session& state, FlushReason reason) {
+  const auto before = state.output.statistics();
+  if (state.output.flush(state.fd, reason) == FlushResult::failed) {
+    close_session(session);
+    return false;
+  }
+  update_output(session, state, before);
+  return true;
+}
+
+/**
+ * @brief Counts the writes of an outbound queue, watches a blocked session for a writable socket
+ * and lists a session with bytes to flush.
+ * @param session The session id.
+ * @param state The session.
+ * @param before The counters of the queue before the writes.
+ */
+void app::IoEndpoint::update_output(uint32_t session, Session& state, const OutboundStatistics& before) {
+  const auto& after = state.output.statistics();
+  m_statistics.sentBytes += after.written - before.written;
+  m_statistics.sendCalls += after.writes - before.writes;
+  if (state.output.blocked() != state.watching) {
+    watch_output(session, state, state.output.blocked());
+  }
+  if (!state.pending && !state.output.empty() && !state.output.blocked()) {
+    state.pending = true;
+    m_pending.push_back(session);
+  }
+}
+
+/**
+ * @brief Closes a session.
+ * @param session The session id.
+ */
+void app::IoEndpoint::close_session(uint32_t session) {
+  auto it = m_sessions.find(session);
+  if (it == m_sessions.end()) {
+    return;
+  }
+  if (it->second->fd >= 0) {
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, it->second->fd, nullptr);
+    ::close(it->second->fd);
+  } else {
+    m_peers.erase(peer_key(it->second->peer));
+  }
+  m_sessions.erase(it);
+  m_statistics.closed++;
+  if (m_sessionHandler) {
+    m_sessionHandler(*this, session, false);
+  }
+}
+
+/**
+ * @brief Closes the UDP peers that sent nothing for the idle timeout through close_session(), so the
+ * session handler sees them closed. The peers are checked at most every quarter of the timeout.
+ * @param now The current time in ns.
+ */
+void app::IoEndpoint::expire_peers(int64_t now) {
+  const auto idle = std::chrono::nanoseconds(m_peerIdle).count();
+  if (now < m_nextExpiry) {
+    return;
+  }
+  m_nextExpiry = now + std::max<int64_t>(idle / 4, 1'000'000);
+
+  std::vector<uint32_t> expired;
+  for (const auto& [key, session] : m_peers) {
+    auto it = m_sessions.find(session);
+    if (it != m_sessions.end() && now - it->second->lastReceive >= idle) {
+      expired.push_back(session);
+    }
+  }
+  for (auto session : expired) {
+    close_session(session);
+  }
+  if (!expired.empty()) {
+    m_statistics.expiredPeers += expired.size();
+    spdlog::debug("Endpoint {} closed {} idle UDP peers", m_id, expired.size());
+  }
+}
+
+/**
+ * @brief Enables or disables the notification about a writable socket.
+ * @param session The session id.
+ * @param state The session.
+ * @param enable true to watch for a writable socket.
+ */
+void app::IoEndpoint::watch_output(uint32_t session, Session& state, bool enable) {
+  epoll_event event{};
+  event.events = enable ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+  event.data.u64 = session;
+  epoll_ctl(m_epollFd, EPOLL_CTL_MOD, state.fd, &event);
+  state.watching = enable;
+}
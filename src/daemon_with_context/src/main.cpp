@@ -13,6 +13,8 @@
 
 #include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include <cstdio>
 #include <filesystem>
@@ -24,8 +26,13 @@
 #include <spdlog/spdlog.h>
 
 #include "appContext.hpp"
+#include "busyPoller.hpp"
+#include "checksum.hpp"
+#include "cpuDispatch.hpp"
+#include "cpuResources.hpp"
 #include "daemon.hpp"
 #include "daemonConfig.hpp"
+#include "threadRoles.hpp"
 #include "version.hpp"
 
 using namespace std::chrono_literals;
@@ -53,20 +60,37 @@ static DaemonEvent daemon_event;
 /**
  * @brief The options for the program.
  */
-static const std::array<std::string_view, 8> OPTIONS = {
+static const std::array<std::string_view, 25> OPTIONS = {
     "  -D, --background         start as daemon\n",
     "  -F, --foreground         start in foreground with test console\n",
     "  -S, --cfgpath            path to folder with configuration files\n",
     "  -x, --cfgfile            specified configuration file\n",
     "  -P, --pidfile            create pid file\n",
     "  -L, --logfile            specified log file\n",
+    "  -l, --listen             listen address [host:]port of the context endpoint\n",
+    "  -C, --capture            record received traffic into capture file\n",
+    "  -B, --busy-poll          busy-poll the context, park after the given idle polls\n",
+    "  -c, --cpu                pin the context task to the given CPU\n",
+    "  -K, --critical-cpus      CPU list of latency-critical threads, default isolated CPUs\n",
+    "  -k, --housekeeping-cpus  CPU list of housekeeping threads, default the other CPUs\n",
+    "  -Q, --critical-sched     scheduling of critical threads: other[:nice], fifo:prio, rr:prio\n",
+    "  -q, --housekeeping-sched scheduling of housekeeping threads: other[:nice], batch[:nice]\n",
+    "  -R, --redundancy         hot standby: id@[host:]port,peer@[host:]port[,heartbeat ms[,lease ms]]\n",
+    "  -s, --snapshot           write the context state to the file on SIGUSR1\n",
+    "  -M, --mapping            map source addresses to points by the file, reloaded on SIGHUP\n",
+    "  -E, --expressions        compute points by the formulas of the file\n",
+    "  -A, --alarms             evaluate the limit alarms of the file for the changed points\n",
+    "  -X, --cpu-level          highest SIMD level of the kernels: scalar, sse4.2, avx2, avx512, neon\n",
+    "  -p, --poll               interrogate every session: period ms[:aligned|hashed|staggered]\n",
+    "  -W, --coalesce           coalesce the sends of a session: flush bytes[:latency budget us]\n",
+    "  -N, --socket-name        name of the activated sockets of the context endpoint, default endpoint\n",
     "  -v, --version            version\n",
     "  -h, --help               this message\n"};
 
 /**
  *  @brief The help options for the program.
  */
-static const char* help_options = "h?vDFP:S:x:L:";
+static const char* help_options = "h?vDFP:S:x:L:l:C:B:c:K:k:Q:q:R:s:M:E:A:X:p:W:N:";
 static const struct option long_options[] = {
     {"help", no_argument, nullptr, 0},
     {"version", no_argument, nullptr, 'v'},
@@ -76,15 +100,38 @@ static const struct option long_options[] = {
     {"cfgpath", required_argument, nullptr, 'S'},
     {"cfgfile", required_argument, nullptr, 'x'},
     {"logfile", required_argument, nullptr, 'L'},
+    {"listen", required_argument, nullptr, 'l'},
+    {"capture", required_argument, nullptr, 'C'},
+    {"busy-poll", required_argument, nullptr, 'B'},
+    {"cpu", required_argument, nullptr, 'c'},
+    {"critical-cpus", required_argument, nullptr, 'K'},
+    {"housekeeping-cpus", required_argument, nullptr, 'k'},
+    {"critical-sched", required_argument, nullptr, 'Q'},
+    {"housekeeping-sched", required_argument, nullptr, 'q'},
+    {"redundancy", required_argument, nullptr, 'R'},
+    {"snapshot", required_argument, nullptr, 's'},
+    {"mapping", required_argument, nullptr, 'M'},
+    {"expressions", required_argument, nullptr, 'E'},
+    {"alarms", required_argument, nullptr, 'A'},
+    {"cpu-level", required_argument, nullptr, 'X'},
+    {"poll", required_argument, nullptr, 'p'},
+    {"coalesce", required_argument, nullptr, 'W'},
+    {"socket-name", required_argument, nullptr, 'N'},
     {nullptr, 0, nullptr, 0},
 };
 
 /**
  * @brief The sample command lines for the program.
  */
-static const std::array<std::string_view, 4> SAMPLE_COMMANDS = {
+static const std::array<std::string_view, 16> SAMPLE_COMMANDS = {
     " -F\n", " -D -P /var/run/some.pid\n", " -F -S /app/config\n",
-    " -D -x /app/config/settings.xml -P /var/run/some.pid\n"};
+    " -D -x /app/config/settings.xml -P /var/run/some.pid\n", " -D -l 2404 -C /var/tmp/traffic.dcap\n",
+    " -D -l 2404 -B 20000 -c 3\n", " -D -l 2404 -K 2-3 -k 0-1 -Q fifo:50 -q other:5\n",
+    " -D -l 2404 -R 1@:2501,2@10.0.0.2:2502,10,50\n",
+    " -D -l 2404 -s /var/tmp/context.snapshot\n", " -D -l 2404 -M /app/config/points.map\n",
+    " -D -l 2404 -E /app/config/computed.expr\n", " -D -l 2404 -A /app/config/limits.alarm\n",
+    " -D -l 2404 -X sse4.2\n", " -D -l 2404 -p 5000:staggered\n",
+    " -D -l 2404 -W 65536:200\n", " -F -N iec104\n"};
 
 //----------------------------------------------------------------------------
 // Prototypes
@@ -215,6 +262,99 @@ static void process_command_line(int argc, char* argv[], app::DaemonConfig& conf
         config.logFile.assign(optarg);
         break;
 
+      case 'l':
+        handle_option_argument("listen address", optarg, argv[0]);
+        config.listenAddress.assign(optarg);
+        break;
+
+      case 'C':
+        handle_option_argument("capture file", optarg, argv[0]);
+        config.captureFile.assign(optarg);
+        break;
+
+      case 'B':
+        handle_option_argument("busy-poll", optarg, argv[0]);
+        try {
+          config.busyPollSpins = static_cast<uint32_t>(std::stoul(optarg));
+        } catch (const std::exception&) {
+          display_help(argv[0], "busy-poll");
+        }
+        break;
+
+      case 'c':
+        handle_option_argument("cpu", optarg, argv[0]);
+        try {
+          config.taskCpu = std::stoi(optarg);
+        } catch (const std::exception&) {
+          display_help(argv[0], "cpu");
+        }
+        break;
+
+      case 'K':
+        handle_option_argument("critical cpus", optarg, argv[0]);
+        config.criticalCpus.assign(optarg);
+        break;
+
+      case 'k':
+        handle_option_argument("housekeeping cpus", optarg, argv[0]);
+        config.housekeepingCpus.assign(optarg);
+        break;
+
+      case 'Q':
+        handle_option_argument("critical scheduling", optarg, argv[0]);
+        config.criticalSched.assign(optarg);
+        break;
+
+      case 'q':
+        handle_option_argument("housekeeping scheduling", optarg, argv[0]);
+        config.housekeepingSched.assign(optarg);
+        break;
+
+      case 'R':
+        handle_option_argument("redundancy", optarg, argv[0]);
+        config.redundancy.assign(optarg);
+        break;
+
+      case 's':
+        handle_option_argument("snapshot file", optarg, argv[0]);
+        config.snapshotFile.assign(optarg);
+        break;
+
+      case 'M':
+        handle_option_argument("mapping file", optarg, argv[0]);
+        config.mappingFile.assign(optarg);
+        break;
+
+      case 'E':
+        handle_option_argument("expression file", optarg, argv[0]);
+        config.expressionFile.assign(optarg);
+        break;
+
+      case 'A':
+        handle_option_argument("alarm file", optarg, argv[0]);
+        config.alarmFile.assign(optarg);
+        break;
+
+      case 'X':
+        handle_option_argument("cpu level", optarg, argv[0]);
+        config.cpuLevel.assign(optarg);
+        break;
+
+      case 'p':
+        handle_option_argument("poll period", optarg, argv[0]);
+        config.poll.assign(optarg);
+        break;
+
+      case 'W':
+        handle_option_argument("coalescing", optarg, argv[0]);
+        config.coalesce.assign(optarg);
+        break;
+
+      case 'N':
+        handle_option_argument("socket name", optarg, argv[0]);
+        config.socketName.assign(optarg);
+        break;
+
       default:
         std::cerr << "Unknown option: " << std::to_string(current_option) << std::endl;
         display_help(argv[0]);
@@ -249,6 +389,87 @@ handleConsoleType handle_console() {
   return handleConsoleType::none;
 }
 
+/*************************************************************************/ /**
+ * @brief Builds the thread partition from the detected isolated CPUs and the configuration.
+ * @param config The configuration.
+ * @return The partition, none if a CPU list or a scheduling is invalid.
+ *****************************************************************************/
+std::optional<app::ThreadPartition> make_thread_partition(const app::DaemonConfig& config) {
+  auto partition = app::ThreadPartition::detect();
+  if (!config.criticalCpus.empty() || !config.housekeepingCpus.empty()) {
+    partition.critical.cpus = app::CpuResources::parse_cpu_list(config.criticalCpus);
+    partition.housekeeping.cpus = app::CpuResources::parse_cpu_list(config.housekeepingCpus);
+    partition.origin = "configured";
+  }
+  if (!partition.critical.parse_scheduling(config.criticalSched)) {
+    spdlog::error("invalid scheduling of critical threads '{}'", config.criticalSched);
+    return std::nullopt;
+  }
+  if (!partition.housekeeping.parse_scheduling(config.housekeepingSched)) {
+    spdlog::error("invalid scheduling of housekeeping threads '{}'", config.housekeepingSched);
+    return std::nullopt;
+  }
+  return partition;
+}
+
+/*************************************************************************/ /**
+ * @brief Binds the SIMD kernels to the configured or detected CPU level and logs the variants.
+ * @param config The configuration.
+ * @return false if the level is unknown or the CPU doesn't support it.
+ *****************************************************************************/
+bool bind_kernels(const app::DaemonConfig& config) {
+  auto& dispatch = app::CpuDispatch::instance();
+  if (!config.cpuLevel.empty()) {
+    auto level = app::parse_cpu_level(config.cpuLevel);
+    if (!level.has_value() || !dispatch.force_level(*level)) {
+      spdlog::error("invalid cpu level '{}', the CPU supports up to {}", config.cpuLevel,
+                    app::to_string(dispatch.detected_level()));
+      return false;
+    }
+  }
+  dispatch.bind();
+  spdlog::info("cpu level {} (detected {}): {}", app::to_string(dispatch.level()),
+               app::to_string(dispatch.detected_level()), dispatch.features().to_string());
+  for (const auto& binding : dispatch.bindings()) {
+    spdlog::info("kernel '{}': {}", binding.name, app::to_string(binding.level));
+  }
+  spdlog::info("kernel 'crc32c': {}", app::to_string(app::Checksum::best_path(app::ChecksumAlgorithm::crc32c)));
+  return true;
+}
+
+/*************************************************************************/ /**
+ * @brief Tags the calling thread with its role and logs failed settings.
+ * @param role The role.
+ * @param name The thread name.
+ *****************************************************************************/
+void assign_thread_role(app::ThreadRole role, std::string_view name) {
+  if (auto error = app::ThreadRoles::instance().assign(role, name)) {
+    spdlog::warn("{} thread '{}' runs without its role settings: {}", app::to_string(role), name, *error);
+    return;
+  }
+  spdlog::info("{} thread '{}': {}", app::to_string(role), name,
+               app::ThreadRoles::instance().partition().settings(role).describe());
+}
+
+/*************************************************************************/ /**
+ * @brief Prepares the application task: tags it as critical and pins it to a CPU.
+ * @param cpu The CPU, negative for no pinning.
+ *****************************************************************************/
+void prepare_task(int cpu) {
+  assign_thread_role(app::ThreadRole::critical, "context");
+  if (cpu < 0) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (auto error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); error != 0) {
+    spdlog::warn("can't pin the application task to CPU {}: {}", cpu, std::system_category().message(error));
+    return;
+  }
+  spdlog::info("application task pinned to CPU {}", cpu);
+}
+
 /*************************************************************************/ /**
  * @brief Subscriber main function
  * @desc Threads cannot always actively monitor a stop token.
@@ -265,10 +486,11 @@ void TaskAppContextFunc(app::AppContext& app_context, app::DaemonConfig& daemon_
     daemon_event.event_condition.notify_all();
   });
 
+  prepare_task(daemon_config.taskCpu);
   spdlog::info("application task started");
 
   while (true) {
-    spdlog::info("application task ticks {} ms", sooner.count());
+    spdlog::debug("application task ticks {} ms", sooner.count());
     // observe serves states
     sooner = app_context.process_executing(sooner);
     if (sooner.count() > 0) {
@@ -287,6 +509,52 @@ void TaskAppContextFunc(app::AppContext& app_context, app::DaemonConfig& daemon_
   spdlog::info("application task completed");
 }
 
+/*************************************************************************/ /**
+ * @brief Busy-polling main function
+ * @desc The task polls the context without blocking and parks in process_executing only after
+ * the configured idle polls, so input arriving while it spins is handled without a wakeup.
+ * @param app_context - application context
+ * @param daemon_config - configuration
+ * @param token - stop task token
+ *****************************************************************************/
+void TaskAppContextBusyPollFunc(app::AppContext& app_context, app::DaemonConfig& daemon_config, std::stop_token token) {
+  auto sooner = 1000ms;
+
+  // Register a stop callback
+  std::stop_callback stop_cb(token, [&]() {
+    // Wake thread on stop request
+    daemon_event.event_condition.notify_all();
+  });
+
+  prepare_task(daemon_config.taskCpu);
+  app::BusyPoller poller(app::BusyPollConfig{.idleSpins = daemon_config.busyPollSpins});
+  spdlog::info("application task started, busy-polling with {} idle polls", poller.idle_spins());
+
+  poller.start();
+  while (!token.stop_requested()) {
+    if (!poller.polled(app_context.process_polling())) {
+      app::BusyPoller::cpu_relax();
+      continue;
+    }
+
+    // park: the context waits for its input or the task sleeps as in the normal mode
+    auto parkStart = app::BusyPoller::Clock::now();
+    sooner = app_context.process_executing(sooner);
+    if (sooner.count() > 0) {
+      std::unique_lock lck(daemon_event.event_mutex);
+      daemon_event.event_condition.wait_for(lck, std::chrono::milliseconds(sooner));
+    }
+    poller.parked(parkStart);
+  }
+
+  const auto& stats = poller.statistics();
+  spdlog::info("stop requested for an application task");
+  spdlog::info("busy-poll: {} polls, {} productive, {} parks ({} short), spin ratio {:.1f}%, {} idle polls",
+               stats.polls, stats.productivePolls, stats.parks, stats.shortParks, stats.spin_ratio() * 100.0,
+               poller.idle_spins());
+  spdlog::info("application task completed");
+}
+
 /*************************************************************************/ /**
  * @brief Check and exit on error
  *****************************************************************************/
@@ -343,11 +611,25 @@ int main(int argc, char** argv) {
     return appContext.process_user2();
   });
 
+  //----------------------------------------------------------
+  // Hand the activated sockets to the context by its name
+  //----------------------------------------------------------
+  appContext.adopt_sockets(daemon.take_sockets(appConfig.socketName));
+  daemon.close_unclaimed_sockets();
+
   //----------------------------------------------------------
   // Check integrity this configuration
   //----------------------------------------------------------
   check_and_exit_on_error(appContext.validate_configuration(appConfig), "configuration mismatch");
 
+  auto partition = make_thread_partition(appConfig);
+  check_and_exit_on_error(partition.has_value(), "thread partition mismatch");
+  spdlog::info("thread partition ({}): critical {}, housekeeping {}", partition->origin,
+               partition->critical.describe(), partition->housekeeping.describe());
+  app::ThreadRoles::instance().configure(*partition);
+
+  check_and_exit_on_error(bind_kernels(appConfig), "cpu level mismatch");
+
   //----------------------------------------------------------
   // Prepare application to start
   //----------------------------------------------------------
@@ -371,12 +653,15 @@ int main(int argc, char** argv) {
     }
   }
 
+  // signals, console and reload run in the main thread, the daemon process exists from here on
+  assign_thread_role(app::ThreadRole::housekeeping, "main");
+
   //----------------------------------------------------------
   // start application task
   //----------------------------------------------------------
   // Create all workers and pass stop tokens
-  taskAppContext =
-      std::move(std::thread(TaskAppContextFunc, std::ref(appContext), std::ref(appConfig), stop_src.get_token()));
+  auto taskFunc = appConfig.busyPollSpins > 0 ? TaskAppContextBusyPollFunc : TaskAppContextFunc;
+  taskAppContext = std::move(std::thread(taskFunc, std::ref(appContext), std::ref(appConfig), stop_src.get_token()));
 
   //----------------------------------------------------------
   // Main loop
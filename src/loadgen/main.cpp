@@ -0,0 +1,961 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+//----------------------------------------------------------------------------
+// Includes
+//----------------------------------------------------------------------------
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "latencyHistogram.hpp"
+#include "netAddress.hpp"
+#include "reconnectManager.hpp"
+#include "version.hpp"
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+//----------------------------------------------------------------------------
+// Typedefs, enums, unions, variables
+//----------------------------------------------------------------------------
+
+/**
+ * @brief The transport of the client sessions.
+ */
+enum class Protocol { tcp, udp };
+
+/**
+ * @brief One entry of the request mix.
+ */
+struct MixEntry {
+  size_t size{64};    ///< request size in bytes
+  unsigned weight{1};  ///< relative weight of the entry
+};
+
+/**
+ * @brief The configuration of the load generator.
+ */
+struct LoadConfig {
+  std::string targetAddress;                      ///< The address of the daemon endpoint
+  Protocol protocol{Protocol::tcp};               ///< The transport
+  size_t sessions{100};                           ///< The number of concurrent client sessions
+  double rate{1000.0};                            ///< The total request rate per second
+  std::chrono::milliseconds duration{10000};      ///< The duration of the measurement
+  std::chrono::milliseconds warmup{1000};         ///< The time before the measurement starts
+  std::vector<MixEntry> mix{{64, 1}};             ///< The request mix
+  size_t workers{1};                              ///< The number of worker threads
+  std::string outputFile;                         ///< The JSON report file, stdout if empty
+  std::optional<app::ReconnectConfig> reconnect;  ///< The reconnection of broken TCP sessions, none to give up
+};
+
+/**
+ * @brief The header at the start of every request. The daemon echoes it back.
+ */
+struct RequestHeader {
+  uint64_t sequence;  ///< request sequence number of the worker
+  uint32_t session;   ///< session index
+  uint32_t size;      ///< request size including the header
+};
+
+/**
+ * @brief One client session.
+ */
+struct ClientSession {
+  int fd{-1};                                                  ///< socket
+  uint64_t sentBytes{0};                                       ///< bytes passed to the socket or queued
+  uint64_t receivedBytes{0};                                   ///< received bytes
+  std::vector<std::byte> output;                               ///< bytes not yet accepted by the socket
+  std::deque<std::pair<uint64_t, Clock::time_point>> pending;  ///< end offset and intended time of TCP requests
+  bool connecting{false};                                      ///< a non-blocking reconnect is in progress
+};
+
+/**
+ * @brief The measurement of one worker.
+ */
+struct WorkerResult {
+  app::LatencyHistogram latency;         ///< latency from the intended send time to the response
+  uint64_t sent{0};                      ///< requests sent during the measurement
+  uint64_t sentBytes{0};                 ///< bytes sent during the measurement
+  uint64_t responses{0};                 ///< responses to requests of the measurement
+  uint64_t errors{0};                    ///< failed sessions
+  uint64_t lost{0};                      ///< requests without response at the end, skipped ones included
+  uint64_t skipped{0};                   ///< requests due while their session was down or connecting
+  uint64_t maxBacklog{0};                ///< largest number of requests behind the schedule
+  uint64_t reconnects{0};                ///< sessions connected again after a failure
+  uint64_t attempts{0};                  ///< reconnect attempts
+  uint64_t peakConnecting{0};            ///< most reconnect attempts in flight of a worker
+  app::LatencyHistogram connectLatency;  ///< latency of the successful reconnect attempts
+  app::LatencyHistogram recovery;        ///< time from the failure of a session to its reconnection
+};
+
+/**
+ * @brief The options for the program.
+ */
+static const std::array<std::string_view, 12> OPTIONS = {
+    "  -t, --target             daemon endpoint [host:]port\n",
+    "  -p, --protocol           transport: tcp or udp\n",
+    "  -c, --sessions           number of concurrent client sessions\n",
+    "  -r, --rate               total requests per second\n",
+    "  -d, --duration           measurement duration in seconds\n",
+    "  -W, --warmup             warmup duration in seconds, not measured\n",
+    "  -m, --mix                request mix size:weight[,size:weight...]\n",
+    "  -T, --threads            number of worker threads\n",
+    "  -o, --output             write the JSON report into this file\n",
+    "  -R, --reconnect          reconnect failed TCP sessions: base ms[:cap ms[:max connecting[:policy]]]\n",
+    "  -v, --version            version\n",
+    "  -h, --help               this message\n"};
+
+/**
+ *  @brief The help options for the program.
+ */
+static const char* help_options = "h?vt:p:c:r:d:W:m:T:o:R:";
+static const struct option long_options[] = {
+    {"help", no_argument, nullptr, 'h'},
+    {"version", no_argument, nullptr, 'v'},
+    {"target", required_argument, nullptr, 't'},
+    {"protocol", required_argument, nullptr, 'p'},
+    {"sessions", required_argument, nullptr, 'c'},
+    {"rate", required_argument, nullptr, 'r'},
+    {"duration", required_argument, nullptr, 'd'},
+    {"warmup", required_argument, nullptr, 'W'},
+    {"mix", required_argument, nullptr, 'm'},
+    {"threads", required_argument, nullptr, 'T'},
+    {"output", required_argument, nullptr, 'o'},
+    {"reconnect", required_argument, nullptr, 'R'},
+    {nullptr, 0, nullptr, 0},
+};
+
+/**
+ * @brief The sample command lines for the program.
+ */
+static const std::array<std::string_view, 4> SAMPLE_COMMANDS = {
+    " -t 127.0.0.1:2404 -c 1000 -r 20000 -d 30\n", " -t 2404 -p udp -c 2000 -r 50000 -T 4\n",
+    " -t 2404 -m 16:70,256:25,4096:5 -o capacity.json\n", " -t 2404 -c 2000 -d 60 -R 100:10000:64\n"};
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+
+/*************************************************************************/ /**
+ * Displays the help message for the program.
+ * @param programName The name of the program.
+ * @param errorOption The option with an error.
+ *****************************************************************************/
+static void display_help(const char* programName, std::string_view errorOption = "") {
+  if (!errorOption.empty()) {
+    std::cerr << "Error in option: " << errorOption << "\n";
+  }
+  std::cout << "\nUsage: " << programName << " [OPTIONS]\n" << std::endl;
+  for (const auto& option : OPTIONS) {
+    std::cout << option;
+  }
+  std::cout << "\nSample command lines:" << std::endl;
+  for (const auto& cmd : SAMPLE_COMMANDS) {
+    std::cout << programName << cmd;
+  }
+
+  if (!errorOption.empty()) {
+    exit(EXIT_FAILURE);
+  }
+}
+
+/*************************************************************************/ /**
+ * @brief Parses the request mix "size:weight[,size:weight...]".
+ * @param text The mix text.
+ * @return The mix, empty if the text is invalid.
+ *****************************************************************************/
+static std::vector<MixEntry> parse_mix(const std::string& text) {
+  std::vector<MixEntry> mix;
+  size_t start{0};
+  while (start < text.size()) {
+    auto end = text.find(',', start);
+    auto item = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    auto colon = item.find(':');
+    MixEntry entry;
+    entry.size = std::stoul(item.substr(0, colon));
+    entry.weight = colon == std::string::npos ? 1U : static_cast<unsigned>(std::stoul(item.substr(colon + 1)));
+    if (entry.size < sizeof(RequestHeader) || entry.size > 60000 || entry.weight == 0) {
+      return {};
+    }
+    mix.push_back(entry);
+    if (end == std::string::npos) {
+      break;
+    }
+    start = end + 1;
+  }
+  return mix;
+}
+
+/*************************************************************************/ /**
+ * @brief Parses the reconnection "base ms[:cap ms[:max connecting[:policy]]]".
+ * @param text The reconnection text.
+ * @return The configuration, none if the text is invalid.
+ *****************************************************************************/
+static std::optional<app::ReconnectConfig> parse_reconnect(const std::string& text) {
+  app::ReconnectConfig config;
+  std::vector<std::string> fields;
+  for (size_t start = 0;;) {
+    auto end = text.find(':', start);
+    fields.push_back(text.substr(start, end == std::string::npos ? std::string::npos : end - start));
+    if (end == std::string::npos) {
+      break;
+    }
+    start = end + 1;
+  }
+  if (fields.size() > 4) {
+    return std::nullopt;
+  }
+  config.base = std::chrono::milliseconds(std::stoul(fields[0]));
+  if (fields.size() > 1) {
+    config.cap = std::chrono::milliseconds(std::stoul(fields[1]));
+  }
+  if (fields.size() > 2) {
+    config.maxConnecting = std::stoul(fields[2]);
+  }
+  if (fields.size() > 3) {
+    auto policy = app::parse_backoff_policy(fields[3]);
+    if (!policy) {
+      return std::nullopt;
+    }
+    config.policy = *policy;
+  }
+  if (config.base.count() <= 0 || config.cap < config.base) {
+    return std::nullopt;
+  }
+  return config;
+}
+
+/*************************************************************************/ /**
+ * @brief Processes the command line options passed to the program.
+ * @param argc The number of command line arguments.
+ * @param argv The array of command line argument strings.
+ * @param config The load configuration.
+ *****************************************************************************/
+static void process_command_line(int argc, char* argv[], LoadConfig& config) {
+  int option_index = 0;
+  for (;;) {
+    int current_option = getopt_long(argc, argv, help_options, long_options, &option_index);
+    if (current_option == -1) {
+      break;
+    }
+
+    try {
+      switch (current_option) {
+        case 'h':
+        case '?':
+          display_help(argv[0]);
+          exit(EXIT_SUCCESS);
+
+        case 'v':
+          std::cout << argv[0] << " v." << version::loadgen::getVersion(true) << std::endl;
+          exit(EXIT_SUCCESS);
+
+        case 't':
+          config.targetAddress.assign(optarg);
+          break;
+
+        case 'p':
+          if (std::string_view(optarg) == "tcp") {
+            config.protocol = Protocol::tcp;
+          } else if (std::string_view(optarg) == "udp") {
+            config.protocol = Protocol::udp;
+          } else {
+            display_help(argv[0], optarg);
+          }
+          break;
+
+        case 'c':
+          config.sessions = std::stoul(optarg);
+          break;
+
+        case 'r':
+          config.rate = std::stod(optarg);
+          break;
+
+        case 'd':
+          config.duration = std::chrono::milliseconds(static_cast<int64_t>(std::stod(optarg) * 1000));
+          break;
+
+        case 'W':
+          config.warmup = std::chrono::milliseconds(static_cast<int64_t>(std::stod(optarg) * 1000));
+          break;
+
+        case 'm':
+          config.mix = parse_mix(optarg);
+          if (config.mix.empty()) {
+            display_help(argv[0], optarg);
+          }
+          break;
+
+        case 'T':
+          config.workers = std::stoul(optarg);
+          break;
+
+        case 'o':
+          config.outputFile.assign(optarg);
+          break;
+
+        case 'R':
+          config.reconnect = parse_reconnect(optarg);
+          if (!config.reconnect) {
+            display_help(argv[0], optarg);
+          }
+          break;
+
+        default:
+          display_help(argv[0], std::to_string(current_option));
+      }
+    } catch (const std::exception&) {
+      display_help(argv[0], std::string(argv[optind - 1]));
+    }
+  }
+
+  if (config.targetAddress.empty() || config.sessions == 0 || config.rate <= 0 || config.workers == 0) {
+    display_help(argv[0], "target, sessions, rate and threads are required");
+  }
+  config.workers = std::min(config.workers, config.sessions);
+}
+
+/*************************************************************************/ /**
+ * @brief Raises the limit of open files to the hard limit, sessions need one socket each.
+ *****************************************************************************/
+static void raise_file_limit() {
+  rlimit limit{};
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+/*************************************************************************/ /**
+ * @brief Opens a client session to the daemon.
+ * @param address The daemon address.
+ * @param protocol The transport.
+ * @return The non-blocking socket or -1 on error.
+ *****************************************************************************/
+static int open_session(const sockaddr_in& address, Protocol protocol) {
+  int fd = socket(AF_INET, (protocol == Protocol::tcp ? SOCK_STREAM : SOCK_DGRAM) | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+    ::close(fd);
+    return -1;
+  }
+  if (protocol == Protocol::tcp) {
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  }
+  int flags = fcntl(fd, F_GETFL);
+  fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+  return fd;
+}
+
+/*************************************************************************/ /**
+ * @brief Gets the time of the reconnect manager.
+ * @param time The time point.
+ * @return The time in nanoseconds.
+ *****************************************************************************/
+static int64_t to_nanoseconds(Clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+/**
+ * @brief The Worker class drives the requests of a share of the sessions at a fixed rate.
+ *
+ * The load is open-loop: request k is due at start + k / rate regardless of outstanding responses.
+ * The latency is measured from the due time, not from the actual send time, so a generator or
+ * daemon stall shows up in the latency instead of silently lowering the load (coordinated omission).
+ */
+class Worker {
+ public:
+  Worker(const LoadConfig& config, const sockaddr_in& address, size_t firstSession, size_t sessionCount,
+         double rate)
+      : m_config(config), m_address(address), m_firstSession(firstSession), m_rate(rate), m_random(firstSession) {
+    m_sessions.resize(sessionCount);
+    unsigned total{0};
+    for (const auto& entry : config.mix) {
+      total += entry.weight;
+      m_mixLimits.push_back(total);
+      m_maxSize = std::max(m_maxSize, entry.size);
+    }
+    m_mixTotal = total;
+    if (config.reconnect && config.protocol == Protocol::tcp) {
+      // the limit of the attempts in flight is shared by the workers
+      auto reconnect = *config.reconnect;
+      if (reconnect.maxConnecting > 0) {
+        reconnect.maxConnecting = std::max<size_t>(1, reconnect.maxConnecting / config.workers);
+      }
+      m_reconnect.emplace(reconnect);
+    }
+  }
+
+  ~Worker() {
+    for (auto& session : m_sessions) {
+      if (session.fd >= 0) {
+        ::close(session.fd);
+      }
+    }
+    if (m_epollFd >= 0) {
+      ::close(m_epollFd);
+    }
+  }
+
+  /**
+   * @brief Opens all sessions of the worker.
+   * @return true if all sessions are open, otherwise false.
+   */
+  bool connect() {
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    for (size_t i = 0; i < m_sessions.size(); ++i) {
+      m_sessions[i].fd = open_session(m_address, m_config.protocol);
+      if (m_sessions[i].fd < 0) {
+        spdlog::error("Session {} can't connect: {}", m_firstSession + i, std::system_category().message(errno));
+        return false;
+      }
+      epoll_event event{};
+      event.events = EPOLLIN;
+      event.data.u64 = i;
+      epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_sessions[i].fd, &event);
+      if (m_reconnect) {
+        // the blocking connect is the first attempt of the session
+        auto now = to_nanoseconds(Clock::now());
+        m_reconnect->add(i, now);
+        m_reconnect->next_attempt(now);
+        m_reconnect->connected(i, now);
+      }
+    }
+    if (m_reconnect) {
+      m_reconnect->reset_metrics();
+    }
+    return true;
+  }
+
+  /**
+   * @brief Sends the requests at the fixed rate and collects the responses.
+   * @param start The common start time of all workers.
+   */
+  void run(Clock::time_point start) {
+    auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_rate));
+    auto measureStart = start + m_config.warmup;
+    auto end = measureStart + m_config.duration;
+    m_measureStart = measureStart;
+
+    std::vector<std::byte> request(m_maxSize);
+    uint64_t sequence{0};
+    auto due = start;
+    size_t nextSession{0};
+
+    while (due < end) {
+      auto now = Clock::now();
+      uint64_t backlog{0};
+      while (due <= now && due < end) {
+        send_request(nextSession, sequence++, due, request);
+        nextSession = (nextSession + 1) % m_sessions.size();
+        due += interval;
+        backlog++;
+      }
+      m_result.maxBacklog = std::max(m_result.maxBacklog, backlog);
+      auto until = std::min(due, end);
+      if (m_reconnect) {
+        until = std::min(until, reconnect_sessions(now));
+      }
+      wait_for_responses(until);
+    }
+
+    // collect the outstanding responses
+    auto deadline = Clock::now() + 1s;
+    while (Clock::now() < deadline && outstanding() > 0) {
+      wait_for_responses(std::min(deadline, Clock::now() + 10ms));
+    }
+    m_result.lost += outstanding();
+    if (m_reconnect) {
+      m_result.peakConnecting = m_reconnect->statistics().peak;
+      m_result.connectLatency = m_reconnect->connect_latency();
+      m_result.recovery = m_reconnect->recovery();
+    }
+  }
+
+  /**
+   * @brief Gets the measurement of the worker.
+   * @return The measurement.
+   */
+  [[nodiscard]] const WorkerResult& result() const {
+    return m_result;
+  }
+
+ private:
+  /**
+   * @brief Picks a request size from the mix.
+   */
+  size_t pick_size() {
+    auto value = std::uniform_int_distribution<unsigned>(0, m_mixTotal - 1)(m_random);
+    auto it = std::upper_bound(m_mixLimits.begin(), m_mixLimits.end(), value);
+    return m_config.mix[static_cast<size_t>(it - m_mixLimits.begin())].size;
+  }
+
+  /**
+   * @brief Sends one request, due at the given time. A request due while its session is down is
+   * skipped and counted as lost, so an outage shows in the report.
+   */
+  void send_request(size_t index, uint64_t sequence, Clock::time_point due, std::vector<std::byte>& request) {
+    auto& session = m_sessions[index];
+    if (session.fd < 0 || session.connecting) {
+      if (due >= m_measureStart) {
+        m_result.skipped++;
+        m_result.lost++;
+      }
+      return;
+    }
+
+    auto size = pick_size();
+    RequestHeader header{sequence, static_cast<uint32_t>(m_firstSession + index), static_cast<uint32_t>(size)};
+    std::memcpy(request.data(), &header, sizeof(header));
+    auto data = std::span<const std::byte>(request.data(), size);
+
+    bool measured = due >= m_measureStart;
+    if (measured) {
+      m_result.sent++;
+      m_result.sentBytes += size;
+    }
+
+    if (m_config.protocol == Protocol::udp) {
+      if (::send(session.fd, data.data(), data.size(), MSG_DONTWAIT) == static_cast<ssize_t>(data.size())) {
+        m_datagrams.emplace(sequence, due);
+      } else if (measured) {
+        m_result.lost++;
+      }
+      return;
+    }
+
+    session.sentBytes += size;
+    session.pending.emplace_back(session.sentBytes, due);
+    if (!session.output.empty()) {
+      session.output.insert(session.output.end(), data.begin(), data.end());
+      return;
+    }
+
+    size_t offset{0};
+    while (offset < data.size()) {
+      auto sent = ::send(session.fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (sent < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          fail_session(index);
+          return;
+        }
+        break;
+      }
+      offset += static_cast<size_t>(sent);
+    }
+    if (offset < data.size()) {
+      session.output.assign(data.begin() + static_cast<std::ptrdiff_t>(offset), data.end());
+      watch_output(index, true);
+    }
+  }
+
+  /**
+   * @brief Waits until the given time and processes the responses. epoll_pwait2() waits to the
+   * nanosecond since Linux 5.11, older kernels wait with epoll_wait() to the next millisecond.
+   */
+  void wait_for_responses(Clock::time_point until) {
+    std::array<epoll_event, 256> events{};
+    auto remaining = std::max(until - Clock::now(), Clock::duration::zero());
+    int count{-1};
+    bool waited{false};
+#ifdef SYS_epoll_pwait2
+    if (m_preciseWait) {
+      auto seconds = std::chrono::duration_cast<std::chrono::seconds>(remaining);
+      auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining - seconds);
+      timespec timeout{static_cast<time_t>(seconds.count()), static_cast<long>(nanoseconds.count())};
+      // the system call itself, glibc wraps it only since 2.35
+      count = static_cast<int>(syscall(SYS_epoll_pwait2, m_epollFd, events.data(), static_cast<int>(events.size()),
+                                       &timeout, nullptr, 0));
+      waited = count >= 0 || errno != ENOSYS;
+      m_preciseWait = waited;
+    }
+#endif
+    if (!waited) {
+      auto timeout = std::chrono::ceil<std::chrono::milliseconds>(remaining);
+      count = epoll_wait(m_epollFd, events.data(), static_cast<int>(events.size()), static_cast<int>(timeout.count()));
+    }
+    if (count < 0) {
+      if (errno != EINTR) {
+        spdlog::error("Epoll wait failed: {}", std::system_category().message(errno));
+      }
+      return;
+    }
+
+    for (int i = 0; i < count; ++i) {
+      auto index = static_cast<size_t>(events[static_cast<size_t>(i)].data.u64);
+      if (m_sessions[index].connecting) {
+        finish_connect(index);
+        continue;
+      }
+      if (events[static_cast<size_t>(i)].events & EPOLLOUT) {
+        flush_output(index);
+      }
+      if (events[static_cast<size_t>(i)].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        read_responses(index);
+      }
+    }
+  }
+
+  /**
+   * @brief Reads the responses of a session and records their latency.
+   */
+  void read_responses(size_t index) {
+    auto& session = m_sessions[index];
+    std::array<std::byte, 64 * 1024> buffer{};
+    for (;;) {
+      auto received = recv(session.fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+      if (received < 0 && errno == EINTR) {
+        continue;
+      }
+      if (received <= 0) {
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+          fail_session(index);
+        }
+        break;
+      }
+
+      auto now = Clock::now();
+      if (m_config.protocol == Protocol::udp) {
+        RequestHeader header{};
+        if (static_cast<size_t>(received) >= sizeof(header)) {
+          std::memcpy(&header, buffer.data(), sizeof(header));
+          if (auto it = m_datagrams.find(header.sequence); it != m_datagrams.end()) {
+            complete(it->second, now);
+            m_datagrams.erase(it);
+          }
+        }
+        continue;
+      }
+
+      session.receivedBytes += static_cast<uint64_t>(received);
+      while (!session.pending.empty() && session.pending.front().first <= session.receivedBytes) {
+        complete(session.pending.front().second, now);
+        session.pending.pop_front();
+      }
+    }
+  }
+
+  /**
+   * @brief Records the latency of a completed request.
+   */
+  void complete(Clock::time_point due, Clock::time_point now) {
+    if (due >= m_measureStart) {
+      m_result.responses++;
+      m_result.latency.record(now - due);
+    }
+  }
+
+  /**
+   * @brief Writes the queued bytes of a session.
+   */
+  void flush_output(size_t index) {
+    auto& session = m_sessions[index];
+    auto sent = ::send(session.fd, session.output.data(), session.output.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        fail_session(index);
+      }
+      return;
+    }
+    session.output.erase(session.output.begin(), session.output.begin() + sent);
+    if (session.output.empty()) {
+      watch_output(index, false);
+    }
+  }
+
+  /**
+   * @brief Enables or disables the notification about a writable socket.
+   */
+  void watch_output(size_t index, bool enable) {
+    epoll_event event{};
+    event.events = enable ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    event.data.u64 = index;
+    epoll_ctl(m_epollFd, EPOLL_CTL_MOD, m_sessions[index].fd, &event);
+  }
+
+  /**
+   * @brief Closes a failed session, its outstanding requests are lost.
+   */
+  void fail_session(size_t index) {
+    auto& session = m_sessions[index];
+    if (session.fd < 0) {
+      return;
+    }
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, session.fd, nullptr);
+    ::close(session.fd);
+    session.fd = -1;
+    m_result.errors++;
+    for (const auto& [offset, due] : session.pending) {
+      if (due >= m_measureStart) {
+        m_result.lost++;
+      }
+    }
+    session.pending.clear();
+    session.output.clear();
+    if (m_reconnect) {
+      m_reconnect->lost(index, to_nanoseconds(Clock::now()));
+    }
+  }
+
+  /**
+   * @brief Times out the expired reconnect attempts and starts the due ones.
+   * @param now The current time.
+   * @return The time of the next attempt or timeout.
+   */
+  Clock::time_point reconnect_sessions(Clock::time_point now) {
+    const auto nanoseconds = to_nanoseconds(now);
+    while (auto index = m_reconnect->next_expired(nanoseconds)) {
+      close_connect(static_cast<size_t>(*index));
+    }
+    auto delay = m_reconnect->run(nanoseconds, 1000ms, [this](uint64_t index) { start_connect(index); });
+    return now + delay;
+  }
+
+  /**
+   * @brief Starts a non-blocking connect of a failed session.
+   */
+  void start_connect(size_t index) {
+    auto& session = m_sessions[index];
+    m_result.attempts++;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || (::connect(fd, reinterpret_cast<const sockaddr*>(&m_address), sizeof(m_address)) < 0 &&
+                   errno != EINPROGRESS)) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+      m_reconnect->failed(index, to_nanoseconds(Clock::now()));
+      return;
+    }
+    session.fd = fd;
+    session.connecting = true;
+    epoll_event event{};
+    event.events = EPOLLOUT;
+    event.data.u64 = index;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event);
+  }
+
+  /**
+   * @brief Completes the connect of a session when its socket is writable or failed.
+   */
+  void finish_connect(size_t index) {
+    auto& session = m_sessions[index];
+    int error{0};
+    socklen_t length = sizeof(error);
+    getsockopt(session.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+    auto now = to_nanoseconds(Clock::now());
+    if (error != 0) {
+      close_connect(index);
+      m_reconnect->failed(index, now);
+      return;
+    }
+    int enable = 1;
+    setsockopt(session.fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    session.connecting = false;
+    session.sentBytes = 0;
+    session.receivedBytes = 0;
+    watch_output(index, false);
+    m_reconnect->connected(index, now);
+    m_result.reconnects++;
+  }
+
+  /**
+   * @brief Closes the socket of a failed or expired connect.
+   */
+  void close_connect(size_t index) {
+    auto& session = m_sessions[index];
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, session.fd, nullptr);
+    ::close(session.fd);
+    session.fd = -1;
+    session.connecting = false;
+  }
+
+  /**
+   * @brief Gets the number of outstanding measured requests.
+   */
+  [[nodiscard]] uint64_t outstanding() const {
+    uint64_t count{0};
+    for (const auto& [sequence, due] : m_datagrams) {
+      count += due >= m_measureStart ? 1 : 0;
+    }
+    for (const auto& session : m_sessions) {
+      for (const auto& [offset, due] : session.pending) {
+        count += due >= m_measureStart ? 1 : 0;
+      }
+    }
+    return count;
+  }
+
+  const LoadConfig& m_config;                                   ///< configuration
+  sockaddr_in m_address;                                        ///< daemon address
+  size_t m_firstSession;                                        ///< index of the first session
+  double m_rate;                                                ///< request rate of this worker
+  std::mt19937_64 m_random;                                     ///< random source of the mix
+  std::vector<unsigned> m_mixLimits;                            ///< cumulative mix weights
+  unsigned m_mixTotal{0};                                       ///< sum of the mix weights
+  size_t m_maxSize{0};                                          ///< largest request size
+  int m_epollFd{-1};                                            ///< epoll instance
+  bool m_preciseWait{true};                                     ///< epoll_pwait2() is available
+  std::vector<ClientSession> m_sessions;                        ///< sessions of the worker
+  std::unordered_map<uint64_t, Clock::time_point> m_datagrams;  ///< due time of outstanding UDP requests
+  Clock::time_point m_measureStart;                             ///< end of the warmup
+  WorkerResult m_result;                                        ///< measurement
+  std::optional<app::ReconnectManager> m_reconnect;             ///< reconnection of failed sessions, if enabled
+};
+
+/*************************************************************************/ /**
+ * @brief Formats the measurement as JSON.
+ *****************************************************************************/
+static std::string format_report(const LoadConfig& config, const WorkerResult& total) {
+  auto seconds = std::chrono::duration<double>(config.duration).count();
+  auto us = [&](double percentile) { return static_cast<double>(total.latency.percentile(percentile)) / 1000.0; };
+  auto scaled = [](const app::LatencyHistogram& histogram, double percentile, double unit) {
+    return static_cast<double>(histogram.percentile(percentile)) / unit;
+  };
+
+  std::string mix;
+  for (const auto& entry : config.mix) {
+    mix += fmt::format("{}{{\"size\": {}, \"weight\": {}}}", mix.empty() ? "" : ", ", entry.size, entry.weight);
+  }
+
+  return fmt::format(
+      "{{\n"
+      "  \"target\": \"{}\",\n"
+      "  \"protocol\": \"{}\",\n"
+      "  \"sessions\": {},\n"
+      "  \"threads\": {},\n"
+      "  \"mix\": [{}],\n"
+      "  \"duration_s\": {:.3f},\n"
+      "  \"target_rate_rps\": {:.1f},\n"
+      "  \"requests\": {},\n"
+      "  \"responses\": {},\n"
+      "  \"lost\": {},\n"
+      "  \"skipped\": {},\n"
+      "  \"session_errors\": {},\n"
+      "  \"max_send_backlog\": {},\n"
+      "  \"reconnects\": {},\n"
+      "  \"reconnect_attempts\": {},\n"
+      "  \"max_connecting\": {},\n"
+      "  \"connect_latency_us\": {{\"p50\": {:.1f}, \"p99\": {:.1f}, \"max\": {:.1f}}},\n"
+      "  \"reconnect_ms\": {{\"p50\": {:.1f}, \"p99\": {:.1f}, \"max\": {:.1f}}},\n"
+      "  \"throughput_rps\": {:.1f},\n"
+      "  \"throughput_mbps\": {:.3f},\n"
+      "  \"latency_us\": {{\n"
+      "    \"min\": {:.1f}, \"mean\": {:.1f}, \"p50\": {:.1f}, \"p75\": {:.1f}, \"p90\": {:.1f},\n"
+      "    \"p99\": {:.1f}, \"p99.9\": {:.1f}, \"p99.99\": {:.1f}, \"max\": {:.1f}\n"
+      "  }}\n"
+      "}}\n",
+      config.targetAddress, config.protocol == Protocol::tcp ? "tcp" : "udp", config.sessions, config.workers, mix,
+      seconds, config.rate, total.sent, total.responses, total.lost, total.skipped, total.errors,
+      total.maxBacklog, total.reconnects, total.attempts, total.peakConnecting,
+      scaled(total.connectLatency, 50, 1e3), scaled(total.connectLatency, 99, 1e3),
+      static_cast<double>(total.connectLatency.max()) / 1e3,
+      scaled(total.recovery, 50, 1e6), scaled(total.recovery, 99, 1e6), static_cast<double>(total.recovery.max()) / 1e6,
+      static_cast<double>(total.responses) / seconds, static_cast<double>(total.sentBytes) * 8 / seconds / 1e6,
+      static_cast<double>(total.latency.min()) / 1000.0, total.latency.mean() / 1000.0, us(50), us(75), us(90),
+      us(99), us(99.9), us(99.99), static_cast<double>(total.latency.max()) / 1000.0);
+}
+
+/*************************************************************************/ /**
+ * @file main.c
+ * @brief Drives an open-loop load against a daemon endpoint and reports the result as JSON.
+ *****************************************************************************/
+int main(int argc, char** argv) {
+  LoadConfig config;
+  process_command_line(argc, argv, config);
+
+  auto address = app::parse_ipv4_address(config.targetAddress, "127.0.0.1");
+  if (!address) {
+    spdlog::error("Invalid target address '{}'", config.targetAddress);
+    return EXIT_FAILURE;
+  }
+
+  raise_file_limit();
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  size_t first{0};
+  for (size_t i = 0; i < config.workers; ++i) {
+    auto count = config.sessions / config.workers + (i < config.sessions % config.workers ? 1 : 0);
+    workers.push_back(std::make_unique<Worker>(config, *address, first, count,
+                                               config.rate * static_cast<double>(count) /
+                                                   static_cast<double>(config.sessions)));
+    first += count;
+    if (!workers.back()->connect()) {
+      return EXIT_FAILURE;
+    }
+  }
+  spdlog::info("{} {} sessions connected to {}", config.sessions,
+               config.protocol == Protocol::tcp ? "TCP" : "UDP", config.targetAddress);
+
+  auto start = Clock::now() + 100ms;
+  {
+    std::vector<std::jthread> threads;
+    for (auto& worker : workers) {
+      threads.emplace_back([&worker, start]() { worker->run(start); });
+    }
+  }
+
+  WorkerResult total;
+  for (const auto& worker : workers) {
+    const auto& result = worker->result();
+    total.latency.merge(result.latency);
+    total.sent += result.sent;
+    total.sentBytes += result.sentBytes;
+    total.responses += result.responses;
+    total.errors += result.errors;
+    total.lost += result.lost;
+    total.skipped += result.skipped;
+    total.maxBacklog = std::max(total.maxBacklog, result.maxBacklog);
+    total.reconnects += result.reconnects;
+    total.attempts += result.attempts;
+    total.peakConnecting = std::max(total.peakConnecting, result.peakConnecting);
+    total.connectLatency.merge(result.connectLatency);
+    total.recovery.merge(result.recovery);
+  }
+
+  auto report = format_report(config, total);
+  if (config.outputFile.empty()) {
+    std::cout << report;
+  } else {
+    std::ofstream(config.outputFile) << report;
+  }
+  return total.errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
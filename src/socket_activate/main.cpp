@@ -0,0 +1,236 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+//----------------------------------------------------------------------------
+// Includes
+//----------------------------------------------------------------------------
+
+#include <getopt.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "netAddress.hpp"
+#include "socketActivation.hpp"
+#include "version.hpp"
+
+//----------------------------------------------------------------------------
+// Typedefs, enums, unions, variables
+//----------------------------------------------------------------------------
+
+/**
+ * @brief A socket to bind, "[name=][host:]port".
+ */
+struct SocketSpec {
+  std::string name;     ///< The name the daemon takes the socket by
+  std::string address;  ///< The address to bind
+  int type;             ///< SOCK_STREAM for a listener, SOCK_DGRAM for a UDP socket
+};
+
+/**
+ * @brief The configuration of the launcher.
+ */
+struct ActivateConfig {
+  std::vector<SocketSpec> sockets;  ///< The sockets in the order of their descriptors
+  int backlog{SOMAXCONN};           ///< The backlog of the listeners
+  char** command{nullptr};          ///< The program and its arguments
+};
+
+/// The name of a socket without a name, the default socket name of the daemon contexts
+static constexpr std::string_view DefaultName = "endpoint";
+
+/**
+ * @brief The options for the program.
+ */
+static const std::array<std::string_view, 5> OPTIONS = {
+    "  -l, --listen             TCP listener [name=][host:]port, repeatable, name default endpoint\n",
+    "  -u, --datagram           UDP socket [name=][host:]port, repeatable, name default endpoint\n",
+    "  -b, --backlog            backlog of the listeners, default SOMAXCONN\n",
+    "  -v, --version            version\n",
+    "  -h, --help               this message\n"};
+
+/**
+ *  @brief The help options for the program, the first argument that is no option starts the command.
+ */
+static const char* help_options = "+h?vl:u:b:";
+static const struct option long_options[] = {
+    {"help", no_argument, nullptr, 'h'},
+    {"version", no_argument, nullptr, 'v'},
+    {"listen", required_argument, nullptr, 'l'},
+    {"datagram", required_argument, nullptr, 'u'},
+    {"backlog", required_argument, nullptr, 'b'},
+    {nullptr, 0, nullptr, 0},
+};
+
+/**
+ * @brief The sample command lines for the program.
+ */
+static const std::array<std::string_view, 3> SAMPLE_COMMANDS = {
+    " -l 2404 -- daemon_with_context -F\n", " -l 2404 -u 2404 -- daemon_with_context -F -p 5000\n",
+    " -l iec104=2404 -l modbus=127.0.0.1:502 -- daemon_with_context -F -N iec104\n"};
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+
+/*************************************************************************/ /**
+ * Displays the help message for the program.
+ * @param programName The name of the program.
+ * @param errorOption The option with an error.
+ *****************************************************************************/
+static void display_help(const char* programName, std::string_view errorOption = "") {
+  if (!errorOption.empty()) {
+    std::cerr << "Error in option: " << errorOption << "\n";
+  }
+  std::cout << "\nUsage: " << programName << " [OPTIONS] -- program [ARGUMENTS]\n" << std::endl;
+  for (const auto& option : OPTIONS) {
+    std::cout << option;
+  }
+  std::cout << "\nSample command lines:" << std::endl;
+  for (const auto& cmd : SAMPLE_COMMANDS) {
+    std::cout << programName << cmd;
+  }
+
+  if (!errorOption.empty()) {
+    exit(EXIT_FAILURE);
+  }
+}
+
+/*************************************************************************/ /**
+ * @brief Splits a socket option "[name=][host:]port".
+ * @param text The option.
+ * @param type The socket type.
+ * @return The socket to bind.
+ *****************************************************************************/
+static SocketSpec parse_socket(std::string_view text, int type) {
+  auto separator = text.find('=');
+  if (separator == std::string_view::npos) {
+    return {std::string(DefaultName), std::string(text), type};
+  }
+  return {std::string(text.substr(0, separator)), std::string(text.substr(separator + 1)), type};
+}
+
+/*************************************************************************/ /**
+ * @brief Processes the command line options passed to the program.
+ * @param argc The number of command line arguments.
+ * @param argv The array of command line argument strings.
+ * @param config The launcher configuration.
+ *****************************************************************************/
+static void process_command_line(int argc, char* argv[], ActivateConfig& config) {
+  int option_index = 0;
+  for (;;) {
+    int current_option = getopt_long(argc, argv, help_options, long_options, &option_index);
+    if (current_option == -1) {
+      break;
+    }
+
+    try {
+      switch (current_option) {
+        case 'h':
+        case '?':
+          display_help(argv[0]);
+          exit(EXIT_SUCCESS);
+
+        case 'v':
+          std::cout << argv[0] << " v." << version::socketActivate::getVersion(true) << std::endl;
+          exit(EXIT_SUCCESS);
+
+        case 'l':
+          config.sockets.push_back(parse_socket(optarg, SOCK_STREAM));
+          break;
+
+        case 'u':
+          config.sockets.push_back(parse_socket(optarg, SOCK_DGRAM));
+          break;
+
+        case 'b':
+          config.backlog = std::stoi(optarg);
+          break;
+
+        default:
+          display_help(argv[0], std::to_string(current_option));
+      }
+    } catch (const std::exception&) {
+      display_help(argv[0], std::string(argv[optind - 1]));
+    }
+  }
+
+  if (config.sockets.empty() || optind >= argc || config.backlog <= 0) {
+    display_help(argv[0], "a socket, a positive backlog and the program are required");
+  }
+  config.command = &argv[optind];
+}
+
+/*************************************************************************/ /**
+ * @brief Binds a socket, a listener listens at once: its clients wait in the backlog.
+ * @param spec The socket to bind.
+ * @param backlog The backlog of a listener.
+ * @return The socket, its descriptor is -1 on error.
+ *****************************************************************************/
+static app::ActivatedSocket bind_socket(const SocketSpec& spec, int backlog) {
+  app::ActivatedSocket activated{-1, spec.name, spec.type, spec.type == SOCK_STREAM};
+  auto address = app::parse_ipv4_address(spec.address);
+  if (!address) {
+    spdlog::error("Invalid address '{}' of the socket '{}'", spec.address, spec.name);
+    return activated;
+  }
+
+  int fd = socket(AF_INET, spec.type | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    spdlog::error("Can't create the socket '{}': {}", spec.name, std::system_category().message(errno));
+    return activated;
+  }
+  int enable = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  if (bind(fd, reinterpret_cast<const sockaddr*>(&*address), sizeof(*address)) < 0 ||
+      (spec.type == SOCK_STREAM && listen(fd, backlog) < 0)) {
+    spdlog::error("Can't bind the socket '{}' on {}: {}", spec.name, spec.address,
+                  std::system_category().message(errno));
+    ::close(fd);
+    return activated;
+  }
+  activated.fd = fd;
+  return activated;
+}
+
+/*************************************************************************/ /**
+ * @brief The socket activation stand-in: binds the sockets, passes them as LISTEN_FDS and
+ * LISTEN_FDNAMES and replaces itself by the program, which keeps the process id of LISTEN_PID.
+ *****************************************************************************/
+int main(int argc, char** argv) {
+  ActivateConfig config;
+  process_command_line(argc, argv, config);
+
+  std::vector<app::ActivatedSocket> sockets;
+  for (const auto& spec : config.sockets) {
+    auto socket = bind_socket(spec, config.backlog);
+    if (socket.fd < 0) {
+      return EXIT_FAILURE;
+    }
+    spdlog::info("Socket '{}': {} {}", spec.name, spec.type == SOCK_STREAM ? "listens on" : "bound to",
+                 spec.address);
+    sockets.push_back(std::move(socket));
+  }
+
+  if (!app::SocketActivation::pass(sockets)) {
+    spdlog::error("Can't pass the sockets: {}", std::system_category().message(errno));
+    return EXIT_FAILURE;
+  }
+
+  execvp(config.command[0], config.command);
+  spdlog::error("Can't execute '{}': {}", config.command[0], std::system_category().message(errno));
+  return EXIT_FAILURE;
+}
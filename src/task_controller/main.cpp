@@ -1,11 +1,18 @@
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
 #include <functional>
 #include <iostream>
+#include <string>
+#include <string_view>
 #include <stop_token>
 #include <thread>
 #include <vector>
 
 #include <spdlog/spdlog.h>
 
+#include "cpuResources.hpp"
+
 class ThreadController {
  public:
   using ThreadFunction = std::function<void(size_t index, std::stop_token)>;
@@ -21,6 +28,25 @@ class ThreadController {
     }
   }
 
+  // Grows the pool with new threads or stops the threads with the highest indexes.
+  void resize(ThreadFunction function, size_t numThreads) {
+    while (threads_.size() < numThreads) {
+      createThread(function, threads_.size());
+    }
+    while (threads_.size() > numThreads) {
+      stopSources_.back().request_stop();
+      if (threads_.back().joinable()) {
+        threads_.back().join();
+      }
+      threads_.pop_back();
+      stopSources_.pop_back();
+    }
+  }
+
+  size_t size() const {
+    return threads_.size();
+  }
+
   void stopAll() {
     for (auto& stopSource : stopSources_) {
       if (stopSource.stop_possible()) {
@@ -52,7 +78,11 @@ class ThreadController {
   std::vector<std::stop_source> stopSources_;
 };
 
-static const size_t NUM_THREADS = 1000;
+// How often the CPU limits and the throttling counters are read.
+static const std::chrono::seconds MONITOR_INTERVAL{1};
+
+// Runtime of the example when no duration in seconds is given on the command line.
+static const std::chrono::seconds DEFAULT_RUNTIME{3};
 
 void threadTask(size_t index, std::stop_token stopToken) {
   while (!stopToken.stop_requested()) {
@@ -62,12 +92,67 @@ void threadTask(size_t index, std::stop_token stopToken) {
   spdlog::warn("Thread <{}> is stopping.", index);
 }
 
-int main() {
+void logLimits(const app::CpuLimits& limits) {
+  spdlog::info("CPU limits: online {}, affinity {}, cpuset {}, quota {} -> {} worker threads", limits.onlineCpus,
+               limits.affinityCpus, limits.cpusetCpus > 0 ? std::to_string(limits.cpusetCpus) : "-",
+               limits.quotaCpus ? fmt::format("{:.2f} CPUs", *limits.quotaCpus) : "max", limits.workers());
+}
+
+// Throttling in the last monitor interval, in the "name=value" form of the metrics log.
+void logThrottling(const app::CpuThrottling& delta) {
+  auto ratio =
+      delta.periods > 0 ? static_cast<double>(delta.throttledPeriods) / static_cast<double>(delta.periods) : 0.0;
+  auto level = delta.throttledPeriods > 0 ? spdlog::level::warn : spdlog::level::info;
+  spdlog::log(level,
+              "metrics: cpu_usage_usec={} cpu_periods={} cpu_throttled_periods={} cpu_throttled_usec={} "
+              "cpu_throttled_ratio={:.3f}",
+              delta.usageUsec, delta.periods, delta.throttledPeriods, delta.throttledUsec, ratio);
+}
+
+int main(int argc, char* argv[]) {
+  auto runtime = DEFAULT_RUNTIME;
+  if (argc > 1) {
+    // A runtime that is not a positive number of seconds is a usage error, not an uncaught exception.
+    std::string_view text(argv[1]);
+    long seconds{0};
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), seconds);
+    if (error != std::errc() || end != text.data() + text.size() || seconds <= 0 || argc > 2) {
+      std::cerr << "Usage: " << argv[0] << " [runtime in seconds, default " << DEFAULT_RUNTIME.count() << "]"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+    runtime = std::chrono::seconds(seconds);
+  }
+
+  // Size the pool from the CPUs the process may use instead of a fixed thread count,
+  // more runnable threads than granted CPUs only get throttled by the cgroup quota.
+  app::CpuResources resources;
+  auto limits = resources.limits();
+  logLimits(limits);
+
   ThreadController controller;
+  controller.startThreads(threadTask, limits.workers());
 
-  controller.startThreads(threadTask, NUM_THREADS);
+  auto throttling = resources.throttling();
+  auto deadline = std::chrono::steady_clock::now() + runtime;
+  while (std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_until(std::min(std::chrono::steady_clock::now() + MONITOR_INTERVAL, deadline));
 
-  std::this_thread::sleep_for(std::chrono::seconds(3));
+    // Limits change when the container is updated or the affinity is set from outside (taskset, cpuset moves).
+    auto current = resources.limits();
+    if (current != limits) {
+      logLimits(current);
+      controller.resize(threadTask, current.workers());
+      limits = current;
+    }
+
+    if (auto now = resources.throttling()) {
+      if (throttling) {
+        logThrottling(*now - *throttling);
+      }
+      throttling = now;
+    }
+  }
 
   controller.stopAll();
 
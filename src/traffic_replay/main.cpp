@@ -0,0 +1,410 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2024 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+//----------------------------------------------------------------------------
+// Includes
+//----------------------------------------------------------------------------
+
+#include <getopt.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "latencyHistogram.hpp"
+#include "netAddress.hpp"
+#include "trafficCapture.hpp"
+#include "version.hpp"
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+//----------------------------------------------------------------------------
+// Typedefs, enums, unions, variables
+//----------------------------------------------------------------------------
+
+/**
+ * @brief The configuration of the replay.
+ */
+struct ReplayConfig {
+  std::string captureFile;                 ///< The path of the capture file
+  std::string targetAddress;               ///< The address of the daemon endpoint
+  double speed{1.0};                       ///< Replay speed factor, 0 means as fast as possible
+  std::optional<uint32_t> endpoint;        ///< Replay only records of this endpoint
+  std::chrono::milliseconds drainTime{1000};  ///< Time to wait for outstanding responses
+};
+
+/**
+ * @brief One connection to the daemon replaying one captured session.
+ */
+struct ReplaySession {
+  int fd{-1};                                                  ///< socket
+  uint64_t sentBytes{0};                                       ///< sent bytes
+  uint64_t receivedBytes{0};                                   ///< received bytes
+  std::deque<std::pair<uint64_t, Clock::time_point>> pending;  ///< end offset and send time of each record
+};
+
+/**
+ * @brief The measurement of the replay.
+ */
+struct ReplayResult {
+  uint64_t records{0};                          ///< replayed records
+  uint64_t bytes{0};                            ///< replayed bytes
+  uint64_t receivedBytes{0};                    ///< received response bytes
+  std::chrono::nanoseconds captureDuration{0};  ///< duration of the capture
+  std::chrono::nanoseconds elapsed{0};          ///< duration of the replay
+  std::chrono::nanoseconds maxLag{0};           ///< maximal delay behind the schedule
+  app::LatencyHistogram latency;                ///< record round trip latencies
+};
+
+/**
+ * @brief The options for the program.
+ */
+static const std::array<std::string_view, 7> OPTIONS = {
+    "  -i, --input              capture file to replay\n",
+    "  -t, --target             daemon endpoint [host:]port\n",
+    "  -s, --speed              replay speed factor: 1 original pacing, N times faster, 0 maximal speed\n",
+    "  -e, --endpoint           replay only records of this endpoint id\n",
+    "  -w, --wait               milliseconds to wait for outstanding responses\n",
+    "  -v, --version            version\n",
+    "  -h, --help               this message\n"};
+
+/**
+ *  @brief The help options for the program.
+ */
+static const char* help_options = "h?vi:t:s:e:w:";
+static const struct option long_options[] = {
+    {"help", no_argument, nullptr, 'h'},
+    {"version", no_argument, nullptr, 'v'},
+    {"input", required_argument, nullptr, 'i'},
+    {"target", required_argument, nullptr, 't'},
+    {"speed", required_argument, nullptr, 's'},
+    {"endpoint", required_argument, nullptr, 'e'},
+    {"wait", required_argument, nullptr, 'w'},
+    {nullptr, 0, nullptr, 0},
+};
+
+/**
+ * @brief The sample command lines for the program.
+ */
+static const std::array<std::string_view, 3> SAMPLE_COMMANDS = {
+    " -i traffic.dcap -t 127.0.0.1:2404\n", " -i traffic.dcap -t 2404 -s 10\n", " -i traffic.dcap -t 2404 -s 0\n"};
+
+//----------------------------------------------------------------------------
+// Declarations
+//----------------------------------------------------------------------------
+
+/*************************************************************************/ /**
+ * Displays the help message for the program.
+ * @param programName The name of the program.
+ * @param errorOption The option with an error.
+ *****************************************************************************/
+static void display_help(const char* programName, std::string_view errorOption = "") {
+  if (!errorOption.empty()) {
+    std::cerr << "Error in option: " << errorOption << "\n";
+  }
+  std::cout << "\nUsage: " << programName << " [OPTIONS]\n" << std::endl;
+  for (const auto& option : OPTIONS) {
+    std::cout << option;
+  }
+  std::cout << "\nSample command lines:" << std::endl;
+  for (const auto& cmd : SAMPLE_COMMANDS) {
+    std::cout << programName << cmd;
+  }
+
+  if (!errorOption.empty()) {
+    exit(EXIT_FAILURE);
+  }
+}
+
+/*************************************************************************/ /**
+ * @brief Processes the command line options passed to the program.
+ * @param argc The number of command line arguments.
+ * @param argv The array of command line argument strings.
+ * @param config The replay configuration.
+ *****************************************************************************/
+static void process_command_line(int argc, char* argv[], ReplayConfig& config) {
+  int option_index = 0;
+  for (;;) {
+    int current_option = getopt_long(argc, argv, help_options, long_options, &option_index);
+    if (current_option == -1) {
+      break;
+    }
+
+    try {
+      switch (current_option) {
+        case 'h':
+        case '?':
+          display_help(argv[0]);
+          exit(EXIT_SUCCESS);
+
+        case 'v':
+          std::cout << argv[0] << " v." << version::trafficReplay::getVersion(true) << std::endl;
+          exit(EXIT_SUCCESS);
+
+        case 'i':
+          config.captureFile.assign(optarg);
+          break;
+
+        case 't':
+          config.targetAddress.assign(optarg);
+          break;
+
+        case 's':
+          config.speed = std::stod(optarg);
+          break;
+
+        case 'e':
+          config.endpoint = static_cast<uint32_t>(std::stoul(optarg));
+          break;
+
+        case 'w':
+          config.drainTime = std::chrono::milliseconds(std::stol(optarg));
+          break;
+
+        default:
+          display_help(argv[0], std::to_string(current_option));
+      }
+    } catch (const std::exception&) {
+      display_help(argv[0], std::string(argv[optind - 1]));
+    }
+  }
+
+  if (config.captureFile.empty() || config.targetAddress.empty() || config.speed < 0) {
+    display_help(argv[0], "input, target and a non-negative speed are required");
+  }
+}
+
+/*************************************************************************/ /**
+ * @brief Connects a new session to the daemon.
+ * @param address The daemon address.
+ * @return The non-blocking socket or -1 on error.
+ *****************************************************************************/
+static int connect_session(const sockaddr_in& address) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+    ::close(fd);
+    return -1;
+  }
+  int enable = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  return fd;
+}
+
+/*************************************************************************/ /**
+ * @brief Reads all responses and matches them to the sent records.
+ * @param sessions The replay sessions.
+ * @param result The measurement.
+ * @param timeout The maximal time to wait for responses.
+ * @param writableFd Additionally wait until this socket becomes writable, -1 for none.
+ *****************************************************************************/
+static void pump_responses(std::map<uint64_t, ReplaySession>& sessions, ReplayResult& result,
+                           std::chrono::nanoseconds timeout, int writableFd = -1) {
+  std::vector<pollfd> fds;
+  std::vector<ReplaySession*> owners;
+  fds.reserve(sessions.size());
+  for (auto& [id, session] : sessions) {
+    short events = POLLIN;
+    if (session.fd == writableFd) {
+      events |= POLLOUT;
+    }
+    fds.push_back(pollfd{session.fd, events, 0});
+    owners.push_back(&session);
+  }
+
+  auto timeoutMs = static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(timeout).count());
+  if (poll(fds.data(), fds.size(), std::max(timeoutMs, 0)) <= 0) {
+    return;
+  }
+
+  std::array<std::byte, 64 * 1024> buffer{};
+  for (size_t i = 0; i < fds.size(); ++i) {
+    if ((fds[i].revents & (POLLIN | POLLERR | POLLHUP)) == 0) {
+      continue;
+    }
+    auto& session = *owners[i];
+    for (;;) {
+      auto received = recv(session.fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+      if (received <= 0) {
+        break;
+      }
+      session.receivedBytes += static_cast<uint64_t>(received);
+      result.receivedBytes += static_cast<uint64_t>(received);
+    }
+
+    auto now = Clock::now();
+    while (!session.pending.empty() && session.pending.front().first <= session.receivedBytes) {
+      result.latency.record(now - session.pending.front().second);
+      session.pending.pop_front();
+    }
+  }
+}
+
+/*************************************************************************/ /**
+ * @brief Sends a captured payload without blocking the response processing.
+ * @return true if the payload is sent, otherwise false.
+ *****************************************************************************/
+static bool send_payload(std::map<uint64_t, ReplaySession>& sessions, ReplaySession& session,
+                         std::span<const std::byte> payload, ReplayResult& result) {
+  size_t offset{0};
+  while (offset < payload.size()) {
+    auto sent = send(session.fd, payload.data() + offset, payload.size() - offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        pump_responses(sessions, result, 100ms, session.fd);
+        continue;
+      }
+      return false;
+    }
+    offset += static_cast<size_t>(sent);
+  }
+  session.sentBytes += payload.size();
+  return true;
+}
+
+/*************************************************************************/ /**
+ * @brief Prints the measurement.
+ *****************************************************************************/
+static void print_result(const ReplayResult& result, const ReplayConfig& config, size_t sessions) {
+  auto seconds = std::chrono::duration<double>(result.elapsed).count();
+  auto us = [&](double percentile) { return static_cast<double>(result.latency.percentile(percentile)) / 1000.0; };
+
+  fmt::print("Replay of {} at {}\n", config.captureFile,
+             config.speed > 0 ? fmt::format("{:g}x speed", config.speed) : std::string("maximal speed"));
+  fmt::print("  sessions          : {}\n", sessions);
+  fmt::print("  records           : {}\n", result.records);
+  fmt::print("  bytes             : {}\n", result.bytes);
+  fmt::print("  capture duration  : {:.3f} s\n", std::chrono::duration<double>(result.captureDuration).count());
+  fmt::print("  replay duration   : {:.3f} s\n", seconds);
+  fmt::print("  throughput        : {:.0f} records/s, {:.3f} MB/s\n",
+             seconds > 0 ? static_cast<double>(result.records) / seconds : 0.0,
+             seconds > 0 ? static_cast<double>(result.bytes) / seconds / 1e6 : 0.0);
+  fmt::print("  max schedule lag  : {:.3f} ms\n", static_cast<double>(result.maxLag.count()) / 1e6);
+  fmt::print("  responses         : {} of {} records, {} bytes\n", result.latency.count(), result.records,
+             result.receivedBytes);
+  if (result.latency.count() > 0) {
+    fmt::print("  latency us        : p50 {:.1f}  p90 {:.1f}  p99 {:.1f}  p99.9 {:.1f}  max {:.1f}\n", us(50), us(90),
+               us(99), us(99.9), static_cast<double>(result.latency.max()) / 1000.0);
+  }
+}
+
+/*************************************************************************/ /**
+ * @file main.c
+ * @brief Replays a traffic capture against a daemon endpoint.
+ *
+ * Every captured session is replayed over its own TCP connection. The records are sent at their
+ * captured time divided by the speed factor. If the daemon answers, the time until the response
+ * bytes for a record are complete is measured as its latency.
+ *****************************************************************************/
+int main(int argc, char** argv) {
+  ReplayConfig config;
+  process_command_line(argc, argv, config);
+
+  auto address = app::parse_ipv4_address(config.targetAddress, "127.0.0.1");
+  if (!address) {
+    spdlog::error("Invalid target address '{}'", config.targetAddress);
+    return EXIT_FAILURE;
+  }
+
+  app::TrafficCaptureReader reader;
+  if (!reader.open(config.captureFile)) {
+    spdlog::error("Can't open capture file '{}'", config.captureFile);
+    return EXIT_FAILURE;
+  }
+
+  std::map<uint64_t, ReplaySession> sessions;
+  ReplayResult result;
+  std::optional<std::chrono::nanoseconds> firstTimestamp;
+  auto start = Clock::now();
+
+  while (auto record = reader.next()) {
+    if (config.endpoint && record->endpoint != *config.endpoint) {
+      continue;
+    }
+    if (!firstTimestamp) {
+      firstTimestamp = record->timestamp;
+      start = Clock::now();
+    }
+
+    auto offset = record->timestamp - *firstTimestamp;
+    result.captureDuration = offset;
+    if (config.speed > 0) {
+      auto due = start + std::chrono::duration_cast<Clock::duration>(offset / config.speed);
+      for (auto now = Clock::now(); now < due; now = Clock::now()) {
+        pump_responses(sessions, result, due - now);
+      }
+      result.maxLag = std::max(result.maxLag, std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - due));
+    }
+
+    auto key = (static_cast<uint64_t>(record->endpoint) << 32) | record->session;
+    auto [it, inserted] = sessions.try_emplace(key);
+    if (inserted) {
+      it->second.fd = connect_session(*address);
+      if (it->second.fd < 0) {
+        spdlog::error("Can't connect to {}: {}", config.targetAddress, std::system_category().message(errno));
+        return EXIT_FAILURE;
+      }
+    }
+
+    auto& session = it->second;
+    if (!send_payload(sessions, session, record->payload, result)) {
+      spdlog::error("Connection lost while replaying");
+      break;
+    }
+    session.pending.emplace_back(session.sentBytes, Clock::now());
+    result.records++;
+    result.bytes += record->payload.size();
+
+    if (config.speed == 0) {
+      pump_responses(sessions, result, 0ns);
+    }
+  }
+
+  if (reader.is_truncated()) {
+    spdlog::warn("Capture file is truncated, replayed the complete records");
+  }
+
+  // wait for the outstanding responses
+  auto sendEnd = Clock::now();
+  auto deadline = sendEnd + config.drainTime;
+  auto outstanding = [&]() {
+    return std::any_of(sessions.begin(), sessions.end(), [](const auto& s) { return !s.second.pending.empty(); });
+  };
+  for (auto now = Clock::now(); now < deadline && outstanding(); now = Clock::now()) {
+    pump_responses(sessions, result, std::min<Clock::duration>(deadline - now, 10ms));
+  }
+  result.elapsed = outstanding() ? sendEnd - start : Clock::now() - start;
+
+  for (auto& [id, session] : sessions) {
+    ::close(session.fd);
+  }
+
+  print_result(result, config, sessions.size());
+  return EXIT_SUCCESS;
+}